@@ -8,8 +8,17 @@
 #include "cinder/Thread.h"
 #include "cinder/Url.h"
 
+#include <atomic>
 #include <string>
 
+#include "AvfBandwidthEstimator.h"
+#include "AvfByteSource.h"
+#include "AvfFrameIndex.h"
+#include "AvfMediaTime.h"
+#include "AvfPreload.h"
+#include "AvfSceneDetector.h"
+#include "AvfWorkerPool.h"
+
 #if defined( CINDER_MAC ) || defined( CINDER_COCOA_TOUCH )
 	#include <CoreVideo/CoreVideo.h>
 	#include <CoreVideo/CVBase.h>
@@ -21,8 +30,8 @@
 
 	#if defined( __OBJC__ )
 		@class AVPlayer, AVPlayerItem, AVPlayerItemTrack, AVPlayerItemVideoOutput, AVPlayerItemOutput;
-		@class AVAsset, AVURLAsset, AVAssetTrack, AVAssetReader;
-		@class MovieDelegate;
+		@class AVAsset, AVURLAsset, AVAssetTrack, AVAssetReader, AVAssetReaderTrackOutput;
+		@class MovieDelegate, ByteSourceLoader;
 		@class NSURL;
 
 	#else
@@ -34,11 +43,13 @@
 		class AVAsset;
 		class AVAssetTrack;
 		class AVAssetReader;
+		class AVAssetReaderTrackOutput;
 		class AVURLAsset;
 		class NSArray;
 		class NSError;
 		// -- 
 		class MovieDelegate;
+		class ByteSourceLoader;
 	#endif
 #endif
 
@@ -46,6 +57,7 @@ namespace cinder { namespace avf {
 
 class MovieResponder;
 class MovieLoader;
+class FrameReader;
 typedef std::shared_ptr<MovieLoader> MovieLoaderRef;
 	
 class MovieBase {
@@ -66,8 +78,18 @@ class MovieBase {
 	//! Returns the movie's pixel aspect ratio. Returns 1.0 if the movie does not contain an explicit pixel aspect ratio.
 	float		getPixelAspectRatio() const;
 	
-	//! Returns whether the movie has loaded and buffered enough to playback without interruption
+	/** Returns whether the movie has loaded and buffered enough to playback without interruption, either in AVFoundation's
+		opinion or as predicted by getPlayThroughEstimate(), whichever says so first **/
 	bool		checkPlayThroughOk();
+	/** Predicts when the rest of the movie will have loaded, from the throughput measured so far and the data rate of the
+		movie's tracks. Movies playing local files or memory are always stall-free. **/
+	PlayThroughEstimate	getPlayThroughEstimate();
+	/** With \a enable, play() on a movie still loading waits until playback is predicted not to stall, then starts right away
+		instead of when AVFoundation would, so remote clips start as early as it is safe to. **/
+	void		setStartWhenPlayThroughPredicted( bool enable = true ) { mStartWhenPredicted = enable; }
+	bool		isStartingWhenPlayThroughPredicted() const { return mStartWhenPredicted; }
+	//! Returns whether play() was called on the movie and it waits for the prediction to allow playback
+	bool		isWaitingForPlayThrough() const { return mAwaitingPlayThrough; }
 	//! Returns whether the movie is in a loaded state, implying its structures are ready for reading but it may not be ready for playback
 	bool		isLoaded() const { return mLoaded; }
 	//! Returns whether the movie is playable, implying the movie is fully formed and can be played but media data is still downloading
@@ -76,8 +98,12 @@ class MovieBase {
 	bool		isProtected() const { return mProtected; }
 	//! Returns the movie's length measured in seconds
 	float		getDuration() const { return mDuration; }
+	//! Returns the movie's exact length
+	MediaTime	getMediaDuration() const { return mMediaDuration; }
 	//! Returns the movie's framerate measured as frames per second
 	float		getFramerate() const { return mFrameRate; }
+	//! Returns the exact duration of one frame of the first video track. Invalid in the absence of visual media.
+	MediaTime	getFrameDuration() const { return mFrameDuration; }
 	//! Returns the total number of frames (video samples) in the movie
 	int32_t		getNumFrames();
 
@@ -88,13 +114,50 @@ class MovieBase {
 	//! Returns whether the first video track in the movie contains an alpha channel. Returns false in the absence of visual media.
 	virtual bool hasAlpha() const { return false; }
 
-	//! Returns whether a movie has a new frame available
+	//! Returns the number of video tracks in the movie, such as the angles of a multi-angle file
+	size_t		getNumVideoTracks() const;
+	//! Returns the index of the video track being played, \c 0 unless another was selected
+	size_t		getVideoTrackIndex() const { return mVideoTrackIndex; }
+	/** Plays video track \a index instead of the current one, updating the size and framerate to match. The other video tracks are disabled rather than composited.
+		Returns \c false when the movie has not loaded yet or has no such track. MultiTrackPlayer decodes several tracks at once. **/
+	bool		selectVideoTrack( size_t index );
+	/** Renders only \a area of each frame, in pixels of the full frame, so the pixels outside it are never converted or copied. Frames then have the size of \a area.
+		It is a hint: frames already in flight keep the previous crop, so offset into a frame by getFrameCrop() rather than by the hint. **/
+	void		setCropHint( const Area &area );
+	//! Goes back to delivering full frames
+	void		resetCropHint();
+	//! Returns the area set by setCropHint(), empty when full frames are delivered
+	const Area&	getCropHint() const { return mCropHint; }
+	//! Returns the crop hint the frame last returned by getSurface() or getTexture() was rendered with, empty for a full frame
+	const Area&	getFrameCrop() const { return mFrameCrop; }
+
+	//! Returns whether a frame has arrived since the last call to getSurface() or getTexture()
 	bool		checkNewFrame();
+	/** Returns the presentation time, frame index and decode time of the frame last returned by getSurface() or getTexture().
+		Frame indices follow the nominal framerate and decode times are invalid until loadFrameIndex() has read the sample table. **/
+	const FrameInfo&	getFrameInfo() const { return mFrameInfo; }
+	/** Reads the sample table of the video track so getFrameInfo() carries exact frame indices, decode times and key frame flags.
+		Scans the compressed samples without decoding them, which still blocks for a moment on long movies. Returns \c false when the track can't be read. **/
+	bool		loadFrameIndex();
+	//! Returns the sample table read by loadFrameIndex(), empty until then
+	const FrameIndex&	getFrameIndex() const { return mFrameIndex; }
+	/** Finds the frames of the video track that start a scene, by decoding it in full through a FrameReader of its own. Loads the frame index first.
+		Blocks for as long as decoding takes; the cuts are kept in the frame index, so scene-aware scrubbing costs nothing afterwards. **/
+	bool		detectSceneCuts( const SceneDetector::Options &options = SceneDetector::Options() );
+	//! Returns the frames found by detectSceneCuts() to start a scene, in presentation order. Empty until then.
+	const std::vector<size_t>&	getSceneCuts() const { return mFrameIndex.getSceneCuts(); }
+	/** Returns the exact frame on screen at \a time, blocking until it is decoded, for offline rendering. Describes it in \a info when given.
+		Decodes through a FrameReader of its own, independent of playback, so sequential requests run at decode speed. Returns an empty Surface before the movie has loaded or when its video track can't be read. **/
+	Surface8u	getFrameAt( const MediaTime &time, FrameInfo *info = NULL );
 
 	//! Returns the current time of a movie in seconds
 	float		getCurrentTime() const;
+	//! Returns the exact current time of a movie. Invalid before the movie has loaded.
+	MediaTime	getCurrentMediaTime() const;
 	//! Sets the movie to the time \a seconds
 	void		seekToTime( float seconds );
+	//! Sets the movie to the exact time \a time
+	void		seekToTime( const MediaTime &time );
 	//! Sets the movie time to the start time of frame \a frame
 	void		seekToFrame( int frame );
 	//! Sets the movie time to its beginning
@@ -103,6 +166,8 @@ class MovieBase {
 	void		seekToEnd();
 	//! Limits the active portion of a movie to a subset beginning at \a startTime seconds and lasting for \a duration seconds. QuickTime will not process the movie outside the active segment.
 	void		setActiveSegment( float startTime, float duration );
+	//! Limits the active portion of a movie to a subset beginning at \a startTime and lasting for \a duration.
+	void		setActiveSegment( const MediaTime &startTime, const MediaTime &duration );
 	//! Resets the active segment to be the entire movie
 	void		resetActiveSegment();
 
@@ -115,7 +180,8 @@ class MovieBase {
 	/** Sets the playback rate, which begins playback immediately for nonzero values.
 	 * 1.0 represents normal speed. Negative values indicate reverse playback and \c 0 stops.
 	 *
-	 * Returns a boolean value indicating whether the rate value can be played (some media types cannot be played backwards)
+	 * Returns a boolean value indicating whether the rate value can be played (some media types cannot be played backwards).
+	 * ReversePlayer plays any file backwards, including long-GOP content that AVPlayer refuses.
 	 */
 	bool		setRate( float rate );
 
@@ -132,6 +198,24 @@ class MovieBase {
 	//! Stops playback
 	void		stop();
 	
+	/** Returns whether the FrameTicker updates the movie, which it does while the movie is visible and either playing or
+		waiting for the frame of a seek. Paused and hidden movies cost nothing per frame. **/
+	bool		isActive() const;
+	bool		isVisible() const { return mVisible; }
+	/** Hides or shows the movie, for example when it scrolls off screen. A hidden movie stops decoding video while its audio
+		and playhead carry on, and keeps its last frame, which getSurface() or getTexture() return until the next one arrives. **/
+	void		setVisible( bool visible = true );
+	
+	//! Returns the priority of the movie's background work on the shared WorkerPool
+	WorkerPool::Priority	getPriority() const { return mWorkQueue->getPriority(); }
+	//! Sets the priority of the movie's background work relative to other movies, for example lowering it for movies off screen
+	void		setPriority( WorkerPool::Priority priority ) { mWorkQueue->setPriority( priority ); }
+	
+	//! Returns whether the movie plays from a file preloaded into memory, which may still be loading
+	bool		isPreloaded() const { return mPreloadedFile != nullptr; }
+	//! Returns the file the movie was preloaded from, or an empty ref when it streams
+	PreloadedFileRef	getPreloadedFile() const { return mPreloadedFile; }
+	
 	//! Returns the native AvFoundation Player data structure
 	AVPlayer*	getPlayerHandle() const { return mPlayer; }
 	
@@ -146,14 +230,25 @@ class MovieBase {
 	MovieBase();
 	void init();
 	void initFromUrl( const Url& url );
-	void initFromPath( const fs::path& filePath );
+	void initFromPath( const fs::path& filePath, bool preloadToMemory = false );
 	void initFromLoader( const MovieLoader& loader );
+	void initFromByteSource( const ByteSourceRef& source );
 	
 	void loadAsset();
 	void updateFrame();
 	uint32_t countFrames() const;
+	FrameInfo describeFrame( const MediaTime &time ) const;
 	void processAsssetTracks(AVAsset* asset);
+	AVAssetTrack* getVideoTrack() const;
+	void enableSelectedVideoTrack();
+	void applyCropHint();
 	void createPlayerItemOutput(const AVPlayerItem* playerItem);
+	//! Updates \a movie on every tick of the shared FrameTicker, returning whether it stays active
+	static bool tickFrame(void* movie, double time);
+	bool shouldBeActive() const;
+	void updateActivity();
+	//! Starts playback, or leaves it to the tick when playback has to wait for the prediction to allow it
+	void startPlayback();
 	
 	void lock() { mMutex.lock(); }
 	void unlock() { mMutex.unlock(); }
@@ -168,12 +263,34 @@ class MovieBase {
 			
 	int32_t						mWidth, mHeight;
 	int32_t						mFrameCount;
+	size_t						mVideoTrackIndex;
+	Area						mCropHint;
+	//! The crop of the current frame, and of the frames the output delivers. A new hint moves to mOutputCrop at the flush that follows it.
+	Area						mFrameCrop, mOutputCrop, mPendingCrop;
+	bool						mCropPending;
+	FrameIndex					mFrameIndex;
+	FrameInfo					mFrameInfo;
+	std::shared_ptr<FrameReader>	mFrameReader;
 	float						mFrameRate;
 	float						mDuration;
+	MediaTime					mMediaDuration, mFrameDuration;
 	bool						mLoaded, mPlayThroughOk, mPlayable, mProtected;
 	bool						mPlayingForward, mLoop, mPalindrome;
 	bool						mHasAudio, mHasVideo;
 	bool						mPlaying;	// required to auto-start the movie
+	bool						mVisible;
+	std::atomic<bool>			mFramePending;	// a seek or flush awaits its frame, even while paused
+	std::atomic<bool>			mHasNewFrame;	// set by the FrameTicker, cleared by getSurface() and getTexture()
+	std::atomic<bool>			mAwaitingPlayThrough;	// play() waits for getPlayThroughEstimate() to allow playback
+	bool						mStartWhenPredicted;
+	
+	//! Measures the throughput of AVFoundation's downloads, for movies whose ByteSource doesn't measure its own
+	BandwidthEstimator			mBandwidth;
+	//! The access log as far as mBandwidth has been fed from it
+	int64_t						mLoggedBytes;
+	double						mLoggedTransferDuration, mLastPlayThroughCheck;
+	//! The data rate of the movie's tracks in bytes per second, \c 0 until they are known
+	double						mMediaBitrate;
 	
 	AVPlayer*					mPlayer;
 	AVPlayerItem*				mPlayerItem;
@@ -181,6 +298,8 @@ class MovieBase {
 	AVPlayerItemVideoOutput*	mPlayerVideoOutput;
 
 	std::mutex					mMutex;
+	//! Runs the movie's background work in order on the shared WorkerPool
+	WorkerPool::QueueRef		mWorkQueue;
 	
 	signals::signal<void()>		mSignalNewFrame, mSignalReady, mSignalCancelled, mSignalEnded, mSignalJumped, mSignalOutputWasFlushed;
 
@@ -194,6 +313,9 @@ class MovieBase {
 	friend class MovieResponder;
 	MovieResponder* mResponder;
 	MovieDelegate* mPlayerDelegate;
+	ByteSourceLoader* mByteSourceLoader;
+	ByteSourceRef mByteSource;
+	PreloadedFileRef mPreloadedFile;
 };
 
 typedef std::shared_ptr<class MovieSurface> MovieSurfaceRef;
@@ -201,14 +323,25 @@ class MovieSurface : public MovieBase {
  public:
 	MovieSurface() : MovieBase() {}
 	MovieSurface( const Url& url );
-	MovieSurface( const fs::path& path );
+	/** Plays the movie at \a path. With \a preloadToMemory the whole file is read into memory in the background and counted against
+		PreloadBudget::getShared(), so playback never touches the disk. Files over the budget stream from disk as usual. **/
+	MovieSurface( const fs::path& path, bool preloadToMemory = false );
 	MovieSurface( const MovieLoader& loader );
+	//! Plays the bytes of \a dataSource from memory, without writing them to a file first
+	MovieSurface( const DataSourceRef& dataSource );
+	/** Plays the bytes of \a source, read through range requests as playback needs them. ReadScheduler::openFile() gives one that shares
+		the disk with other movies, and HttpCache::open() one that keeps what a remote movie played on disk. **/
+	MovieSurface( const ByteSourceRef& source );
 	
 	virtual ~MovieSurface();
 
 	static MovieSurfaceRef create( const ci::Url& url ) { return MovieSurfaceRef( new MovieSurface( url ) ); }
-	static MovieSurfaceRef create( const fs::path& path ) { return MovieSurfaceRef( new MovieSurface( path ) ); }
+	static MovieSurfaceRef create( const fs::path& path, bool preloadToMemory = false ) { return MovieSurfaceRef( new MovieSurface( path, preloadToMemory ) ); }
 	static MovieSurfaceRef create( const MovieLoaderRef loader ) { return MovieSurfaceRef( new MovieSurface( *loader ) ); }
+	static MovieSurfaceRef create( const DataSourceRef& dataSource ) { return MovieSurfaceRef( new MovieSurface( dataSource ) ); }
+	static MovieSurfaceRef create( const ByteSourceRef& source ) { return MovieSurfaceRef( new MovieSurface( source ) ); }
+	//! Plays the \a size bytes at \a data in place. They have to stay valid for as long as the movie exists.
+	static MovieSurfaceRef create( const void* data, size_t size ) { return create( MemoryByteSource::create( data, size ) ); }
 
 	//! \inherit
 	virtual bool hasAlpha() const;
@@ -234,14 +367,25 @@ class MovieGl : public MovieBase {
   public:
 	MovieGl() : MovieBase(), mVideoTextureRef(NULL), mVideoTextureCacheRef(NULL) {}
 	MovieGl( const Url& url );
-	MovieGl( const fs::path& path );
+	/** Plays the movie at \a path. With \a preloadToMemory the whole file is read into memory in the background and counted against
+		PreloadBudget::getShared(), so playback never touches the disk. Files over the budget stream from disk as usual. **/
+	MovieGl( const fs::path& path, bool preloadToMemory = false );
 	MovieGl( const MovieLoader& loader );
+	//! Plays the bytes of \a dataSource from memory, without writing them to a file first
+	MovieGl( const DataSourceRef& dataSource );
+	/** Plays the bytes of \a source, read through range requests as playback needs them. ReadScheduler::openFile() gives one that shares
+		the disk with other movies, and HttpCache::open() one that keeps what a remote movie played on disk. **/
+	MovieGl( const ByteSourceRef& source );
 	
 	virtual ~MovieGl();
 
 	static MovieGlRef create( const Url& url ) { return MovieGlRef( new MovieGl( url ) ); }
-	static MovieGlRef create( const fs::path& path ) { return MovieGlRef( new MovieGl( path ) ); }
+	static MovieGlRef create( const fs::path& path, bool preloadToMemory = false ) { return MovieGlRef( new MovieGl( path, preloadToMemory ) ); }
 	static MovieGlRef create( const MovieLoaderRef loader ) { return MovieGlRef( new MovieGl( *loader ) ); }
+	static MovieGlRef create( const DataSourceRef& dataSource ) { return MovieGlRef( new MovieGl( dataSource ) ); }
+	static MovieGlRef create( const ByteSourceRef& source ) { return MovieGlRef( new MovieGl( source ) ); }
+	//! Plays the \a size bytes at \a data in place. They have to stay valid for as long as the movie exists.
+	static MovieGlRef create( const void* data, size_t size ) { return create( MemoryByteSource::create( data, size ) ); }
 	
 	//! \inherit
 	virtual bool hasAlpha() const;
@@ -279,7 +423,6 @@ public:
 	void playerItemDidNotReachEndCallback() { mParent->playerItemCancelled(); }
 	void playerItemTimeJumpedCallback() { mParent->playerItemJumped(); }
 	void outputSequenceWasFlushedCallback(AVPlayerItemOutput* output) { mParent->outputWasFlushed(output); }
-    void playerUpdateFrame() { mParent->updateFrame(); }
 	
 private:
 	MovieBase* const mParent;
@@ -288,11 +431,13 @@ private:
 
 class MovieLoader {
 public:
-	MovieLoader() {}
-	MovieLoader( const Url &url );
+	MovieLoader() : mPlayer( NULL ), mByteSourceLoader( NULL ), mOwnsMovie( false ), mLoggedBytes( 0 ), mLoggedTransferDuration( 0 ) {}
+	/** Starts loading the movie at \a url. With \a preloadToMemory a file URL is read into memory in the background as
+		MovieSurface( const fs::path&, bool ) does, other URLs are unaffected. **/
+	MovieLoader( const Url &url, bool preloadToMemory = false );
 	~MovieLoader();
 	
-	static MovieLoaderRef	create( const Url &url ) { return std::shared_ptr<MovieLoader>( new MovieLoader( url ) ); }
+	static MovieLoaderRef	create( const Url &url, bool preloadToMemory = false ) { return std::shared_ptr<MovieLoader>( new MovieLoader( url, preloadToMemory ) ); }
 	
 	//! Returns whether the movie is in a loaded state, implying its structures are ready for reading but it may not be ready for playback
 	bool	checkLoaded() const;
@@ -300,6 +445,8 @@ public:
 	bool	checkPlayable() const;
 	//! Returns whether the movie is ready for playthrough, implying media data is still downloading, but all data is expected to arrive before it is needed
 	bool	checkPlayThroughOk() const;
+	//! Predicts when the rest of the movie will have loaded, as MovieBase::getPlayThroughEstimate() does
+	PlayThroughEstimate	getPlayThroughEstimate() const;
 	//! Returns whether the movie has content protection applied to it
 	bool	checkProtection() const;
 	
@@ -321,13 +468,23 @@ public:
 	
 	//! Returns the native QuickTime Movie and marks itself as no longer the owner. In general you should not call this.
 	AVPlayer*		transferMovieHandle() const { mOwnsMovie = false; return mPlayer; }
+	//! Returns the loader reading a preloaded file into the movie, which goes along with the movie handle. \c nil unless preloading.
+	ByteSourceLoader*	getByteSourceLoader() const { return mByteSourceLoader; }
+	//! Returns the file being preloaded, or an empty ref
+	PreloadedFileRef	getPreloadedFile() const { return mPreloadedFile; }
 	
 protected:
 	void	updateLoadState() const;
 	
-	AVPlayer*		mPlayer;
-	Url				mUrl;
+	AVPlayer*			mPlayer;
+	ByteSourceLoader*	mByteSourceLoader;
+	PreloadedFileRef	mPreloadedFile;
+	Url					mUrl;
 	mutable bool	mLoaded, mBufferFull, mBufferEmpty, mPlayable, mProtected, mPlayThroughOK, mOwnsMovie;
+	//! Shared by copies of the loader, which see the same downloads
+	std::shared_ptr<BandwidthEstimator>	mBandwidth;
+	mutable int64_t	mLoggedBytes;
+	mutable double	mLoggedTransferDuration;
 };
 
 inline int32_t floatToFixed( float fl ) { return ((int32_t)((float)(fl) * ((int32_t) 0x00010000L))); }
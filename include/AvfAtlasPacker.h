@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cinder { namespace avf {
+
+//! A rectangle placed by SkylinePacker, in pixels from the top left of the atlas
+struct PackedRect {
+	PackedRect() : mX( 0 ), mY( 0 ), mWidth( 0 ), mHeight( 0 ) {}
+	PackedRect( int32_t x, int32_t y, int32_t width, int32_t height ) : mX( x ), mY( y ), mWidth( width ), mHeight( height ) {}
+
+	bool	empty() const { return mWidth <= 0 || mHeight <= 0; }
+
+	int32_t	mX, mY, mWidth, mHeight;
+};
+
+/** \brief Packs rectangles into a fixed size atlas using the bottom-left skyline heuristic
+ *	The top edge of everything placed so far is kept as a list of horizontal segments, and each rectangle goes where it
+ *	rests lowest. That wastes little space on the mixed sizes of a movie wall while staying linear in the number of
+ *	segments per insert. Only depends on the C++ standard library.
+**/
+class SkylinePacker {
+  public:
+	//! \a padding pixels are kept free to the right of and below every rectangle, so filtering never samples a neighbour
+	SkylinePacker( int32_t width, int32_t height, int32_t padding = 0 );
+
+	//! Places a \a width by \a height rectangle, returning \c false when it no longer fits
+	bool		insert( int32_t width, int32_t height, PackedRect *result );
+	//! Forgets every placed rectangle
+	void		clear();
+
+	int32_t		getWidth() const { return mWidth; }
+	int32_t		getHeight() const { return mHeight; }
+	int32_t		getPadding() const { return mPadding; }
+	//! Returns the share of the atlas covered by placed rectangles and their padding, in [\c 0,\c 1]
+	float		getOccupancy() const;
+
+  private:
+	struct Segment {
+		int32_t	mX, mY, mWidth;
+	};
+
+	//! Returns the height \a width pixels starting at segment \a index would rest at, or \c -1 when \a height pixels no longer fit above it
+	int32_t		findRestingHeight( size_t index, int32_t width, int32_t height ) const;
+
+	int32_t					mWidth, mHeight, mPadding;
+	std::vector<Segment>	mSkyline;
+	int64_t					mUsedArea;
+};
+
+//! One rectangle copy performed by blitPixels()
+struct PixelBlit {
+	const uint8_t	*mSrc;
+	size_t			mSrcRowBytes;
+	int32_t			mSrcInc;
+	uint8_t			*mDst;
+	size_t			mDstRowBytes;
+	int32_t			mDstInc;
+	//! Whether rows go through swizzlePixels() with \a mDstFromSrc rather than a straight copy
+	bool			mSwizzle;
+	int8_t			mDstFromSrc[4];
+	int32_t			mWidth, mHeight;
+};
+
+/** Performs \a blits, which must not overlap in their destinations. Copies are spread by byte count over \a numThreads tasks on the shared
+	WorkerPool, so many small rectangles share a task rather than each spawning one; \c 0 picks a count based on the total size. **/
+void blitPixels( const std::vector<PixelBlit> &blits, size_t numThreads = 0 );
+
+} } // namespace cinder::avf
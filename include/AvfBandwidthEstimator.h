@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace cinder { namespace avf {
+
+//! What BandwidthEstimator::predict() expects of the rest of a download
+struct PlayThroughEstimate {
+	PlayThroughEstimate() : mValid( false ), mStallFree( false ), mBandwidth( 0 ), mMediaBitrate( 0 ), mBufferedSeconds( 0 ),
+		mRemainingSeconds( 0 ), mTimeToLoad( 0 ), mStartDelay( 0 ) {}
+
+	//! Whether there was enough to go on: a bandwidth estimate and a media bitrate, or nothing left to load
+	bool		mValid;
+	//! Whether playback started now is expected to reach the end without stalling
+	bool		mStallFree;
+	//! Estimated throughput, and the data rate of the media, both in bytes per second
+	double		mBandwidth, mMediaBitrate;
+	//! Seconds of media loaded ahead of the playhead, and left to play from it
+	double		mBufferedSeconds, mRemainingSeconds;
+	//! Seconds until the rest of the media is expected to have loaded
+	double		mTimeToLoad;
+	//! Seconds to wait before starting playback that doesn't stall, \c 0 when it can start right away
+	double		mStartDelay;
+};
+
+/** \brief Estimates network throughput from timed downloads, and predicts when playback can start without stalling
+ *	Keeps two exponentially weighted moving averages of the throughput, weighted by the duration of each sample, and
+ *	reports the lower one: the fast average reacts to a drop within a couple of seconds, the slow one ignores short bursts.
+ *	Samples too small to time reliably are ignored. Thread-safe. Only depends on the C++ standard library.
+**/
+class BandwidthEstimator {
+  public:
+	class Options {
+	  public:
+		Options();
+
+		//! Sets the half-lives, in seconds of sampled downloads, of the fast and slow averages. Defaults to 2 and 5.
+		Options&	setHalfLives( double fastSeconds, double slowSeconds );
+		double		getFastHalfLife() const { return mFastHalfLife; }
+		double		getSlowHalfLife() const { return mSlowHalfLife; }
+		//! Sets the smallest sample that counts, in bytes. Defaults to 16KB.
+		Options&	setMinSampleBytes( uint64_t bytes ) { mMinSampleBytes = bytes; return *this; }
+		uint64_t	getMinSampleBytes() const { return mMinSampleBytes; }
+		//! Sets the share of the estimate that predictions rely on, leaving room for the throughput to drop. Defaults to 0.8.
+		Options&	setSafetyFactor( double factor );
+		double		getSafetyFactor() const { return mSafetyFactor; }
+		//! Sets the seconds that have to be buffered ahead of the playhead before playback counts as stall-free. Defaults to 2.
+		Options&	setMinBufferSeconds( double seconds ) { mMinBufferSeconds = seconds; return *this; }
+		double		getMinBufferSeconds() const { return mMinBufferSeconds; }
+
+	  private:
+		double		mFastHalfLife, mSlowHalfLife, mSafetyFactor, mMinBufferSeconds;
+		uint64_t	mMinSampleBytes;
+	};
+
+	explicit BandwidthEstimator( const Options &options = Options() );
+
+	const Options&	getOptions() const { return mOptions; }
+
+	//! Adds a download of \a bytes that took \a seconds
+	void		addSample( uint64_t bytes, double seconds );
+	//! Forgets every sample, for example when the movie moves to another server
+	void		reset();
+
+	//! Returns whether enough has been sampled for an estimate
+	bool		hasEstimate() const;
+	//! Returns the estimated throughput in bytes per second, \c 0 without an estimate
+	double		getBandwidth() const;
+	//! Returns the bytes and seconds of every sample that counted
+	uint64_t	getBytesSampled() const;
+	double		getSecondsSampled() const;
+
+	/** Predicts the rest of a download of media at \a mediaBitrate bytes per second, with \a bufferedSeconds loaded ahead of the playhead
+		and \a remainingSeconds left to play. Playback started after PlayThroughEstimate::mStartDelay keeps ahead of the download
+		at every point, assuming the throughput holds at the safety factor of the estimate. **/
+	PlayThroughEstimate	predict( double mediaBitrate, double bufferedSeconds, double remainingSeconds ) const;
+
+  private:
+	// expects mMutex to be held
+	double		getEstimate( double average, double halfLife ) const;
+
+	Options				mOptions;
+	mutable std::mutex	mMutex;
+	//! The averages before the correction for their zero start
+	double				mFast, mSlow;
+	double				mSecondsSampled;
+	uint64_t			mBytesSampled;
+};
+
+} } // namespace cinder::avf
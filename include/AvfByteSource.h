@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cinder { namespace avf {
+
+typedef std::shared_ptr<class ByteSource> ByteSourceRef;
+class BandwidthEstimator;
+
+/** \brief Random access to the bytes of a movie that lives neither in a file nor at a URL, such as a clip decrypted into memory
+ *	Movies read from a ByteSource through range requests, so only the bytes AVFoundation is about to parse or decode are
+ *	handed over, and nothing is written to a temporary file first. Only depends on the C++ standard library.
+**/
+class ByteSource {
+  public:
+	virtual ~ByteSource() {}
+
+	virtual uint64_t		getSize() const = 0;
+	//! Copies up to \a size bytes at \a offset to \a dst, returning the number copied, which is only less than \a size at the end. Called from any thread.
+	virtual size_t			read( uint64_t offset, void *dst, size_t size ) = 0;
+	//! Returns the \a size bytes at \a offset in place when the source holds them contiguously, which saves a copy, otherwise \c NULL
+	virtual const uint8_t*	getData( uint64_t /*offset*/, size_t /*size*/ ) { return NULL; }
+	//! Tells the source how many bytes per second playback consumes, for sources that read ahead. Movies call it once they know their data rate.
+	virtual void			setBitrateHint( double /*bytesPerSecond*/ ) {}
+	//! Returns the estimate of the throughput of sources that download their bytes, \c NULL for the others
+	virtual const BandwidthEstimator*	getBandwidthEstimator() const { return NULL; }
+
+	//! Returns the extension the content would have as a file, such as \c "mov", used when its container can't be told from its bytes
+	const std::string&		getExtensionHint() const { return mExtensionHint; }
+	//! Sets the extension hint, with or without the leading dot
+	void					setExtensionHint( const std::string &extension );
+
+  protected:
+	std::string		mExtensionHint;
+};
+
+//! ByteSource over a contiguous block of memory
+class MemoryByteSource : public ByteSource {
+  public:
+	//! Serves the \a size bytes at \a data without copying them. \a data has to outlive the source, unless \a owner keeps it alive.
+	static ByteSourceRef	create( const void *data, size_t size, const std::shared_ptr<const void> &owner = std::shared_ptr<const void>() );
+	//! Takes over \a data
+	static ByteSourceRef	create( std::vector<uint8_t> &&data );
+
+	virtual uint64_t		getSize() const { return mSize; }
+	virtual size_t			read( uint64_t offset, void *dst, size_t size );
+	virtual const uint8_t*	getData( uint64_t offset, size_t size );
+
+  protected:
+	MemoryByteSource( const void *data, size_t size, const std::shared_ptr<const void> &owner );
+
+	const uint8_t				*mData;
+	size_t						mSize;
+	std::shared_ptr<const void>	mOwner;
+};
+
+//! Half-open span of bytes [mOffset, mOffset + mLength)
+struct ByteRange {
+	ByteRange() : mOffset( 0 ), mLength( 0 ) {}
+	ByteRange( uint64_t offset, uint64_t length ) : mOffset( offset ), mLength( length ) {}
+
+	uint64_t	getEnd() const { return mOffset + mLength; }
+	bool		empty() const { return mLength == 0; }
+
+	uint64_t	mOffset, mLength;
+};
+
+//! Sparse set of byte ranges, such as the parts of a remote file that are in a cache. Touching ranges are merged.
+class ByteRangeSet {
+  public:
+	void		add( const ByteRange &range );
+	void		clear() { mRanges.clear(); }
+	bool		empty() const { return mRanges.empty(); }
+
+	//! Returns whether every byte of \a range is in the set
+	bool		contains( const ByteRange &range ) const;
+	//! Returns the parts of \a range that aren't in the set, in order
+	std::vector<ByteRange>	getMissing( const ByteRange &range ) const;
+	//! Returns where the span of the set that holds \a offset ends, or \a offset when the set doesn't hold it
+	uint64_t	getContiguousEnd( uint64_t offset ) const;
+	//! Returns the number of bytes in the set
+	uint64_t	getTotalBytes() const;
+	//! Returns the ranges of the set, in order
+	std::vector<ByteRange>	getRanges() const;
+
+  private:
+	//! Start to end of disjoint, non-touching ranges
+	std::map<uint64_t, uint64_t>	mRanges;
+};
+
+/** Clamps a request for \a length bytes at \a offset to a resource of \a size bytes, \a toEnd extending it to the end of the resource.
+	Returns \c false when no bytes of the request lie inside the resource. **/
+bool	clampByteRange( uint64_t offset, uint64_t length, bool toEnd, uint64_t size, ByteRange *result );
+
+/** Hands \a range of \a source to \a respond in pieces of at most \a chunkSize bytes, in order. \a respond returns \c false to cancel.
+	Pieces point into the source when it is contiguous and into a scratch buffer otherwise, so they are only valid during the call.
+	Returns whether the whole range was served. **/
+bool	serveByteRange( ByteSource &source, const ByteRange &range, size_t chunkSize, const std::function<bool( const uint8_t *data, size_t size )> &respond );
+
+enum ContainerType { CONTAINER_UNKNOWN, CONTAINER_QUICKTIME, CONTAINER_MPEG4, CONTAINER_M4V, CONTAINER_3GPP };
+
+//! Identifies the container from the first bytes of the content, falling back on \a extensionHint when they aren't conclusive
+ContainerType	detectContainerType( const uint8_t *header, size_t size, const std::string &extensionHint = std::string() );
+//! Identifies the container of \a source from its first bytes and its extension hint
+ContainerType	detectContainerType( ByteSource &source );
+//! Returns the uniform type identifier of \a type, such as \c "com.apple.quicktime-movie", or \c NULL for CONTAINER_UNKNOWN
+const char*		getContainerTypeIdentifier( ContainerType type );
+
+} } // namespace cinder::avf
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AvfByteSource.h"
+#include "AvfMediaTime.h"
+
+namespace cinder { namespace avf {
+
+//! Properties of a movie read from its header when it is packed, so clips can be laid out before any of them is opened
+struct ClipInfo {
+	ClipInfo() : mWidth( 0 ), mHeight( 0 ), mNumFrames( 0 ), mHasVideo( false ), mHasAudio( false ) {}
+
+	MediaTime	mDuration;
+	//! Duration of the most common frame of the first video track
+	MediaTime	mFrameDuration;
+	//! Presentation size of the first video track
+	int32_t		mWidth, mHeight;
+	uint32_t	mNumFrames;
+	bool		mHasVideo, mHasAudio;
+};
+
+/** Fills \a result from the movie header of the QuickTime or MPEG-4 file in \a data, walking only the atoms that describe the movie
+	and its tracks. Returns \c false when \a data holds no movie header. **/
+bool parseClipInfo( const uint8_t *data, size_t size, ClipInfo *result );
+
+/** \brief Builds a clip pack: many movies concatenated in one file behind an index of their names, offsets, sizes and ClipInfo
+ *	Clips are stored byte for byte, each starting on a 64 byte boundary, and the index is sorted by name so a ClipPack looks
+ *	clips up in place. Only depends on the C++ standard library and runs wherever packs are built, including Linux.
+**/
+class ClipPackWriter {
+  public:
+	//! Adds the movie at \a path under \a name. The file is read by write().
+	void		addFile( const std::string &name, const std::string &path );
+	//! Adds a copy of the \a size bytes at \a data under \a name
+	void		addData( const std::string &name, const void *data, size_t size );
+	size_t		getNumClips() const { return mClips.size(); }
+
+	//! Writes the pack to \a path. Throws ClipPackExc when a file can't be read or written, or when two clips share a name.
+	void		write( const std::string &path ) const;
+
+  private:
+	struct Clip {
+		std::string				mName, mPath;
+		std::vector<uint8_t>	mData;
+	};
+
+	std::vector<Clip>	mClips;
+};
+
+typedef std::shared_ptr<class ClipPack> ClipPackRef;
+
+/** \brief Read-only view of a clip pack, memory-mapped once
+ *	Opening a pack maps the file and checks its index, without reading or parsing any clip, and each clip is served from the
+ *	mapping as a ByteSource for Movie playback from memory. Thousands of clips thus cost one file descriptor and one mapping,
+ *	instead of a file and a header parse each.
+**/
+class ClipPack : public std::enable_shared_from_this<ClipPack> {
+  public:
+	~ClipPack();
+
+	//! Maps the pack at \a path. Throws ClipPackExc when it can't be opened or isn't a valid pack, including one that is truncated or names two clips alike.
+	static ClipPackRef	create( const std::string &path ) { return ClipPackRef( new ClipPack( path ) ); }
+
+	size_t		getNumClips() const { return mNumClips; }
+	//! Returns the name of clip \a index. Clips are sorted by name.
+	std::string	getName( size_t index ) const;
+	//! Looks up the clip named \a name by binary search over the mapped index, storing its position in \a index
+	bool		findClip( const std::string &name, size_t *index ) const;
+	bool		hasClip( const std::string &name ) const { size_t index; return findClip( name, &index ); }
+	ClipInfo	getInfo( size_t index ) const;
+	uint64_t	getClipSize( size_t index ) const;
+
+	//! Returns the bytes of clip \a index in place, for example to open it with MovieSurface::create(). The source keeps the pack mapped.
+	ByteSourceRef	getClip( size_t index );
+	//! Returns the clip named \a name, or an empty ref when the pack has none
+	ByteSourceRef	getClip( const std::string &name );
+
+	//! Writes clip \a index to a file at \a path. Throws ClipPackExc on failure.
+	void		extract( size_t index, const std::string &path ) const;
+	//! Writes every clip to \a directory under its name, which must not contain path separators. Throws ClipPackExc on failure.
+	void		extractAll( const std::string &directory ) const;
+
+  protected:
+	explicit ClipPack( const std::string &path );
+
+	const uint8_t*	getRecord( size_t index ) const;
+
+	const uint8_t	*mData;
+	size_t			mSize;
+	size_t			mNumClips;
+	uint64_t		mNamesOffset;
+};
+
+class ClipPackExc : public std::exception {
+};
+
+} } // namespace cinder::avf
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cinder { namespace avf {
+
+/** \brief Allocation policy shared by every frame buffer the block creates or pools
+ *	Frames start on a 64 byte boundary and their rows are padded to a whole number of cache lines, so SIMD kernels
+ *	never split a cache line at the start of a row. Frames at or above the huge page threshold are mapped directly
+ *	from the kernel and advised to use huge pages where the platform supports it.
+**/
+class FrameAllocator {
+  public:
+	//! Alignment of frame base addresses and row strides, in bytes
+	static const size_t ALIGNMENT = 64;
+
+	//! Returns the padded stride for a row of \a width pixels of \a pixelInc bytes
+	static size_t	getRowBytes( int32_t width, int32_t pixelInc );
+	//! Rounds \a size up to a multiple of ALIGNMENT
+	static size_t	alignSize( size_t size ) { return ( size + ALIGNMENT - 1 ) & ~( ALIGNMENT - 1 ); }
+
+	//! Allocates \a size bytes aligned to ALIGNMENT. Returns \c NULL on failure. Release with FrameAllocator::free().
+	static void*	allocate( size_t size );
+	//! Releases memory returned by allocate(). \c NULL is ignored.
+	static void		free( void *data );
+	//! Deallocator matching the signature expected by Surface::setDeallocator()
+	static void		freeDeallocator( void *data ) { free( data ); }
+
+	//! Returns the size, in bytes, from which frames are backed by huge pages. Defaults to 8MB.
+	static size_t	getHugePageThreshold();
+	//! Sets the size, in bytes, from which frames are backed by huge pages. \c 0 disables huge pages.
+	static void		setHugePageThreshold( size_t bytes );
+};
+
+} } // namespace cinder::avf
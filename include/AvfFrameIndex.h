@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AvfMediaTime.h"
+
+namespace cinder { namespace avf {
+
+//! Identifies a delivered frame: the source time it shows, its position in the track and when it was decoded
+struct FrameInfo {
+	FrameInfo() : mFrameIndex( -1 ), mKeyFrame( false ) {}
+
+	//! Returns whether a frame has been described, false before the first frame is delivered
+	bool		isValid() const { return mTime.isValid(); }
+
+	//! Presentation time stamp
+	MediaTime	mTime;
+	MediaTime	mDuration;
+	//! Decode time stamp. Invalid when the track has no reordering or its sample table isn't known.
+	MediaTime	mDecodeTime;
+	//! Position of the frame in presentation order, \c -1 when unknown
+	int64_t		mFrameIndex;
+	bool		mKeyFrame;
+};
+
+/** \brief Sample table of one video track in presentation order
+ *	Records the exact timing and sync flag of every frame so that random access, GOP boundaries and reverse playback
+ *	can be planned without touching the media. Only depends on the C++ standard library.
+**/
+class FrameIndex {
+  public:
+	struct Frame {
+		Frame() : mKeyFrame( false ) {}
+		Frame( const MediaTime &time, const MediaTime &duration, const MediaTime &decodeTime, bool keyFrame )
+			: mTime( time ), mDuration( duration ), mDecodeTime( decodeTime ), mKeyFrame( keyFrame ) {}
+
+		//! Presentation time stamp
+		MediaTime	mTime;
+		MediaTime	mDuration;
+		//! Decode time stamp. Invalid when the track has no reordering.
+		MediaTime	mDecodeTime;
+		//! Whether decoding can start at this frame
+		bool		mKeyFrame;
+	};
+
+	//! A run of frames [\a mFirst, \a mEnd) together with the key frame decoding has to start from to reach them
+	struct Span {
+		Span() : mDecodeStart( 0 ), mFirst( 0 ), mEnd( 0 ) {}
+		Span( size_t decodeStart, size_t first, size_t end ) : mDecodeStart( decodeStart ), mFirst( first ), mEnd( end ) {}
+
+		size_t	getNumFrames() const { return mEnd - mFirst; }
+		bool	empty() const { return mEnd <= mFirst; }
+		bool	contains( size_t frame ) const { return frame >= mFirst && frame < mEnd; }
+		bool	operator==( const Span &rhs ) const { return mDecodeStart == rhs.mDecodeStart && mFirst == rhs.mFirst && mEnd == rhs.mEnd; }
+
+		size_t	mDecodeStart, mFirst, mEnd;
+	};
+
+	//! Appends a frame in any order. Call finalize() once every frame has been added.
+	void			addFrame( const MediaTime &time, const MediaTime &duration, const MediaTime &decodeTime, bool keyFrame );
+	//! Sorts the frames into presentation order and builds the key frame table. The first frame is always treated as a key frame.
+	void			finalize();
+	void			clear();
+
+	size_t			getNumFrames() const { return mFrames.size(); }
+	bool			empty() const { return mFrames.empty(); }
+	const Frame&	getFrame( size_t index ) const { return mFrames[index]; }
+	//! Returns the description of frame \a index handed out alongside its pixels
+	FrameInfo		getFrameInfo( size_t index ) const;
+	//! Returns the presentation time just past the last frame
+	MediaTime		getEndTime() const;
+
+	//! Finds the frame on screen at \a time, the last one starting at or before it. Returns \c false when \a time precedes the first frame.
+	bool			findFrame( const MediaTime &time, size_t *index ) const;
+	//! Returns the index of the key frame at or before \a index
+	size_t			getKeyFrameBefore( size_t index ) const;
+	//! Returns the index of the first key frame after \a index, or getNumFrames() when there is none
+	size_t			getKeyFrameAfter( size_t index ) const;
+	//! Returns the number of key frames, and so of GOPs
+	size_t			getNumKeyFrames() const { return mKeyFrames.size(); }
+
+	/** Returns the span ending with \a frame that reverse playback should decode next, holding at most \a maxFrames frames.
+		Spans never cross a key frame, so a GOP longer than \a maxFrames is covered by several spans that each decode from its key frame. **/
+	Span			getReverseSpan( size_t frame, size_t maxFrames ) const;
+
+	//! Records that frame \a index starts a scene, as found by a SceneDetector. Cuts may come in any order.
+	void			addSceneCut( size_t index );
+	void			clearSceneCuts();
+	//! Returns the frames that start a scene, in presentation order. The first frame starts a scene without being listed.
+	const std::vector<size_t>&	getSceneCuts() const { return mSceneCuts; }
+	//! Returns the index of the first frame of the scene holding frame \a index
+	size_t			getSceneStart( size_t index ) const;
+	//! Returns the index of the first frame of the scene after the one holding frame \a index, or getNumFrames() when it is the last
+	size_t			getNextSceneStart( size_t index ) const;
+
+  private:
+	std::vector<Frame>	mFrames;
+	std::vector<size_t>	mKeyFrames;
+	std::vector<size_t>	mSceneCuts;
+};
+
+} } // namespace cinder::avf
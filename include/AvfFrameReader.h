@@ -0,0 +1,84 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+
+#include <memory>
+
+#include "Avf.h"
+#include "AvfFrameIndex.h"
+#include "AvfFrameRing.h"
+#include "AvfMediaTime.h"
+#include "AvfSceneDetector.h"
+
+namespace cinder { namespace avf {
+
+typedef std::shared_ptr<class FrameReader> FrameReaderRef;
+
+/** \brief Non-realtime access to the exact frame at any time of a video track, for offline rendering
+ *	Every request blocks until the frame on screen at the requested time has been decoded, and always returns that frame, as
+ *	identified through the track's FrameIndex. A single forward decode stream is kept between requests along with the last few
+ *	frames, so requests with increasing times run at decode speed, and repeated or slightly earlier times need no decoding at all.
+ *	The stream only restarts from a key frame when a request jumps back past the cached frames or ahead past the next key frame.
+**/
+class FrameReader {
+  public:
+	~FrameReader();
+
+	//! Reads video track \a videoTrack of the movie at \a path, caching the last \a cacheFrames decoded frames
+	static FrameReaderRef	create( const fs::path &path, size_t videoTrack = 0, size_t cacheFrames = 2 ) { return FrameReaderRef( new FrameReader( path, videoTrack, cacheFrames ) ); }
+	//! Reads \a track of \a asset, both of which are retained
+	static FrameReaderRef	create( AVAsset *asset, AVAssetTrack *track, size_t cacheFrames = 2 ) { return FrameReaderRef( new FrameReader( asset, track, cacheFrames ) ); }
+
+	int32_t		getWidth() const { return mWidth; }
+	int32_t		getHeight() const { return mHeight; }
+	Vec2i		getSize() const { return Vec2i( getWidth(), getHeight() ); }
+	//! Returns the sample table of the track, which defines the frames requests resolve to
+	const FrameIndex&	getFrameIndex() const { return mFrameIndex; }
+	MediaTime	getMediaDuration() const { return mFrameIndex.getEndTime(); }
+
+	//! Returns the frame on screen at \a time, describing it in \a info when given. Returns an empty Surface when \a time lies outside the track or decoding fails.
+	Surface8u	getFrameAt( const MediaTime &time, FrameInfo *info = NULL );
+	//! Returns frame \a index in presentation order, describing it in \a info when given
+	Surface8u	getFrame( size_t index, FrameInfo *info = NULL );
+
+	/** Compares every frame the reader decodes with the one before, recording the frames that start a scene in the FrameIndex.
+		Costs a pass over a small luma grid per frame. A cut is recorded once the frame after it is decoded, which tells it from a flash.
+		Frames not decoded in sequence, such as either side of a seek, aren't compared. **/
+	void		enableSceneDetection( const SceneDetector::Options &options = SceneDetector::Options() );
+	void		disableSceneDetection();
+	bool		isSceneDetectionEnabled() const { return mSceneDetector != nullptr; }
+	//! Returns whether every frame has been compared with the frames either side, which makes getSceneCuts() complete
+	bool		isSceneDetectionComplete() const;
+	//! Returns the frames found to start a scene so far, in presentation order
+	const std::vector<size_t>&	getSceneCuts() const { return mFrameIndex.getSceneCuts(); }
+	/** Decodes the frames not compared yet in sequence, enabling detection with \a options unless it is enabled already, so getSceneCuts()
+		lists every cut of the track. Blocks for as long as decoding takes. Returns \c false when decoding fails. **/
+	bool		detectSceneCuts( const SceneDetector::Options &options = SceneDetector::Options() );
+
+  protected:
+	FrameReader( const fs::path &path, size_t videoTrack, size_t cacheFrames );
+	FrameReader( AVAsset *asset, AVAssetTrack *track, size_t cacheFrames );
+
+	void		open( AVAsset *asset, AVAssetTrack *track );
+	bool		decodeFrame( size_t frame, Surface8u *result );
+	bool		restartStream( size_t frame );
+	void		stopStream();
+	void		detectScene( size_t frame, const Surface8u &surface );
+
+	AVAsset*		mAsset;
+	AVAssetTrack*	mTrack;
+	int32_t			mWidth, mHeight;
+	FrameIndex		mFrameIndex;
+
+	AVAssetReader*				mReader;
+	AVAssetReaderTrackOutput*	mReaderOutput;
+	FrameRing<Surface8u>		mRing;
+
+	std::unique_ptr<SceneDetector>	mSceneDetector;
+	//! The frames compared with the frames either side
+	std::vector<bool>				mSceneCompared;
+	size_t							mNumSceneCompared;
+};
+
+} } // namespace cinder::avf
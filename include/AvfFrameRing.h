@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace cinder { namespace avf {
+
+/** \brief Fixed capacity ring of the most recently decoded frames of one stream, keyed by frame index
+ *	Pushing past the capacity drops the oldest frame, so memory stays bounded however far the stream runs.
+**/
+template<typename FrameT>
+class FrameRing {
+  public:
+	explicit FrameRing( size_t capacity ) : mSlots( capacity > 0 ? capacity : 1 ), mHead( 0 ), mSize( 0 ) {}
+
+	size_t	getCapacity() const { return mSlots.size(); }
+	size_t	getSize() const { return mSize; }
+	bool	empty() const { return mSize == 0; }
+
+	//! Stores \a frame as frame \a index, evicting the oldest frame when the ring is full
+	void push( size_t index, const FrameT &frame )
+	{
+		Slot &slot = mSlots[( mHead + mSize ) % mSlots.size()];
+		slot.mIndex = index;
+		slot.mFrame = frame;
+		if( mSize < mSlots.size() )
+			++mSize;
+		else
+			mHead = ( mHead + 1 ) % mSlots.size();
+	}
+
+	//! Returns frame \a index, or \c NULL when it isn't in the ring
+	const FrameT* find( size_t index ) const
+	{
+		for( size_t i = 0; i < mSize; ++i ) {
+			const Slot &slot = mSlots[( mHead + i ) % mSlots.size()];
+			if( slot.mIndex == index )
+				return &slot.mFrame;
+		}
+		return NULL;
+	}
+
+	//! Returns the latest frame at or before \a index, storing its index in \a found, or \c NULL when every frame comes after it
+	const FrameT* findAtOrBefore( size_t index, size_t *found ) const
+	{
+		const Slot *best = NULL;
+		for( size_t i = 0; i < mSize; ++i ) {
+			const Slot &slot = mSlots[( mHead + i ) % mSlots.size()];
+			if( slot.mIndex <= index && ( ! best || slot.mIndex > best->mIndex ) )
+				best = &slot;
+		}
+		if( ! best )
+			return NULL;
+		*found = best->mIndex;
+		return &best->mFrame;
+	}
+
+	//! Returns the index of the newest frame. The ring must not be empty.
+	size_t	getNewestIndex() const { return mSlots[( mHead + mSize - 1 ) % mSlots.size()].mIndex; }
+	//! Returns the index of the oldest frame. The ring must not be empty.
+	size_t	getOldestIndex() const { return mSlots[mHead].mIndex; }
+
+	void clear()
+	{
+		for( size_t i = 0; i < mSlots.size(); ++i )
+			mSlots[i].mFrame = FrameT();
+		mHead = mSize = 0;
+	}
+
+  private:
+	struct Slot {
+		Slot() : mIndex( 0 ) {}
+
+		size_t	mIndex;
+		FrameT	mFrame;
+	};
+
+	std::vector<Slot>	mSlots;
+	size_t				mHead, mSize;
+};
+
+} } // namespace cinder::avf
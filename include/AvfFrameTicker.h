@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cinder { namespace avf {
+
+/** \brief Process-wide driver that updates every registered movie once per display refresh
+ *	A single Clock, normally a DisplayLinkClock, calls tick() once per frame, and tick() walks the registered targets in one
+ *	contiguous array. This replaces a display link per movie, so fifty movies cost one wakeup per vsync instead of fifty.
+ *	Targets are plain function pointers with a context, which keeps the per-frame loop free of allocations and indirections
+ *	beyond the call itself. Idle targets, such as paused or hidden movies, stay registered but are skipped without a call,
+ *	and the clock only runs while at least one target is active.
+**/
+class FrameTicker {
+  public:
+	/** Called once per tick with the target it was registered with and the time of the tick in seconds. Returns whether the
+		target stays active; returning \c false makes it idle atomically with respect to setActive() on other threads. **/
+	typedef bool (*TickFn)( void *target, double time );
+
+	//! Source of the ticks. Implementations call FrameTicker::tick() between start() and stop().
+	class Clock {
+	  public:
+		virtual ~Clock() {}
+		virtual void	start( FrameTicker *ticker ) = 0;
+		//! After stop() returns the clock starts no further ticks on the ticker passed to start()
+		virtual void	stop() = 0;
+	};
+
+	explicit FrameTicker( std::unique_ptr<Clock> clock = std::unique_ptr<Clock>() );
+	~FrameTicker();
+
+	//! Returns the ticker shared by every movie, created without a clock on first use
+	static FrameTicker&	getShared();
+
+	bool		hasClock() const;
+	//! Replaces the clock, for example with a ManualClock in tests. Ticks move to the new clock right away when targets are registered.
+	void		setClock( std::unique_ptr<Clock> clock );
+
+	//! Registers \a target, which is called with \a fn on every tick while it is active. Adding a target twice updates its function and state.
+	void		add( void *target, TickFn fn, bool active = true );
+	//! Unregisters \a target. Waits for a tick in progress on another thread, so \a target may be destroyed once this returns.
+	void		remove( void *target );
+	bool		contains( void *target ) const;
+	//! Resumes or suspends ticking of a registered \a target. Unknown targets are ignored.
+	void		setActive( void *target, bool active );
+	bool		isActive( void *target ) const;
+	size_t		getNumTargets() const;
+	size_t		getNumActiveTargets() const;
+
+	//! Calls every registered target. Called by the Clock; targets may add or remove targets from within their call.
+	void		tick( double time );
+	uint64_t	getNumTicks() const;
+	//! Returns the time passed to the last tick(), or \c -1 before the first one
+	double		getLastTickTime() const;
+
+  private:
+	struct Target {
+		void	*mTarget;
+		TickFn	mFn;
+		bool	mActive;
+	};
+
+	// expect mMutex to be held
+	Target*		find( void *target );
+	void		activate( Target *entry, bool active );
+	void		compact();
+
+	mutable std::recursive_mutex	mMutex;
+	std::unique_ptr<Clock>			mClock;
+	std::vector<Target>				mTargets;
+	size_t							mNumActive;
+	bool							mTicking, mNeedsCompact;
+	uint64_t						mNumTicks;
+	double							mLastTickTime;
+};
+
+/** \brief Clock whose time only moves when advance() is called, for deterministic tests and offline rendering
+ *	Ticks fall on every multiple of the interval, starting at time \c 0, and advance() delivers all the ticks it passes over.
+**/
+class ManualClock : public FrameTicker::Clock {
+  public:
+	explicit ManualClock( double interval = 1.0 / 60.0 );
+
+	virtual void	start( FrameTicker *ticker );
+	virtual void	stop();
+
+	bool		isRunning() const;
+	double		getInterval() const { return mInterval; }
+	double		getTime() const;
+	//! Moves the time forward by \a seconds, ticking once for every multiple of the interval reached. Returns the number of ticks delivered.
+	size_t		advance( double seconds );
+
+  private:
+	mutable std::mutex	mMutex;
+	FrameTicker			*mTicker;
+	double				mInterval, mTime;
+	uint64_t			mNextTick;
+};
+
+/** \brief Clock driven by the refresh of the display: a CADisplayLink on iOS and a CVDisplayLink on OS X
+ *	Ticks are always delivered on the main thread, where movies are drawn. On OS X a refresh that arrives while the previous
+ *	tick is still waiting for the main thread is dropped rather than queued.
+**/
+class DisplayLinkClock : public FrameTicker::Clock {
+  public:
+	DisplayLinkClock();
+	virtual ~DisplayLinkClock();
+
+	virtual void	start( FrameTicker *ticker );
+	virtual void	stop();
+
+  private:
+	struct Impl;
+	std::unique_ptr<Impl>	mImpl;
+};
+
+} } // namespace cinder::avf
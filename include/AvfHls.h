@@ -0,0 +1,201 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AvfBandwidthEstimator.h"
+#include "AvfHttpCache.h"
+
+namespace cinder { namespace avf {
+
+typedef std::shared_ptr<class HlsPrefetcher> HlsPrefetcherRef;
+
+//! A stream listed by a master playlist, from its \c EXT-X-STREAM-INF tag
+struct HlsVariant {
+	HlsVariant() : mBandwidth( 0 ), mAverageBandwidth( 0 ), mWidth( 0 ), mHeight( 0 ), mFrameRate( 0 ) {}
+
+	//! Absolute URL of the variant's media playlist
+	std::string		mUrl;
+	//! Peak and average bitrate in bits per second, \c 0 when not given
+	uint64_t		mBandwidth, mAverageBandwidth;
+	int32_t			mWidth, mHeight;
+	double			mFrameRate;
+	std::string		mCodecs;
+};
+
+//! A media segment of a media playlist
+struct HlsSegment {
+	HlsSegment() : mDuration( 0 ), mSequence( 0 ), mDiscontinuity( false ), mEncrypted( false ) {}
+
+	//! Absolute URL of the segment
+	std::string		mUrl;
+	//! Duration in seconds, from its \c EXTINF tag
+	double			mDuration;
+	//! Media sequence number, which identifies the segment across reloads of a live playlist
+	uint64_t		mSequence;
+	//! The part of the resource at mUrl that holds the segment, empty for the whole resource
+	ByteRange		mByteRange;
+	//! Whether the segment follows a discontinuity in encoding or timestamps
+	bool			mDiscontinuity;
+	//! Whether the segment is encrypted by an \c EXT-X-KEY, which the prefetcher caches as is
+	bool			mEncrypted;
+};
+
+//! A parsed m3u8 playlist, either a master playlist listing variants or a media playlist listing segments
+struct HlsPlaylist {
+	HlsPlaylist() : mTargetDuration( 0 ), mMediaSequence( 0 ), mEndList( false ) {}
+
+	bool			isMaster() const { return ! mVariants.empty(); }
+	//! Returns the total duration of the segments in seconds
+	double			getDuration() const;
+	//! Returns the index of the segment playing at \a seconds from the start of the playlist, clamped to the segments
+	size_t			findSegment( double seconds ) const;
+
+	std::vector<HlsVariant>	mVariants;
+	std::vector<HlsSegment>	mSegments;
+	double					mTargetDuration;
+	uint64_t				mMediaSequence;
+	//! Whether the playlist is complete, as opposed to a live playlist that grows when reloaded
+	bool					mEndList;
+	//! Absolute URL of the initialization section of fragmented MP4 segments, from \c EXT-X-MAP
+	std::string				mInitUrl;
+	ByteRange				mInitByteRange;
+};
+
+/** Parses the m3u8 \a text of the playlist at \a url, against which relative URIs are resolved. Returns \c false unless it
+	starts with \c #EXTM3U. Unknown tags are skipped. **/
+bool		parseHlsPlaylist( const std::string &text, const std::string &url, HlsPlaylist *result );
+//! Resolves \a reference, a URI found in the playlist at \a base, to an absolute URL
+std::string	resolveHlsUrl( const std::string &base, const std::string &reference );
+/** Returns the index of the variant with the highest bitrate that \a bytesPerSecond can sustain, preferring the average
+	bitrate where given, or of the lowest variant when none fits. Returns \c 0 for an empty list. **/
+size_t		selectHlsVariant( const std::vector<HlsVariant> &variants, double bytesPerSecond );
+
+/** \brief Keeps the next few segments of an HLS stream in an HttpCache, picking the variant the measured bandwidth sustains
+ *	A thread of the prefetcher loads the master playlist, picks a variant, and fetches the segments following the playback
+ *	position into the cache, measuring the throughput as it goes. After each segment it picks the variant again, so the
+ *	prefetch follows the network up and down. Live playlists are reloaded every target duration. A channel switch can then
+ *	start from segments on disk. Only depends on the C++ standard library and POSIX, and fetches over plain HTTP.
+ *	The thread is the prefetcher's own rather than the shared WorkerPool's, since it sleeps until the next live reload or
+ *	retry, and a process keeps at most getMaxPrefetchers() of them.
+**/
+class HlsPrefetcher {
+  public:
+	class Options {
+	  public:
+		Options();
+
+		//! Sets the number of segments kept ahead of the playback position. Defaults to 3.
+		Options&	setSegmentsAhead( size_t count ) { mSegmentsAhead = count; return *this; }
+		size_t		getSegmentsAhead() const { return mSegmentsAhead; }
+		//! Sets the bandwidth, in bytes per second, assumed before any has been measured. Defaults to \c 0, which starts on the lowest variant.
+		Options&	setInitialBandwidth( double bytesPerSecond ) { mInitialBandwidth = bytesPerSecond; return *this; }
+		double		getInitialBandwidth() const { return mInitialBandwidth; }
+		//! Sets the share of the measured bandwidth a variant may use, leaving room for the throughput to drop. Defaults to 0.8.
+		Options&	setSafetyFactor( double factor ) { mSafetyFactor = factor; return *this; }
+		double		getSafetyFactor() const { return mSafetyFactor; }
+
+	  private:
+		size_t		mSegmentsAhead;
+		double		mInitialBandwidth, mSafetyFactor;
+	};
+
+	~HlsPrefetcher();
+
+	/** Starts prefetching the stream at \a url, a master or a media playlist over \c http, into \a cache. Throws HlsExc
+		when \a url isn't an \c http URL or getMaxPrefetchers() are running already; the playlists themselves load in the background. **/
+	static HlsPrefetcherRef	create( const std::string &url, const HttpCacheRef &cache = HttpCache::getShared(), const Options &options = Options() )
+	{ return HlsPrefetcherRef( new HlsPrefetcher( url, cache, options ) ); }
+
+	//! Returns the number of prefetchers, and so of prefetch threads, that may exist at once. Defaults to 8.
+	static size_t		getMaxPrefetchers();
+	//! Sets the number of prefetchers that may exist at once, which doesn't affect the ones running already
+	static void			setMaxPrefetchers( size_t count );
+
+	const std::string&	getUrl() const { return mUrl; }
+	const HttpCacheRef&	getCache() const { return mCache; }
+	const Options&		getOptions() const { return mOptions; }
+
+	//! Returns whether the media playlist has loaded
+	bool				isReady() const;
+	//! Returns whether a playlist failed to load or parse, after which the prefetcher gives up
+	bool				hasFailed() const;
+	//! Waits up to \a timeoutSeconds for the segments ahead of the playback position to be cached, returning whether they are
+	bool				waitForSegments( double timeoutSeconds ) const;
+
+	//! Returns the variants of the master playlist, empty when the URL was a media playlist
+	std::vector<HlsVariant>	getVariants() const;
+	//! Returns the index of the variant being prefetched
+	size_t				getVariantIndex() const;
+	//! Prefetches variant \a index whatever the bandwidth, for example the one the player was told to play
+	void				lockVariant( size_t index );
+	//! Goes back to picking the variant by the measured bandwidth
+	void				unlockVariant();
+	//! Returns the media playlist being prefetched, as last loaded
+	HlsPlaylist			getPlaylist() const;
+
+	//! Moves the playback position to \a seconds from the start of the media playlist
+	void				setPosition( double seconds );
+	//! Moves the playback position to the segment with media sequence number \a sequence
+	void				setSequence( uint64_t sequence );
+	//! Returns the media sequence number of the segment at the playback position
+	uint64_t			getSequence() const;
+
+	//! Returns whether \a segment is in the cache in full
+	bool				isCached( const HlsSegment &segment ) const;
+	//! Returns the number of segments from the playback position on that are in the cache, up to the ones kept ahead
+	size_t				getNumSegmentsCached() const;
+	/** Opens \a segment through the cache, which serves it from disk when it was prefetched. For segments with a byte range,
+		read the range from the stream. **/
+	HttpStreamRef		openSegment( const HlsSegment &segment ) const;
+
+	//! Returns the estimate of the throughput of the segment downloads
+	const BandwidthEstimator&	getBandwidthEstimator() const { return mBandwidth; }
+
+  protected:
+	HlsPrefetcher( const std::string &url, const HttpCacheRef &cache, const Options &options );
+
+	//! Fetches and parses the playlist at \a url, returning \c false on failure or when stopping
+	bool				loadPlaylist( const std::string &url, HlsPlaylist *result );
+	//! Fetches \a segment into the cache, returning \c false on failure
+	bool				fetchSegment( const HlsSegment &segment );
+	//! Fetches the resource at \a url into the cache, whole or as far as \a range goes, feeding mBandwidth with the time spent receiving
+	bool				fetchIntoCache( const std::string &url, const ByteRange &range );
+	//! Returns the segments of the playlist to keep cached, expects mMutex to be held
+	std::vector<HlsSegment>	getWindow() const;
+	void				run();
+
+	std::string				mUrl;
+	HttpCacheRef			mCache;
+	Options					mOptions;
+	BandwidthEstimator		mBandwidth;
+
+	mutable std::mutex				mMutex;
+	mutable std::condition_variable	mCond;
+	std::vector<HlsVariant>	mVariants;
+	size_t					mVariantIndex;
+	bool					mVariantLocked;
+	HlsPlaylist				mPlaylist;
+	//! The variant mPlaylist belongs to, which lags behind mVariantIndex while the playlist of a new one loads
+	size_t					mPlaylistVariant;
+	bool					mReady, mFailed, mStopping;
+	//! The playback position; a position set in seconds waits in mPendingPosition until the playlist has loaded
+	uint64_t				mSequence;
+	double					mPendingPosition;
+	bool					mSequenceSet;
+	//! Incremented whenever the position or the variant changes, waking the thread
+	uint64_t				mGeneration;
+	std::thread				mThread;
+};
+
+class HlsExc : public std::exception {
+};
+
+} } // namespace cinder::avf
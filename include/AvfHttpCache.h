@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "AvfBandwidthEstimator.h"
+#include "AvfByteSource.h"
+#include "AvfWorkerPool.h"
+
+namespace cinder { namespace avf {
+
+typedef std::shared_ptr<class HttpCache> HttpCacheRef;
+typedef std::shared_ptr<class HttpStream> HttpStreamRef;
+
+struct HttpResponse;
+
+/** \brief Disk cache of remote movies, kept as the byte ranges that were actually played
+ *	Each resource is a sparse file next to an index of the ranges it holds, so a clip played again, or scrubbed back to, comes
+ *	from disk instead of the network. When the cache outgrows its capacity, the resources used least recently are evicted
+ *	whole, sparing the ones that are open. Resources are revalidated by their ETag when opened. Only depends on the C++
+ *	standard library and POSIX, and fetches over plain HTTP with fetchHttpRange().
+**/
+class HttpCache : public std::enable_shared_from_this<HttpCache> {
+  public:
+	~HttpCache();
+
+	//! Creates a cache in \a directory, which is created if needed and picks up what a previous cache left there. Throws HttpCacheExc when it can't be created.
+	static HttpCacheRef	create( const std::string &directory, uint64_t capacity = 1024 * 1024 * 1024 ) { return HttpCacheRef( new HttpCache( directory, capacity ) ); }
+	//! Returns the cache shared by every movie, created on first use in \c avf-http-cache under \c TMPDIR
+	static HttpCacheRef	getShared();
+
+	/** Opens the resource at \a url, which has to be an \c http URL, reading \a prefetchBytes ahead of playback. Throws
+		HttpCacheExc when neither the server nor the cache knows its size, or when the resource changed on the server while other
+		streams still read the cached version. A resource the cache holds in full plays offline. **/
+	HttpStreamRef		open( const std::string &url, uint64_t prefetchBytes = 8 * 1024 * 1024 );
+	/** Fetches \a range of the resource at \a url into the cache, or all of it for an empty \a range, on the calling thread.
+		Unlike open() it doesn't ask the server for the size first, and fetches nothing that is on disk already. Returns \c false
+		on failure or when \a keepGoing says to stop. The time spent receiving is added to \a bandwidth when given. **/
+	bool				fetch( const std::string &url, const ByteRange &range, const std::function<bool()> &keepGoing, BandwidthEstimator *bandwidth = NULL );
+
+	const std::string&	getDirectory() const { return mDirectory; }
+	uint64_t			getCapacity() const;
+	//! Sets the capacity in bytes, evicting right away when the cache holds more
+	void				setCapacity( uint64_t capacity );
+	//! Returns the bytes held by every resource together
+	uint64_t			getCachedBytes() const;
+	//! Returns the ranges of \a url that are on disk
+	ByteRangeSet		getCachedRanges( const std::string &url ) const;
+	//! Returns whether \a range of \a url is on disk, or all of it for an empty \a range
+	bool				isCached( const std::string &url, const ByteRange &range = ByteRange() ) const;
+	//! Removes every resource that isn't open
+	void				clear();
+
+  protected:
+	struct Entry;
+	typedef std::shared_ptr<Entry>	EntryRef;
+
+	HttpCache( const std::string &directory, uint64_t capacity );
+
+	std::string		getPath( const std::string &key, const char *extension ) const;
+	void			loadIndex( const std::string &key );
+	//! Finds or creates the entry of \a url and counts it as open. Throws HttpCacheExc when another resource holds its key.
+	EntryRef		acquireEntry( const std::string &url );
+	/** Adopts the size and version the server gave in \a response, or keeps what the cache knows when \a response is \c NULL,
+		and opens the cache file. Returns \c false when the entry can't be used, including when the resource changed while
+		others have it open. **/
+	bool			updateEntry( const EntryRef &entry, const HttpResponse *response );
+	//! Writes the index of \a entry, whose mutex has to be locked
+	void			saveIndex( const Entry &entry ) const;
+	void			removeEntry( const EntryRef &entry );
+	//! Counts \a bytes more for \a entry and evicts what no longer fits
+	void			addBytes( const EntryRef &entry, uint64_t bytes );
+	void			evict();
+	void			closeEntry( const EntryRef &entry );
+
+	friend class HttpStream;
+
+	std::string							mDirectory;
+	mutable std::mutex					mMutex;
+	uint64_t							mCapacity, mCachedBytes, mUseCounter;
+	std::map<std::string, EntryRef>		mEntries;
+};
+
+/** \brief ByteSource over a remote resource that goes through an HttpCache
+ *	Reads are served from the cache file where it holds them and fetched otherwise, and the stream keeps fetching ahead of
+ *	the last read, so playback finds its next bytes on disk. Fetching ahead runs as low priority tasks of the shared
+ *	WorkerPool, one request of at most a few megabytes per task, so open streams don't cost a thread each.
+**/
+class HttpStream : public ByteSource {
+  public:
+	~HttpStream();
+
+	virtual uint64_t	getSize() const;
+	virtual size_t		read( uint64_t offset, void *dst, size_t size );
+
+	const std::string&	getUrl() const;
+	uint64_t			getPrefetchBytes() const;
+	void				setPrefetchBytes( uint64_t bytes );
+	//! Returns the ranges of the resource that are on disk
+	ByteRangeSet		getCachedRanges() const;
+	//! Returns the bytes this stream fetched from the network
+	uint64_t			getBytesFetched() const;
+	//! Returns the estimate of the throughput of the stream's fetches
+	virtual const BandwidthEstimator*	getBandwidthEstimator() const { return &mBandwidth; }
+
+  protected:
+	HttpStream( const HttpCacheRef &cache, const HttpCache::EntryRef &entry, uint64_t prefetchBytes );
+
+	/** Fetches the first part of \a range that is neither cached nor being fetched into the cache file, returning \c false on
+		failure or when \a keepGoing says to stop **/
+	bool				fetch( const ByteRange &range, const std::function<bool()> &keepGoing );
+	//! Posts a prefetch task unless one is already waiting or running, expects mPrefetchMutex to be held
+	void				schedulePrefetch();
+	//! Fetches the next missing range ahead of the read position and schedules the one after it
+	void				prefetchNext();
+
+	friend class HttpCache;
+
+	HttpCacheRef			mCache;
+	HttpCache::EntryRef		mEntry;
+
+	mutable std::mutex		mPrefetchMutex;
+	uint64_t				mPosition, mPrefetchBytes, mBytesFetched;
+	//! Incremented by every read, so a prefetch task that found nothing to do knows to look again
+	uint64_t				mGeneration;
+	bool					mStopping, mPrefetchScheduled;
+	WorkerPool::QueueRef	mPrefetchQueue;
+	BandwidthEstimator		mBandwidth;
+	//! Whether fetches take on the version the server answers with, for streams that only fill the cache
+	bool					mAdoptVersion;
+};
+
+class HttpCacheExc : public std::exception {
+};
+
+} } // namespace cinder::avf
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "AvfByteSource.h"
+
+namespace cinder { namespace avf {
+
+//! Parts of an \c http URL
+struct HttpUrl {
+	HttpUrl() : mPort( 80 ) {}
+
+	std::string		mHost;
+	int				mPort;
+	//! Path and query, starting with a slash
+	std::string		mPath;
+};
+
+//! Splits \a url into its parts. Returns \c false unless it is a well-formed \c http URL.
+bool	parseHttpUrl( const std::string &url, HttpUrl *result );
+
+//! What a server answered to fetchHttpRange()
+struct HttpResponse {
+	HttpResponse() : mStatus( 0 ), mOffset( 0 ), mTotalSize( 0 ), mTotalSizeKnown( false ) {}
+
+	int				mStatus;
+	//! Offset in the resource of the first byte handed to the receiver
+	uint64_t		mOffset;
+	//! Size of the whole resource, from \c Content-Range or the \c Content-Length of a complete answer
+	uint64_t		mTotalSize;
+	bool			mTotalSizeKnown;
+	std::string		mETag, mContentType;
+	//! The URL that answered, after redirects
+	std::string		mUrl;
+};
+
+/** \brief Fetches \a range of the resource at \a url over plain HTTP/1.1, handing the body to \a receive as it arrives
+ *	An empty \a range fetches the whole resource. Servers that ignore the \c Range header are handled by skipping to the range.
+ *	Redirects are followed. \a receive returns \c false to cancel. Returns \c false on network, protocol or HTTP errors and on
+ *	cancellation, with \a response filled in as far as it got. Bodies may be delimited by \c Content-Length, by the chunked
+ *	transfer coding or by the connection closing. Only depends on the C++ standard library and POSIX sockets.
+**/
+bool	fetchHttpRange( const std::string &url, const ByteRange &range, HttpResponse *response,
+						const std::function<bool( const uint8_t *data, size_t size )> &receive, int timeoutSeconds = 10 );
+
+} } // namespace cinder::avf
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cinder { namespace avf {
+
+/** \brief Exact rational media time, \a value / \a timeScale seconds, laid out like a CMTime
+ *	Arithmetic and comparisons are exact whenever the result can be represented, so frame steps such as \c 1001/30000
+ *	accumulate without drift. A time scale of \c 0 marks an invalid time, which propagates through arithmetic and is also
+ *	the result of any arithmetic whose value overflows 64 bits.
+**/
+class MediaTime {
+  public:
+	//! Time scale used by the float overloads when none is known. Matches the MovieWriter default.
+	static const int32_t DEFAULT_TIME_SCALE = 600;
+
+	//! Constructs an invalid time
+	MediaTime() : mValue( 0 ), mTimeScale( 0 ) {}
+	MediaTime( int64_t value, int32_t timeScale ) : mValue( value ), mTimeScale( timeScale > 0 ? timeScale : 0 ) {}
+
+	//! Returns \a seconds rounded to the nearest unit of \a timeScale
+	static MediaTime	fromSeconds( double seconds, int32_t timeScale = DEFAULT_TIME_SCALE );
+	/** Returns the exact duration of a frame at the nominal rate \a framesPerSecond. Whole rates and NTSC rates such as 29.97, which are
+		\c N*1000/1001, give exact steps like \c 1001/30000; other rates are kept to a thousandth of a frame per second. **/
+	static MediaTime	fromFrameRate( double framesPerSecond );
+	//! Returns the start time of \a frame for frames lasting \a frameDuration
+	static MediaTime	fromFrame( int64_t frame, const MediaTime &frameDuration ) { return frameDuration * frame; }
+	static MediaTime	zero() { return MediaTime( 0, 1 ); }
+	//! Returns an invalid time, as the default constructor does. Arithmetic that overflows returns one too.
+	static MediaTime	invalid() { return MediaTime(); }
+
+	int64_t		getValue() const { return mValue; }
+	int32_t		getTimeScale() const { return mTimeScale; }
+	bool		isValid() const { return mTimeScale > 0; }
+
+	double		toSeconds() const { return isValid() ? static_cast<double>( mValue ) / mTimeScale : 0.0; }
+	//! Returns the index of the frame containing this time for frames lasting \a frameDuration, rounding toward negative infinity. Returns \c 0 for invalid arguments.
+	int64_t		toFrame( const MediaTime &frameDuration ) const;
+	//! Returns the time expressed in units of \a timeScale, rounded to nearest
+	MediaTime	rescaled( int32_t timeScale ) const;
+	//! Returns the same time with the smallest possible time scale
+	MediaTime	reduced() const;
+
+	MediaTime	operator+( const MediaTime &rhs ) const;
+	MediaTime	operator-( const MediaTime &rhs ) const;
+	MediaTime	operator*( int64_t scale ) const;
+	MediaTime	operator-() const;
+	MediaTime&	operator+=( const MediaTime &rhs ) { return *this = *this + rhs; }
+	MediaTime&	operator-=( const MediaTime &rhs ) { return *this = *this - rhs; }
+
+	//! Returns a negative value, zero or a positive value as \a lhs is earlier than, equal to or later than \a rhs. Invalid times sort after valid ones.
+	static int	compare( const MediaTime &lhs, const MediaTime &rhs );
+
+	bool		operator==( const MediaTime &rhs ) const { return compare( *this, rhs ) == 0; }
+	bool		operator!=( const MediaTime &rhs ) const { return compare( *this, rhs ) != 0; }
+	bool		operator<( const MediaTime &rhs ) const { return compare( *this, rhs ) < 0; }
+	bool		operator<=( const MediaTime &rhs ) const { return compare( *this, rhs ) <= 0; }
+	bool		operator>( const MediaTime &rhs ) const { return compare( *this, rhs ) > 0; }
+	bool		operator>=( const MediaTime &rhs ) const { return compare( *this, rhs ) >= 0; }
+
+  private:
+	int64_t		mValue;
+	int32_t		mTimeScale;
+};
+
+} } // namespace cinder::avf
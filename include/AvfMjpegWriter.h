@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cinder { namespace avf {
+
+//! Describes where the color channels of a packed 8-bit pixel live, for example \c { 4, 2, 1, 0 } for BGRA
+struct MjpegPixelLayout {
+	MjpegPixelLayout( int32_t pixelInc = 3, int32_t redOffset = 0, int32_t greenOffset = 1, int32_t blueOffset = 2 )
+		: mPixelInc( pixelInc ), mRedOffset( redOffset ), mGreenOffset( greenOffset ), mBlueOffset( blueOffset ) {}
+
+	int32_t		mPixelInc, mRedOffset, mGreenOffset, mBlueOffset;
+};
+
+//! Encodes a single baseline 4:2:0 JPEG image into \a result. \a quality is in the range [\c 0,\c 1.0].
+void encodeJpeg( const uint8_t *data, int32_t width, int32_t height, int32_t rowBytes, const MjpegPixelLayout &layout, float quality, std::vector<uint8_t> *result );
+
+typedef std::shared_ptr<class MjpegWriter> MjpegWriterRef;
+
+/** \brief Portable Motion-JPEG QuickTime writer
+ *	Every frame is an independent JPEG, so frames are encoded concurrently on a pool of worker threads
+ *	and written to the movie in presentation order as they complete. Only depends on the C++ standard library.
+**/
+class MjpegWriter {
+  public:
+	//! \a numThreads of \c 0 uses one worker per hardware thread
+	MjpegWriter( const std::string &path, int32_t width, int32_t height, int32_t timeScale = 600, float quality = 0.9f, size_t numThreads = 0 );
+	~MjpegWriter();
+
+	static MjpegWriterRef	create( const std::string &path, int32_t width, int32_t height, int32_t timeScale = 600, float quality = 0.9f, size_t numThreads = 0 )
+		{ return MjpegWriterRef( new MjpegWriter( path, width, height, timeScale, quality, numThreads ) ); }
+
+	/** \brief Queues a frame for encoding, lasting \a duration units of the writer's time scale. The pixels are copied before returning,
+		mapped through the 256 entry table \a lut on the way when given. Blocks while the number of frames in flight exceeds twice the
+		number of worker threads, which bounds memory use. Throws MjpegWriterExc after finish() or once writing to the file has failed. **/
+	void		addFrame( const uint8_t *data, int32_t rowBytes, const MjpegPixelLayout &layout, int64_t duration, const uint8_t *lut = NULL );
+	/** Waits for all queued frames, writes the movie header and closes the file. Throws MjpegWriterExc when any of it couldn't be
+		written, leaving an unplayable file behind. Calling finish() more than once has no effect. **/
+	void		finish();
+
+	//! Returns the number of frames added so far
+	uint32_t	getNumFrames() const { return mNumFrames; }
+	//! Returns the number of worker threads encoding frames
+	size_t		getNumThreads() const { return mThreads.size(); }
+
+  private:
+	struct Job {
+		uint32_t				mIndex;
+		int32_t					mRowBytes;
+		MjpegPixelLayout		mLayout;
+		std::shared_ptr<uint8_t>	mPixels;
+	};
+
+	void		workerLoop();
+	void		writeEncodedFrames();
+	bool		writeMovieHeader();
+
+	std::FILE*				mFile;
+	int32_t					mWidth, mHeight, mTimeScale;
+	float					mQuality;
+	uint32_t				mNumFrames;
+	bool					mFinished, mStopping;
+	// set by the first short write, after which frames are still encoded but no longer written
+	bool					mWriteFailed;
+
+	std::vector<std::thread>					mThreads;
+	std::deque<std::shared_ptr<Job> >			mJobs;
+	size_t										mInFlight;
+	std::mutex									mJobMutex;
+	std::condition_variable						mJobCondition, mSlotCondition;
+
+	// encoded frames waiting for their predecessors, keyed by frame index
+	std::map<uint32_t, std::vector<uint8_t> >	mEncoded;
+	uint32_t									mNextToWrite;
+	std::mutex									mWriteMutex;
+
+	uint64_t				mMediaDataStart, mWritePosition;
+	std::vector<uint64_t>	mSampleOffsets;
+	std::vector<uint32_t>	mSampleSizes;
+	std::vector<int64_t>	mSampleDurations;
+};
+
+class MjpegWriterExc : public std::exception {
+};
+
+} } // namespace cinder::avf
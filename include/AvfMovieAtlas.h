@@ -0,0 +1,71 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Area.h"
+#include "cinder/Rect.h"
+#include "cinder/Surface.h"
+
+#include <memory>
+#include <vector>
+
+#include "Avf.h"
+#include "AvfAtlasPacker.h"
+
+namespace cinder { namespace avf {
+
+typedef std::shared_ptr<class MovieAtlas> MovieAtlasRef;
+
+/** \brief Composites the current frames of many movies into one Surface
+ *	Each movie gets a fixed rectangle of the atlas, placed by a SkylinePacker once its size is known. update() copies only the movies
+ *	with a new frame, spreading the copies across threads, so a wall of small clips costs a single texture upload per display frame
+ *	drawn with the per-movie texture coordinates.
+**/
+class MovieAtlas {
+  public:
+	//! \a padding pixels separate neighbouring movies. \a numThreads of \c 0 picks a count based on the amount of pixels copied.
+	static MovieAtlasRef	create( int32_t width, int32_t height, int32_t padding = 1, size_t numThreads = 0 ) { return MovieAtlasRef( new MovieAtlas( width, height, padding, numThreads ) ); }
+
+	//! Adds \a movie to the atlas and returns its index. It is placed by the first update() after its size is known.
+	size_t		addMovie( const MovieSurfaceRef &movie );
+	size_t		getNumMovies() const { return mEntries.size(); }
+	const MovieSurfaceRef&	getMovie( size_t index ) const { return mEntries[index].mMovie; }
+	//! Returns whether movie \a index has a rectangle in the atlas. It has none until it has loaded, or when the atlas is full.
+	bool		isPlaced( size_t index ) const { return mEntries[index].mState == PLACED; }
+	//! Returns the pixels of the atlas holding movie \a index, empty when it isn't placed
+	Area		getArea( size_t index ) const;
+	//! Returns the texture coordinates of movie \a index in [\c 0,\c 1], with the origin at the top left as in getSurface()
+	Rectf		getTexCoords( size_t index ) const;
+
+	//! Copies the new frames of every movie into the atlas, returning whether anything changed and the atlas needs uploading
+	bool		update();
+	//! Removes every movie's rectangle and places them all again, largest first, which recovers space after movies changed size
+	void		repack();
+
+	const Surface8u&	getSurface() const { return mSurface; }
+	int32_t		getWidth() const { return mSurface.getWidth(); }
+	int32_t		getHeight() const { return mSurface.getHeight(); }
+	//! Returns the share of the atlas covered by movies, in [\c 0,\c 1]
+	float		getOccupancy() const { return mPacker.getOccupancy(); }
+
+  protected:
+	MovieAtlas( int32_t width, int32_t height, int32_t padding, size_t numThreads );
+
+	enum State { WAITING, PLACED, REJECTED };
+
+	struct Entry {
+		MovieSurfaceRef	mMovie;
+		State			mState;
+		PackedRect		mRect;
+		//! The frame last copied, which keeps its buffer from being recycled, so a new frame always has other pixels
+		Surface8u		mFrame;
+	};
+
+	void		place( Entry *entry );
+
+	SkylinePacker		mPacker;
+	Surface8u			mSurface;
+	size_t				mNumThreads;
+	std::vector<Entry>	mEntries;
+};
+
+} } // namespace cinder::avf
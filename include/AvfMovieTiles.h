@@ -0,0 +1,60 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Area.h"
+#include "cinder/Surface.h"
+
+#include <memory>
+#include <vector>
+
+#include "Avf.h"
+
+namespace cinder { namespace avf {
+
+typedef std::shared_ptr<class MovieTiles> MovieTilesRef;
+
+/** \brief Splits the frames of one movie into a grid of tiles, such as the outputs of a video wall
+ *	Tiles are views into the decoded frame and never copy pixels. When only some tiles are enabled, the movie is given a crop hint
+ *	covering just their bounding box, so the pixels no tile needs are never converted. Each tile has its own new frame flag,
+ *	so every output can tell whether it has something new to show.
+**/
+class MovieTiles {
+  public:
+	//! Splits \a movie into \a columns by \a rows tiles, all enabled
+	static MovieTilesRef	create( const MovieSurfaceRef &movie, int32_t columns, int32_t rows ) { return MovieTilesRef( new MovieTiles( movie, columns, rows ) ); }
+
+	const MovieSurfaceRef&	getMovie() const { return mMovie; }
+	int32_t		getNumColumns() const { return mColumns; }
+	int32_t		getNumRows() const { return mRows; }
+	//! Returns the pixels of the full frame covered by a tile. Tiles split any remainder so the grid covers the frame exactly.
+	Area		getTileArea( int32_t column, int32_t row ) const;
+
+	bool		isTileEnabled( int32_t column, int32_t row ) const { return mEnabled[index( column, row )]; }
+	//! Enables or disables a tile, narrowing the movie's crop hint to the tiles still enabled
+	void		enableTile( int32_t column, int32_t row, bool enable = true );
+	void		enableAllTiles( bool enable = true );
+
+	//! Fetches the movie's current frame and flags every enabled tile when it is new. Call once per frame before getTile().
+	void		update();
+	//! Returns whether a tile has a frame it hasn't returned from getTile() yet
+	bool		checkNewFrame( int32_t column, int32_t row ) const { return mNewFrame[index( column, row )]; }
+	//! Returns a view of a tile in the current frame and clears its new frame flag. Empty when the tile is disabled, and cut short while a frame from before a crop hint change doesn't cover it.
+	Surface8u	getTile( int32_t column, int32_t row );
+
+  protected:
+	MovieTiles( const MovieSurfaceRef &movie, int32_t columns, int32_t rows );
+
+	size_t		index( int32_t column, int32_t row ) const { return static_cast<size_t>( row * mColumns + column ); }
+	void		updateCropHint();
+
+	MovieSurfaceRef		mMovie;
+	int32_t				mColumns, mRows;
+	std::vector<bool>	mEnabled, mNewFrame;
+	bool				mCropChanged;
+
+	Surface8u			mFrame;
+	//! Position of the frame's top left pixel in the full frame, from the crop hint the frame was rendered with
+	Vec2i				mFrameOrigin;
+};
+
+} } // namespace cinder::avf
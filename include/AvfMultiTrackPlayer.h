@@ -0,0 +1,97 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "Avf.h"
+#include "AvfFrameIndex.h"
+#include "AvfMediaTime.h"
+
+namespace cinder { namespace avf {
+
+typedef std::shared_ptr<class MultiTrackPlayer> MultiTrackPlayerRef;
+
+/** \brief Plays several video tracks of one movie in sync, such as the angles of a multi-angle file
+ *	A single AVAssetReader with one output per track reads the file once for all of them, instead of one player per angle
+ *	each demuxing the same file. Every call to update() advances all tracks to the shared playhead, so their frames always
+ *	come from the same moment. update() decodes the tracks in parallel on the shared WorkerPool and returns once all of them
+ *	have reached the playhead.
+**/
+class MultiTrackPlayer {
+  public:
+	~MultiTrackPlayer();
+
+	//! Plays every video track of the movie at \a path
+	static MultiTrackPlayerRef	create( const fs::path &path ) { return MultiTrackPlayerRef( new MultiTrackPlayer( path, std::vector<size_t>() ) ); }
+	//! Plays the video tracks of the movie at \a path listed in \a videoTracks, as indices among its video tracks
+	static MultiTrackPlayerRef	create( const fs::path &path, const std::vector<size_t> &videoTracks ) { return MultiTrackPlayerRef( new MultiTrackPlayer( path, videoTracks ) ); }
+
+	//! Returns the number of tracks being played
+	size_t		getNumTracks() const { return mTracks.size(); }
+	//! Returns the index among the movie's video tracks of track \a track
+	size_t		getVideoTrackIndex( size_t track ) const { return mTracks[track].mVideoTrackIndex; }
+	int32_t		getWidth( size_t track ) const { return mTracks[track].mWidth; }
+	int32_t		getHeight( size_t track ) const { return mTracks[track].mHeight; }
+	Vec2i		getSize( size_t track ) const { return Vec2i( getWidth( track ), getHeight( track ) ); }
+	MediaTime	getMediaDuration() const { return mMediaDuration; }
+
+	void		play();
+	void		stop();
+	bool		isPlaying() const { return mPlaying; }
+	//! Returns whether playback has reached the end of the movie. Always \c false while looping.
+	bool		isDone() const;
+	void		setLoop( bool loop = true ) { mLoop = loop; }
+	//! Sets the speed of playback, \c 1.0 being real time. Only forward playback is supported, so negative values are treated as their magnitude.
+	void		setRate( float rate );
+	float		getRate() const { return mRate; }
+
+	//! Returns the time of the shared playhead
+	MediaTime	getCurrentMediaTime() const;
+	float		getCurrentTime() const { return (float)getCurrentMediaTime().toSeconds(); }
+	void		seekToTime( const MediaTime &time );
+	void		seekToTime( float seconds ) { seekToTime( MediaTime::fromSeconds( seconds, getTimeScale() ) ); }
+	void		seekToStart() { seekToTime( MediaTime::zero() ); }
+
+	//! Decodes every track up to the playhead. Call once per frame before getSurface().
+	void		update();
+	//! Returns the frame of track \a track at the playhead as of the last update()
+	Surface8u	getSurface( size_t track ) const { return mTracks[track].mSurface; }
+	//! Returns the timing and position of the frame of track \a track returned by getSurface(). Frame indices follow the track's nominal framerate.
+	FrameInfo	getFrameInfo( size_t track ) const;
+
+  protected:
+	MultiTrackPlayer( const fs::path &path, const std::vector<size_t> &videoTracks );
+
+	struct Track {
+		Track() : mTrack( NULL ), mVideoTrackIndex( 0 ), mWidth( 0 ), mHeight( 0 ), mOutput( NULL ) {}
+
+		AVAssetTrack*				mTrack;
+		size_t						mVideoTrackIndex;
+		int32_t						mWidth, mHeight;
+		AVAssetReaderTrackOutput*	mOutput;
+		Surface8u					mSurface, mNextSurface;
+		MediaTime					mTime, mNextTime, mFrameDuration;
+	};
+
+	bool		startReader( const MediaTime &time );
+	void		stopReader();
+	bool		readNextFrame( Track *track );
+	int32_t		getTimeScale() const;
+	void		setPlayhead( const MediaTime &time );
+
+	AVURLAsset*			mAsset;
+	std::vector<Track>	mTracks;
+	AVAssetReader*		mReader;
+	MediaTime			mMediaDuration, mReaderTime;
+
+	bool				mPlaying, mLoop;
+	float				mRate;
+	MediaTime			mPlayheadTime;
+	std::chrono::steady_clock::time_point	mPlayheadClock;
+};
+
+} } // namespace cinder::avf
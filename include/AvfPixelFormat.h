@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Compile-time description of the packed RGB pixel formats the block exchanges with CoreVideo, and converters
+// between them that the compiler specializes per format pair. Only depends on the C++ standard library.
+
+namespace cinder { namespace avf {
+
+enum PixelFormat {
+	PIXEL_FORMAT_RGB,
+	PIXEL_FORMAT_BGR,
+	PIXEL_FORMAT_ARGB,
+	PIXEL_FORMAT_BGRA,
+	PIXEL_FORMAT_ABGR,
+	PIXEL_FORMAT_RGBA,
+	PIXEL_FORMAT_ARGB64,
+	PIXEL_FORMAT_COUNT
+};
+
+struct PixelFormatDesc {
+	//! CoreVideo pixel format type
+	uint32_t	mCvType;
+	//! Bytes per channel, and per pixel
+	int8_t		mChannelBytes, mPixelInc;
+	//! Channel offsets measured in channels, \c -1 when absent
+	int8_t		mRed, mGreen, mBlue, mAlpha;
+
+	constexpr bool	hasAlpha() const { return mAlpha >= 0; }
+	//! Returns whether the format can go through convert(), meaning it has 8-bit channels
+	constexpr bool	isConvertible() const { return mChannelBytes == 1; }
+};
+
+constexpr uint32_t makeFourCc( char a, char b, char c, char d )
+{
+	return ( static_cast<uint32_t>( static_cast<uint8_t>( a ) ) << 24 ) | ( static_cast<uint32_t>( static_cast<uint8_t>( b ) ) << 16 )
+			| ( static_cast<uint32_t>( static_cast<uint8_t>( c ) ) << 8 ) | static_cast<uint32_t>( static_cast<uint8_t>( d ) );
+}
+
+//! Indexed by PixelFormat. The CoreVideo types match kCVPixelFormatType_24RGB, _24BGR, _32ARGB, _32BGRA, _32ABGR, _32RGBA and _64ARGB.
+constexpr PixelFormatDesc sPixelFormatDescs[PIXEL_FORMAT_COUNT] = {
+	{ 0x00000018,							1, 3,	0, 1, 2, -1 },
+	{ makeFourCc( '2', '4', 'B', 'G' ),		1, 3,	2, 1, 0, -1 },
+	{ 0x00000020,							1, 4,	1, 2, 3, 0 },
+	{ makeFourCc( 'B', 'G', 'R', 'A' ),		1, 4,	2, 1, 0, 3 },
+	{ makeFourCc( 'A', 'B', 'G', 'R' ),		1, 4,	3, 2, 1, 0 },
+	{ makeFourCc( 'R', 'G', 'B', 'A' ),		1, 4,	0, 1, 2, 3 },
+	{ makeFourCc( 'b', '6', '4', 'a' ),		2, 8,	1, 2, 3, 0 }
+};
+
+constexpr const PixelFormatDesc& getPixelFormatDesc( PixelFormat format ) { return sPixelFormatDescs[format]; }
+
+//! Looks up the PixelFormat of a CoreVideo pixel format type. Returns \c false for types the table doesn't describe, such as planar YpCbCr.
+inline bool findPixelFormat( uint32_t cvType, PixelFormat *result )
+{
+	for( int32_t i = 0; i < PIXEL_FORMAT_COUNT; ++i ) {
+		if( sPixelFormatDescs[i].mCvType == cvType ) {
+			*result = static_cast<PixelFormat>( i );
+			return true;
+		}
+	}
+	return false;
+}
+
+//! Converts one row of \a width pixels from \a Src to \a Dst. Channels missing from \a Src are written as \c 255.
+template<PixelFormat Src, PixelFormat Dst>
+struct PixelRowConverter {
+	static void convert( const uint8_t *src, uint8_t *dst, int32_t width )
+	{
+		const PixelFormatDesc &s = sPixelFormatDescs[Src];
+		const PixelFormatDesc &d = sPixelFormatDescs[Dst];
+		for( int32_t x = 0; x < width; ++x, src += s.mPixelInc, dst += d.mPixelInc ) {
+			dst[d.mRed] = src[s.mRed];
+			dst[d.mGreen] = src[s.mGreen];
+			dst[d.mBlue] = src[s.mBlue];
+			if( d.hasAlpha() )
+				dst[d.mAlpha] = s.hasAlpha()? src[s.mAlpha]: 0xFF;
+		}
+	}
+};
+
+template<PixelFormat Format>
+struct PixelRowConverter<Format, Format> {
+	static void convert( const uint8_t *src, uint8_t *dst, int32_t width )
+	{
+		std::memcpy( dst, src, static_cast<size_t>( width ) * sPixelFormatDescs[Format].mPixelInc );
+	}
+};
+
+//! Converts a \a width by \a height image from \a Src to \a Dst, fully specialized for the pair
+template<PixelFormat Src, PixelFormat Dst>
+void convert( const uint8_t *src, size_t srcRowBytes, uint8_t *dst, size_t dstRowBytes, int32_t width, int32_t height )
+{
+	static_assert( sPixelFormatDescs[Src].isConvertible() && sPixelFormatDescs[Dst].isConvertible(), "convert() only handles 8-bit channels" );
+	for( int32_t y = 0; y < height; ++y )
+		PixelRowConverter<Src, Dst>::convert( src + y * srcRowBytes, dst + y * dstRowBytes, width );
+}
+
+typedef void (*PixelConvertFn)( const uint8_t *src, size_t srcRowBytes, uint8_t *dst, size_t dstRowBytes, int32_t width, int32_t height );
+
+namespace detail {
+
+template<PixelFormat Src>
+PixelConvertFn selectPixelConverter( PixelFormat dst )
+{
+	switch( dst ) {
+		case PIXEL_FORMAT_RGB:	return &convert<Src, PIXEL_FORMAT_RGB>;
+		case PIXEL_FORMAT_BGR:	return &convert<Src, PIXEL_FORMAT_BGR>;
+		case PIXEL_FORMAT_ARGB:	return &convert<Src, PIXEL_FORMAT_ARGB>;
+		case PIXEL_FORMAT_BGRA:	return &convert<Src, PIXEL_FORMAT_BGRA>;
+		case PIXEL_FORMAT_ABGR:	return &convert<Src, PIXEL_FORMAT_ABGR>;
+		case PIXEL_FORMAT_RGBA:	return &convert<Src, PIXEL_FORMAT_RGBA>;
+		default:				return NULL;
+	}
+}
+
+} // namespace detail
+
+//! Returns the specialized converter from \a src to \a dst, or \c NULL when either format isn't convertible. Meant to be called once per frame.
+inline PixelConvertFn getPixelConverter( PixelFormat src, PixelFormat dst )
+{
+	switch( src ) {
+		case PIXEL_FORMAT_RGB:	return detail::selectPixelConverter<PIXEL_FORMAT_RGB>( dst );
+		case PIXEL_FORMAT_BGR:	return detail::selectPixelConverter<PIXEL_FORMAT_BGR>( dst );
+		case PIXEL_FORMAT_ARGB:	return detail::selectPixelConverter<PIXEL_FORMAT_ARGB>( dst );
+		case PIXEL_FORMAT_BGRA:	return detail::selectPixelConverter<PIXEL_FORMAT_BGRA>( dst );
+		case PIXEL_FORMAT_ABGR:	return detail::selectPixelConverter<PIXEL_FORMAT_ABGR>( dst );
+		case PIXEL_FORMAT_RGBA:	return detail::selectPixelConverter<PIXEL_FORMAT_RGBA>( dst );
+		default:				return NULL;
+	}
+}
+
+//! Converts between any two convertible formats with a single dispatch. Returns \c false when no converter exists.
+inline bool convertPixels( PixelFormat srcFormat, const uint8_t *src, size_t srcRowBytes, PixelFormat dstFormat, uint8_t *dst, size_t dstRowBytes, int32_t width, int32_t height )
+{
+	PixelConvertFn fn = getPixelConverter( srcFormat, dstFormat );
+	if( ! fn )
+		return false;
+	fn( src, srcRowBytes, dst, dstRowBytes, width, height );
+	return true;
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "AvfByteSource.h"
+#include "AvfWorkerPool.h"
+
+namespace cinder { namespace avf {
+
+/** \brief Caps the memory that movies preloaded with PreloadedFile hold at once
+ *	A file is only preloaded when it is no larger than the maximum file size and fits in what is left of the limit, otherwise
+ *	its movie streams from disk as usual. Only depends on the C++ standard library.
+**/
+class PreloadBudget {
+  public:
+	//! \a limit and \a maxFileSize are in bytes
+	PreloadBudget( uint64_t limit, uint64_t maxFileSize );
+
+	//! Returns the budget shared by every movie. Defaults to 256MB in total and 32MB per file.
+	static PreloadBudget&	getShared();
+
+	uint64_t	getLimit() const;
+	//! Lowering the limit below what is in use only refuses new files, it doesn't evict preloaded ones
+	void		setLimit( uint64_t limit );
+	uint64_t	getMaxFileSize() const;
+	//! Files larger than \a size are never preloaded
+	void		setMaxFileSize( uint64_t size );
+	uint64_t	getUsed() const;
+
+	//! Reserves \a size bytes, returning \c false when they exceed the maximum file size or what is left of the limit
+	bool		reserve( uint64_t size );
+	//! Hands back \a size bytes reserved earlier
+	void		release( uint64_t size );
+
+  private:
+	mutable std::mutex	mMutex;
+	uint64_t			mLimit, mMaxFileSize, mUsed;
+};
+
+typedef std::shared_ptr<class PreloadedFile> PreloadedFileRef;
+
+/** \brief ByteSource that reads a whole file into memory in the background, so playback never waits on the disk
+ *	The file is read on the shared WorkerPool into memory that is locked where the system allows it, so it is never paged back
+ *	out. Until it is complete, ranges that haven't arrived yet are read from the file, so a movie can open straight away.
+**/
+class PreloadedFile : public ByteSource {
+  public:
+	~PreloadedFile();
+
+	/** Starts preloading the file at \a path against \a budget. Returns an empty ref when the file can't be opened or doesn't fit
+		in \a budget, in which case the movie should stream it instead. \a budget has to outlive the file. **/
+	static PreloadedFileRef	create( const std::string &path, PreloadBudget &budget = PreloadBudget::getShared(), WorkerPool::Priority priority = WorkerPool::PRIORITY_LOW );
+
+	virtual uint64_t		getSize() const;
+	virtual size_t			read( uint64_t offset, void *dst, size_t size );
+	virtual const uint8_t*	getData( uint64_t offset, size_t size );
+
+	//! Returns the number of bytes read into memory so far, from the start of the file
+	uint64_t	getLoadedSize() const;
+	//! Returns whether the whole file is in memory
+	bool		isLoaded() const { return getLoadedSize() == getSize(); }
+	//! Returns whether the memory is locked against paging. Locking is best effort, as it is subject to per-process limits.
+	bool		isLocked() const;
+	//! Blocks until the whole file is in memory or reading it failed. Returns isLoaded().
+	bool		waitUntilLoaded();
+
+  protected:
+	struct State;
+
+	explicit PreloadedFile( const std::shared_ptr<State> &state );
+
+	std::shared_ptr<State>	mState;
+};
+
+} } // namespace cinder::avf
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AvfByteSource.h"
+
+namespace cinder { namespace avf {
+
+//! Storage a ReadScheduler reads files from, one read at a time
+class ReadDevice {
+  public:
+	virtual ~ReadDevice() {}
+
+	virtual uint64_t	getSize( size_t file ) const = 0;
+	//! Reads up to \a size bytes at \a offset of \a file into \a dst, returning the number read, which is only less than \a size at the end or on error
+	virtual size_t		read( size_t file, uint64_t offset, void *dst, size_t size ) = 0;
+	//! Returns an estimate of where \a offset of \a file lies on the medium. Reads are ordered by location, so nearby locations should be cheap to go between.
+	virtual uint64_t	getLocation( size_t file, uint64_t offset ) const = 0;
+	//! Called once the stream over \a file is gone
+	virtual void		closeFile( size_t /*file*/ ) {}
+};
+
+typedef std::shared_ptr<ReadDevice> ReadDeviceRef;
+
+/** \brief ReadDevice over files of the local file system
+ *	The physical layout of a file isn't known, so files are located by inode number, which follows allocation order on most
+ *	file systems, and bytes by their offset within the file.
+**/
+class FileReadDevice : public ReadDevice {
+  public:
+	virtual ~FileReadDevice();
+
+	//! Opens the file at \a path, returning its index, which may be that of a file closed before. Throws ReadSchedulerExc when it can't be opened.
+	size_t				addFile( const std::string &path );
+	//! Returns the number of file slots, open or free for reuse
+	size_t				getNumSlots() const;
+
+	virtual uint64_t	getSize( size_t file ) const;
+	virtual size_t		read( size_t file, uint64_t offset, void *dst, size_t size );
+	virtual uint64_t	getLocation( size_t file, uint64_t offset ) const;
+	virtual void		closeFile( size_t file );
+
+  private:
+	struct File {
+		int			mFd;
+		uint64_t	mSize, mInode;
+	};
+
+	mutable std::mutex	mMutex;
+	std::vector<File>	mFiles;
+	//! Indices of closed files, reused by addFile()
+	std::vector<size_t>	mFreeFiles;
+};
+
+/** \brief ReadDevice modelling a single spinning disk, for testing and tuning a ReadScheduler without one
+ *	Files are laid out back to back. Every read that doesn't continue where the previous one ended costs a seek, and the
+ *	disk keeps count of seeks, bytes and the time it would have taken. The content of each byte is given by getByte().
+**/
+class SimulatedDisk : public ReadDevice {
+  public:
+	//! \a seekTime is in seconds and \a bytesPerSecond is the sequential transfer rate
+	SimulatedDisk( double seekTime = 0.008, double bytesPerSecond = 100e6 );
+
+	//! Adds a file of \a size bytes after the last one, returning its index
+	size_t				addFile( uint64_t size );
+	//! Sleeps for the simulated duration of each read, so stalls can be observed in real time
+	void				setRealTime( bool realTime = true );
+
+	virtual uint64_t	getSize( size_t file ) const;
+	virtual size_t		read( size_t file, uint64_t offset, void *dst, size_t size );
+	virtual uint64_t	getLocation( size_t file, uint64_t offset ) const;
+
+	uint32_t			getNumReads() const;
+	uint32_t			getNumSeeks() const;
+	uint64_t			getBytesRead() const;
+	//! Returns the seconds the reads so far would have taken
+	double				getElapsedTime() const;
+
+	//! Returns the content of byte \a offset of \a file
+	static uint8_t		getByte( size_t file, uint64_t offset ) { return static_cast<uint8_t>( ( offset * 131 ) ^ ( offset >> 11 ) ^ ( file * 29 ) ); }
+
+  private:
+	mutable std::mutex		mMutex;
+	double					mSeekTime, mBytesPerSecond;
+	bool					mRealTime;
+	std::vector<uint64_t>	mStarts, mSizes;
+	uint64_t				mHead, mBytesRead;
+	uint32_t				mNumReads, mNumSeeks;
+	double					mElapsedTime;
+};
+
+//! How well a ScheduledStream's read-ahead is keeping up
+struct BufferHealth {
+	BufferHealth() : mBufferedBytes( 0 ), mTargetBytes( 0 ), mBufferedSeconds( 0 ), mNumStalls( 0 ) {}
+
+	//! Returns the buffered share of the read-ahead target in the range [\c 0,\c 1]
+	float		getFill() const { return ( mTargetBytes > 0 ) ? static_cast<float>( std::min<uint64_t>( mBufferedBytes, mTargetBytes ) ) / mTargetBytes : 1.0f; }
+
+	//! Bytes in memory from the read position on, without a gap
+	uint64_t	mBufferedBytes;
+	uint64_t	mTargetBytes;
+	//! Playback time covered by the buffered bytes at the stream's bitrate
+	double		mBufferedSeconds;
+	//! Number of reads that had to wait for the disk
+	uint32_t	mNumStalls;
+};
+
+typedef std::shared_ptr<class ReadScheduler> ReadSchedulerRef;
+typedef std::shared_ptr<class ScheduledStream> ScheduledStreamRef;
+
+/** \brief Orders the disk reads of every movie streaming from one device, so the disk sweeps instead of thrashing between files
+ *	Each stream keeps a read-ahead of a few seconds at its bitrate. The scheduler performs one read at a time, always the one
+ *	nearest the disk head in its direction of travel, elevator style, and reads several chunks of a file in one go when they
+ *	are due. Reads a movie is blocked on go before read-ahead. Only depends on the C++ standard library.
+**/
+class ReadScheduler : public std::enable_shared_from_this<ReadScheduler> {
+  public:
+	class Options {
+	  public:
+		Options();
+
+		//! Sets the unit of reading and buffering, in bytes. Defaults to 1MB.
+		Options&	setChunkSize( size_t size ) { mChunkSize = std::max<size_t>( size, 4096 ); return *this; }
+		size_t		getChunkSize() const { return mChunkSize; }
+		//! Sets the largest number of chunks read at once from one file. Defaults to 4.
+		Options&	setMaxBatchChunks( size_t count ) { mMaxBatchChunks = std::max<size_t>( count, 1 ); return *this; }
+		size_t		getMaxBatchChunks() const { return mMaxBatchChunks; }
+		//! Sets the seconds of playback each stream reads ahead. Defaults to 4.
+		Options&	setReadAheadSeconds( double seconds ) { mReadAheadSeconds = seconds; return *this; }
+		double		getReadAheadSeconds() const { return mReadAheadSeconds; }
+		//! Bounds the read-ahead of a stream in bytes, whatever its bitrate. Defaults to 2MB and 64MB.
+		Options&	setReadAheadLimits( uint64_t minBytes, uint64_t maxBytes ) { mMinReadAhead = minBytes; mMaxReadAhead = std::max( minBytes, maxBytes ); return *this; }
+		uint64_t	getMinReadAhead() const { return mMinReadAhead; }
+		uint64_t	getMaxReadAhead() const { return mMaxReadAhead; }
+		//! Sets the bitrate, in bytes per second, assumed for streams that don't know theirs. Defaults to 1MB per second.
+		Options&	setDefaultBitrate( double bytesPerSecond ) { mDefaultBitrate = bytesPerSecond; return *this; }
+		double		getDefaultBitrate() const { return mDefaultBitrate; }
+		//! Whether the scheduler reads on a thread of its own. Without one, reads only happen in processNext(). Defaults to \c true.
+		Options&	enableThread( bool enable = true ) { mThread = enable; return *this; }
+		bool		isThreadEnabled() const { return mThread; }
+
+	  private:
+		size_t		mChunkSize, mMaxBatchChunks;
+		double		mReadAheadSeconds, mDefaultBitrate;
+		uint64_t	mMinReadAhead, mMaxReadAhead;
+		bool		mThread;
+	};
+
+	~ReadScheduler();
+
+	static ReadSchedulerRef	create( const ReadDeviceRef &device, const Options &options = Options() ) { return ReadSchedulerRef( new ReadScheduler( device, options ) ); }
+	//! Returns the scheduler shared by every movie streaming from local files, created on first use over a FileReadDevice
+	static ReadSchedulerRef	getShared();
+
+	const ReadDeviceRef&	getDevice() const { return mDevice; }
+	const Options&			getOptions() const { return mOptions; }
+
+	//! Opens a stream over \a file of the device. \a bytesPerSecond of \c 0 uses the default bitrate until setBitrateHint() is called.
+	ScheduledStreamRef	openStream( size_t file, double bytesPerSecond = 0 );
+	//! Opens the file at \a path through the device, which has to be a FileReadDevice. Throws ReadSchedulerExc on failure.
+	ScheduledStreamRef	openFile( const std::string &path, double bytesPerSecond = 0 );
+	size_t				getNumStreams() const;
+
+	/** Performs the next read, returning \c false when no stream needs one. The scheduler's thread calls it in a loop, without a
+		thread it has to be called by the application, as streams wait on it for data they don't have. **/
+	bool				processNext();
+
+  protected:
+	struct Stream;
+	struct Request {
+		std::shared_ptr<Stream>	mStream;
+		uint64_t				mFirstChunk, mNumChunks, mLocation;
+	};
+
+	ReadScheduler( const ReadDeviceRef &device, const Options &options );
+
+	uint64_t	getTargetBytes( const Stream &stream ) const;
+	uint64_t	getBufferedBytes( const Stream &stream ) const;
+	//! Drops the chunks of \a stream that are behind its read position or beyond its read-ahead
+	void		trimStream( Stream &stream );
+	bool		findRequest( Stream &stream, Request *result ) const;
+	//! Picks the next read and marks its chunks in flight. Called with the mutex locked.
+	bool		pickRequest( Request *result );
+	//! Reads \a request from the device and hands the chunks to its stream. Called with the mutex unlocked.
+	void		performRequest( const Request &request );
+	void		threadLoop();
+
+	friend class ScheduledStream;
+
+	ReadDeviceRef							mDevice;
+	Options									mOptions;
+	std::vector<std::shared_ptr<Stream>>	mStreams;
+	uint64_t								mHead;
+	bool									mMovingUp;
+
+	mutable std::mutex						mMutex;
+	//! Signalled when a stream needs a read
+	std::condition_variable					mWorkCond;
+	//! Signalled when a read completes
+	std::condition_variable					mDataCond;
+	bool									mStopping;
+	std::thread								mThread;
+};
+
+//! ByteSource reading one file through a ReadScheduler. Reads block until the scheduler has read their bytes.
+class ScheduledStream : public ByteSource {
+  public:
+	~ScheduledStream();
+
+	virtual uint64_t	getSize() const;
+	virtual size_t		read( uint64_t offset, void *dst, size_t size );
+	//! Scales the read-ahead to \a bytesPerSecond, as movies do once they know their data rate
+	virtual void		setBitrateHint( double bytesPerSecond );
+
+	double				getBitrate() const;
+	BufferHealth		getBufferHealth() const;
+
+  protected:
+	ScheduledStream( const ReadSchedulerRef &scheduler, const std::shared_ptr<ReadScheduler::Stream> &stream );
+
+	friend class ReadScheduler;
+
+	ReadSchedulerRef						mScheduler;
+	std::shared_ptr<ReadScheduler::Stream>	mStream;
+};
+
+class ReadSchedulerExc : public std::exception {
+};
+
+} } // namespace cinder::avf
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+
+#include <memory>
+
+#include "Avf.h"
+#include "AvfFrameIndex.h"
+#include "AvfFrameReader.h"
+#include "AvfMediaTime.h"
+#include "AvfTimeRemap.h"
+
+namespace cinder { namespace avf {
+
+typedef std::shared_ptr<class RemapPlayer> RemapPlayerRef;
+
+/** \brief Plays the first video track of a movie through a TimeRemapCurve
+ *	Rather than changing an AVPlayer's rate every frame, each output time is mapped through the curve and the frame on screen
+ *	at the resulting source time is picked from the track's FrameIndex. Frames come from a FrameReader, whose single forward
+ *	decode stream keeps its recent output, so ramps that slow down or pause reuse decoded frames instead of seeking.
+**/
+class RemapPlayer {
+  public:
+	//! \a ringFrames is the number of decoded frames kept around for reuse and blending
+	static RemapPlayerRef	create( const fs::path &path, size_t ringFrames = 8 ) { return RemapPlayerRef( new RemapPlayer( path, ringFrames ) ); }
+
+	int32_t		getWidth() const { return mReader->getWidth(); }
+	int32_t		getHeight() const { return mReader->getHeight(); }
+	Vec2i		getSize() const { return mReader->getSize(); }
+	const FrameIndex&	getFrameIndex() const { return mReader->getFrameIndex(); }
+
+	const TimeRemapCurve&	getCurve() const { return mCurve; }
+	void		setCurve( const TimeRemapCurve &curve ) { mCurve = curve; }
+
+	//! Returns whether source times falling between two frames show a blend of both. Disabled by default.
+	bool		isFrameBlending() const { return mFrameBlending; }
+	//! Enables blending the two frames around each source time, weighted by the position between them
+	void		enableFrameBlending( bool enable = true ) { mFrameBlending = enable; }
+
+	//! Returns the source time shown at \a outputSeconds
+	MediaTime	getSourceTime( double outputSeconds ) const;
+	//! Returns the frame shown at \a outputSeconds, decoding forward as needed. Blended frames are written to a buffer reused between calls.
+	Surface8u	getSurface( double outputSeconds );
+	//! Returns the timing and position of the frame last returned by getSurface(). For a blend, that is the earlier of the two frames.
+	const FrameInfo&	getFrameInfo() const { return mFrameInfo; }
+
+  protected:
+	RemapPlayer( const fs::path &path, size_t ringFrames );
+
+	FrameReaderRef	mReader;
+	TimeRemapCurve	mCurve;
+	bool			mFrameBlending;
+	Surface8u		mBlendSurface;
+	FrameInfo		mFrameInfo;
+};
+
+} } // namespace cinder::avf
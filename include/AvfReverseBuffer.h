@@ -0,0 +1,208 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "AvfFrameIndex.h"
+#include "AvfWorkerPool.h"
+
+namespace cinder { namespace avf {
+
+/** \brief Decoded frames for reverse playback, filled a span at a time in the background
+ *	Every span is decoded forward and served backwards. While the current span is being shown, the span before it is
+ *	prefetched, so at most two spans of \a maxFrames frames are resident, plus the one being decoded. The decoder is
+ *	supplied by the caller and runs on a serial queue of the shared WorkerPool, one span at a time. It fills one frame
+ *	per index of the span, in presentation order.
+ *	\a FrameT only has to be copyable, which keeps the buffer independent of any image type.
+**/
+template<typename FrameT>
+class ReverseBuffer {
+  public:
+	typedef std::function<bool( const FrameIndex::Span &span, std::vector<FrameT> *frames )>	DecodeFn;
+
+	ReverseBuffer( const FrameIndex &index, size_t maxFrames, const DecodeFn &decodeFn )
+		: mIndex( index ), mMaxFrames( maxFrames > 0 ? maxFrames : 1 ), mDecodeFn( decodeFn ), mHasDemand( false ), mHasPrefetch( false ), mScheduled( false ), mQuit( false )
+	{
+		mQueue = WorkerPool::getShared().createQueue();
+	}
+
+	~ReverseBuffer()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mQuit = true;
+		}
+		mReady.notify_all();
+		// a span being decoded still uses the decoder, so it has to finish first
+		mQueue->clear();
+		mQueue->wait();
+	}
+
+	size_t	getMaxFrames() const { return mMaxFrames; }
+	WorkerPool::Priority	getPriority() const { return mQueue->getPriority(); }
+	//! Sets the priority of decoding on the shared WorkerPool relative to the work of other movies
+	void	setPriority( WorkerPool::Priority priority ) { mQueue->setPriority( priority ); }
+
+	/** Looks up frame \a index, scheduling its span when it isn't resident and the span before it once it is.
+		Returns \c false while the frame is still being decoded, unless \a wait is \c true. **/
+	bool getFrame( size_t index, FrameT *result, bool wait = false )
+	{
+		if( index >= mIndex.getNumFrames() )
+			return false;
+
+		std::unique_lock<std::mutex> lock( mMutex );
+		const ResidentSpan *resident = findResident( index );
+		if( ! resident ) {
+			FrameIndex::Span span = mIndex.getReverseSpan( index, mMaxFrames );
+			if( ! ( mHasDemand && mDemand == span ) && ! ( mDecoding.mEnd > 0 && mDecoding == span ) ) {
+				mDemand = span;
+				mHasDemand = true;
+				// the same span waiting as read-ahead would otherwise be decoded a second time
+				if( mHasPrefetch && mPrefetch == span )
+					mHasPrefetch = false;
+				mFailed = FrameIndex::Span();
+				schedule();
+			}
+			if( ! wait )
+				return false;
+			mReady.wait( lock, [&]() { return mQuit || findResident( index ) != NULL || ( mFailed.mEnd > 0 && mFailed == span ); } );
+			resident = findResident( index );
+			if( ! resident )
+				return false;
+		}
+
+		*result = resident->mFrames[index - resident->mSpan.mFirst];
+		const FrameIndex::Span current = resident->mSpan;
+		evict( index );
+		schedulePrefetch( current );
+		return true;
+	}
+
+	//! Drops every resident and pending span, for example after a seek far from the playhead
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mResident.clear();
+		mHasDemand = mHasPrefetch = false;
+	}
+
+  private:
+	struct ResidentSpan {
+		FrameIndex::Span	mSpan;
+		std::vector<FrameT>	mFrames;
+	};
+
+	// expects mMutex to be held
+	const ResidentSpan* findResident( size_t index ) const
+	{
+		for( typename std::deque<ResidentSpan>::const_iterator it = mResident.begin(); it != mResident.end(); ++it ) {
+			if( it->mSpan.contains( index ) && it->mFrames.size() == it->mSpan.getNumFrames() )
+				return &*it;
+		}
+		return NULL;
+	}
+
+	// expects mMutex to be held
+	bool isResident( const FrameIndex::Span &span ) const
+	{
+		for( typename std::deque<ResidentSpan>::const_iterator it = mResident.begin(); it != mResident.end(); ++it ) {
+			if( it->mSpan == span )
+				return true;
+		}
+		return false;
+	}
+
+	// drops spans the playhead has already moved past in reverse; expects mMutex to be held
+	void evict( size_t index )
+	{
+		for( typename std::deque<ResidentSpan>::iterator it = mResident.begin(); it != mResident.end(); ) {
+			if( it->mSpan.mFirst > index )
+				it = mResident.erase( it );
+			else
+				++it;
+		}
+	}
+
+	// expects mMutex to be held
+	void schedulePrefetch( const FrameIndex::Span &current )
+	{
+		if( current.mFirst == 0 )
+			return;
+		FrameIndex::Span previous = mIndex.getReverseSpan( current.mFirst - 1, mMaxFrames );
+		if( isResident( previous ) || ( mHasPrefetch && mPrefetch == previous ) || ( mHasDemand && mDemand == previous ) || mDecoding == previous )
+			return;
+		mPrefetch = previous;
+		mHasPrefetch = true;
+		schedule();
+	}
+
+	// posts a decode task unless one is already waiting or running; expects mMutex to be held
+	void schedule()
+	{
+		if( mScheduled || mQuit || ! ( mHasDemand || mHasPrefetch ) )
+			return;
+		mScheduled = true;
+		mQueue->post( std::bind( &ReverseBuffer::decodeNext, this ) );
+	}
+
+	// decodes one span per task, so the spans of other movies on the same pool interleave with this one's
+	void decodeNext()
+	{
+		std::unique_lock<std::mutex> lock( mMutex );
+		if( mQuit || ! ( mHasDemand || mHasPrefetch ) ) {
+			mScheduled = false;
+			return;
+		}
+
+		// a frame somebody is waiting on always goes before read-ahead
+		mDecoding = mHasDemand ? mDemand : mPrefetch;
+		if( ! mHasDemand || ( mHasPrefetch && mPrefetch == mDemand ) )
+			mHasPrefetch = false;
+		mHasDemand = false;
+
+		// the span can have been decoded since it was asked for, for example read-ahead that a demand overtook
+		if( isResident( mDecoding ) ) {
+			mDecoding = FrameIndex::Span();
+			mReady.notify_all();
+			mScheduled = false;
+			schedule();
+			return;
+		}
+
+		ResidentSpan decoded;
+		decoded.mSpan = mDecoding;
+		lock.unlock();
+		bool success = mDecodeFn( decoded.mSpan, &decoded.mFrames );
+		lock.lock();
+		mDecoding = FrameIndex::Span();
+
+		if( success && decoded.mFrames.size() == decoded.mSpan.getNumFrames() ) {
+			// keep the newest spans: the one just decoded and the one being shown
+			while( mResident.size() >= 2 )
+				mResident.pop_front();
+			mResident.push_back( decoded );
+		}
+		else
+			mFailed = decoded.mSpan;
+		mReady.notify_all();
+
+		mScheduled = false;
+		schedule();
+	}
+
+	const FrameIndex&			mIndex;
+	size_t						mMaxFrames;
+	DecodeFn					mDecodeFn;
+
+	std::mutex					mMutex;
+	std::condition_variable		mReady;
+	std::deque<ResidentSpan>	mResident;
+	FrameIndex::Span			mDemand, mPrefetch, mDecoding, mFailed;
+	bool						mHasDemand, mHasPrefetch, mScheduled, mQuit;
+	WorkerPool::QueueRef		mQueue;
+};
+
+} } // namespace cinder::avf
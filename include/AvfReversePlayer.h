@@ -0,0 +1,91 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+
+#include <chrono>
+#include <memory>
+
+#include "Avf.h"
+#include "AvfFrameIndex.h"
+#include "AvfMediaTime.h"
+#include "AvfReverseBuffer.h"
+
+namespace cinder { namespace avf {
+
+typedef std::shared_ptr<class ReversePlayer> ReversePlayerRef;
+
+/** \brief Reverse playback of any codec, independent of AVPlayer's canPlayReverse support
+ *	The first video track is indexed once, without decoding, to find its GOPs. Playback then decodes a span of at most
+ *	\a maxBufferedFrames frames forward through an AVAssetReader, shows it backwards and prefetches the span before it on a
+ *	background thread. Memory stays bounded for long GOPs, which are split into several spans that each decode from the key frame.
+**/
+class ReversePlayer {
+  public:
+	~ReversePlayer();
+
+	//! Defaults to spans of 30 frames, so at most 90 frames are decoded at once
+	static ReversePlayerRef	create( const fs::path &path, size_t maxBufferedFrames = 30 ) { return ReversePlayerRef( new ReversePlayer( path, maxBufferedFrames ) ); }
+
+	int32_t		getWidth() const { return mWidth; }
+	int32_t		getHeight() const { return mHeight; }
+	Vec2i		getSize() const { return Vec2i( getWidth(), getHeight() ); }
+	//! Returns the sample table of the track being played
+	const FrameIndex&	getFrameIndex() const { return mFrameIndex; }
+	MediaTime	getMediaDuration() const { return mFrameIndex.getEndTime(); }
+
+	//! Starts playing backwards from the current time
+	void		play();
+	void		stop();
+	bool		isPlaying() const { return mPlaying; }
+	//! Returns whether playback has reached the first frame
+	bool		isDone() const;
+
+	/** Sets the speed of reverse playback, \c 1.0 being real time. Values above \c 1.0 scrub, skipping frames as needed.
+		Negative values are treated as their magnitude, since playback only runs backwards. **/
+	void		setRate( float rate );
+	float		getRate() const { return mRate; }
+
+	//! Returns the time of the playhead
+	MediaTime	getCurrentMediaTime() const;
+	float		getCurrentTime() const { return (float)getCurrentMediaTime().toSeconds(); }
+	void		seekToTime( const MediaTime &time );
+	void		seekToTime( float seconds ) { seekToTime( MediaTime::fromSeconds( seconds, getFrameTimeScale() ) ); }
+	void		seekToFrame( size_t frame );
+	//! Moves the playhead to the last frame, where reverse playback starts
+	void		seekToEnd();
+
+	WorkerPool::Priority	getPriority() const { return mBuffer->getPriority(); }
+	//! Sets the priority of span decoding on the shared WorkerPool relative to other movies
+	void		setPriority( WorkerPool::Priority priority ) { mBuffer->setPriority( priority ); }
+
+	//! Returns the frame at the playhead. While that frame is still decoding, returns the last frame shown, so the call never blocks once playback has started.
+	Surface8u	getSurface();
+	//! Returns the timing and position of the frame last returned by getSurface()
+	FrameInfo	getFrameInfo() const { return mHasSurface? mFrameIndex.getFrameInfo( mSurfaceFrame ): FrameInfo(); }
+
+  protected:
+	ReversePlayer( const fs::path &path, size_t maxBufferedFrames );
+
+	bool		decodeSpan( const FrameIndex::Span &span, std::vector<Surface8u> *frames );
+	int32_t		getFrameTimeScale() const;
+	void		setPlayhead( const MediaTime &time );
+
+	AVURLAsset*		mAsset;
+	AVAssetTrack*	mTrack;
+	int32_t			mWidth, mHeight;
+
+	FrameIndex		mFrameIndex;
+	std::unique_ptr<ReverseBuffer<Surface8u> >	mBuffer;
+
+	bool			mPlaying;
+	float			mRate;
+	MediaTime		mPlayheadTime;
+	std::chrono::steady_clock::time_point	mPlayheadClock;
+
+	Surface8u		mSurface;
+	size_t			mSurfaceFrame;
+	bool			mHasSurface;
+};
+
+} } // namespace cinder::avf
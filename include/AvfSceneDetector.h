@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AvfMediaTime.h"
+
+namespace cinder { namespace avf {
+
+//! A frame that starts a new scene
+struct SceneCut {
+	SceneCut() : mFrameIndex( 0 ), mScore( 0 ) {}
+	SceneCut( size_t frameIndex, const MediaTime &time, float score ) : mFrameIndex( frameIndex ), mTime( time ), mScore( score ) {}
+
+	//! Position of the frame in presentation order
+	size_t		mFrameIndex;
+	MediaTime	mTime;
+	//! How different the frame was from the one before, in [\c 0,\c 1]
+	float		mScore;
+};
+
+/** \brief Finds scene cuts by comparing every frame with the one before
+ *	Each frame is reduced to a small grid of luma averages, which is compared with the grid of the previous frame by the sum
+ *	of absolute differences, and by the difference of their luma histograms. The SAD catches cuts between similar looking
+ *	shots, the histogram ignores motion within a shot. A frame whose weighted score passes the threshold and stands out from
+ *	the scores before it starts a scene, unless the frame after it looks like the one before it again, which makes it a
+ *	flash. Each frame is thus decided on when the next one is added. Frames that don't directly follow the previous one,
+ *	such as after a seek, are only remembered, never compared. Only depends on the C++ standard library.
+**/
+class SceneDetector {
+  public:
+	class Options {
+	  public:
+		Options();
+
+		//! Sets the score in [\c 0,\c 1] a frame has to reach to start a scene. Defaults to 0.2.
+		Options&	setThreshold( float threshold ) { mThreshold = threshold; return *this; }
+		float		getThreshold() const { return mThreshold; }
+		//! Sets the share of the histogram difference in the score, the rest being the SAD. Defaults to 0.5.
+		Options&	setHistogramWeight( float weight );
+		float		getHistogramWeight() const { return mHistogramWeight; }
+		//! Sets how many times the recent average score a cut has to reach, so fast motion doesn't read as a cut. Defaults to 3.
+		Options&	setContrast( float contrast ) { mContrast = contrast; return *this; }
+		float		getContrast() const { return mContrast; }
+		//! Sets the fewest frames a scene has, so a flash doesn't make two cuts. Defaults to 6.
+		Options&	setMinSceneFrames( size_t frames ) { mMinSceneFrames = frames; return *this; }
+		size_t		getMinSceneFrames() const { return mMinSceneFrames; }
+		//! Sets the width of the luma grid, whose height follows the aspect ratio of the frames. Defaults to 64.
+		Options&	setGridWidth( int32_t width ) { mGridWidth = ( width < 4 ) ? 4 : width; return *this; }
+		int32_t		getGridWidth() const { return mGridWidth; }
+
+	  private:
+		float		mThreshold, mHistogramWeight, mContrast;
+		size_t		mMinSceneFrames;
+		int32_t		mGridWidth;
+	};
+
+	explicit SceneDetector( const Options &options = Options() );
+
+	const Options&	getOptions() const { return mOptions; }
+
+	/** Compares frame \a index, shown at \a time, with the frame before. \a data holds \a height rows of \a rowBytes bytes,
+		with pixels of \a pixelInc bytes whose color channels lie at the given offsets. Returns whether the frame before
+		\a index starts a scene, which takes this frame to tell from a flash. The cut is then the last of getCuts(). **/
+	bool		addFrame( size_t index, const MediaTime &time, const uint8_t *data, int32_t width, int32_t height, size_t rowBytes,
+						int32_t pixelInc, int32_t redOffset, int32_t greenOffset, int32_t blueOffset );
+	//! Forgets the previous frame, so the next one isn't compared with it
+	void		restart();
+	//! Forgets the previous frame and every cut
+	void		clear();
+
+	//! Returns the cuts found so far in the order they were found
+	const std::vector<SceneCut>&	getCuts() const { return mCuts; }
+	//! Returns the score of the last frame compared, \c 0 when it wasn't compared. After a flash, the frame is scored against the one before the flash.
+	float		getLastScore() const { return mLastScore; }
+	//! Returns the number of frames decided on, each of which was compared with the frame before and followed by the next one
+	size_t		getNumCompared() const { return mNumCompared; }
+
+	static const size_t	NUM_BINS = 32;
+
+  private:
+	//! A frame reduced to a luma grid and its histogram
+	struct Reduced {
+		std::vector<uint8_t>	mGrid;
+		uint32_t				mHistogram[NUM_BINS];
+	};
+
+	//! Reduces the frame to mCurrent
+	void		reduce( const uint8_t *data, int32_t width, int32_t height, size_t rowBytes, int32_t pixelInc, int32_t redOffset, int32_t greenOffset, int32_t blueOffset );
+	//! Returns the weighted score of the difference between two frames with grids of the same size
+	float		score( const Reduced &a, const Reduced &b ) const;
+
+	Options					mOptions;
+	int32_t					mGridHeight;
+	//! The frame being added, the one before it, and the one that frame was compared with
+	Reduced					mCurrent, mPrevious, mBefore;
+	//! The index of the previous frame, and whether there is one to compare with
+	size_t					mPreviousIndex;
+	bool					mHasPrevious;
+	//! The previous frame, compared but not decided on yet, and whether it would start a scene
+	SceneCut				mPending;
+	bool					mHasPending, mPendingIsCut;
+	//! Running average of the scores within the current scene
+	float					mAverageScore, mLastScore;
+	size_t					mLastCut, mNumCompared;
+	bool					mHasCut;
+	std::vector<SceneCut>	mCuts;
+};
+
+} } // namespace cinder::avf
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Portable pixel kernels used by the movie reader and writer. Each kernel has a
+// scalar fallback, so it builds anywhere, plus SSE2 and NEON paths. A few kernels
+// have paths for later instruction sets, compiled only when the target enables
+// them: the SSSE3 shuffles in swizzlePixels() and applyLookupTable(), which the
+// default x86_64 OS X target includes, the aarch64 table lookups, and a 32 byte
+// form of the applyLookupTable() shuffles under -mavx2.
+
+namespace cinder { namespace avf {
+
+//! Adds \a count 8-bit samples from \a src into the 32-bit accumulator \a acc
+void accumulatePixels( const uint8_t *src, uint32_t *acc, size_t count );
+//! Writes the average of \a frames accumulated samples to \a dst, rounded to nearest. \a frames must be non-zero.
+void resolveAccumulatedPixels( const uint32_t *acc, uint8_t *dst, size_t count, uint32_t frames );
+//! Writes the lerp from \a a to \a b of \a count bytes to \a dst, \a weight being the share of \a b in [\c 0,\c 256]. \a dst may alias either input.
+void blendPixels( const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t count, uint32_t weight );
+//! Returns the sum of the absolute differences between the \a count bytes of \a a and \a b
+uint64_t sumAbsDifferences( const uint8_t *a, const uint8_t *b, size_t count );
+
+//! Maps \a count bytes of \a src through the 256 entry table \a lut into \a dst. The channel at \a alphaOffset of every \a pixelInc bytes is copied unchanged; pass \c -1 when there is no alpha.
+void applyLookupTable( const uint8_t *lut, const uint8_t *src, uint8_t *dst, size_t count, int32_t pixelInc, int32_t alphaOffset );
+
+/** Reorders \a numPixels pixels of \a srcInc bytes into pixels of \a dstInc bytes. Destination channel \c c receives source channel \c dstFromSrc[c],
+	or \c 255 when that entry is negative. Four byte to four byte and three byte to four byte layouts run as a single byte shuffle. **/
+void swizzlePixels( const uint8_t *src, int32_t srcInc, uint8_t *dst, int32_t dstInc, const int8_t *dstFromSrc, size_t numPixels );
+/** Copies \a height rows of \a width pixels between buffers with different strides, as a straight memcpy when \a dstFromSrc is \c NULL or through swizzlePixels() otherwise.
+	Rows are split into \a numThreads bands run on the shared WorkerPool; \c 0 picks a count based on the size of the copy. When \a lut is given, the destination bytes
+	are mapped through it as each row is written, as by applyLookupTable() with the destination channel \a alphaOffset left unchanged. **/
+void copyPixelRows( const uint8_t *src, size_t srcRowBytes, int32_t srcInc, uint8_t *dst, size_t dstRowBytes, int32_t dstInc, const int8_t *dstFromSrc,
+					int32_t width, int32_t height, size_t numThreads = 0, const uint8_t *lut = NULL, int32_t alphaOffset = -1 );
+
+} } // namespace cinder::avf
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AvfFrameIndex.h"
+#include "AvfMediaTime.h"
+
+namespace cinder { namespace avf {
+
+/** \brief Curve mapping output time to source time, both in seconds, such as a slow-motion speed ramp
+ *	Keys are interpolated linearly or with a monotone cubic, which never overshoots and so never runs backwards between keys
+ *	that move forward. Outside the keys the curve continues at the speed of the nearest segment. Without keys it is the identity.
+**/
+class TimeRemapCurve {
+  public:
+	enum Interpolation { INTERPOLATION_LINEAR, INTERPOLATION_SMOOTH };
+
+	TimeRemapCurve() : mInterpolation( INTERPOLATION_SMOOTH ) {}
+
+	//! Maps \a outputTime to \a sourceTime, replacing any key at the same output time
+	TimeRemapCurve&	addKey( double outputTime, double sourceTime );
+	TimeRemapCurve&	clear();
+	size_t			getNumKeys() const { return mKeys.size(); }
+
+	Interpolation	getInterpolation() const { return mInterpolation; }
+	TimeRemapCurve&	setInterpolation( Interpolation interpolation );
+
+	//! Returns the source time shown at \a outputTime
+	double			getSourceTime( double outputTime ) const;
+	//! Returns the playback speed at \a outputTime, the slope of the curve
+	double			getSpeed( double outputTime ) const;
+
+  private:
+	struct Key {
+		double	mOutput, mSource, mTangent;
+	};
+
+	void	updateTangents();
+	size_t	findSegment( double outputTime ) const;
+
+	std::vector<Key>	mKeys;
+	Interpolation		mInterpolation;
+};
+
+//! The frames to show for one source time. Without blending \a mWeight is \c 0 and only \a mFrame matters.
+struct RemapFrames {
+	RemapFrames() : mFrame( 0 ), mNextFrame( 0 ), mWeight( 0 ) {}
+
+	size_t		mFrame, mNextFrame;
+	//! Share of \a mNextFrame in [\c 0,\c 256], the scale expected by blendPixels()
+	uint32_t	mWeight;
+};
+
+//! Selects the frames of \a index on screen at \a sourceTime, clamped to the track. With \a blend, the weight is how far \a sourceTime is into the frame.
+RemapFrames selectRemapFrames( const FrameIndex &index, const MediaTime &sourceTime, bool blend );
+
+} } // namespace cinder::avf
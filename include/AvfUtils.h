@@ -6,7 +6,13 @@
 #include "cinder/Surface.h"
 #include "cinder/ImageIo.h"
 
+#include "Avf.h"
+#include "AvfByteSource.h"
+#include "AvfFrameIndex.h"
+#include "AvfMediaTime.h"
+
 #include <string>
+#include <vector>
 
 #if defined( CINDER_COCOA )
 	#include <CoreVideo/CoreVideo.h>
@@ -21,18 +27,46 @@ bool setAudioSessionModes();
 bool dictionarySetValue( CFMutableDictionaryRef dict, CFStringRef key, SInt32 value );
 bool dictionarySetPixelBufferPixelFormatType( bool alpha, CFMutableDictionaryRef dict );
 bool dictionarySetPixelBufferSize( const unsigned int width, const unsigned int height, CFMutableDictionaryRef dict );
+//! Sets the row alignment of pixel buffers to FrameAllocator::ALIGNMENT
 bool dictionarySetPixelBufferBytesPerRowAlignment( CFMutableDictionaryRef dict );
 void dictionarySetPixelBufferOpenGLCompatibility( CFMutableDictionaryRef dict );
 bool dictionarySetPixelBufferOptions( unsigned int width, unsigned int height, bool alpha, CFMutableDictionaryRef *pixelBufferOptions );
 CFMutableDictionaryRef initQTVisualContextOptions( int width, int height, bool alpha );
 
+//! Creates a Surface8u whose memory comes from the FrameAllocator: 64 byte aligned, with cache line padded rows
+Surface8u createFrameSurface( int32_t width, int32_t height, bool alpha, SurfaceChannelOrder channelOrder );
+
 //! Designed to be the deallocator for surfaces returned by convertToPixelBufferToSurface
 static void CVPixelBufferDealloc( void *refcon );
 //! Makes a cinder::Surface form a CVPixelBufferRef, setting a proper deallocation function to free the CVPixelBufferRef upon the destruction of the Surface::Obj
 Surface8u convertCvPixelBufferToSurface( CVPixelBufferRef pixelBufferRef );
 Surface8u convertCmSampleBufferToSurface( CMSampleBufferRef sampleBufferRef );
+//! Returns a Surface sharing the pixels of \a area of \a surface without copying them. The view keeps \a surface alive, and is empty when \a area lies outside it.
+Surface8u createSurfaceView( const Surface8u &surface, const Area &area );
+
+//! Converts \a time to a CMTime, mapping an invalid MediaTime to \c kCMTimeInvalid
+inline CMTime toCmTime( const MediaTime &time ) { return time.isValid() ? CMTimeMake( time.getValue(), time.getTimeScale() ) : kCMTimeInvalid; }
+//! Converts \a time to a MediaTime. Invalid, indefinite and infinite CMTimes become an invalid MediaTime.
+inline MediaTime toMediaTime( const CMTime &time ) { return CMTIME_IS_NUMERIC( time ) ? MediaTime( time.value, time.timescale ) : MediaTime(); }
+
+/** Returns the exact duration of a frame of \a track, from its minimum frame duration when that agrees with the nominal frame rate,
+	or else from the nominal rate through MediaTime::fromFrameRate(). Returns an invalid time when the track has neither. **/
+MediaTime getFrameDuration( AVAssetTrack *track );
+//! Fills \a result with the timing and sync flag of every sample of \a track by reading its compressed samples, without decoding. Returns \c false when the track can't be read.
+bool scanFrameIndex( AVAsset *asset, AVAssetTrack *track, FrameIndex *result );
+/** Creates and starts a reader decoding \a track to 32BGRA frames with FrameAllocator aligned rows, from \a start for \a duration.
+	An invalid \a duration reads to the end of the track. Returns \c nil on failure, otherwise release the reader and \a output when done. **/
+AVAssetReader* createFrameReader( AVAsset *asset, AVAssetTrack *track, const MediaTime &start, const MediaTime &duration, AVAssetReaderTrackOutput **output );
+//! Creates and starts a single reader decoding all of \a tracks, filling \a outputs with one output per track in the same order. Every output has to be read for the reader to make progress.
+AVAssetReader* createFrameReader( AVAsset *asset, const std::vector<AVAssetTrack*> &tracks, const MediaTime &start, const MediaTime &duration, std::vector<AVAssetReaderTrackOutput*> *outputs );
 CMSampleBufferRef convertSurfaceToCmSampleBuffer( Surface8u source );
 
+//! Returns a ByteSource over the bytes of \a dataSource, which are loaded into memory once and kept alive by the source. The extension hint comes from its file path hint.
+ByteSourceRef createByteSource( const DataSourceRef &dataSource );
+/** Creates an asset that reads \a source through range requests, answered by \a *loader on the shared WorkerPool instead of through a file.
+	Release the asset first and then the loader, which the asset doesn't retain. Returns \c nil when the container of \a source isn't recognized. **/
+AVURLAsset* createByteSourceAsset( const ByteSourceRef &source, ByteSourceLoader **loader );
+
 typedef std::shared_ptr<class ImageTargetCvPixelBuffer> ImageTargetCvPixelBufferRef;
 
 class ImageTargetCvPixelBuffer : public cinder::ImageTarget {
@@ -64,4 +98,12 @@ CVPixelBufferRef createCvPixelBuffer( ImageSourceRef imageSource, bool convertTo
 
 CVPixelBufferRef createCvPixelBuffer( ImageSourceRef imageSource, CVPixelBufferPoolRef pbPool, bool convertToYpCbCr = false );
 
+/** Creates a CVPixelBufferRef from a Surface8u without going through ImageIo. Layouts that CoreVideo can hold as-is (RGB, BGR, ARGB, BGRA) are copied row by row,
+	anything else is swizzled into \c kCVPixelFormatType_32BGRA in a single pass. Large frames are split across \a numThreads threads, \c 0 picks a count based on the frame size.
+	Falls back to the ImageSource path when \a convertToYpCbCr. When \a lut is given, every color byte is mapped through the 256 entry table as it is copied, alpha excepted.
+	Release the result with CVPixelBufferRelease(). **/
+CVPixelBufferRef createCvPixelBuffer( const Surface8u &surface, bool convertToYpCbCr = false, size_t numThreads = 0, const uint8_t *lut = NULL );
+//! Creates a CVPixelBufferRef from a Surface8u, allocated from \a pbPool. Falls back to the ImageSource path when the pool's pixel format can not be produced by a copy or swizzle.
+CVPixelBufferRef createCvPixelBuffer( const Surface8u &surface, CVPixelBufferPoolRef pbPool, bool convertToYpCbCr = false, size_t numThreads = 0, const uint8_t *lut = NULL );
+
 } } // namespace cinder::avf
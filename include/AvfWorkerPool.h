@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cinder { namespace avf {
+
+/** \brief Fixed set of threads running the background work of every movie
+ *	Each thread owns a deque per priority and takes its own work first, then steals from the other threads, highest priority
+ *	first. Work that has to keep its order, such as the callbacks of one movie, goes through a Queue, which runs its tasks one
+ *	at a time on whichever thread is free. A single shared pool replaces a thread or dispatch queue per movie, so fifty movies
+ *	no longer mean fifty threads contending. Only depends on the C++ standard library.
+**/
+class WorkerPool {
+  public:
+	enum Priority { PRIORITY_HIGH, PRIORITY_NORMAL, PRIORITY_LOW, NUM_PRIORITIES };
+	typedef std::function<void()> Task;
+
+	//! Runs the tasks posted to it one at a time in the order they were posted
+	class Queue : public std::enable_shared_from_this<Queue> {
+	  public:
+		void		post( const Task &task );
+		//! Drops the tasks that haven't started yet
+		void		clear();
+		//! Blocks until every task posted so far has run. Must not be called from one of the queue's own tasks.
+		void		wait();
+
+		Priority	getPriority() const { return static_cast<Priority>( mPriority.load() ); }
+		//! Takes effect from the next task on
+		void		setPriority( Priority priority ) { mPriority = priority; }
+
+	  private:
+		friend class WorkerPool;
+		Queue( WorkerPool *pool, Priority priority );
+
+		void		runNext();
+
+		WorkerPool				*mPool;
+		std::atomic<int>		mPriority;
+		std::mutex				mMutex;
+		std::condition_variable	mIdle;
+		std::deque<Task>		mTasks;
+		//! Whether a task of this queue is waiting in the pool or running
+		bool					mScheduled;
+	};
+	typedef std::shared_ptr<Queue> QueueRef;
+
+	//! \a numThreads of \c 0 uses one thread per hardware thread
+	explicit WorkerPool( size_t numThreads = 0 );
+	//! Runs every task already posted, then joins the threads
+	~WorkerPool();
+
+	//! Returns the pool shared by every movie, created on first use
+	static WorkerPool&	getShared();
+	//! Sets the number of threads of the shared pool, \c 0 being one per hardware thread. Only has an effect before the shared pool's first use.
+	static void			setSharedNumThreads( size_t numThreads );
+
+	size_t		getNumThreads() const { return mThreads.size(); }
+	//! Creates a serial queue whose tasks run at \a priority
+	QueueRef	createQueue( Priority priority = PRIORITY_NORMAL );
+	//! Runs \a task on any thread, in no particular order with other tasks
+	void		post( const Task &task, Priority priority = PRIORITY_NORMAL );
+	/** Calls \a fn for every index in [\c 0, \a count) across the pool and returns once all calls have finished.
+		The calling thread takes part, so this is safe to call from a pool thread. **/
+	void		parallelFor( size_t count, const std::function<void( size_t )> &fn );
+
+  private:
+	struct Worker {
+		std::mutex			mMutex;
+		std::deque<Task>	mTasks[NUM_PRIORITIES];
+	};
+
+	void		workerLoop( size_t index );
+	bool		popTask( size_t index, Task *task );
+
+	std::vector<std::unique_ptr<Worker> >	mWorkers;
+	std::vector<std::thread>				mThreads;
+	std::mutex					mSleepMutex;
+	std::condition_variable		mWake;
+	//! Tasks waiting in the deques. Briefly negative when a task is taken before its post has counted it.
+	std::atomic<int64_t>		mPending;
+	std::atomic<size_t>			mNextWorker;
+	bool						mStopping;
+};
+
+} } // namespace cinder::avf
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "cinder/Cinder.h"
 #include "cinder/ImageIo.h"
 #include "cinder/Stream.h"
 
 #include "Avf.h"
+#include "AvfMediaTime.h"
+#include "AvfMjpegWriter.h"
 
 #if defined( CINDER_MAC ) || defined( CINDER_COCOA_TOUCH )
 	#include "cinder/cocoa/CinderCocoa.h"
@@ -41,6 +44,9 @@ typedef std::shared_ptr<MovieWriter> MovieWriterRef;
 
 class MovieWriter {
   public:
+	//! Transfer functions that can be applied to linear input pixels before encoding
+	enum TransferFunction { TRANSFER_LINEAR, TRANSFER_SRGB, TRANSFER_REC709, TRANSFER_PQ, TRANSFER_HLG, TRANSFER_GAMMA };
+
 	//! Defines the encoding parameters of a MovieWriter
 	class Format {
 	  public:
@@ -64,7 +70,11 @@ class MovieWriter {
 		//! Returns the standard duration of a frame measured in seconds
 		float		getDefaultDuration() const { return mDefaultTime; }
 		//! Sets the default duration of a frame, measured in seconds. Defaults to \c 1/30 sec, meaning \c 30 FPS.
-		Format&		setDefaultDuration( float defaultDuration ) { mDefaultTime = defaultDuration; return *this; }
+		Format&		setDefaultDuration( float defaultDuration ) { mDefaultTime = defaultDuration; mDefaultMediaTime = MediaTime(); return *this; }
+		//! Returns the exact standard duration of a frame. Durations set in seconds are rounded to the time scale.
+		MediaTime	getDefaultMediaDuration() const;
+		//! Sets the exact default duration of a frame, such as \c MediaTime( 1001, 30000 ) for \c 29.97 FPS
+		Format&		setDefaultDuration( const MediaTime &defaultDuration );
 		//! Returns the integer base value for the encoding time scale. Defaults to \c 600
 		long		getTimeScale() const { return mTimeBase; }
 		//! Sets the integer base value for encoding time scale. Defaults to \c 600.
@@ -94,15 +104,40 @@ class MovieWriter {
 		//! Enables multiPass encoding. Defaults to \c false. While multiPass encoding can result in significantly smaller movies, it often takes much longer to compress and requires the creation of two temporary files for storing intermediate results.
 		Format&		enableMultiPass( bool enable = true ) { mEnableMultiPass = enable; return *this; }
 
+		//! Returns the number of addFrame() calls that make up one timelapse frame. Defaults to \c 1, which records every frame.
+		int32_t		getCaptureInterval() const { return mCaptureFrames; }
+		//! Records only one frame out of every \a frames calls to addFrame(). Frames in between are skipped before any pixel conversion takes place. Defaults to \c 1.
+		Format&		setCaptureInterval( int32_t frames ) { mCaptureFrames = std::max<int32_t>( frames, 1 ); return *this; }
+		//! Returns the span of source time, measured in seconds, that makes up one timelapse frame. Defaults to \c 0, which disables the time based interval.
+		float		getCaptureIntervalSeconds() const { return mCaptureSeconds; }
+		//! Records one frame for every \a seconds of source time passed to addFrame() through its \a duration parameter. Defaults to \c 0, which disables the time based interval.
+		Format&		setCaptureIntervalSeconds( float seconds ) { mCaptureSeconds = std::max( seconds, 0.0f ); return *this; }
+		//! Returns whether the writer is recording a timelapse, meaning that either capture interval has been set
+		bool		isTimelapse() const { return mCaptureFrames > 1 || mCaptureSeconds > 0; }
+		//! Returns whether skipped timelapse frames are averaged into the recorded frame. Defaults to \c false.
+		bool		isTemporalAveraging() const { return mTemporalAveraging; }
+		//! Averages every frame of a capture interval into the recorded frame, producing a motion blurred timelapse. Only meaningful when a capture interval is set. Defaults to \c false.
+		Format&		enableTemporalAveraging( bool enable = true ) { mTemporalAveraging = enable; return *this; }
+		//! Returns the transfer function applied to input pixels before encoding. Defaults to \c TRANSFER_LINEAR, which leaves pixels untouched.
+		TransferFunction	getTransferFunction() const { return mTransferFunction; }
+		/** Encodes linear input pixels with \a function before they reach the codec, for example to write linear renders as sRGB or Rec. 709.
+			\c TRANSFER_GAMMA raises pixels to \c 1/getGamma(). \c TRANSFER_PQ treats an input of \c 1.0 as 10000 cd/m2. Alpha is left untouched. **/
+		Format&		setTransferFunction( TransferFunction function ) { mTransferFunction = function; return *this; }
+
 	  private:
 		void		initDefaults();
 
 		uint32_t	mCodec;
 		long		mTimeBase;
 		float		mDefaultTime;
+		MediaTime	mDefaultMediaTime;
 		float		mQualityFloat;
 		float		mGamma;
 		bool		mEnableMultiPass;
+		int32_t		mCaptureFrames;
+		float		mCaptureSeconds;
+		bool		mTemporalAveraging;
+		TransferFunction	mTransferFunction;
 
 		friend class MovieWriter;
 	};
@@ -117,6 +152,8 @@ class MovieWriter {
 
 	//! Returns the Movie's default frame duration measured in seconds. You can also think of this as the Movie's frameRate.
 	float	getDefaultDuration() const { return mFormat.mDefaultTime; }
+	//! Returns the Movie's exact default frame duration
+	MediaTime	getDefaultMediaDuration() const { return mFormat.getDefaultMediaDuration(); }
 	//! Returns the width of the Movie in pixels
 	int32_t	getWidth() const { return mWidth; }
 	//! Returns the height of the Movie in pixels
@@ -136,33 +173,51 @@ class MovieWriter {
 	static bool getUserCompressionSettings( Format* result, ImageSourceRef previewImage = ImageSourceRef() );
 
 	/** \brief Appends a frame to the Movie. The optional \a duration parameter allows a frame to be inserted for a time other than the Format's default duration.
+		When the Format records a timelapse, \a duration is the span of source time the frame represents and recorded frames always last the Format's default duration.
 		\note Calling addFrame() after a call to finish() will throw a MovieWriterExcAlreadyFinished exception.
 	**/
 //	void addFrame( const ImageSourceRef& imageSource, float duration = -1.0f );
 	void addFrame( const Surface8u& imageSource, float duration = -1.0f );
+	//! Appends a frame lasting exactly \a duration. An invalid \a duration uses the Format's default duration. Frame times never drift, even when \a duration doesn't divide the time scale.
+	void addFrame( const Surface8u& imageSource, const MediaTime &duration );
 	
 	//! Returns the number of frames in the movie
 	uint32_t	getNumFrames() const { return mNumFrames; }
 
-	//! Completes the encoding of the movie and closes the file. Calling finish() more than once has no effect.
+	//! Completes the encoding of the movie and closes the file. Throws MovieWriterExcFrameEncode when a \c CODEC_JPEG movie couldn't be written. Calling finish() more than once has no effect.
 	void finish();
 	
+	//! Supported codecs. \c CODEC_JPEG is encoded frame-parallel by an MjpegWriter rather than by AVFoundation.
 	enum { CODEC_H264 = 'avc1', CODEC_JPEG = 'jpeg', CODEC_MP4 = 'mp4v', CODEC_PNG = 'png ', CODEC_RAW = 'raw ', CODEC_ANIMATION = 'rle ' };
 
   private:
 	void createCompressionSession();
+	int64_t advanceTime( const MediaTime& duration );
+	bool captureTimelapseFrame( const Surface8u& imageSource, float duration );
+	void resetTimelapseAccumulator( const Surface8u& imageSource );
+	void buildTransferLut();
 
 	AVAssetWriter* mWriter;
 	AVAssetWriterInput* mWriterSink;
 	AVAssetWriterInputPixelBufferAdaptor* mSinkAdapater;
+	MjpegWriterRef	mMjpegWriter;
 	
 	fs::path		mPath;
 	uint32_t		mNumFrames;
 	int64_t			mCurrentTimeValue;
+	MediaTime		mCurrentTime;
 	int32_t			mWidth, mHeight;
 	Format			mFormat;
 	bool			mRequestedMultiPass, mDoingMultiPass, mFinished;
 
+	int32_t					mCaptureFrameCount;
+	float					mCaptureElapsed;
+	std::vector<uint32_t>	mAccumulator;
+	Surface8u				mAccumulatorSurface;
+
+	uint8_t					mTransferLut[256];
+	CFNumberRef				mGammaLevel;
+
 //	IoStreamRef		mMultiPassFrameCache;
 //	std::vector<std::pair<int64_t,int64_t> >	mFrameTimes;
 };
@@ -4,20 +4,19 @@
 
 #if defined( CINDER_COCOA )
     #import <AVFoundation/AVFoundation.h>
-    #if defined( CINDER_COCOA_TOUCH )
-        #import <CoreVideo/CoreVideo.h>
-    #else
-        #import <CoreVideo/CVDisplayLink.h>
-    #endif
+    #import <CoreVideo/CoreVideo.h>
 #endif
 
 #include "Avf.h"
+#include "AvfFrameAllocator.h"
+#include "AvfFrameReader.h"
+#include "AvfFrameTicker.h"
+#include "AvfPixelFormat.h"
 #include "AvfUtils.h"
 
 ////////////////////////////////////////////////////////////////////////
 //
 // TODO: use global time from the system clock
-// TODO: setup CADisplayLink for iOS, remove CVDisplayLink callback on OSX
 // TODO: test operations for thread-safety -- add/remove locks as necessary
 //
 ////////////////////////////////////////////////////////////////////////
@@ -26,24 +25,13 @@ static void* AVPlayerItemStatusContext = &AVPlayerItemStatusContext;
 
 @interface MovieDelegate : NSObject<AVPlayerItemOutputPullDelegate> {
 	ci::avf::MovieResponder* responder;
-#if defined( CINDER_COCOA_TOUCH )
-    CADisplayLink* displayLink;
-#endif
 }
 
 - (id)initWithResponder:(ci::avf::MovieResponder*)player;
-#if defined( CINDER_COCOA_TOUCH )
-- (void)initDisplayLink;
-#endif
 - (void)playerReady;
 - (void)playerItemDidReachEndCallback;
 - (void)playerItemDidNotReachEndCallback;
 - (void)playerItemTimeJumpedCallback;
-#if defined( CINDER_COCOA_TOUCH )
-- (void)displayLinkCallback:(CADisplayLink*)sender;
-#elif defined( CINDER_COCOA )
-- (void)displayLinkCallback:(CVDisplayLinkRef*)sender;
-#endif
 - (void)outputSequenceWasFlushed:(AVPlayerItemOutput *)output;
 
 @end
@@ -51,22 +39,10 @@ static void* AVPlayerItemStatusContext = &AVPlayerItemStatusContext;
 
 @implementation MovieDelegate
 
-- (void)dealloc
-{
-#if defined( CINDER_COCOA_TOUCH )
-    [self->displayLink release];
-#endif
-	[super dealloc];
-}
-
 - (id)init
 {
 	self = [super init];
 	self->responder = nil;
-
-#if defined( CINDER_COCOA_TOUCH )
-    [self initDisplayLink];
-#endif
     return self;
 }
 
@@ -74,24 +50,9 @@ static void* AVPlayerItemStatusContext = &AVPlayerItemStatusContext;
 {
 	self = [super init];
 	self->responder = player;
-
-#if defined( CINDER_COCOA_TOUCH )
-    [self initDisplayLink];
-#endif
 	return self;
 }
 
-#if defined( CINDER_COCOA_TOUCH )
-- (void)initDisplayLink
-{
-    [self->displayLink invalidate];
-    self->displayLink = nil;
-    
-    self->displayLink = [CADisplayLink displayLinkWithTarget:self selector:@selector(displayLinkCallback:)] ;
-    [self->displayLink addToRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
-}
-#endif
-
 - (void)playerReady
 {
 	self->responder->playerReadyCallback();
@@ -134,35 +95,6 @@ static void* AVPlayerItemStatusContext = &AVPlayerItemStatusContext;
 	}
 }
 
-#pragma mark - CADisplayLink Callback
-
-#if defined( CINDER_COCOA_TOUCH )
-- (void)displayLinkCallback:(CADisplayLink*)sender
-#elif defined( CINDER_COCOA )
-- (void)displayLinkCallback:(CVDisplayLinkRef*)sender
-#endif
-{
-#if defined( CINDER_COCOA_TOUCH )
-    self->responder->playerUpdateFrame();
-#endif
-    
-	/*
-	 CMTime outputItemTime = kCMTimeInvalid;
-	 
-	 // Calculate the nextVsync time which is when the screen will be refreshed next.
-	 CFTimeInterval nextVSync = ([sender timestamp] + [sender duration]);
-	 
-	 outputItemTime = [[self videoOutput] itemTimeForHostTime:nextVSync];
-	 
-	 if ([[self videoOutput] hasNewPixelBufferForItemTime:outputItemTime]) {
-	 CVPixelBufferRef pixelBuffer = NULL;
-	 pixelBuffer = [[self videoOutput] copyPixelBufferForItemTime:outputItemTime itemTimeForDisplay:NULL];
-	 
-	 [[self playerView] displayPixelBuffer:pixelBuffer];
-	 }
-	 */
-}
-
 - (void)outputSequenceWasFlushed:(AVPlayerItemOutput *)output
 {
 	self->responder->outputSequenceWasFlushedCallback(output);
@@ -177,6 +109,67 @@ namespace cinder {
 }
 
 namespace cinder { namespace avf {
+
+// One queue delivers the output callbacks of every movie, which hand their work to the movie's WorkerPool queue.
+// Creating a queue per movie leaked it, and left as many threads as movies contending for the same cores.
+static dispatch_queue_t sharedVideoOutputQueue()
+{
+	static dispatch_queue_t queue = NULL;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		queue = dispatch_queue_create("movieVideoOutputQueue", DISPATCH_QUEUE_SERIAL);
+	});
+	return queue;
+}
+
+// Feeds \a estimator with the downloads logged by \a item since \a loggedBytes and \a loggedDuration, which are advanced.
+// Returns the bitrate of the stream being downloaded in bytes per second, as the playlist of an HLS stream indicates it, or 0.
+static double sampleAccessLog(AVPlayerItem* item, BandwidthEstimator& estimator, int64_t* loggedBytes, double* loggedDuration)
+{
+	AVPlayerItemAccessLog* log = [item accessLog];
+	if (!log) return 0;
+	
+	// every event covers a stretch of the download, so their totals only grow
+	int64_t bytes = 0;
+	double duration = 0, indicated_bitrate = 0;
+	for (AVPlayerItemAccessLogEvent* event in [log events]) {
+		bytes += std::max<int64_t>([event numberOfBytesTransferred], 0);
+		duration += std::max<double>([event transferDuration], 0);
+		if ([event indicatedBitrate] > 0)
+			indicated_bitrate = [event indicatedBitrate] / 8;
+	}
+	if (bytes > *loggedBytes && duration > *loggedDuration)
+		estimator.addSample(bytes - *loggedBytes, duration - *loggedDuration);
+	*loggedBytes = std::max(*loggedBytes, bytes);
+	*loggedDuration = std::max(*loggedDuration, duration);
+	return indicated_bitrate;
+}
+
+// Returns the data rate of the tracks of \a asset in bytes per second
+static double getMediaBitrate(AVAsset* asset)
+{
+	double bits_per_second = 0;
+	for (AVAssetTrack* track in [asset tracks])
+		bits_per_second += [track estimatedDataRate];
+	return bits_per_second / 8;
+}
+
+static PlayThroughEstimate predictPlayThrough(AVPlayerItem* item, const BandwidthEstimator& estimator, double mediaBitrate)
+{
+	double current = CMTimeGetSeconds([item currentTime]);
+	double buffered = 0;
+	for (NSValue* value in [item loadedTimeRanges]) {
+		CMTimeRange range = [value CMTimeRangeValue];
+		double start = CMTimeGetSeconds(range.start), end = CMTimeGetSeconds(CMTimeRangeGetEnd(range));
+		if (start <= current && current <= end)
+			buffered = std::max(buffered, end - current);
+	}
+	
+	// a live stream never ends, so a day of it stands in for the rest
+	CMTime duration = [item duration];
+	double remaining = CMTIME_IS_NUMERIC(duration) ? CMTimeGetSeconds(duration) - current : 24 * 60 * 60;
+	return estimator.predict(mediaBitrate, buffered, remaining);
+}
 	
 MovieBase::MovieBase()
 :	mPlayer(NULL),
@@ -184,13 +177,21 @@ MovieBase::MovieBase()
 	mAsset(NULL),
 	mPlayerVideoOutput(NULL),
 	mPlayerDelegate(NULL),
-	mResponder(NULL)
+	mResponder(NULL),
+	mByteSourceLoader(NULL)
 {
+	mWorkQueue = WorkerPool::getShared().createQueue();
 	init();
 }
 
 MovieBase::~MovieBase()
 {
+	FrameTicker::getShared().remove(this);
+	
+	// callbacks still queued would run on a destroyed movie
+	mWorkQueue->clear();
+	mWorkQueue->wait();
+	
 	// remove all observers
 	removeObservers();
 	
@@ -200,10 +201,16 @@ MovieBase::~MovieBase()
 		[mPlayer release];
 	}
 	
+	// the reader shares the asset, whose resource loader goes away below
+	mFrameReader.reset();
+	
 	if (mAsset) {
 		[mAsset cancelLoading];
 		[mAsset release];
 	}
+	
+	// the asset doesn't retain its resource loader, so it goes last
+	[mByteSourceLoader release];
 }
 	
 float MovieBase::getPixelAspectRatio() const
@@ -212,10 +219,10 @@ float MovieBase::getPixelAspectRatio() const
 	
 	if (!mAsset) return pixelAspectRatio;
 	
-	NSArray* video_tracks = [mAsset tracksWithMediaType:AVMediaTypeVideo];
-	if (video_tracks) {
+	AVAssetTrack* video_track = getVideoTrack();
+	if (video_track) {
 		CMFormatDescriptionRef format_desc = NULL;
-		NSArray* descriptions_arr = [[video_tracks objectAtIndex:0] formatDescriptions];
+		NSArray* descriptions_arr = [video_track formatDescriptions];
 		if ([descriptions_arr count] > 0)
 			format_desc = (CMFormatDescriptionRef)[descriptions_arr objectAtIndex:0];
 		
@@ -223,7 +230,7 @@ float MovieBase::getPixelAspectRatio() const
 		if (format_desc)
 			size = CMVideoFormatDescriptionGetPresentationDimensions(format_desc, false, false);
 		else
-			size = [[video_tracks objectAtIndex:0] naturalSize];
+			size = [video_track naturalSize];
 		
 		CFDictionaryRef pixelAspectRatioDict = (CFDictionaryRef) CMFormatDescriptionGetExtension(format_desc, kCMFormatDescriptionExtension_PixelAspectRatio);
 		if (pixelAspectRatioDict) {
@@ -243,13 +250,79 @@ float MovieBase::getPixelAspectRatio() const
 	return pixelAspectRatio;
 }
 
+size_t MovieBase::getNumVideoTracks() const
+{
+	if (!mAsset) return 0;
+	
+	return [[mAsset tracksWithMediaType:AVMediaTypeVideo] count];
+}
+
+bool MovieBase::selectVideoTrack( size_t index )
+{
+	if (!mAsset || !mLoaded || index >= getNumVideoTracks()) return false;
+	
+	mVideoTrackIndex = index;
+	processAsssetTracks(mAsset);
+	mFrameCount = -1;
+	mFrameIndex.clear();
+	mFrameReader.reset();
+	enableSelectedVideoTrack();
+	// the composition renders a single track, which has to follow the selection
+	if (mCropHint.getWidth() > 0)
+		applyCropHint();
+	
+	return true;
+}
+
+void MovieBase::setCropHint( const Area &area )
+{
+	Area crop = area.getClipBy( getBounds() );
+	if (crop == mCropHint) return;
+	
+	// a crop covering the whole frame is no crop at all, and skips the compositor entirely
+	mCropHint = (crop == getBounds() || crop.getWidth() <= 0 || crop.getHeight() <= 0)? Area( 0, 0, 0, 0 ): crop;
+	applyCropHint();
+}
+
+void MovieBase::resetCropHint()
+{
+	if (mCropHint.getWidth() <= 0) return;
+	
+	mCropHint = Area( 0, 0, 0, 0 );
+	applyCropHint();
+}
+
 bool MovieBase::checkPlayThroughOk()
 {
-	mPlayThroughOk = [mPlayerItem isPlaybackLikelyToKeepUp];
+	mPlayThroughOk = [mPlayerItem isPlaybackLikelyToKeepUp] || getPlayThroughEstimate().mStallFree;
 	
 	return mPlayThroughOk;
 }
 
+PlayThroughEstimate MovieBase::getPlayThroughEstimate()
+{
+	PlayThroughEstimate result;
+	if (!mPlayerItem) return result;
+	
+	// nothing has to come over the network for local files and sources that don't download
+	const BandwidthEstimator* estimator = mByteSource ? mByteSource->getBandwidthEstimator() : &mBandwidth;
+	if (!estimator || [[mAsset URL] isFileURL]) {
+		result.mValid = result.mStallFree = true;
+		return result;
+	}
+	
+	double bitrate;
+	{
+		// the tick checks the estimate on another thread while play() waits
+		std::lock_guard<std::mutex> lock(mMutex);
+		bitrate = mMediaBitrate;
+		double indicated_bitrate = sampleAccessLog(mPlayerItem, mBandwidth, &mLoggedBytes, &mLoggedTransferDuration);
+		if (bitrate <= 0)
+			bitrate = indicated_bitrate;
+	}
+	return predictPlayThrough(mPlayerItem, *estimator, bitrate);
+}
+
 int32_t MovieBase::getNumFrames()
 {
 	if (mFrameCount <= 0)
@@ -260,20 +333,8 @@ int32_t MovieBase::getNumFrames()
 
 bool MovieBase::checkNewFrame()
 {
-	if (!mPlayer || !mPlayerVideoOutput) return false;
-	
-	bool result;
-	
-	lock();
-	if (mPlayerVideoOutput) {
-		result = [mPlayerVideoOutput hasNewPixelBufferForItemTime:[mPlayer currentTime]];
-	}
-	else {
-		result = false;
-	}
-	unlock();
-	
-	return result;
+	// the FrameTicker takes every pixel buffer off the output, so asking the output would only ever see the ones it hasn't reached yet
+	return mHasNewFrame;
 }
 
 float MovieBase::getCurrentTime() const
@@ -283,25 +344,32 @@ float MovieBase::getCurrentTime() const
 	return CMTimeGetSeconds([mPlayer currentTime]);
 }
 
+MediaTime MovieBase::getCurrentMediaTime() const
+{
+	if (!mPlayer) return MediaTime();
+	
+	return toMediaTime([mPlayer currentTime]);
+}
+
 void MovieBase::seekToTime( float seconds )
 {
 	if (!mPlayer) return;
 	
-	CMTime seek_time = CMTimeMakeWithSeconds(seconds, [mPlayer currentTime].timescale);
-	[mPlayer seekToTime:seek_time toleranceBefore:kCMTimeZero toleranceAfter:kCMTimeZero];
+	seekToTime( MediaTime::fromSeconds( seconds, [mPlayer currentTime].timescale ) );
 }
 
-void MovieBase::seekToFrame( int frame )
+void MovieBase::seekToTime( const MediaTime &time )
 {
-	if (!mPlayer) return;
+	if (!mPlayer || !time.isValid()) return;
 	
-	CMTime currentTime = [mPlayer currentTime];
-	CMTime oneFrame = CMTimeMakeWithSeconds(1.0 / mFrameRate, currentTime.timescale);
-	CMTime startTime = kCMTimeZero;
-	CMTime addedFrame = CMTimeMultiply(oneFrame, frame);
-	CMTime added = CMTimeAdd(startTime, addedFrame);
+	[mPlayer seekToTime:toCmTime(time) toleranceBefore:kCMTimeZero toleranceAfter:kCMTimeZero];
+}
+
+void MovieBase::seekToFrame( int frame )
+{
+	if (!mPlayer || !mFrameDuration.isValid()) return;
 	
-	[mPlayer seekToTime:added toleranceBefore:kCMTimeZero toleranceAfter:kCMTimeZero];
+	seekToTime( MediaTime::fromFrame( frame, mFrameDuration ) );
 }
 
 void MovieBase::seekToStart()
@@ -328,8 +396,15 @@ void MovieBase::setActiveSegment( float startTime, float duration )
 	if (!mPlayer || !mPlayerItem) return;
 	
 	int32_t scale = [mPlayer currentTime].timescale;
-	CMTime cm_start = CMTimeMakeWithSeconds(startTime, scale);
-	CMTime cm_duration = CMTimeMakeWithSeconds(startTime + duration, scale);
+	setActiveSegment( MediaTime::fromSeconds( startTime, scale ), MediaTime::fromSeconds( duration, scale ) );
+}
+
+void MovieBase::setActiveSegment( const MediaTime &startTime, const MediaTime &duration )
+{
+	if (!mPlayer || !mPlayerItem) return;
+	
+	CMTime cm_start = toCmTime(startTime);
+	CMTime cm_duration = toCmTime(startTime + duration);
 	
 	if (mPlayingForward) {
 		[mPlayer seekToTime:cm_start];
@@ -403,6 +478,7 @@ bool MovieBase::setRate( float rate )
 	}
 	
 	[mPlayer setRate:rate];
+	updateActivity();
 	
 	return success;
 }
@@ -474,22 +550,70 @@ void MovieBase::play(bool toggle)
 		return;
 	}
 	
-	if (toggle) {
-		isPlaying()? [mPlayer pause]: [mPlayer play];
+	if (toggle && (isPlaying() || mAwaitingPlayThrough)) {
+		mAwaitingPlayThrough = false;
+		[mPlayer pause];
 	}
 	else {
+		startPlayback();
+	}
+	updateActivity();
+}
+
+void MovieBase::startPlayback()
+{
+	if (!mStartWhenPredicted) {
 		[mPlayer play];
+		return;
 	}
+	
+	// runs on the tick's thread too, so it leaves mPlayThroughOk alone
+	if (![mPlayerItem isPlaybackLikelyToKeepUp] && !getPlayThroughEstimate().mStallFree) {
+		mAwaitingPlayThrough = true;
+		return;
+	}
+	mAwaitingPlayThrough = false;
+	// -play would still wait for AVFoundation to consider the buffer full enough
+	if ([mPlayer respondsToSelector:@selector(playImmediatelyAtRate:)])
+		[mPlayer playImmediatelyAtRate:1.0f];
+	else
+		[mPlayer play];
 }
 
 void MovieBase::stop()
 {
 	mPlaying = false;
+	mAwaitingPlayThrough = false;
 	
 	if (!mPlayer)
 		return;
 	
 	[mPlayer pause];
+	updateActivity();
+}
+
+bool MovieBase::isActive() const
+{
+	return FrameTicker::getShared().isActive(const_cast<MovieBase*>(this));
+}
+
+void MovieBase::setVisible( bool visible )
+{
+	if (mVisible == visible) return;
+	
+	mVisible = visible;
+	if (mPlayerItem && mPlayerVideoOutput) {
+		// without an output the item decodes no video at all; the last frame stays with the movie
+		if (visible) {
+			if (![[mPlayerItem outputs] containsObject:mPlayerVideoOutput])
+				[mPlayerItem addOutput:mPlayerVideoOutput];
+			mFramePending = true;
+		}
+		else {
+			[mPlayerItem removeOutput:mPlayerVideoOutput];
+		}
+	}
+	updateActivity();
 }
 
 void MovieBase::init()
@@ -498,11 +622,25 @@ void MovieBase::init()
 	mPlayThroughOk = mPlayable = mProtected = false;
 	mPlaying = mPlayingForward = true;
 	mLoop = mPalindrome = false;
+	mVisible = mFramePending = true;
+	mHasNewFrame = false;
+	mAwaitingPlayThrough = mStartWhenPredicted = false;
+	mBandwidth.reset();
+	mLoggedBytes = 0;
+	mLoggedTransferDuration = 0;
+	mLastPlayThroughCheck = -1;
+	mMediaBitrate = 0;
 	mFrameRate = -1;
 	mWidth = -1;
 	mHeight = -1;
 	mDuration = -1;
+	mMediaDuration = mFrameDuration = MediaTime();
 	mFrameCount = -1;
+	mVideoTrackIndex = 0;
+	mCropHint = mFrameCrop = mOutputCrop = mPendingCrop = Area( 0, 0, 0, 0 );
+	mCropPending = false;
+	mFrameIndex.clear();
+	mFrameInfo = FrameInfo();
 }
     
 void MovieBase::initFromUrl( const Url& url )
@@ -521,8 +659,18 @@ void MovieBase::initFromUrl( const Url& url )
 	loadAsset();
 }
 
-void MovieBase::initFromPath( const fs::path& filePath )
+void MovieBase::initFromPath( const fs::path& filePath, bool preloadToMemory )
 {
+	if (preloadToMemory) {
+		// streams as usual when the file doesn't fit the budget
+		PreloadedFileRef preloaded = PreloadedFile::create(filePath.string());
+		if (preloaded) {
+			mPreloadedFile = preloaded;
+			initFromByteSource(preloaded);
+			return;
+		}
+	}
+	
 	NSURL* asset_url = [NSURL fileURLWithPath:[NSString stringWithCString:filePath.c_str() encoding:[NSString defaultCStringEncoding]]];
 	if (!asset_url)
 		throw AvfPathInvalidExc();
@@ -537,12 +685,27 @@ void MovieBase::initFromPath( const fs::path& filePath )
 	loadAsset();
 }
 
+void MovieBase::initFromByteSource( const ByteSourceRef& source )
+{
+	mByteSource = source;
+	mAsset = createByteSourceAsset(source, &mByteSourceLoader);
+	if (!mAsset)
+		throw AvfFileInvalidExc();
+	
+	mResponder = new MovieResponder(this);
+	mPlayerDelegate = [[MovieDelegate alloc] initWithResponder:mResponder];
+	
+	loadAsset();
+}
+
 void MovieBase::initFromLoader( const MovieLoader& loader )
 {
 	if (!loader.ownsMovie()) return;
 	
 	loader.waitForLoaded();
 	mPlayer = loader.transferMovieHandle();
+	mByteSourceLoader = [loader.getByteSourceLoader() retain];
+	mPreloadedFile = loader.getPreloadedFile();
 	mPlayerItem = [mPlayer currentItem];
 	mAsset = reinterpret_cast<AVURLAsset*>([mPlayerItem asset]);
 	
@@ -554,7 +717,8 @@ void MovieBase::initFromLoader( const MovieLoader& loader )
 	
 	// collect asset information
 	mLoaded = true;
-	mDuration = (float) CMTimeGetSeconds([mAsset duration]);
+	mMediaDuration = toMediaTime([mAsset duration]);
+	mDuration = (float) mMediaDuration.toSeconds();
 	mPlayable = [mAsset isPlayable];
 	mProtected = [mAsset hasProtectedContent];
 	mPlayThroughOk = [mPlayerItem isPlaybackLikelyToKeepUp];
@@ -588,7 +752,8 @@ void MovieBase::loadAsset()
 			error = nil;
 			status = [mAsset statusOfValueForKey:@"duration" error:&error];
 			if (status == AVKeyValueStatusLoaded && !error) {
-				mDuration = (float) CMTimeGetSeconds([mAsset duration]);
+				mMediaDuration = toMediaTime([mAsset duration]);
+				mDuration = (float) mMediaDuration.toSeconds();
 			} else {
                 ci::app::console() << "AVKeyValueStatusLoaded error -- duration" << std::endl;
             }
@@ -635,9 +800,17 @@ void MovieBase::updateFrame()
 			releaseFrame();
 			
 			CVImageBufferRef buffer = nil;
-			buffer = [mPlayerVideoOutput copyPixelBufferForItemTime:[mPlayerItem currentTime] itemTimeForDisplay:nil];
+			CMTime display_time = kCMTimeInvalid;
+			buffer = [mPlayerVideoOutput copyPixelBufferForItemTime:[mPlayerItem currentTime] itemTimeForDisplay:&display_time];
 			if (buffer) {
+				mFramePending = false;
+				mFrameInfo = describeFrame(toMediaTime(display_time));
+				{
+					std::lock_guard<std::mutex> crop_lock(mMutex);
+					mFrameCrop = mOutputCrop;
+				}
 				newFrame(buffer);
+				mHasNewFrame = true;
 				mSignalNewFrame();
 			}
 		}
@@ -649,11 +822,76 @@ uint32_t MovieBase::countFrames() const
 {
 	if (!mAsset) return 0;
 	
-	CMTime dur = [mAsset duration];
-	CMTime one_frame = CMTimeMakeWithSeconds(1.0 / mFrameRate, dur.timescale);
-	double dur_seconds = CMTimeGetSeconds(dur);
-	double one_frame_seconds = CMTimeGetSeconds(one_frame);
-	return static_cast<uint32_t>(dur_seconds / one_frame_seconds);
+	return static_cast<uint32_t>(toMediaTime([mAsset duration]).toFrame(mFrameDuration));
+}
+
+bool MovieBase::loadFrameIndex()
+{
+	if (!mFrameIndex.empty()) return true;
+	
+	AVAssetTrack* video_track = getVideoTrack();
+	if (!video_track) return false;
+	
+	return scanFrameIndex(mAsset, video_track, &mFrameIndex) && !mFrameIndex.empty();
+}
+
+Surface8u MovieBase::getFrameAt( const MediaTime &time, FrameInfo *info )
+{
+	if (!mLoaded || !mAsset) return Surface8u();
+	
+	if (!mFrameReader) {
+		AVAssetTrack* video_track = getVideoTrack();
+		if (!video_track) return Surface8u();
+		// an asset that can't be read frame by frame yields no frames, as an unloaded one does
+		try {
+			mFrameReader = FrameReader::create(mAsset, video_track);
+		}
+		catch (AvfExc&) {
+			return Surface8u();
+		}
+	}
+	
+	return mFrameReader->getFrameAt(time, info);
+}
+
+bool MovieBase::detectSceneCuts( const SceneDetector::Options &options )
+{
+	if (!mLoaded || !mAsset || !loadFrameIndex()) return false;
+	
+	AVAssetTrack* video_track = getVideoTrack();
+	if (!video_track) return false;
+	
+	// a reader of its own leaves the stream of getFrameAt() where it is
+	FrameReaderRef reader;
+	try {
+		reader = FrameReader::create(mAsset, video_track);
+	}
+	catch (AvfExc&) {
+		return false;
+	}
+	if (!reader->detectSceneCuts(options)) return false;
+	
+	// both indices come from the same sample table, so the frames line up
+	mFrameIndex.clearSceneCuts();
+	const std::vector<size_t>& cuts = reader->getSceneCuts();
+	for (std::vector<size_t>::const_iterator it = cuts.begin(); it != cuts.end(); ++it)
+		mFrameIndex.addSceneCut(*it);
+	return true;
+}
+
+FrameInfo MovieBase::describeFrame( const MediaTime &time ) const
+{
+	size_t index;
+	if (!mFrameIndex.empty() && mFrameIndex.findFrame(time, &index))
+		return mFrameIndex.getFrameInfo(index);
+	
+	// without a sample table the position follows from the nominal framerate
+	FrameInfo result;
+	result.mTime = time;
+	result.mDuration = mFrameDuration;
+	if (time.isValid() && mFrameDuration.isValid())
+		result.mFrameIndex = time.toFrame(mFrameDuration);
+	return result;
 }
 
 void MovieBase::processAsssetTracks(AVAsset* asset)
@@ -662,7 +900,7 @@ void MovieBase::processAsssetTracks(AVAsset* asset)
 	NSArray* video_tracks = [asset tracksWithMediaType:AVMediaTypeVideo];
 	mHasVideo = [video_tracks count] > 0;
 	if (mHasVideo) {
-		AVAssetTrack* video_track = [video_tracks objectAtIndex:0];
+		AVAssetTrack* video_track = getVideoTrack();
 		if (video_track) {
 			// Grab track dimensions from format description
 			CGSize size = [video_track naturalSize];
@@ -671,6 +909,7 @@ void MovieBase::processAsssetTracks(AVAsset* asset)
 			mHeight = static_cast<int32_t>(size.height);
 			mWidth = static_cast<int32_t>(size.width);
 			mFrameRate = [video_track nominalFrameRate];
+			mFrameDuration = getFrameDuration(video_track);
 		}
 		else throw AvfFileInvalidExc();
 	}
@@ -686,14 +925,113 @@ void MovieBase::processAsssetTracks(AVAsset* asset)
 	// No need for changes on OSX
 	
 #endif
+	
+	// sources that read ahead, such as a ScheduledStream, size their buffer by the movie's data rate
+	double bitrate = getMediaBitrate(asset);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mMediaBitrate = bitrate;
+	}
+	if (mByteSource)
+		mByteSource->setBitrateHint(bitrate);
+}
+
+AVAssetTrack* MovieBase::getVideoTrack() const
+{
+	if (!mAsset) return nil;
+	
+	NSArray* video_tracks = [mAsset tracksWithMediaType:AVMediaTypeVideo];
+	return (mVideoTrackIndex < [video_tracks count])? [video_tracks objectAtIndex:mVideoTrackIndex]: nil;
+}
+
+void MovieBase::enableSelectedVideoTrack()
+{
+	if (!mPlayer || !mPlayerItem) return;
+	
+	// the video output composites every enabled video track, so only the selected one stays on
+	CMPersistentTrackID selected_id = [getVideoTrack() trackID];
+	for (AVPlayerItemTrack* track in [mPlayerItem tracks]) {
+		AVAssetTrack* asset_track = [track assetTrack];
+		if ([[asset_track mediaType] isEqualToString:AVMediaTypeVideo])
+			[track setEnabled:([asset_track trackID] == selected_id)];
+	}
+	
+	// refresh the output so a paused movie shows the new track
+	[mPlayer seekToTime:[mPlayer currentTime] toleranceBefore:kCMTimeZero toleranceAfter:kCMTimeZero];
+}
+
+void MovieBase::applyCropHint()
+{
+	if (!mPlayerItem) return;
+	
+	AVAssetTrack* track = getVideoTrack();
+	if (!track || mCropHint.getWidth() <= 0) {
+		[mPlayerItem setVideoComposition:nil];
+	}
+	else {
+		// the decoder still produces whole frames, but the compositor only renders and converts the cropped area into the output's buffers
+		AVMutableVideoCompositionLayerInstruction* layer_instruction = [AVMutableVideoCompositionLayerInstruction videoCompositionLayerInstructionWithAssetTrack:track];
+		CGAffineTransform transform = CGAffineTransformConcat([track preferredTransform], CGAffineTransformMakeTranslation(-mCropHint.x1, -mCropHint.y1));
+		[layer_instruction setTransform:transform atTime:kCMTimeZero];
+		
+		AVMutableVideoCompositionInstruction* instruction = [AVMutableVideoCompositionInstruction videoCompositionInstruction];
+		[instruction setTimeRange:CMTimeRangeMake(kCMTimeZero, [mAsset duration])];
+		[instruction setLayerInstructions:@[layer_instruction]];
+		
+		AVMutableVideoComposition* composition = [AVMutableVideoComposition videoComposition];
+		[composition setRenderSize:CGSizeMake(mCropHint.getWidth(), mCropHint.getHeight())];
+		[composition setFrameDuration:mFrameDuration.isValid()? toCmTime(mFrameDuration): CMTimeMake(1, 30)];
+		[composition setInstructions:@[instruction]];
+		[mPlayerItem setVideoComposition:composition];
+	}
+	
+	// frames already in the output were rendered with the previous crop; the flush of a seek in place drops them, and every
+	// frame after it comes from the new composition, which is how each frame gets tagged with the crop it has
+	{
+		std::lock_guard<std::mutex> crop_lock(mMutex);
+		mPendingCrop = mCropHint;
+		mCropPending = true;
+	}
+	if (mPlayer)
+		[mPlayer seekToTime:[mPlayer currentTime] toleranceBefore:kCMTimeZero toleranceAfter:kCMTimeZero];
 }
 
 void MovieBase::createPlayerItemOutput(const AVPlayerItem* playerItem)
 {
-	NSDictionary* pixBuffAttributes = @{(id)kCVPixelBufferPixelFormatTypeKey: @(kCVPixelFormatType_32BGRA)};
+	NSDictionary* pixBuffAttributes = @{(id)kCVPixelBufferPixelFormatTypeKey: @(kCVPixelFormatType_32BGRA),
+										(id)kCVPixelBufferBytesPerRowAlignmentKey: @(FrameAllocator::ALIGNMENT)};
 	mPlayerVideoOutput = [[AVPlayerItemVideoOutput alloc] initWithPixelBufferAttributes:pixBuffAttributes];
-	[mPlayerVideoOutput setDelegate:mPlayerDelegate queue:dispatch_queue_create("movieVideoOutputQueue", DISPATCH_QUEUE_SERIAL)];
-	[playerItem addOutput:mPlayerVideoOutput];
+	[mPlayerVideoOutput setDelegate:mPlayerDelegate queue:sharedVideoOutputQueue()];
+	if (mVisible)
+		[playerItem addOutput:mPlayerVideoOutput];
+	
+	// frames are pulled from the output on the tick shared by every movie
+	FrameTicker& ticker = FrameTicker::getShared();
+	if (!ticker.hasClock())
+		ticker.setClock(std::unique_ptr<FrameTicker::Clock>(new DisplayLinkClock));
+	ticker.add(this, &MovieBase::tickFrame, shouldBeActive());
+}
+
+bool MovieBase::tickFrame(void* movie, double time)
+{
+	MovieBase* self = static_cast<MovieBase*>(movie);
+	// a few checks a second follow the estimate closely enough
+	if (self->mAwaitingPlayThrough && time - self->mLastPlayThroughCheck >= 0.25) {
+		self->mLastPlayThroughCheck = time;
+		self->startPlayback();
+	}
+	self->updateFrame();
+	return self->shouldBeActive();
+}
+
+bool MovieBase::shouldBeActive() const
+{
+	return mAwaitingPlayThrough || (mVisible && mPlayerVideoOutput && (mFramePending || isPlaying()));
+}
+
+void MovieBase::updateActivity()
+{
+	FrameTicker::getShared().setActive(this, shouldBeActive());
 }
 
 void MovieBase::addObservers()
@@ -762,6 +1100,7 @@ void MovieBase::playerItemEnded()
 		this->seekToStart();
 	}
 	
+	updateActivity();
 	mSignalEnded();
 }
 	
@@ -772,12 +1111,24 @@ void MovieBase::playerItemCancelled()
 	
 void MovieBase::playerItemJumped()
 {
+	// a paused movie still has to show the frame it jumped to
+	mFramePending = true;
+	updateActivity();
 	mSignalJumped();
 }
 
 void MovieBase::outputWasFlushed(AVPlayerItemOutput* output)
 {
-	mSignalOutputWasFlushed();
+	{
+		std::lock_guard<std::mutex> crop_lock(mMutex);
+		if (mCropPending) {
+			mOutputCrop = mPendingCrop;
+			mCropPending = false;
+		}
+	}
+	mFramePending = true;
+	updateActivity();
+	mWorkQueue->post([this] { mSignalOutputWasFlushed(); });
 }
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -787,9 +1138,9 @@ MovieSurface::MovieSurface( const Url& url ) : MovieBase()
 	MovieBase::initFromUrl( url );
 }
 
-MovieSurface::MovieSurface( const fs::path& path ) : MovieBase()
+MovieSurface::MovieSurface( const fs::path& path, bool preloadToMemory ) : MovieBase()
 {
-	MovieBase::initFromPath( path );
+	MovieBase::initFromPath( path, preloadToMemory );
 }
 
 MovieSurface::MovieSurface( const MovieLoader& loader ) : MovieBase()
@@ -797,44 +1148,34 @@ MovieSurface::MovieSurface( const MovieLoader& loader ) : MovieBase()
 	MovieBase::initFromLoader( loader );
 }
 
+MovieSurface::MovieSurface( const DataSourceRef& dataSource ) : MovieBase()
+{
+	MovieBase::initFromByteSource( createByteSource( dataSource ) );
+}
+
+MovieSurface::MovieSurface( const ByteSourceRef& source ) : MovieBase()
+{
+	MovieBase::initFromByteSource( source );
+}
+
 MovieSurface::~MovieSurface()
 {
+	// a tick on another thread must not reach newFrame() once this part of the movie is gone
+	FrameTicker::getShared().remove(this);
 	deallocateVisualContext();
 }
 		
 bool MovieSurface::hasAlpha() const
 {
-	if (mPlayerVideoOutput && mPlayer && [mPlayerVideoOutput hasNewPixelBufferForItemTime:[mPlayer currentTime]]) {
-		CVImageBufferRef pixel_buffer = nil;
-		pixel_buffer = [mPlayerVideoOutput copyPixelBufferForItemTime:[mPlayerItem currentTime] itemTimeForDisplay:nil];
-		if ( pixel_buffer != nil ) {
-			CVPixelBufferLockBaseAddress( pixel_buffer, 0 );
-			OSType type = CVPixelBufferGetPixelFormatType(pixel_buffer);
-			CVPixelBufferUnlockBaseAddress( pixel_buffer, 0 );
-#if defined ( CINDER_COCOA_TOUCH)
-			return (type == kCVPixelFormatType_32ARGB ||
-					type == kCVPixelFormatType_32BGRA ||
-					type == kCVPixelFormatType_32ABGR ||
-					type == kCVPixelFormatType_32RGBA ||
-					type == kCVPixelFormatType_64ARGB);
-#elif defined ( CINDER_COCOA )
-			return (type == k32ARGBPixelFormat || type == k32BGRAPixelFormat);
-#endif
-			
-		}
-	}
-	
+	// copying a pixel buffer off the output here would take the frame from the FrameTicker, so go by the last frame it delivered
 	return mSurface.hasAlpha();
 }
 
 Surface MovieSurface::getSurface()
 {
-#if defined( CINDER_COCOA_TOUCH )
-#elif defined( CINDER_COCOA )
-    updateFrame();
-#endif
-	
+	// frames arrive on the FrameTicker, so an idle movie costs nothing here
 //	lock();
+	mHasNewFrame = false;
 	Surface result = mSurface;
 //	unlock();
 	
@@ -863,18 +1204,29 @@ MovieGl::MovieGl( const Url& url ) : MovieBase(), mVideoTextureRef(NULL), mVideo
 	MovieBase::initFromUrl( url );
 }
 
-MovieGl::MovieGl( const fs::path& path ) : MovieBase(), mVideoTextureRef(NULL), mVideoTextureCacheRef(NULL)
+MovieGl::MovieGl( const fs::path& path, bool preloadToMemory ) : MovieBase(), mVideoTextureRef(NULL), mVideoTextureCacheRef(NULL)
 {
-	MovieBase::initFromPath( path );
+	MovieBase::initFromPath( path, preloadToMemory );
 }
 	
 MovieGl::MovieGl( const MovieLoader& loader ) : MovieBase(), mVideoTextureRef(NULL), mVideoTextureCacheRef(NULL)
 {
 	MovieBase::initFromLoader(loader);
 }
+
+MovieGl::MovieGl( const DataSourceRef& dataSource ) : MovieBase(), mVideoTextureRef(NULL), mVideoTextureCacheRef(NULL)
+{
+	MovieBase::initFromByteSource( createByteSource( dataSource ) );
+}
+
+MovieGl::MovieGl( const ByteSourceRef& source ) : MovieBase(), mVideoTextureRef(NULL), mVideoTextureCacheRef(NULL)
+{
+	MovieBase::initFromByteSource( source );
+}
 		
 MovieGl::~MovieGl()
 {
+	FrameTicker::getShared().remove(this);
 	deallocateVisualContext();
 }
 	
@@ -885,15 +1237,8 @@ bool MovieGl::hasAlpha() const
 	CVPixelBufferLockBaseAddress( mVideoTextureRef, 0 );
 	OSType type = CVPixelBufferGetPixelFormatType(mVideoTextureRef);
 	CVPixelBufferUnlockBaseAddress( mVideoTextureRef, 0 );
-#if defined ( CINDER_COCOA_TOUCH)
-	return (type == kCVPixelFormatType_32ARGB ||
-			type == kCVPixelFormatType_32BGRA ||
-			type == kCVPixelFormatType_32ABGR ||
-			type == kCVPixelFormatType_32RGBA ||
-			type == kCVPixelFormatType_64ARGB);
-#elif defined ( CINDER_COCOA )
-	return (type == k32ARGBPixelFormat || type == k32BGRAPixelFormat);
-#endif
+	PixelFormat format;
+	return findPixelFormat( type, &format ) && getPixelFormatDesc( format ).hasAlpha();
 	
 	/*
 	CGColorSpaceRef color_space = CVImageBufferGetColorSpace(mVideoTextureRef);
@@ -904,9 +1249,8 @@ bool MovieGl::hasAlpha() const
 
 const gl::Texture MovieGl::getTexture()
 {
-	updateFrame();
-	
 	lock();
+	mHasNewFrame = false;
 	gl::Texture result = mTexture;
 	unlock();
 	
@@ -1028,15 +1372,28 @@ void MovieGl::releaseFrame()
 
 /////////////////////////////////////////////////////////////////////////////////
 // MovieLoader
-MovieLoader::MovieLoader( const Url &url )
-:	mUrl(url), mBufferFull(false), mBufferEmpty(false), mLoaded(false),
-	mPlayable(false), mPlayThroughOK(false), mProtected(false), mOwnsMovie(true)
+MovieLoader::MovieLoader( const Url &url, bool preloadToMemory )
+:	mUrl(url), mByteSourceLoader(NULL), mBufferFull(false), mBufferEmpty(false), mLoaded(false),
+	mPlayable(false), mPlayThroughOK(false), mProtected(false), mOwnsMovie(true),
+	mBandwidth(new BandwidthEstimator), mLoggedBytes(0), mLoggedTransferDuration(0)
 {
 	NSURL* asset_url = [NSURL URLWithString:[NSString stringWithCString:mUrl.c_str() encoding:[NSString defaultCStringEncoding]]];
 	if (!asset_url)
 		throw AvfUrlInvalidExc();
 	
-	AVPlayerItem* playerItem = [[AVPlayerItem alloc] initWithURL:asset_url];
+	AVPlayerItem* playerItem = nil;
+	if (preloadToMemory && [asset_url isFileURL]) {
+		mPreloadedFile = PreloadedFile::create([[asset_url path] UTF8String]);
+		AVURLAsset* asset = mPreloadedFile ? createByteSourceAsset(mPreloadedFile, &mByteSourceLoader) : nil;
+		if (asset) {
+			playerItem = [[AVPlayerItem alloc] initWithAsset:asset];
+			[asset release];
+		}
+		else
+			mPreloadedFile.reset();
+	}
+	if (!playerItem)
+		playerItem = [[AVPlayerItem alloc] initWithURL:asset_url];
 	mPlayer = [[AVPlayer alloc] init];
 	[mPlayer replaceCurrentItemWithPlayerItem:playerItem];	// starts the downloading process
 }
@@ -1046,6 +1403,8 @@ MovieLoader::~MovieLoader()
 	if( mOwnsMovie && mPlayer ) {
 		[mPlayer release];
 	}
+	// a movie that took the player retained the loader as well
+	[mByteSourceLoader release];
 }
 	
 bool MovieLoader::checkLoaded() const
@@ -1072,6 +1431,27 @@ bool MovieLoader::checkPlayThroughOk() const
 	return mPlayThroughOK;
 }
 
+PlayThroughEstimate MovieLoader::getPlayThroughEstimate() const
+{
+	AVPlayerItem* playerItem = [mPlayer currentItem];
+	if (!playerItem || !mBandwidth) return PlayThroughEstimate();
+	
+	PlayThroughEstimate result;
+	if (mPreloadedFile || [[(AVURLAsset*)[playerItem asset] URL] isFileURL]) {
+		result.mValid = result.mStallFree = true;
+		return result;
+	}
+	
+	double bitrate = sampleAccessLog(playerItem, *mBandwidth, &mLoggedBytes, &mLoggedTransferDuration);
+	// the tracks would block until they have loaded
+	if ([playerItem status] == AVPlayerItemStatusReadyToPlay) {
+		double track_bitrate = getMediaBitrate([playerItem asset]);
+		if (track_bitrate > 0)
+			bitrate = track_bitrate;
+	}
+	return predictPlayThrough(playerItem, *mBandwidth, bitrate);
+}
+
 bool MovieLoader::checkProtection() const
 {
 	updateLoadState();
@@ -1106,47 +1486,11 @@ void MovieLoader::updateLoadState() const
 {    
 	AVPlayerItem* playerItem = [mPlayer currentItem];
 	mLoaded = mPlayable = [playerItem status] == AVPlayerItemStatusReadyToPlay;
-	mPlayThroughOK = [playerItem isPlaybackLikelyToKeepUp];
+	mPlayThroughOK = [playerItem isPlaybackLikelyToKeepUp] || getPlayThroughEstimate().mStallFree;
 	mProtected = [[playerItem asset] hasProtectedContent];
 	app::console() << "  loaded: " << mLoaded << std::endl;
 	app::console() << "  protected: " << mProtected << std::endl;
 	app::console() << "  playback okay?: " << mPlayThroughOK << std::endl;
-	
-	//NSArray* loaded = [playerItem seekableTimeRanges];  // this value appears to be garbage (wtf?)
-//	NSArray* loaded = [playerItem loadedTimeRanges];      // this value appears to be garbage (wtf?)
-//	for (NSValue* value in loaded) {
-//		CMTimeRange range = [value CMTimeRangeValue];
-//		float start = CMTimeGetSeconds(range.start);
-//		float dur = CMTimeGetSeconds(range.duration);
-		//mLoaded = (CMTimeCompare([playerItem duration], range.duration) >= 0);
-//	}
-	
-	AVPlayerItemAccessLog* log = [playerItem accessLog];
-	if (log) {
-		NSArray* load_events = [log events];
-		for (AVPlayerItemAccessLogEvent* log_event in load_events) {
-			int segemnts = log_event.numberOfSegmentsDownloaded;
-			int stalls = log_event.numberOfStalls;							// only accurate if playing!
-			double segment_interval = log_event.segmentsDownloadedDuration;	// only accurate if playing!
-			double watched_interval = log_event.durationWatched;			// only accurate if playing!
-			NSString* str = log_event.serverAddress;
-			std::string address = (str? std::string([str UTF8String]): "");
-			long long bytes_transfered = log_event.numberOfBytesTransferred;
-			double bitrate = log_event.observedBitrate;
-			int dropped_frames = log_event.numberOfDroppedVideoFrames;		// only accurate if playing!
-			
-			app::console() << "-------------------------" << std::endl;
-			app::console() << "  segments: " << segemnts << std::endl;
-			app::console() << "  stalls: " << stalls << std::endl;
-			app::console() << "  segment_interval: " << segment_interval << std::endl;
-			app::console() << "  watched_interval: " << watched_interval << std::endl;
-			app::console() << "  address: " << address << std::endl;
-			app::console() << "  bytes_transfered: " << bytes_transfered << std::endl;
-			app::console() << "  bitrate: " << bitrate << std::endl;
-			app::console() << "  dropped_frames: " << dropped_frames << std::endl;
-			app::console() << "  COMPLETLEY LOADED?: " << (segment_interval >= 0) << std::endl;
-		}
-	}
 }
 
 } /* namespace avf */ } /* namespace cinder */
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "AvfAtlasPacker.h"
+#include "AvfSimd.h"
+#include "AvfWorkerPool.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+namespace cinder { namespace avf {
+
+SkylinePacker::SkylinePacker( int32_t width, int32_t height, int32_t padding )
+	: mWidth( std::max( width, 0 ) ), mHeight( std::max( height, 0 ) ), mPadding( std::max( padding, 0 ) )
+{
+	clear();
+}
+
+void SkylinePacker::clear()
+{
+	mSkyline.clear();
+	Segment floor = { 0, 0, mWidth };
+	mSkyline.push_back( floor );
+	mUsedArea = 0;
+}
+
+float SkylinePacker::getOccupancy() const
+{
+	int64_t area = static_cast<int64_t>( mWidth ) * mHeight;
+	return ( area > 0 )? static_cast<float>( static_cast<double>( mUsedArea ) / area ): 0.0f;
+}
+
+int32_t SkylinePacker::findRestingHeight( size_t index, int32_t width, int32_t height ) const
+{
+	// the rectangle rests on the highest segment it spans
+	int32_t y = 0;
+	for( int32_t remaining = width; remaining > 0; ++index ) {
+		y = std::max( y, mSkyline[index].mY );
+		if( y + height > mHeight )
+			return -1;
+		remaining -= mSkyline[index].mWidth;
+	}
+	return y;
+}
+
+bool SkylinePacker::insert( int32_t width, int32_t height, PackedRect *result )
+{
+	if( width <= 0 || height <= 0 || width > mWidth || height > mHeight )
+		return false;
+
+	size_t best = mSkyline.size();
+	int32_t bestTop = std::numeric_limits<int32_t>::max(), bestWidth = std::numeric_limits<int32_t>::max(), bestY = 0, bestFootprint = 0;
+	for( size_t i = 0; i < mSkyline.size(); ++i ) {
+		if( mSkyline[i].mX + width > mWidth )
+			break;
+		// padding is trimmed at the atlas edges, where there is no neighbour to bleed into
+		int32_t footprint = std::min( width + mPadding, mWidth - mSkyline[i].mX );
+		int32_t y = findRestingHeight( i, footprint, height );
+		if( y < 0 )
+			continue;
+		// lowest top edge first, then the narrowest segment so wide gaps stay free for wide rectangles
+		int32_t top = std::min( y + height + mPadding, mHeight );
+		if( top < bestTop || ( top == bestTop && mSkyline[i].mWidth < bestWidth ) ) {
+			best = i;
+			bestTop = top;
+			bestWidth = mSkyline[i].mWidth;
+			bestY = y;
+			bestFootprint = footprint;
+		}
+	}
+	if( best == mSkyline.size() )
+		return false;
+
+	Segment placed = { mSkyline[best].mX, bestTop, bestFootprint };
+	*result = PackedRect( placed.mX, bestY, width, height );
+	mUsedArea += static_cast<int64_t>( bestFootprint ) * ( bestTop - bestY );
+
+	// the new segment covers the start of the ones it spans, which are removed or shortened
+	mSkyline.insert( mSkyline.begin() + best, placed );
+	const int32_t right = placed.mX + placed.mWidth;
+	size_t next = best + 1;
+	while( next < mSkyline.size() && mSkyline[next].mX < right ) {
+		int32_t segmentRight = mSkyline[next].mX + mSkyline[next].mWidth;
+		if( segmentRight <= right ) {
+			mSkyline.erase( mSkyline.begin() + next );
+		}
+		else {
+			mSkyline[next].mWidth = segmentRight - right;
+			mSkyline[next].mX = right;
+			break;
+		}
+	}
+
+	// neighbours at the same height merge, keeping the skyline short
+	for( size_t i = 0; i + 1 < mSkyline.size(); ) {
+		if( mSkyline[i].mY == mSkyline[i + 1].mY ) {
+			mSkyline[i].mWidth += mSkyline[i + 1].mWidth;
+			mSkyline.erase( mSkyline.begin() + i + 1 );
+		}
+		else
+			++i;
+	}
+
+	return true;
+}
+
+namespace {
+
+void blitRange( const PixelBlit *begin, const PixelBlit *end )
+{
+	for( const PixelBlit *blit = begin; blit != end; ++blit )
+		copyPixelRows( blit->mSrc, blit->mSrcRowBytes, blit->mSrcInc, blit->mDst, blit->mDstRowBytes, blit->mDstInc, blit->mSwizzle? blit->mDstFromSrc: NULL,
+					   blit->mWidth, blit->mHeight, 1 );
+}
+
+} // anonymous namespace
+
+void blitPixels( const std::vector<PixelBlit> &blits, size_t numThreads )
+{
+	if( blits.empty() )
+		return;
+
+	size_t total = 0;
+	for( size_t i = 0; i < blits.size(); ++i )
+		total += static_cast<size_t>( blits[i].mWidth ) * blits[i].mHeight * blits[i].mDstInc;
+
+	// the same threshold as copyPixelRows(): below a few megabytes, spinning up threads costs more than the copy
+	if( numThreads == 0 )
+		numThreads = std::min<size_t>( std::max<size_t>( std::thread::hardware_concurrency(), 1 ), total / ( 4 * 1024 * 1024 ) + 1 );
+	numThreads = std::min( numThreads, blits.size() );
+
+	if( numThreads <= 1 ) {
+		blitRange( &blits[0], &blits[0] + blits.size() );
+		return;
+	}
+
+	// consecutive runs of blits of about equal byte count, one per pool task
+	std::vector<size_t> bounds( 1, 0 );
+	const size_t share = ( total + numThreads - 1 ) / numThreads;
+	size_t bytes = 0;
+	for( size_t i = 0; i + 1 < blits.size(); ++i ) {
+		bytes += static_cast<size_t>( blits[i].mWidth ) * blits[i].mHeight * blits[i].mDstInc;
+		if( bytes >= share ) {
+			bounds.push_back( i + 1 );
+			bytes = 0;
+		}
+	}
+	bounds.push_back( blits.size() );
+
+	const PixelBlit *first = &blits[0];
+	WorkerPool::getShared().parallelFor( bounds.size() - 1, [&]( size_t run ) {
+		blitRange( first + bounds[run], first + bounds[run + 1] );
+	} );
+}
+
+} } // namespace cinder::avf
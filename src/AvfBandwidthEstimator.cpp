@@ -0,0 +1,126 @@
+#include "AvfBandwidthEstimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cinder { namespace avf {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BandwidthEstimator::Options
+
+BandwidthEstimator::Options::Options()
+	: mFastHalfLife( 2 ), mSlowHalfLife( 5 ), mSafetyFactor( 0.8 ), mMinBufferSeconds( 2 ), mMinSampleBytes( 16 * 1024 )
+{
+}
+
+BandwidthEstimator::Options& BandwidthEstimator::Options::setHalfLives( double fastSeconds, double slowSeconds )
+{
+	mFastHalfLife = std::max( fastSeconds, 0.01 );
+	mSlowHalfLife = std::max( slowSeconds, mFastHalfLife );
+	return *this;
+}
+
+BandwidthEstimator::Options& BandwidthEstimator::Options::setSafetyFactor( double factor )
+{
+	mSafetyFactor = std::min( std::max( factor, 0.01 ), 1.0 );
+	return *this;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BandwidthEstimator
+
+BandwidthEstimator::BandwidthEstimator( const Options &options )
+	: mOptions( options ), mFast( 0 ), mSlow( 0 ), mSecondsSampled( 0 ), mBytesSampled( 0 )
+{
+}
+
+void BandwidthEstimator::addSample( uint64_t bytes, double seconds )
+{
+	// small downloads are mostly latency, and would drag the estimate down
+	if( bytes < mOptions.getMinSampleBytes() || ! ( seconds > 0 ) )
+		return;
+
+	double rate = bytes / seconds;
+	std::lock_guard<std::mutex> lock( mMutex );
+	// a sample weighs in by its duration, so one long download counts as much as many short ones covering the same time
+	double fastWeight = std::pow( 0.5, seconds / mOptions.getFastHalfLife() );
+	double slowWeight = std::pow( 0.5, seconds / mOptions.getSlowHalfLife() );
+	mFast = fastWeight * mFast + ( 1 - fastWeight ) * rate;
+	mSlow = slowWeight * mSlow + ( 1 - slowWeight ) * rate;
+	mSecondsSampled += seconds;
+	mBytesSampled += bytes;
+}
+
+void BandwidthEstimator::reset()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mFast = mSlow = mSecondsSampled = 0;
+	mBytesSampled = 0;
+}
+
+bool BandwidthEstimator::hasEstimate() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mSecondsSampled > 0;
+}
+
+double BandwidthEstimator::getEstimate( double average, double halfLife ) const
+{
+	// the averages start at zero, which weighs on them until enough has been sampled
+	double zeroWeight = std::pow( 0.5, mSecondsSampled / halfLife );
+	return ( zeroWeight < 1 ) ? average / ( 1 - zeroWeight ) : 0;
+}
+
+double BandwidthEstimator::getBandwidth() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	if( mSecondsSampled <= 0 )
+		return 0;
+	return std::min( getEstimate( mFast, mOptions.getFastHalfLife() ), getEstimate( mSlow, mOptions.getSlowHalfLife() ) );
+}
+
+uint64_t BandwidthEstimator::getBytesSampled() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mBytesSampled;
+}
+
+double BandwidthEstimator::getSecondsSampled() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mSecondsSampled;
+}
+
+PlayThroughEstimate BandwidthEstimator::predict( double mediaBitrate, double bufferedSeconds, double remainingSeconds ) const
+{
+	PlayThroughEstimate result;
+	result.mBandwidth = getBandwidth();
+	result.mMediaBitrate = std::max( mediaBitrate, 0.0 );
+	result.mRemainingSeconds = std::max( remainingSeconds, 0.0 );
+	result.mBufferedSeconds = std::min( std::max( bufferedSeconds, 0.0 ), result.mRemainingSeconds );
+
+	double missingSeconds = result.mRemainingSeconds - result.mBufferedSeconds;
+	if( missingSeconds <= 0 ) {
+		result.mValid = result.mStallFree = true;
+		return result;
+	}
+	if( result.mBandwidth <= 0 || result.mMediaBitrate <= 0 )
+		return result;
+
+	// media seconds loaded per second of download
+	double loadRate = result.mBandwidth * mOptions.getSafetyFactor() / result.mMediaBitrate;
+	result.mTimeToLoad = missingSeconds / loadRate;
+	result.mValid = true;
+
+	/* Playback started after a delay w keeps the margin m ahead of it while loading when
+	 *		buffered + loadRate * t - ( t - w ) >= m		for every t between w and the time to load.
+	 * The left side is linear in t, so checking both ends is enough: at the start the buffer has to reach the margin, and
+	 * at the end, when everything has loaded, playback mustn't have come closer to the end than the margin. */
+	double margin = std::min( mOptions.getMinBufferSeconds(), result.mRemainingSeconds );
+	double delay = std::max( ( margin - result.mBufferedSeconds ) / loadRate, result.mTimeToLoad - result.mRemainingSeconds + margin );
+	result.mStartDelay = std::max( delay, 0.0 );
+	result.mStallFree = delay <= 0;
+	return result;
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,232 @@
+#include "AvfByteSource.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+// Keeps the vector passed to MemoryByteSource::create() alive for as long as the source
+struct VectorOwner {
+	explicit VectorOwner( std::vector<uint8_t> &&data ) : mData( std::move( data ) ) {}
+
+	std::vector<uint8_t>	mData;
+};
+
+bool matchesFourCc( const uint8_t *bytes, const char *fourCc )
+{
+	return std::memcmp( bytes, fourCc, 4 ) == 0;
+}
+
+ContainerType containerTypeFromExtension( std::string extension )
+{
+	std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+	if( extension == "mov" || extension == "qt" )
+		return CONTAINER_QUICKTIME;
+	if( extension == "mp4" )
+		return CONTAINER_MPEG4;
+	if( extension == "m4v" )
+		return CONTAINER_M4V;
+	if( extension == "3gp" || extension == "3gpp" )
+		return CONTAINER_3GPP;
+	return CONTAINER_UNKNOWN;
+}
+
+} // anonymous namespace
+
+void ByteSource::setExtensionHint( const std::string &extension )
+{
+	mExtensionHint = ( ! extension.empty() && extension[0] == '.' ) ? extension.substr( 1 ) : extension;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MemoryByteSource
+
+MemoryByteSource::MemoryByteSource( const void *data, size_t size, const std::shared_ptr<const void> &owner )
+	: mData( static_cast<const uint8_t*>( data ) ), mSize( data ? size : 0 ), mOwner( owner )
+{
+}
+
+ByteSourceRef MemoryByteSource::create( const void *data, size_t size, const std::shared_ptr<const void> &owner )
+{
+	return ByteSourceRef( new MemoryByteSource( data, size, owner ) );
+}
+
+ByteSourceRef MemoryByteSource::create( std::vector<uint8_t> &&data )
+{
+	std::shared_ptr<VectorOwner> owner( new VectorOwner( std::move( data ) ) );
+	const std::vector<uint8_t> &bytes = owner->mData;
+	return ByteSourceRef( new MemoryByteSource( bytes.empty() ? NULL : &bytes[0], bytes.size(), owner ) );
+}
+
+size_t MemoryByteSource::read( uint64_t offset, void *dst, size_t size )
+{
+	if( offset >= mSize )
+		return 0;
+	size_t count = static_cast<size_t>( std::min<uint64_t>( size, mSize - offset ) );
+	std::memcpy( dst, mData + offset, count );
+	return count;
+}
+
+const uint8_t* MemoryByteSource::getData( uint64_t offset, size_t size )
+{
+	return ( offset <= mSize && size <= mSize - offset ) ? mData + offset : NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ByteRangeSet
+
+void ByteRangeSet::add( const ByteRange &range )
+{
+	if( range.empty() )
+		return;
+
+	uint64_t start = range.mOffset, end = range.getEnd();
+	// the first range that could touch the new one is the last one starting at or before it
+	std::map<uint64_t, uint64_t>::iterator it = mRanges.upper_bound( start );
+	if( it != mRanges.begin() && std::prev( it )->second >= start )
+		--it;
+	while( it != mRanges.end() && it->first <= end ) {
+		start = std::min( start, it->first );
+		end = std::max( end, it->second );
+		mRanges.erase( it++ );
+	}
+	mRanges[start] = end;
+}
+
+bool ByteRangeSet::contains( const ByteRange &range ) const
+{
+	return range.empty() || getContiguousEnd( range.mOffset ) >= range.getEnd();
+}
+
+std::vector<ByteRange> ByteRangeSet::getMissing( const ByteRange &range ) const
+{
+	std::vector<ByteRange> result;
+	uint64_t position = range.mOffset;
+	std::map<uint64_t, uint64_t>::const_iterator it = mRanges.upper_bound( position );
+	if( it != mRanges.begin() && std::prev( it )->second > position )
+		--it;
+	for( ; it != mRanges.end() && position < range.getEnd(); ++it ) {
+		if( it->first > position )
+			result.push_back( ByteRange( position, std::min( it->first, range.getEnd() ) - position ) );
+		position = std::max( position, it->second );
+	}
+	if( position < range.getEnd() )
+		result.push_back( ByteRange( position, range.getEnd() - position ) );
+	return result;
+}
+
+uint64_t ByteRangeSet::getContiguousEnd( uint64_t offset ) const
+{
+	std::map<uint64_t, uint64_t>::const_iterator it = mRanges.upper_bound( offset );
+	if( it == mRanges.begin() )
+		return offset;
+	--it;
+	return std::max( it->second, offset );
+}
+
+uint64_t ByteRangeSet::getTotalBytes() const
+{
+	uint64_t result = 0;
+	for( std::map<uint64_t, uint64_t>::const_iterator it = mRanges.begin(); it != mRanges.end(); ++it )
+		result += it->second - it->first;
+	return result;
+}
+
+std::vector<ByteRange> ByteRangeSet::getRanges() const
+{
+	std::vector<ByteRange> result;
+	for( std::map<uint64_t, uint64_t>::const_iterator it = mRanges.begin(); it != mRanges.end(); ++it )
+		result.push_back( ByteRange( it->first, it->second - it->first ) );
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Range requests
+
+bool clampByteRange( uint64_t offset, uint64_t length, bool toEnd, uint64_t size, ByteRange *result )
+{
+	if( offset >= size )
+		return false;
+
+	uint64_t available = size - offset;
+	*result = ByteRange( offset, toEnd ? available : std::min( length, available ) );
+	return ! result->empty();
+}
+
+bool serveByteRange( ByteSource &source, const ByteRange &range, size_t chunkSize, const std::function<bool( const uint8_t *data, size_t size )> &respond )
+{
+	if( chunkSize == 0 )
+		chunkSize = 1;
+
+	std::vector<uint8_t> scratch;
+	uint64_t offset = range.mOffset;
+	while( offset < range.getEnd() ) {
+		size_t size = static_cast<size_t>( std::min<uint64_t>( chunkSize, range.getEnd() - offset ) );
+		const uint8_t *data = source.getData( offset, size );
+		if( ! data ) {
+			scratch.resize( size );
+			size = source.read( offset, &scratch[0], size );
+			if( size == 0 )
+				return false;
+			data = &scratch[0];
+		}
+
+		if( ! respond( data, size ) )
+			return false;
+		offset += size;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Container detection
+
+ContainerType detectContainerType( const uint8_t *header, size_t size, const std::string &extensionHint )
+{
+	// ISO base media files open with an ftyp box naming their major brand
+	if( size >= 12 && matchesFourCc( header + 4, "ftyp" ) ) {
+		const uint8_t *brand = header + 8;
+		if( matchesFourCc( brand, "qt  " ) )
+			return CONTAINER_QUICKTIME;
+		if( matchesFourCc( brand, "M4V " ) || matchesFourCc( brand, "M4VH" ) || matchesFourCc( brand, "M4VP" ) )
+			return CONTAINER_M4V;
+		if( std::memcmp( brand, "3gp", 3 ) == 0 || std::memcmp( brand, "3g2", 3 ) == 0 )
+			return CONTAINER_3GPP;
+		return CONTAINER_MPEG4;
+	}
+
+	// older QuickTime files start straight with one of their top level atoms
+	if( size >= 8 ) {
+		static const char *sQuickTimeAtoms[] = { "moov", "mdat", "wide", "free", "skip", "pnot" };
+		for( size_t i = 0; i < sizeof( sQuickTimeAtoms ) / sizeof( sQuickTimeAtoms[0] ); ++i ) {
+			if( matchesFourCc( header + 4, sQuickTimeAtoms[i] ) )
+				return CONTAINER_QUICKTIME;
+		}
+	}
+
+	return containerTypeFromExtension( extensionHint );
+}
+
+ContainerType detectContainerType( ByteSource &source )
+{
+	uint8_t header[12];
+	size_t size = source.read( 0, header, sizeof( header ) );
+	return detectContainerType( header, size, source.getExtensionHint() );
+}
+
+const char* getContainerTypeIdentifier( ContainerType type )
+{
+	switch( type ) {
+		case CONTAINER_QUICKTIME:	return "com.apple.quicktime-movie";
+		case CONTAINER_MPEG4:		return "public.mpeg-4";
+		case CONTAINER_M4V:			return "com.apple.m4v-video";
+		case CONTAINER_3GPP:		return "public.3gpp";
+		default:					return NULL;
+	}
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,487 @@
+#include "AvfClipPack.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cinder { namespace avf {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Pack layout
+//
+// All integers are little-endian.
+//	header		magic "AVFCLIPS", u32 version, u32 clip count, u64 offset of the name table, u64 reserved
+//	index		one 64 byte record per clip, sorted by name:
+//				u64 data offset, u64 data size, u32 name offset, u32 name length,
+//				i64 duration value, i32 duration scale, i64 frame duration value, i32 frame duration scale,
+//				i32 width, i32 height, u32 frame count, u32 flags
+//	names		the names, back to back
+//	data		the clips, each starting on a 64 byte boundary
+
+namespace {
+
+const char		sMagic[8] = { 'A', 'V', 'F', 'C', 'L', 'I', 'P', 'S' };
+const uint32_t	sVersion = 1;
+const size_t	sHeaderSize = 32;
+const size_t	sRecordSize = 64;
+const size_t	sDataAlignment = 64;
+
+enum { FLAG_VIDEO = 1, FLAG_AUDIO = 2 };
+
+void putLe( std::vector<uint8_t> *out, uint64_t value, size_t bytes )
+{
+	for( size_t i = 0; i < bytes; ++i )
+		out->push_back( static_cast<uint8_t>( value >> ( 8 * i ) ) );
+}
+
+uint64_t getLe( const uint8_t *data, size_t bytes )
+{
+	uint64_t result = 0;
+	for( size_t i = 0; i < bytes; ++i )
+		result |= static_cast<uint64_t>( data[i] ) << ( 8 * i );
+	return result;
+}
+
+uint64_t getBe( const uint8_t *data, size_t bytes )
+{
+	uint64_t result = 0;
+	for( size_t i = 0; i < bytes; ++i )
+		result = ( result << 8 ) | data[i];
+	return result;
+}
+
+bool readFile( const std::string &path, std::vector<uint8_t> *result )
+{
+	FILE *file = std::fopen( path.c_str(), "rb" );
+	if( ! file )
+		return false;
+
+	result->clear();
+	uint8_t buffer[64 * 1024];
+	size_t count;
+	while( ( count = std::fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+		result->insert( result->end(), buffer, buffer + count );
+	bool success = ! std::ferror( file );
+	std::fclose( file );
+	return success;
+}
+
+void writeFile( const std::string &path, const uint8_t *data, size_t size )
+{
+	FILE *file = std::fopen( path.c_str(), "wb" );
+	if( ! file )
+		throw ClipPackExc();
+	bool success = ( size == 0 || std::fwrite( data, 1, size, file ) == size );
+	success = ( std::fclose( file ) == 0 ) && success;
+	if( ! success )
+		throw ClipPackExc();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Movie header parsing
+
+struct Atom {
+	const uint8_t	*mBody;
+	uint64_t		mBodySize;
+	char			mType[4];
+};
+
+// Reads the atom at \a data, handling 64-bit and to-the-end sizes. Returns the atom's total size, or 0 when it is malformed.
+uint64_t readAtom( const uint8_t *data, uint64_t available, Atom *atom )
+{
+	if( available < 8 )
+		return 0;
+
+	uint64_t size = getBe( data, 4 ), header = 8;
+	if( size == 1 ) {
+		if( available < 16 )
+			return 0;
+		size = getBe( data + 8, 8 );
+		header = 16;
+	}
+	else if( size == 0 )
+		size = available;
+	if( size < header || size > available )
+		return 0;
+
+	std::memcpy( atom->mType, data + 4, 4 );
+	atom->mBody = data + header;
+	atom->mBodySize = size - header;
+	return size;
+}
+
+bool findChild( const uint8_t *data, uint64_t size, const char *type, Atom *result )
+{
+	Atom atom;
+	for( uint64_t offset = 0, atomSize; ( atomSize = readAtom( data + offset, size - offset, &atom ) ) > 0; offset += atomSize ) {
+		if( std::memcmp( atom.mType, type, 4 ) == 0 ) {
+			*result = atom;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Finds the atom at the end of \a path, such as "mdia/minf/stbl/stts", below \a parent
+bool findPath( const Atom &parent, const char *path, Atom *result )
+{
+	Atom current = parent;
+	for( const char *type = path; ; type += 5 ) {
+		if( ! findChild( current.mBody, current.mBodySize, type, &current ) )
+			return false;
+		if( type[4] != '/' )
+			break;
+	}
+	*result = current;
+	return true;
+}
+
+// Reads the time scale and duration of an mvhd or mdhd atom, which share their leading layout
+bool readTimeHeader( const Atom &atom, MediaTime *duration )
+{
+	if( atom.mBodySize < 4 )
+		return false;
+	const uint8_t *body = atom.mBody;
+	if( body[0] == 1 ) {
+		if( atom.mBodySize < 32 )
+			return false;
+		*duration = MediaTime( static_cast<int64_t>( getBe( body + 24, 8 ) ), static_cast<int32_t>( getBe( body + 20, 4 ) ) );
+	}
+	else {
+		if( atom.mBodySize < 20 )
+			return false;
+		*duration = MediaTime( static_cast<int64_t>( getBe( body + 16, 4 ) ), static_cast<int32_t>( getBe( body + 12, 4 ) ) );
+	}
+	return true;
+}
+
+void readVideoTrack( const Atom &trak, ClipInfo *result )
+{
+	// presentation size in 16.16 fixed point at the end of the track header
+	Atom tkhd;
+	if( findChild( trak.mBody, trak.mBodySize, "tkhd", &tkhd ) && tkhd.mBodySize >= 84 ) {
+		size_t sizeOffset = ( tkhd.mBody[0] == 1 ) ? 88 : 76;
+		if( tkhd.mBodySize >= sizeOffset + 8 ) {
+			result->mWidth = static_cast<int32_t>( getBe( tkhd.mBody + sizeOffset, 4 ) >> 16 );
+			result->mHeight = static_cast<int32_t>( getBe( tkhd.mBody + sizeOffset + 4, 4 ) >> 16 );
+		}
+	}
+
+	Atom mdhd, stts;
+	MediaTime mediaDuration;
+	if( ! findPath( trak, "mdia/mdhd", &mdhd ) || ! readTimeHeader( mdhd, &mediaDuration ) )
+		return;
+	if( ! findPath( trak, "mdia/minf/stbl/stts", &stts ) || stts.mBodySize < 8 )
+		return;
+
+	// the frame duration is the delta shared by the most samples
+	uint64_t entries = std::min<uint64_t>( getBe( stts.mBody + 4, 4 ), ( stts.mBodySize - 8 ) / 8 );
+	uint64_t numFrames = 0, bestCount = 0;
+	for( uint64_t i = 0; i < entries; ++i ) {
+		uint64_t count = getBe( stts.mBody + 8 + i * 8, 4 ), delta = getBe( stts.mBody + 12 + i * 8, 4 );
+		numFrames += count;
+		if( count > bestCount ) {
+			bestCount = count;
+			result->mFrameDuration = MediaTime( static_cast<int64_t>( delta ), mediaDuration.getTimeScale() );
+		}
+	}
+	result->mNumFrames = static_cast<uint32_t>( numFrames );
+}
+
+} // anonymous namespace
+
+bool parseClipInfo( const uint8_t *data, size_t size, ClipInfo *result )
+{
+	Atom moov, mvhd;
+	if( ! findChild( data, size, "moov", &moov ) )
+		return false;
+
+	*result = ClipInfo();
+	if( findChild( moov.mBody, moov.mBodySize, "mvhd", &mvhd ) )
+		readTimeHeader( mvhd, &result->mDuration );
+
+	Atom trak;
+	for( uint64_t offset = 0, atomSize; ( atomSize = readAtom( moov.mBody + offset, moov.mBodySize - offset, &trak ) ) > 0; offset += atomSize ) {
+		Atom hdlr;
+		if( std::memcmp( trak.mType, "trak", 4 ) != 0 || ! findPath( trak, "mdia/hdlr", &hdlr ) || hdlr.mBodySize < 12 )
+			continue;
+
+		const uint8_t *handler = hdlr.mBody + 8;
+		if( std::memcmp( handler, "vide", 4 ) == 0 ) {
+			if( ! result->mHasVideo )
+				readVideoTrack( trak, result );
+			result->mHasVideo = true;
+		}
+		else if( std::memcmp( handler, "soun", 4 ) == 0 )
+			result->mHasAudio = true;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ClipPackWriter
+
+void ClipPackWriter::addFile( const std::string &name, const std::string &path )
+{
+	Clip clip;
+	clip.mName = name;
+	clip.mPath = path;
+	mClips.push_back( clip );
+}
+
+void ClipPackWriter::addData( const std::string &name, const void *data, size_t size )
+{
+	Clip clip;
+	clip.mName = name;
+	clip.mData.assign( static_cast<const uint8_t*>( data ), static_cast<const uint8_t*>( data ) + size );
+	mClips.push_back( clip );
+}
+
+void ClipPackWriter::write( const std::string &path ) const
+{
+	// byte order, as ClipPack searches with memcmp
+	std::map<std::string, const Clip*> sorted;
+	for( std::vector<Clip>::const_iterator it = mClips.begin(); it != mClips.end(); ++it ) {
+		if( ! sorted.insert( std::make_pair( it->mName, &*it ) ).second )
+			throw ClipPackExc();
+	}
+
+	std::vector<uint8_t> names;
+	for( std::map<std::string, const Clip*>::const_iterator it = sorted.begin(); it != sorted.end(); ++it )
+		names.insert( names.end(), it->first.begin(), it->first.end() );
+
+	const uint64_t namesOffset = sHeaderSize + sorted.size() * sRecordSize;
+	uint64_t dataOffset = namesOffset + names.size();
+
+	std::vector<uint8_t> index;
+	index.insert( index.end(), sMagic, sMagic + sizeof( sMagic ) );
+	putLe( &index, sVersion, 4 );
+	putLe( &index, sorted.size(), 4 );
+	putLe( &index, namesOffset, 8 );
+	putLe( &index, 0, 8 );
+
+	FILE *file = std::fopen( path.c_str(), "wb" );
+	if( ! file )
+		throw ClipPackExc();
+
+	// clips are written behind a placeholder for the index, which needs their info and offsets
+	bool success = true;
+	std::vector<uint8_t> padding( static_cast<size_t>( dataOffset ), 0 );
+	success = std::fwrite( &padding[0], 1, padding.size(), file ) == padding.size();
+
+	uint32_t nameOffset = 0;
+	std::vector<uint8_t> fileData;
+	for( std::map<std::string, const Clip*>::const_iterator it = sorted.begin(); success && it != sorted.end(); ++it ) {
+		const Clip &clip = *it->second;
+		const std::vector<uint8_t> *data = &clip.mData;
+		if( ! clip.mPath.empty() ) {
+			if( ! readFile( clip.mPath, &fileData ) ) {
+				success = false;
+				break;
+			}
+			data = &fileData;
+		}
+
+		uint64_t aligned = ( dataOffset + sDataAlignment - 1 ) & ~static_cast<uint64_t>( sDataAlignment - 1 );
+		std::vector<uint8_t> gap( static_cast<size_t>( aligned - dataOffset ), 0 );
+		if( ! gap.empty() )
+			success = std::fwrite( &gap[0], 1, gap.size(), file ) == gap.size();
+		if( success && ! data->empty() )
+			success = std::fwrite( &( *data )[0], 1, data->size(), file ) == data->size();
+
+		ClipInfo info;
+		if( ! data->empty() )
+			parseClipInfo( &( *data )[0], data->size(), &info );
+
+		putLe( &index, aligned, 8 );
+		putLe( &index, data->size(), 8 );
+		putLe( &index, nameOffset, 4 );
+		putLe( &index, it->first.size(), 4 );
+		putLe( &index, static_cast<uint64_t>( info.mDuration.getValue() ), 8 );
+		putLe( &index, static_cast<uint32_t>( info.mDuration.getTimeScale() ), 4 );
+		putLe( &index, static_cast<uint64_t>( info.mFrameDuration.getValue() ), 8 );
+		putLe( &index, static_cast<uint32_t>( info.mFrameDuration.getTimeScale() ), 4 );
+		putLe( &index, static_cast<uint32_t>( info.mWidth ), 4 );
+		putLe( &index, static_cast<uint32_t>( info.mHeight ), 4 );
+		putLe( &index, info.mNumFrames, 4 );
+		putLe( &index, ( info.mHasVideo ? FLAG_VIDEO : 0 ) | ( info.mHasAudio ? FLAG_AUDIO : 0 ), 4 );
+
+		nameOffset += static_cast<uint32_t>( it->first.size() );
+		dataOffset = aligned + data->size();
+	}
+
+	index.insert( index.end(), names.begin(), names.end() );
+	if( success )
+		success = std::fseek( file, 0, SEEK_SET ) == 0 && std::fwrite( &index[0], 1, index.size(), file ) == index.size();
+	success = ( std::fclose( file ) == 0 ) && success;
+	if( ! success ) {
+		std::remove( path.c_str() );
+		throw ClipPackExc();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ClipPack
+
+ClipPack::ClipPack( const std::string &path )
+	: mData( NULL ), mSize( 0 ), mNumClips( 0 ), mNamesOffset( 0 )
+{
+	int fd = ::open( path.c_str(), O_RDONLY );
+	if( fd < 0 )
+		throw ClipPackExc();
+
+	struct stat info;
+	void *base = MAP_FAILED;
+	if( ::fstat( fd, &info ) == 0 && info.st_size >= static_cast<off_t>( sHeaderSize ) )
+		base = ::mmap( NULL, static_cast<size_t>( info.st_size ), PROT_READ, MAP_SHARED, fd, 0 );
+	// the mapping stays valid without the descriptor
+	::close( fd );
+	if( base == MAP_FAILED )
+		throw ClipPackExc();
+
+	mData = static_cast<const uint8_t*>( base );
+	mSize = static_cast<size_t>( info.st_size );
+
+	bool valid = std::memcmp( mData, sMagic, sizeof( sMagic ) ) == 0 && getLe( mData + 8, 4 ) == sVersion;
+	if( valid ) {
+		mNumClips = static_cast<size_t>( getLe( mData + 12, 4 ) );
+		mNamesOffset = getLe( mData + 16, 8 );
+		valid = mNamesOffset == sHeaderSize + static_cast<uint64_t>( mNumClips ) * sRecordSize && mNamesOffset <= mSize;
+	}
+
+	// every record has to point inside the file, so lookups never have to check again, and names have to be strictly
+	// ascending, or the binary search in findClip() could miss a clip or pick either of two with the same name
+	const uint8_t *previousName = NULL;
+	uint64_t previousLength = 0;
+	for( size_t i = 0; valid && i < mNumClips; ++i ) {
+		const uint8_t *record = getRecord( i );
+		uint64_t offset = getLe( record, 8 ), size = getLe( record + 8, 8 );
+		uint64_t nameStart = mNamesOffset + getLe( record + 16, 4 ), nameLength = getLe( record + 20, 4 );
+		valid = offset <= mSize && size <= mSize - offset && nameStart <= mSize && nameLength <= mSize - nameStart;
+		if( valid && previousName ) {
+			int order = std::memcmp( previousName, mData + nameStart, static_cast<size_t>( std::min( previousLength, nameLength ) ) );
+			valid = order < 0 || ( order == 0 && previousLength < nameLength );
+		}
+		previousName = mData + nameStart;
+		previousLength = nameLength;
+	}
+
+	if( ! valid ) {
+		::munmap( const_cast<uint8_t*>( mData ), mSize );
+		throw ClipPackExc();
+	}
+}
+
+ClipPack::~ClipPack()
+{
+	::munmap( const_cast<uint8_t*>( mData ), mSize );
+}
+
+const uint8_t* ClipPack::getRecord( size_t index ) const
+{
+	return mData + sHeaderSize + index * sRecordSize;
+}
+
+std::string ClipPack::getName( size_t index ) const
+{
+	if( index >= mNumClips )
+		return std::string();
+
+	const uint8_t *record = getRecord( index );
+	const char *name = reinterpret_cast<const char*>( mData + mNamesOffset + getLe( record + 16, 4 ) );
+	return std::string( name, static_cast<size_t>( getLe( record + 20, 4 ) ) );
+}
+
+bool ClipPack::findClip( const std::string &name, size_t *index ) const
+{
+	size_t low = 0, high = mNumClips;
+	while( low < high ) {
+		size_t middle = low + ( high - low ) / 2;
+		const uint8_t *record = getRecord( middle );
+		const uint8_t *candidate = mData + mNamesOffset + getLe( record + 16, 4 );
+		size_t length = static_cast<size_t>( getLe( record + 20, 4 ) );
+
+		int order = std::memcmp( candidate, name.data(), std::min( length, name.size() ) );
+		if( order == 0 )
+			order = ( length < name.size() ) ? -1 : ( length > name.size() ) ? 1 : 0;
+		if( order == 0 ) {
+			*index = middle;
+			return true;
+		}
+		if( order < 0 )
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return false;
+}
+
+ClipInfo ClipPack::getInfo( size_t index ) const
+{
+	ClipInfo result;
+	if( index >= mNumClips )
+		return result;
+
+	const uint8_t *record = getRecord( index );
+	result.mDuration = MediaTime( static_cast<int64_t>( getLe( record + 24, 8 ) ), static_cast<int32_t>( getLe( record + 32, 4 ) ) );
+	result.mFrameDuration = MediaTime( static_cast<int64_t>( getLe( record + 36, 8 ) ), static_cast<int32_t>( getLe( record + 44, 4 ) ) );
+	result.mWidth = static_cast<int32_t>( getLe( record + 48, 4 ) );
+	result.mHeight = static_cast<int32_t>( getLe( record + 52, 4 ) );
+	result.mNumFrames = static_cast<uint32_t>( getLe( record + 56, 4 ) );
+	uint32_t flags = static_cast<uint32_t>( getLe( record + 60, 4 ) );
+	result.mHasVideo = ( flags & FLAG_VIDEO ) != 0;
+	result.mHasAudio = ( flags & FLAG_AUDIO ) != 0;
+	return result;
+}
+
+uint64_t ClipPack::getClipSize( size_t index ) const
+{
+	return ( index < mNumClips ) ? getLe( getRecord( index ) + 8, 8 ) : 0;
+}
+
+ByteSourceRef ClipPack::getClip( size_t index )
+{
+	if( index >= mNumClips )
+		return ByteSourceRef();
+
+	const uint8_t *record = getRecord( index );
+	ByteSourceRef result = MemoryByteSource::create( mData + getLe( record, 8 ), static_cast<size_t>( getLe( record + 8, 8 ) ), shared_from_this() );
+	std::string name = getName( index );
+	size_t dot = name.find_last_of( '.' );
+	if( dot != std::string::npos )
+		result->setExtensionHint( name.substr( dot + 1 ) );
+	return result;
+}
+
+ByteSourceRef ClipPack::getClip( const std::string &name )
+{
+	size_t index;
+	return findClip( name, &index ) ? getClip( index ) : ByteSourceRef();
+}
+
+void ClipPack::extract( size_t index, const std::string &path ) const
+{
+	if( index >= mNumClips )
+		throw ClipPackExc();
+
+	const uint8_t *record = getRecord( index );
+	writeFile( path, mData + getLe( record, 8 ), static_cast<size_t>( getLe( record + 8, 8 ) ) );
+}
+
+void ClipPack::extractAll( const std::string &directory ) const
+{
+	for( size_t i = 0; i < mNumClips; ++i ) {
+		std::string name = getName( i );
+		if( name.empty() || name.find( '/' ) != std::string::npos || name == "." || name == ".." )
+			throw ClipPackExc();
+		extract( i, directory.empty() ? name : directory + "/" + name );
+	}
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,151 @@
+#include "AvfFrameTicker.h"
+
+#if defined( CINDER_COCOA )
+	#import <Foundation/Foundation.h>
+	#import <QuartzCore/QuartzCore.h>
+	#if ! defined( CINDER_COCOA_TOUCH )
+		#import <CoreVideo/CVDisplayLink.h>
+	#endif
+#endif
+
+#include <atomic>
+
+#if defined( CINDER_COCOA_TOUCH )
+
+@interface DisplayLinkClockTarget : NSObject {
+	ci::avf::FrameTicker* ticker;
+}
+
+- (id)initWithTicker:(ci::avf::FrameTicker*)aTicker;
+- (void)displayLinkCallback:(CADisplayLink*)sender;
+
+@end
+
+@implementation DisplayLinkClockTarget
+
+- (id)initWithTicker:(ci::avf::FrameTicker*)aTicker
+{
+	self = [super init];
+	self->ticker = aTicker;
+	return self;
+}
+
+- (void)displayLinkCallback:(CADisplayLink*)sender
+{
+	self->ticker->tick([sender timestamp]);
+}
+
+@end
+
+#endif
+
+namespace cinder { namespace avf {
+
+#if defined( CINDER_COCOA_TOUCH )
+
+struct DisplayLinkClock::Impl {
+	Impl() : mLink( nil ) {}
+
+	CADisplayLink*	mLink;
+};
+
+DisplayLinkClock::DisplayLinkClock() : mImpl( new Impl )
+{
+}
+
+DisplayLinkClock::~DisplayLinkClock()
+{
+	stop();
+}
+
+void DisplayLinkClock::start( FrameTicker *ticker )
+{
+	stop();
+
+	// the display link retains its target, and fires on the run loop it is added to
+	DisplayLinkClockTarget* target = [[DisplayLinkClockTarget alloc] initWithTicker:ticker];
+	mImpl->mLink = [[CADisplayLink displayLinkWithTarget:target selector:@selector(displayLinkCallback:)] retain];
+	[target release];
+	[mImpl->mLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+}
+
+void DisplayLinkClock::stop()
+{
+	if (!mImpl->mLink) return;
+
+	[mImpl->mLink invalidate];
+	[mImpl->mLink release];
+	mImpl->mLink = nil;
+}
+
+#elif defined( CINDER_COCOA )
+
+namespace {
+
+// Shared with the blocks in flight on the main queue, which may outlive the clock
+struct DisplayLinkState {
+	DisplayLinkState() : mTicker( NULL ), mPending( false ) {}
+
+	std::atomic<FrameTicker*>	mTicker;
+	std::atomic<bool>			mPending;
+};
+
+} // anonymous namespace
+
+struct DisplayLinkClock::Impl {
+	Impl() : mLink( NULL ), mState( new DisplayLinkState ) {}
+
+	CVDisplayLinkRef					mLink;
+	std::shared_ptr<DisplayLinkState>	mState;
+};
+
+static CVReturn displayLinkCallback( CVDisplayLinkRef displayLink, const CVTimeStamp *now, const CVTimeStamp *outputTime, CVOptionFlags flagsIn, CVOptionFlags *flagsOut, void *context )
+{
+	// runs on the display link's own thread, while movies are updated and drawn on the main thread
+	std::shared_ptr<DisplayLinkState> state = *static_cast<std::shared_ptr<DisplayLinkState>*>( context );
+	if (state->mPending.exchange( true ))
+		return kCVReturnSuccess;
+
+	double time = static_cast<double>( outputTime->hostTime ) / CVGetHostClockFrequency();
+	dispatch_async(dispatch_get_main_queue(), ^{
+		state->mPending = false;
+		if (FrameTicker* ticker = state->mTicker)
+			ticker->tick( time );
+	});
+	return kCVReturnSuccess;
+}
+
+DisplayLinkClock::DisplayLinkClock() : mImpl( new Impl )
+{
+	if (CVDisplayLinkCreateWithActiveCGDisplays( &mImpl->mLink ) != kCVReturnSuccess) {
+		mImpl->mLink = NULL;
+		return;
+	}
+	CVDisplayLinkSetOutputCallback( mImpl->mLink, &displayLinkCallback, &mImpl->mState );
+}
+
+DisplayLinkClock::~DisplayLinkClock()
+{
+	stop();
+	if (mImpl->mLink)
+		CVDisplayLinkRelease( mImpl->mLink );
+}
+
+void DisplayLinkClock::start( FrameTicker *ticker )
+{
+	mImpl->mState->mTicker = ticker;
+	if (mImpl->mLink && !CVDisplayLinkIsRunning( mImpl->mLink ))
+		CVDisplayLinkStart( mImpl->mLink );
+}
+
+void DisplayLinkClock::stop()
+{
+	// a tick already queued on the main queue finds no ticker
+	mImpl->mState->mTicker = NULL;
+	if (mImpl->mLink && CVDisplayLinkIsRunning( mImpl->mLink ))
+		CVDisplayLinkStop( mImpl->mLink );
+}
+
+#endif
+
+} } // namespace cinder::avf
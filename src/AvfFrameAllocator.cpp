@@ -0,0 +1,109 @@
+#include "AvfFrameAllocator.h"
+
+#include <atomic>
+#include <cstdlib>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined( __APPLE__ )
+	#include <mach/vm_statistics.h>
+#endif
+
+namespace cinder { namespace avf {
+
+namespace {
+
+enum { BACKING_HEAP, BACKING_MAPPED };
+
+// Every allocation is preceded by one ALIGNMENT sized header recording how to release it,
+// which keeps the returned pointer aligned and lets free() work without a size
+struct AllocationHeader {
+	void*		mBase;
+	size_t		mMappedSize;
+	int32_t		mBacking;
+};
+
+std::atomic<size_t> sHugePageThreshold( 8 * 1024 * 1024 );
+
+// Maps at least \a size bytes, updating \a size to the length actually mapped
+void* mapFrameMemory( size_t *size )
+{
+	void *base = MAP_FAILED;
+#if defined( __APPLE__ ) && defined( VM_FLAGS_SUPERPAGE_SIZE_2MB )
+	// superpages have to be requested explicitly, in whole 2MB units, and can fail under memory pressure
+	const size_t superPage = 2 * 1024 * 1024;
+	size_t superSize = ( *size + superPage - 1 ) / superPage * superPage;
+	base = ::mmap( NULL, superSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, VM_FLAGS_SUPERPAGE_SIZE_2MB, 0 );
+	if( base != MAP_FAILED )
+		*size = superSize;
+#endif
+	if( base == MAP_FAILED )
+		base = ::mmap( NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0 );
+#if defined( MADV_HUGEPAGE )
+	if( base != MAP_FAILED )
+		::madvise( base, *size, MADV_HUGEPAGE );
+#endif
+	return ( base == MAP_FAILED )? NULL: base;
+}
+
+} // anonymous namespace
+
+const size_t FrameAllocator::ALIGNMENT;
+
+size_t FrameAllocator::getRowBytes( int32_t width, int32_t pixelInc )
+{
+	return alignSize( static_cast<size_t>( width ) * pixelInc );
+}
+
+void* FrameAllocator::allocate( size_t size )
+{
+	static_assert( sizeof( AllocationHeader ) <= ALIGNMENT, "allocation header must fit in the alignment padding" );
+
+	const size_t total = alignSize( size ) + ALIGNMENT;
+	const size_t threshold = sHugePageThreshold;
+
+	AllocationHeader header;
+	if( threshold > 0 && size >= threshold ) {
+		const size_t page = static_cast<size_t>( ::sysconf( _SC_PAGESIZE ) );
+		header.mMappedSize = ( total + page - 1 ) / page * page;
+		header.mBase = mapFrameMemory( &header.mMappedSize );
+		header.mBacking = BACKING_MAPPED;
+	}
+	else {
+		header.mMappedSize = 0;
+		if( ::posix_memalign( &header.mBase, ALIGNMENT, total ) != 0 )
+			header.mBase = NULL;
+		header.mBacking = BACKING_HEAP;
+	}
+
+	if( ! header.mBase )
+		return NULL;
+
+	*reinterpret_cast<AllocationHeader*>( header.mBase ) = header;
+	return static_cast<uint8_t*>( header.mBase ) + ALIGNMENT;
+}
+
+void FrameAllocator::free( void *data )
+{
+	if( ! data )
+		return;
+
+	const AllocationHeader header = *reinterpret_cast<AllocationHeader*>( static_cast<uint8_t*>( data ) - ALIGNMENT );
+	if( header.mBacking == BACKING_MAPPED )
+		::munmap( header.mBase, header.mMappedSize );
+	else
+		std::free( header.mBase );
+}
+
+size_t FrameAllocator::getHugePageThreshold()
+{
+	return sHugePageThreshold;
+}
+
+void FrameAllocator::setHugePageThreshold( size_t bytes )
+{
+	sHugePageThreshold = bytes;
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,126 @@
+#include "AvfFrameIndex.h"
+
+#include <algorithm>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+bool framePrecedes( const FrameIndex::Frame &lhs, const FrameIndex::Frame &rhs )
+{
+	return lhs.mTime < rhs.mTime;
+}
+
+bool frameStartsAfter( const MediaTime &time, const FrameIndex::Frame &frame )
+{
+	return time < frame.mTime;
+}
+
+} // anonymous namespace
+
+void FrameIndex::addFrame( const MediaTime &time, const MediaTime &duration, const MediaTime &decodeTime, bool keyFrame )
+{
+	mFrames.push_back( Frame( time, duration, decodeTime, keyFrame ) );
+}
+
+void FrameIndex::finalize()
+{
+	std::stable_sort( mFrames.begin(), mFrames.end(), framePrecedes );
+
+	mKeyFrames.clear();
+	if( mFrames.empty() )
+		return;
+
+	mFrames.front().mKeyFrame = true;
+	for( size_t i = 0; i < mFrames.size(); ++i ) {
+		if( mFrames[i].mKeyFrame )
+			mKeyFrames.push_back( i );
+	}
+}
+
+void FrameIndex::clear()
+{
+	mFrames.clear();
+	mKeyFrames.clear();
+	mSceneCuts.clear();
+}
+
+void FrameIndex::addSceneCut( size_t index )
+{
+	std::vector<size_t>::iterator it = std::lower_bound( mSceneCuts.begin(), mSceneCuts.end(), index );
+	if( index > 0 && ( it == mSceneCuts.end() || *it != index ) )
+		mSceneCuts.insert( it, index );
+}
+
+void FrameIndex::clearSceneCuts()
+{
+	mSceneCuts.clear();
+}
+
+size_t FrameIndex::getSceneStart( size_t index ) const
+{
+	std::vector<size_t>::const_iterator it = std::upper_bound( mSceneCuts.begin(), mSceneCuts.end(), index );
+	return ( it == mSceneCuts.begin() ) ? 0 : *( it - 1 );
+}
+
+size_t FrameIndex::getNextSceneStart( size_t index ) const
+{
+	std::vector<size_t>::const_iterator it = std::upper_bound( mSceneCuts.begin(), mSceneCuts.end(), index );
+	return ( it == mSceneCuts.end() ) ? mFrames.size() : *it;
+}
+
+MediaTime FrameIndex::getEndTime() const
+{
+	if( mFrames.empty() )
+		return MediaTime::zero();
+	return mFrames.back().mTime + mFrames.back().mDuration;
+}
+
+FrameInfo FrameIndex::getFrameInfo( size_t index ) const
+{
+	FrameInfo result;
+	if( index >= mFrames.size() )
+		return result;
+
+	const Frame &frame = mFrames[index];
+	result.mTime = frame.mTime;
+	result.mDuration = frame.mDuration;
+	result.mDecodeTime = frame.mDecodeTime;
+	result.mFrameIndex = static_cast<int64_t>( index );
+	result.mKeyFrame = frame.mKeyFrame;
+	return result;
+}
+
+bool FrameIndex::findFrame( const MediaTime &time, size_t *index ) const
+{
+	std::vector<Frame>::const_iterator it = std::upper_bound( mFrames.begin(), mFrames.end(), time, frameStartsAfter );
+	if( it == mFrames.begin() )
+		return false;
+	*index = static_cast<size_t>( it - mFrames.begin() ) - 1;
+	return true;
+}
+
+size_t FrameIndex::getKeyFrameBefore( size_t index ) const
+{
+	std::vector<size_t>::const_iterator it = std::upper_bound( mKeyFrames.begin(), mKeyFrames.end(), index );
+	return ( it == mKeyFrames.begin() ) ? 0 : *( it - 1 );
+}
+
+size_t FrameIndex::getKeyFrameAfter( size_t index ) const
+{
+	std::vector<size_t>::const_iterator it = std::upper_bound( mKeyFrames.begin(), mKeyFrames.end(), index );
+	return ( it == mKeyFrames.end() ) ? mFrames.size() : *it;
+}
+
+FrameIndex::Span FrameIndex::getReverseSpan( size_t frame, size_t maxFrames ) const
+{
+	if( frame >= mFrames.size() || maxFrames == 0 )
+		return Span();
+
+	const size_t keyFrame = getKeyFrameBefore( frame );
+	const size_t end = frame + 1;
+	const size_t first = ( end - keyFrame > maxFrames ) ? end - maxFrames : keyFrame;
+	return Span( keyFrame, first, end );
+}
+
+} } // namespace cinder::avf
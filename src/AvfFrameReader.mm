@@ -0,0 +1,221 @@
+#include "AvfFrameReader.h"
+#include "AvfUtils.h"
+
+#if defined( CINDER_COCOA )
+	#import <AVFoundation/AVFoundation.h>
+	#include <CoreVideo/CoreVideo.h>
+#endif
+
+#include <cmath>
+
+namespace cinder { namespace avf {
+
+FrameReader::FrameReader( const fs::path &path, size_t videoTrack, size_t cacheFrames )
+	: mAsset( nil ), mTrack( nil ), mWidth( 0 ), mHeight( 0 ), mReader( nil ), mReaderOutput( nil ), mRing( cacheFrames ), mNumSceneCompared( 0 )
+{
+	NSURL* asset_url = [NSURL fileURLWithPath:[NSString stringWithCString:path.c_str() encoding:[NSString defaultCStringEncoding]]];
+	if (!asset_url)
+		throw AvfPathInvalidExc();
+
+	NSDictionary* asset_options = @{(id)AVURLAssetPreferPreciseDurationAndTimingKey: @(YES)};
+	AVURLAsset* asset = [[AVURLAsset alloc] initWithURL:asset_url options:asset_options];
+
+	NSArray* video_tracks = [asset tracksWithMediaType:AVMediaTypeVideo];
+	if (videoTrack >= [video_tracks count]) {
+		[asset release];
+		throw AvfFileInvalidExc();
+	}
+
+	// open() takes its own reference
+	AVAssetTrack* track = [video_tracks objectAtIndex:videoTrack];
+	try {
+		open( asset, track );
+	}
+	catch (...) {
+		[asset release];
+		throw;
+	}
+	[asset release];
+}
+
+FrameReader::FrameReader( AVAsset *asset, AVAssetTrack *track, size_t cacheFrames )
+	: mAsset( nil ), mTrack( nil ), mWidth( 0 ), mHeight( 0 ), mReader( nil ), mReaderOutput( nil ), mRing( cacheFrames ), mNumSceneCompared( 0 )
+{
+	if (!asset || !track)
+		throw AvfFileInvalidExc();
+
+	open( asset, track );
+}
+
+FrameReader::~FrameReader()
+{
+	stopStream();
+	mRing.clear();
+
+	[mTrack release];
+	[mAsset release];
+}
+
+void FrameReader::open( AVAsset *asset, AVAssetTrack *track )
+{
+	CGSize size = CGSizeApplyAffineTransform([track naturalSize], [track preferredTransform]);
+	mWidth = static_cast<int32_t>(std::abs(size.width));
+	mHeight = static_cast<int32_t>(std::abs(size.height));
+
+	if (!scanFrameIndex(asset, track, &mFrameIndex) || mFrameIndex.empty())
+		throw AvfErrorLoadingExc();
+
+	mAsset = [asset retain];
+	mTrack = [track retain];
+}
+
+Surface8u FrameReader::getFrameAt( const MediaTime &time, FrameInfo *info )
+{
+	size_t index;
+	if (!time.isValid() || time >= mFrameIndex.getEndTime() || !mFrameIndex.findFrame( time, &index ))
+		return Surface8u();
+
+	return getFrame( index, info );
+}
+
+Surface8u FrameReader::getFrame( size_t index, FrameInfo *info )
+{
+	Surface8u result;
+	if (index >= mFrameIndex.getNumFrames() || !decodeFrame( index, &result ))
+		return Surface8u();
+
+	if (info)
+		*info = mFrameIndex.getFrameInfo( index );
+	return result;
+}
+
+// Returns \a frame from the ring, reading the stream forward to it when it is ahead of the ring
+bool FrameReader::decodeFrame( size_t frame, Surface8u *result )
+{
+	if (const Surface8u *cached = mRing.find( frame )) {
+		*result = *cached;
+		return true;
+	}
+
+	// behind the ring needs a seek, and so does a target whose key frame lies past the frame the stream decodes next
+	bool restart = !mReader || mRing.empty() || frame < mRing.getOldestIndex()
+					|| mFrameIndex.getKeyFrameBefore( frame ) > mRing.getNewestIndex() + 1;
+	if (restart && !restartStream( frame ))
+		return false;
+
+	size_t found;
+	if (!mRing.empty() && frame < mRing.getNewestIndex()) {
+		// already read past it: the decoder skipped the frame, so the one before it stays on screen
+		*result = *mRing.findAtOrBefore( frame, &found );
+		return true;
+	}
+
+	@autoreleasepool {
+		while (true) {
+			CMSampleBufferRef sample = [mReaderOutput copyNextSampleBuffer];
+			if (!sample) {
+				stopStream();
+				break;
+			}
+
+			size_t index;
+			CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer( sample );
+			bool reached = false;
+			if (imageBuffer && mFrameIndex.findFrame( toMediaTime( CMSampleBufferGetPresentationTimeStamp( sample ) ), &index )) {
+				// the Surface releases the buffer it wraps, while the sample buffer keeps its own reference
+				::CVPixelBufferRetain( imageBuffer );
+				Surface8u surface = convertCvPixelBufferToSurface( imageBuffer );
+				if (mSceneDetector)
+					detectScene( index, surface );
+				mRing.push( index, surface );
+				reached = ( index >= frame );
+			}
+			CFRelease( sample );
+
+			if (reached)
+				break;
+		}
+	}
+
+	// a frame the decoder skipped falls back to the closest one before it
+	const Surface8u *decoded = mRing.empty()? NULL: mRing.findAtOrBefore( frame, &found );
+	if (!decoded)
+		return false;
+	*result = *decoded;
+	return true;
+}
+
+bool FrameReader::restartStream( size_t frame )
+{
+	stopStream();
+	mRing.clear();
+	// the first frame of the new stream doesn't follow the last one decoded
+	if (mSceneDetector)
+		mSceneDetector->restart();
+
+	mReader = createFrameReader( mAsset, mTrack, mFrameIndex.getFrame( frame ).mTime, MediaTime(), &mReaderOutput );
+	return mReader != nil;
+}
+
+void FrameReader::enableSceneDetection( const SceneDetector::Options &options )
+{
+	mSceneDetector.reset( new SceneDetector( options ) );
+	mSceneCompared.assign( mFrameIndex.getNumFrames(), false );
+	mNumSceneCompared = 0;
+	mFrameIndex.clearSceneCuts();
+}
+
+void FrameReader::disableSceneDetection()
+{
+	mSceneDetector.reset();
+}
+
+bool FrameReader::isSceneDetectionComplete() const
+{
+	// the first frame has nothing before it to be compared with, and the last nothing after it to be decided on
+	return mSceneDetector && mNumSceneCompared + 2 >= mFrameIndex.getNumFrames();
+}
+
+bool FrameReader::detectSceneCuts( const SceneDetector::Options &options )
+{
+	if (!mSceneDetector)
+		enableSceneDetection( options );
+
+	for (size_t frame = 1; frame + 1 < mFrameIndex.getNumFrames() && !isSceneDetectionComplete(); ++frame) {
+		if (mSceneCompared[frame])
+			continue;
+		// the frames either side have to come out of the same stream, which an empty ring makes decodeFrame() restart
+		mRing.clear();
+		for (size_t next = frame - 1; next < mFrameIndex.getNumFrames() && (next <= frame || !mSceneCompared[next - 1]); ++next) {
+			Surface8u surface;
+			if (!decodeFrame( next, &surface ))
+				return false;
+		}
+	}
+	return true;
+}
+
+void FrameReader::detectScene( size_t frame, const Surface8u &surface )
+{
+	size_t compared = mSceneDetector->getNumCompared();
+	if (mSceneDetector->addFrame( frame, mFrameIndex.getFrame( frame ).mTime, surface.getData(), surface.getWidth(), surface.getHeight(), surface.getRowBytes(),
+								  surface.getPixelInc(), surface.getRedOffset(), surface.getGreenOffset(), surface.getBlueOffset() ))
+		mFrameIndex.addSceneCut( mSceneDetector->getCuts().back().mFrameIndex );
+	// the detector decides on a frame once it has the one after it
+	if (mSceneDetector->getNumCompared() > compared && !mSceneCompared[frame - 1]) {
+		mSceneCompared[frame - 1] = true;
+		++mNumSceneCompared;
+	}
+}
+
+void FrameReader::stopStream()
+{
+	if (mReader)
+		[mReader cancelReading];
+	[mReaderOutput release];
+	[mReader release];
+	mReaderOutput = nil;
+	mReader = nil;
+}
+
+} } // namespace cinder::avf
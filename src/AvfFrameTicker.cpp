@@ -0,0 +1,246 @@
+#include "AvfFrameTicker.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+std::mutex						sSharedMutex;
+std::unique_ptr<FrameTicker>	sSharedTicker;
+
+} // anonymous namespace
+
+FrameTicker::FrameTicker( std::unique_ptr<Clock> clock )
+	: mClock( std::move( clock ) ), mNumActive( 0 ), mTicking( false ), mNeedsCompact( false ), mNumTicks( 0 ), mLastTickTime( -1 )
+{
+}
+
+FrameTicker::~FrameTicker()
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	if( mClock && mNumActive > 0 )
+		mClock->stop();
+}
+
+FrameTicker& FrameTicker::getShared()
+{
+	std::lock_guard<std::mutex> lock( sSharedMutex );
+	if( ! sSharedTicker )
+		sSharedTicker.reset( new FrameTicker );
+	return *sSharedTicker;
+}
+
+bool FrameTicker::hasClock() const
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	return mClock != NULL;
+}
+
+void FrameTicker::setClock( std::unique_ptr<Clock> clock )
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	if( mClock && mNumActive > 0 )
+		mClock->stop();
+	mClock = std::move( clock );
+	if( mClock && mNumActive > 0 )
+		mClock->start( this );
+}
+
+void FrameTicker::add( void *target, TickFn fn, bool active )
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	if( Target *entry = find( target ) ) {
+		entry->mFn = fn;
+		activate( entry, active );
+		return;
+	}
+
+	Target entry = { target, fn, false };
+	mTargets.push_back( entry );
+	activate( &mTargets.back(), active );
+}
+
+void FrameTicker::remove( void *target )
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	Target *entry = find( target );
+	if( ! entry )
+		return;
+
+	activate( entry, false );
+	// a tick in progress on this thread still walks the array, so the slot is only cleared until it finishes
+	if( mTicking ) {
+		entry->mTarget = NULL;
+		mNeedsCompact = true;
+	}
+	else
+		mTargets.erase( mTargets.begin() + ( entry - &mTargets[0] ) );
+}
+
+bool FrameTicker::contains( void *target ) const
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	return const_cast<FrameTicker*>( this )->find( target ) != NULL;
+}
+
+void FrameTicker::setActive( void *target, bool active )
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	if( Target *entry = find( target ) )
+		activate( entry, active );
+}
+
+bool FrameTicker::isActive( void *target ) const
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	const Target *entry = const_cast<FrameTicker*>( this )->find( target );
+	return entry && entry->mActive;
+}
+
+size_t FrameTicker::getNumTargets() const
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	size_t result = 0;
+	for( std::vector<Target>::const_iterator it = mTargets.begin(); it != mTargets.end(); ++it ) {
+		if( it->mTarget )
+			++result;
+	}
+	return result;
+}
+
+size_t FrameTicker::getNumActiveTargets() const
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	return mNumActive;
+}
+
+void FrameTicker::tick( double time )
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	// a target ticking the clock from its own call would walk the array twice
+	if( mTicking )
+		return;
+
+	mTicking = true;
+	++mNumTicks;
+	mLastTickTime = time;
+	// indexed, since targets added from within a call grow the array; those first run on the next tick
+	const size_t count = mTargets.size();
+	for( size_t i = 0; i < count; ++i ) {
+		const Target entry = mTargets[i];
+		if( ! entry.mActive )
+			continue;
+		if( ! entry.mFn( entry.mTarget, time ) && mTargets[i].mTarget == entry.mTarget )
+			activate( &mTargets[i], false );
+	}
+	mTicking = false;
+
+	if( mNeedsCompact )
+		compact();
+}
+
+uint64_t FrameTicker::getNumTicks() const
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	return mNumTicks;
+}
+
+double FrameTicker::getLastTickTime() const
+{
+	std::lock_guard<std::recursive_mutex> lock( mMutex );
+	return mLastTickTime;
+}
+
+FrameTicker::Target* FrameTicker::find( void *target )
+{
+	if( ! target )
+		return NULL;
+	for( std::vector<Target>::iterator it = mTargets.begin(); it != mTargets.end(); ++it ) {
+		if( it->mTarget == target )
+			return &*it;
+	}
+	return NULL;
+}
+
+// the clock runs exactly while some target is active
+void FrameTicker::activate( Target *entry, bool active )
+{
+	if( entry->mActive == active )
+		return;
+
+	entry->mActive = active;
+	if( active ) {
+		if( mNumActive++ == 0 && mClock )
+			mClock->start( this );
+	}
+	else {
+		if( --mNumActive == 0 && mClock )
+			mClock->stop();
+	}
+}
+
+void FrameTicker::compact()
+{
+	mTargets.erase( std::remove_if( mTargets.begin(), mTargets.end(), []( const Target &entry ) { return entry.mTarget == NULL; } ), mTargets.end() );
+	mNeedsCompact = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ManualClock
+
+ManualClock::ManualClock( double interval )
+	: mTicker( NULL ), mInterval( interval > 0 ? interval : 1.0 / 60.0 ), mTime( 0 ), mNextTick( 0 )
+{
+}
+
+void ManualClock::start( FrameTicker *ticker )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mTicker = ticker;
+	// ticks already passed while stopped are not delivered late
+	mNextTick = static_cast<uint64_t>( std::ceil( mTime / mInterval - 1e-6 ) );
+}
+
+void ManualClock::stop()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mTicker = NULL;
+}
+
+bool ManualClock::isRunning() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mTicker != NULL;
+}
+
+double ManualClock::getTime() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mTime;
+}
+
+size_t ManualClock::advance( double seconds )
+{
+	size_t result = 0;
+	std::unique_lock<std::mutex> lock( mMutex );
+	mTime += std::max( seconds, 0.0 );
+	while( mTicker ) {
+		// with some slack, so advancing by the interval always reaches the next tick despite rounding
+		double tickTime = mNextTick * mInterval;
+		if( tickTime > mTime + mInterval * 1e-6 )
+			break;
+		++mNextTick;
+
+		// the ticker may stop this clock from within the tick
+		FrameTicker *ticker = mTicker;
+		lock.unlock();
+		ticker->tick( tickTime );
+		++result;
+		lock.lock();
+	}
+	return result;
+}
+
+} } // namespace cinder::avf
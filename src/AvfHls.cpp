@@ -0,0 +1,558 @@
+#include "AvfHls.h"
+#include "AvfHttpClient.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+//! Playlists larger than this are taken for something else
+const size_t	sMaxPlaylistSize = 4 * 1024 * 1024;
+
+//! Prefetchers alive, each with its thread, and how many may be
+std::mutex		sPrefetchersMutex;
+size_t			sNumPrefetchers = 0, sMaxPrefetchers = 8;
+
+std::string trim( const std::string &text )
+{
+	size_t start = text.find_first_not_of( " \t\r" ), end = text.find_last_not_of( " \t\r" );
+	return ( start == std::string::npos ) ? std::string() : text.substr( start, end - start + 1 );
+}
+
+// Splits an attribute list such as BANDWIDTH=800000,CODECS="avc1.4d401f,mp4a.40.2" into its values, unquoted
+std::map<std::string, std::string> parseAttributes( const std::string &list )
+{
+	std::map<std::string, std::string> result;
+	size_t position = 0;
+	while( position < list.size() ) {
+		size_t equals = list.find( '=', position );
+		if( equals == std::string::npos )
+			break;
+		std::string name = trim( list.substr( position, equals - position ) ), value;
+		if( equals + 1 < list.size() && list[equals + 1] == '"' ) {
+			size_t close = list.find( '"', equals + 2 );
+			if( close == std::string::npos )
+				close = list.size();
+			value = list.substr( equals + 2, close - equals - 2 );
+			position = list.find( ',', close );
+		}
+		else {
+			position = list.find( ',', equals );
+			value = trim( list.substr( equals + 1, position - equals - 1 ) );
+		}
+		result[name] = value;
+		position = ( position == std::string::npos ) ? list.size() : position + 1;
+	}
+	return result;
+}
+
+// Parses "length[@offset]", continuing from \a previousEnd when the offset is left out
+ByteRange parseByteRange( const std::string &text, uint64_t previousEnd )
+{
+	size_t at = text.find( '@' );
+	uint64_t length = std::strtoull( text.c_str(), NULL, 10 );
+	uint64_t offset = ( at == std::string::npos ) ? previousEnd : std::strtoull( text.c_str() + at + 1, NULL, 10 );
+	return ByteRange( offset, length );
+}
+
+// Resolves the "." and ".." segments of \a path, leaving its query alone
+std::string removeDotSegments( const std::string &path )
+{
+	size_t queryStart = path.find_first_of( "?#" );
+	std::string query = ( queryStart == std::string::npos ) ? std::string() : path.substr( queryStart );
+	std::vector<std::string> segments;
+	std::istringstream stream( path.substr( 0, queryStart ) );
+	std::string segment;
+	bool directory = false;
+	while( std::getline( stream, segment, '/' ) ) {
+		directory = ( segment == "." || segment == ".." );
+		if( segment == ".." ) {
+			if( ! segments.empty() )
+				segments.pop_back();
+		}
+		else if( segment != "." && ! segment.empty() )
+			segments.push_back( segment );
+	}
+	std::string result;
+	for( std::vector<std::string>::const_iterator it = segments.begin(); it != segments.end(); ++it )
+		result += "/" + *it;
+	if( result.empty() || directory || path[path.size() - query.size() - 1] == '/' )
+		result += "/";
+	return result + query;
+}
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Playlists
+
+double HlsPlaylist::getDuration() const
+{
+	double result = 0;
+	for( std::vector<HlsSegment>::const_iterator it = mSegments.begin(); it != mSegments.end(); ++it )
+		result += it->mDuration;
+	return result;
+}
+
+size_t HlsPlaylist::findSegment( double seconds ) const
+{
+	double start = 0;
+	for( size_t i = 0; i < mSegments.size(); ++i ) {
+		start += mSegments[i].mDuration;
+		if( seconds < start )
+			return i;
+	}
+	return mSegments.empty() ? 0 : mSegments.size() - 1;
+}
+
+std::string resolveHlsUrl( const std::string &base, const std::string &reference )
+{
+	size_t scheme = reference.find( "://" );
+	if( scheme != std::string::npos && reference.find_first_of( "/?#" ) > scheme )
+		return reference;
+
+	size_t baseScheme = base.find( "://" );
+	if( baseScheme == std::string::npos )
+		return reference;
+	if( reference.compare( 0, 2, "//" ) == 0 )
+		return base.substr( 0, baseScheme + 1 ) + reference;
+
+	size_t authorityEnd = base.find_first_of( "/?#", baseScheme + 3 );
+	std::string origin = base.substr( 0, authorityEnd );
+	std::string path = ( authorityEnd == std::string::npos || base[authorityEnd] != '/' ) ? "/" : base.substr( authorityEnd, base.find_first_of( "?#", authorityEnd ) - authorityEnd );
+	if( reference.empty() )
+		return base;
+	if( reference[0] == '/' )
+		return origin + removeDotSegments( reference );
+	if( reference[0] == '?' )
+		return origin + path + reference;
+	return origin + removeDotSegments( path.substr( 0, path.rfind( '/' ) + 1 ) + reference );
+}
+
+bool parseHlsPlaylist( const std::string &text, const std::string &url, HlsPlaylist *result )
+{
+	*result = HlsPlaylist();
+	std::istringstream stream( text );
+	std::string line;
+	std::getline( stream, line );
+	// a byte order mark may come first
+	if( line.compare( 0, 3, "\xEF\xBB\xBF" ) == 0 )
+		line.erase( 0, 3 );
+	if( trim( line ) != "#EXTM3U" )
+		return false;
+
+	HlsSegment segment;
+	HlsVariant variant;
+	bool segmentPending = false, variantPending = false, encrypted = false;
+	uint64_t sequence = 0, byteRangeEnd = 0;
+	std::vector<HlsSegment> segments;
+	while( std::getline( stream, line ) ) {
+		line = trim( line );
+		if( line.empty() )
+			continue;
+
+		if( line[0] != '#' ) {
+			if( variantPending ) {
+				variant.mUrl = resolveHlsUrl( url, line );
+				result->mVariants.push_back( variant );
+				variant = HlsVariant();
+				variantPending = false;
+			}
+			else if( segmentPending ) {
+				segment.mUrl = resolveHlsUrl( url, line );
+				segment.mEncrypted = encrypted;
+				segments.push_back( segment );
+				segment = HlsSegment();
+				segmentPending = false;
+			}
+			continue;
+		}
+
+		size_t colon = line.find( ':' );
+		std::string tag = line.substr( 0, colon ), value = ( colon == std::string::npos ) ? std::string() : line.substr( colon + 1 );
+		if( tag == "#EXT-X-STREAM-INF" ) {
+			std::map<std::string, std::string> attributes = parseAttributes( value );
+			variant.mBandwidth = std::strtoull( attributes["BANDWIDTH"].c_str(), NULL, 10 );
+			variant.mAverageBandwidth = std::strtoull( attributes["AVERAGE-BANDWIDTH"].c_str(), NULL, 10 );
+			variant.mCodecs = attributes["CODECS"];
+			variant.mFrameRate = std::atof( attributes["FRAME-RATE"].c_str() );
+			int width = 0, height = 0;
+			if( std::sscanf( attributes["RESOLUTION"].c_str(), "%dx%d", &width, &height ) == 2 ) {
+				variant.mWidth = width;
+				variant.mHeight = height;
+			}
+			variantPending = true;
+		}
+		else if( tag == "#EXTINF" ) {
+			segment.mDuration = std::atof( value.c_str() );
+			segmentPending = true;
+		}
+		else if( tag == "#EXT-X-BYTERANGE" ) {
+			segment.mByteRange = parseByteRange( value, byteRangeEnd );
+			byteRangeEnd = segment.mByteRange.getEnd();
+		}
+		else if( tag == "#EXT-X-DISCONTINUITY" )
+			segment.mDiscontinuity = true;
+		else if( tag == "#EXT-X-KEY" ) {
+			std::map<std::string, std::string> attributes = parseAttributes( value );
+			encrypted = ! attributes["METHOD"].empty() && attributes["METHOD"] != "NONE";
+		}
+		else if( tag == "#EXT-X-MAP" ) {
+			std::map<std::string, std::string> attributes = parseAttributes( value );
+			result->mInitUrl = attributes["URI"].empty() ? std::string() : resolveHlsUrl( url, attributes["URI"] );
+			result->mInitByteRange = attributes["BYTERANGE"].empty() ? ByteRange() : parseByteRange( attributes["BYTERANGE"], 0 );
+		}
+		else if( tag == "#EXT-X-TARGETDURATION" )
+			result->mTargetDuration = std::atof( value.c_str() );
+		else if( tag == "#EXT-X-MEDIA-SEQUENCE" )
+			sequence = result->mMediaSequence = std::strtoull( value.c_str(), NULL, 10 );
+		else if( tag == "#EXT-X-ENDLIST" )
+			result->mEndList = true;
+	}
+
+	// the media sequence tag may follow the first segments, so numbering waits until the end
+	for( size_t i = 0; i < segments.size(); ++i )
+		segments[i].mSequence = sequence + i;
+	result->mSegments.swap( segments );
+	return true;
+}
+
+size_t selectHlsVariant( const std::vector<HlsVariant> &variants, double bytesPerSecond )
+{
+	size_t best = 0, lowest = 0;
+	double bestRate = -1, lowestRate = -1;
+	for( size_t i = 0; i < variants.size(); ++i ) {
+		double rate = ( variants[i].mAverageBandwidth > 0 ? variants[i].mAverageBandwidth : variants[i].mBandwidth ) / 8.0;
+		if( lowestRate < 0 || rate < lowestRate ) {
+			lowest = i;
+			lowestRate = rate;
+		}
+		if( rate <= bytesPerSecond && rate > bestRate ) {
+			best = i;
+			bestRate = rate;
+		}
+	}
+	return ( bestRate < 0 ) ? lowest : best;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// HlsPrefetcher
+
+HlsPrefetcher::Options::Options()
+	: mSegmentsAhead( 3 ), mInitialBandwidth( 0 ), mSafetyFactor( 0.8 )
+{
+}
+
+HlsPrefetcher::HlsPrefetcher( const std::string &url, const HttpCacheRef &cache, const Options &options )
+	: mUrl( url ), mCache( cache ), mOptions( options ), mVariantIndex( 0 ), mVariantLocked( false ), mPlaylistVariant( 0 ), mReady( false ),
+	mFailed( false ), mStopping( false ), mSequence( 0 ), mPendingPosition( -1 ), mSequenceSet( false ), mGeneration( 0 )
+{
+	HttpUrl parsed;
+	if( ! cache || ! parseHttpUrl( url, &parsed ) )
+		throw HlsExc();
+
+	std::lock_guard<std::mutex> lock( sPrefetchersMutex );
+	if( sNumPrefetchers >= sMaxPrefetchers )
+		throw HlsExc();
+	mThread = std::thread( &HlsPrefetcher::run, this );
+	++sNumPrefetchers;
+}
+
+HlsPrefetcher::~HlsPrefetcher()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mStopping = true;
+	}
+	mCond.notify_all();
+	mThread.join();
+
+	std::lock_guard<std::mutex> lock( sPrefetchersMutex );
+	--sNumPrefetchers;
+}
+
+size_t HlsPrefetcher::getMaxPrefetchers()
+{
+	std::lock_guard<std::mutex> lock( sPrefetchersMutex );
+	return sMaxPrefetchers;
+}
+
+void HlsPrefetcher::setMaxPrefetchers( size_t count )
+{
+	std::lock_guard<std::mutex> lock( sPrefetchersMutex );
+	sMaxPrefetchers = count;
+}
+
+bool HlsPrefetcher::isReady() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mReady;
+}
+
+bool HlsPrefetcher::hasFailed() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mFailed;
+}
+
+bool HlsPrefetcher::waitForSegments( double timeoutSeconds ) const
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+		+ std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>( timeoutSeconds ) );
+	std::unique_lock<std::mutex> lock( mMutex );
+	while( true ) {
+		if( mFailed )
+			return false;
+		// segments of the variant being left don't count
+		if( mReady && mPlaylistVariant == mVariantIndex ) {
+			std::vector<HlsSegment> window = getWindow();
+			size_t cached = 0;
+			while( cached < window.size() && isCached( window[cached] ) )
+				++cached;
+			if( cached == window.size() )
+				return true;
+		}
+		if( mCond.wait_until( lock, deadline ) == std::cv_status::timeout )
+			return false;
+	}
+}
+
+std::vector<HlsVariant> HlsPrefetcher::getVariants() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mVariants;
+}
+
+size_t HlsPrefetcher::getVariantIndex() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mVariantIndex;
+}
+
+void HlsPrefetcher::lockVariant( size_t index )
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( index < mVariants.size() )
+			mVariantIndex = index;
+		mVariantLocked = true;
+		++mGeneration;
+	}
+	mCond.notify_all();
+}
+
+void HlsPrefetcher::unlockVariant()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mVariantLocked = false;
+		++mGeneration;
+	}
+	mCond.notify_all();
+}
+
+HlsPlaylist HlsPrefetcher::getPlaylist() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mPlaylist;
+}
+
+void HlsPrefetcher::setPosition( double seconds )
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( mReady && ! mPlaylist.mSegments.empty() ) {
+			mSequence = mPlaylist.mSegments[mPlaylist.findSegment( seconds )].mSequence;
+			mSequenceSet = true;
+		}
+		else
+			mPendingPosition = std::max( seconds, 0.0 );
+		++mGeneration;
+	}
+	mCond.notify_all();
+}
+
+void HlsPrefetcher::setSequence( uint64_t sequence )
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mSequence = sequence;
+		mSequenceSet = true;
+		mPendingPosition = -1;
+		++mGeneration;
+	}
+	mCond.notify_all();
+}
+
+uint64_t HlsPrefetcher::getSequence() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mSequence;
+}
+
+bool HlsPrefetcher::isCached( const HlsSegment &segment ) const
+{
+	return mCache->isCached( segment.mUrl, segment.mByteRange );
+}
+
+size_t HlsPrefetcher::getNumSegmentsCached() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::vector<HlsSegment> window = getWindow();
+	size_t result = 0;
+	while( result < window.size() && isCached( window[result] ) )
+		++result;
+	return result;
+}
+
+HttpStreamRef HlsPrefetcher::openSegment( const HlsSegment &segment ) const
+{
+	return mCache->open( segment.mUrl );
+}
+
+std::vector<HlsSegment> HlsPrefetcher::getWindow() const
+{
+	std::vector<HlsSegment> result;
+	const std::vector<HlsSegment> &segments = mPlaylist.mSegments;
+	// a live playlist may have moved past the position, which then continues from its oldest segment
+	for( size_t i = 0; i < segments.size() && result.size() < mOptions.getSegmentsAhead(); ++i ) {
+		if( segments[i].mSequence >= mSequence )
+			result.push_back( segments[i] );
+	}
+	return result;
+}
+
+bool HlsPrefetcher::loadPlaylist( const std::string &url, HlsPlaylist *result )
+{
+	std::string text;
+	HttpResponse response;
+	bool success = fetchHttpRange( url, ByteRange(), &response, [&]( const uint8_t *data, size_t size ) {
+		text.append( reinterpret_cast<const char*>( data ), size );
+		std::lock_guard<std::mutex> lock( mMutex );
+		return text.size() <= sMaxPlaylistSize && ! mStopping;
+	} );
+	// relative URIs resolve against the playlist that answered, after redirects
+	return success && parseHlsPlaylist( text, response.mUrl, result );
+}
+
+bool HlsPrefetcher::fetchSegment( const HlsSegment &segment )
+{
+	return fetchIntoCache( segment.mUrl, segment.mByteRange );
+}
+
+bool HlsPrefetcher::fetchIntoCache( const std::string &url, const ByteRange &range )
+{
+	// fetched on this thread without opening a stream, so only the time spent receiving feeds mBandwidth, and segments that
+	// were on disk already say nothing about the network
+	return mCache->fetch( url, range, [this] {
+		std::lock_guard<std::mutex> lock( mMutex );
+		return ! mStopping;
+	}, &mBandwidth );
+}
+
+void HlsPrefetcher::run()
+{
+	HlsPlaylist top;
+	if( ! loadPlaylist( mUrl, &top ) ) {
+		std::lock_guard<std::mutex> lock( mMutex );
+		mFailed = true;
+		mCond.notify_all();
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock( mMutex );
+	const bool master = top.isMaster();
+	mVariants = top.mVariants;
+	if( master && ! mVariantLocked )
+		mVariantIndex = selectHlsVariant( mVariants, mOptions.getInitialBandwidth() * mOptions.getSafetyFactor() );
+
+	HlsPlaylist media = top;
+	size_t loadedVariant = master ? mVariants.size() : 0;
+	std::chrono::steady_clock::time_point loadedAt = std::chrono::steady_clock::now();
+	while( ! mStopping ) {
+		// the media playlist of a newly picked variant, or the next version of a live one
+		size_t variant = mVariantIndex;
+		double reloadInterval = std::max( media.mTargetDuration, 1.0 );
+		bool reload = ( master && loadedVariant != variant )
+			|| ( ! media.mEndList && std::chrono::steady_clock::now() - loadedAt >= std::chrono::duration<double>( reloadInterval ) );
+		if( reload ) {
+			std::string url = master ? mVariants[variant].mUrl : mUrl;
+			lock.unlock();
+			HlsPlaylist loaded;
+			bool success = loadPlaylist( url, &loaded ) && ! loaded.isMaster();
+			lock.lock();
+			if( ! success ) {
+				// without a playlist yet there is nothing to fall back on
+				if( ! mReady ) {
+					mFailed = true;
+					break;
+				}
+				mCond.wait_for( lock, std::chrono::seconds( 1 ) );
+				continue;
+			}
+			media = loaded;
+			loadedVariant = variant;
+			loadedAt = std::chrono::steady_clock::now();
+		}
+
+		mPlaylist = media;
+		mPlaylistVariant = loadedVariant;
+		if( ! mReady && ! media.mSegments.empty() ) {
+			// a live stream starts three segments from its end, as players do
+			if( mPendingPosition >= 0 )
+				mSequence = media.mSegments[media.findSegment( mPendingPosition )].mSequence;
+			else if( ! mSequenceSet )
+				mSequence = media.mSegments[( ! media.mEndList && media.mSegments.size() > 3 ) ? media.mSegments.size() - 3 : 0].mSequence;
+			mPendingPosition = -1;
+			mSequenceSet = true;
+		}
+		mReady = true;
+		mCond.notify_all();
+
+		// the initialization section comes before any segment can be decoded
+		HlsSegment next;
+		bool found = false;
+		if( ! media.mInitUrl.empty() && ! mCache->isCached( media.mInitUrl, media.mInitByteRange ) ) {
+			next.mUrl = media.mInitUrl;
+			next.mByteRange = media.mInitByteRange;
+			found = true;
+		}
+		std::vector<HlsSegment> window = getWindow();
+		for( size_t i = 0; i < window.size() && ! found; ++i ) {
+			if( ! isCached( window[i] ) ) {
+				next = window[i];
+				found = true;
+			}
+		}
+
+		uint64_t generation = mGeneration;
+		if( found ) {
+			lock.unlock();
+			bool success = fetchSegment( next );
+			lock.lock();
+			if( success ) {
+				if( master && ! mVariantLocked ) {
+					double bandwidth = mBandwidth.hasEstimate() ? mBandwidth.getBandwidth() : mOptions.getInitialBandwidth();
+					mVariantIndex = selectHlsVariant( mVariants, bandwidth * mOptions.getSafetyFactor() );
+				}
+				mCond.notify_all();
+			}
+			else if( mGeneration == generation && ! mStopping )
+				mCond.wait_for( lock, std::chrono::seconds( 1 ) );
+			continue;
+		}
+
+		// everything ahead is cached: sleeps until the position or variant changes, or a live playlist is due
+		if( mGeneration == generation && ! mStopping && mVariantIndex == loadedVariant )
+			mCond.wait_for( lock, std::chrono::duration<double>( media.mEndList ? 60 : reloadInterval ) );
+	}
+	mCond.notify_all();
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,704 @@
+#include "AvfHttpCache.h"
+#include "AvfHttpClient.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <sstream>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+std::mutex		sSharedMutex;
+HttpCacheRef	sSharedCache;
+
+//! Fetched data is written to the cache file in pieces of this size, which readers can use as soon as they land
+const size_t	sWriteSize = 256 * 1024;
+//! Smallest fetch a read makes, so small reads don't each cost a request
+const uint64_t	sMinFetchSize = 256 * 1024;
+//! Largest single prefetch request, so the prefetch follows the read position closely
+const uint64_t	sMaxPrefetchSize = 2 * 1024 * 1024;
+
+const char		sIndexHeader[] = "AVFHTTPCACHE 1";
+
+// FNV-1a, naming the files of a resource after its URL
+std::string hashUrl( const std::string &url )
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for( size_t i = 0; i < url.size(); ++i )
+		hash = ( hash ^ static_cast<uint8_t>( url[i] ) ) * 1099511628211ULL;
+
+	char result[17];
+	std::snprintf( result, sizeof( result ), "%016llx", static_cast<unsigned long long>( hash ) );
+	return result;
+}
+
+bool makeDirectories( const std::string &path )
+{
+	for( size_t slash = path.find( '/', 1 ); ; slash = path.find( '/', slash + 1 ) ) {
+		std::string parent = path.substr( 0, slash );
+		if( ! parent.empty() && ::mkdir( parent.c_str(), 0755 ) != 0 && errno != EEXIST )
+			return false;
+		if( slash == std::string::npos )
+			break;
+	}
+	struct stat info;
+	return ::stat( path.c_str(), &info ) == 0 && S_ISDIR( info.st_mode );
+}
+
+// Use stamps in microseconds, which stay comparable with the index modification times of earlier sessions
+uint64_t getTimeStamp( time_t seconds )
+{
+	return static_cast<uint64_t>( seconds ) * 1000000;
+}
+
+size_t writeAt( int fd, uint64_t offset, const uint8_t *data, size_t size )
+{
+	size_t count = 0;
+	while( count < size ) {
+		ssize_t result = ::pwrite( fd, data + count, size - count, static_cast<off_t>( offset + count ) );
+		if( result < 0 && errno == EINTR )
+			continue;
+		if( result <= 0 )
+			break;
+		count += static_cast<size_t>( result );
+	}
+	return count;
+}
+
+size_t readAt( int fd, uint64_t offset, uint8_t *dst, size_t size )
+{
+	size_t count = 0;
+	while( count < size ) {
+		ssize_t result = ::pread( fd, dst + count, size - count, static_cast<off_t>( offset + count ) );
+		if( result < 0 && errno == EINTR )
+			continue;
+		if( result <= 0 )
+			break;
+		count += static_cast<size_t>( result );
+	}
+	return count;
+}
+
+} // anonymous namespace
+
+// A cached resource. The members up to mNumOpen are guarded by the cache's mutex, the rest by the entry's own.
+struct HttpCache::Entry {
+	Entry() : mBytes( 0 ), mLastUse( 0 ), mNumOpen( 0 ), mSize( 0 ), mSizeKnown( false ), mFd( -1 ) {}
+
+	std::string				mKey, mUrl;
+	uint64_t				mBytes, mLastUse;
+	size_t					mNumOpen;
+
+	std::mutex				mMutex;
+	//! Signalled when data lands in the cache file or a fetch ends
+	std::condition_variable	mDataCond;
+	uint64_t				mSize;
+	bool					mSizeKnown;
+	std::string				mETag;
+	ByteRangeSet			mRanges;
+	//! What the fetches in progress have yet to receive
+	std::list<ByteRange>	mFetching;
+	int						mFd;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// HttpCache
+
+HttpCache::HttpCache( const std::string &directory, uint64_t capacity )
+	: mDirectory( directory ), mCapacity( capacity ), mCachedBytes( 0 ), mUseCounter( 0 )
+{
+	while( mDirectory.size() > 1 && mDirectory[mDirectory.size() - 1] == '/' )
+		mDirectory.erase( mDirectory.size() - 1 );
+	if( mDirectory.empty() || ! makeDirectories( mDirectory ) )
+		throw HttpCacheExc();
+
+	DIR *dir = ::opendir( mDirectory.c_str() );
+	if( ! dir )
+		throw HttpCacheExc();
+	while( struct dirent *file = ::readdir( dir ) ) {
+		std::string name = file->d_name;
+		if( name.size() == 16 + 6 && name.compare( 16, 6, ".index" ) == 0 )
+			loadIndex( name.substr( 0, 16 ) );
+	}
+	::closedir( dir );
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	evict();
+}
+
+HttpCache::~HttpCache()
+{
+}
+
+HttpCacheRef HttpCache::getShared()
+{
+	std::lock_guard<std::mutex> lock( sSharedMutex );
+	if( ! sSharedCache ) {
+		const char *tmp = std::getenv( "TMPDIR" );
+		sSharedCache = create( std::string( ( tmp && *tmp ) ? tmp : "/tmp" ) + "/avf-http-cache" );
+	}
+	return sSharedCache;
+}
+
+std::string HttpCache::getPath( const std::string &key, const char *extension ) const
+{
+	return mDirectory + "/" + key + extension;
+}
+
+void HttpCache::loadIndex( const std::string &key )
+{
+	std::string path = getPath( key, ".index" );
+	std::ifstream file( path.c_str() );
+	std::string header, url, etag;
+	uint64_t size;
+	if( ! std::getline( file, header ) || header != sIndexHeader || ! std::getline( file, url ) || ! std::getline( file, etag ) || ! ( file >> size ) ) {
+		std::remove( path.c_str() );
+		std::remove( getPath( key, ".data" ).c_str() );
+		return;
+	}
+
+	EntryRef entry( new Entry() );
+	entry->mKey = key;
+	entry->mUrl = url;
+	entry->mETag = etag;
+	entry->mSize = size;
+	entry->mSizeKnown = true;
+	uint64_t start, end;
+	while( file >> start >> end ) {
+		if( start < end && end <= size )
+			entry->mRanges.add( ByteRange( start, end - start ) );
+	}
+	entry->mBytes = entry->mRanges.getTotalBytes();
+
+	struct stat info;
+	if( ::stat( path.c_str(), &info ) == 0 )
+		entry->mLastUse = getTimeStamp( info.st_mtime );
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	mEntries[key] = entry;
+	mCachedBytes += entry->mBytes;
+	mUseCounter = std::max( mUseCounter, entry->mLastUse );
+}
+
+void HttpCache::saveIndex( const Entry &entry ) const
+{
+	if( ! entry.mSizeKnown )
+		return;
+
+	// written aside and renamed, so a crash never leaves a torn index claiming data that isn't there
+	std::string path = getPath( entry.mKey, ".index" ), temporary = path + ".tmp";
+	{
+		std::ofstream file( temporary.c_str(), std::ios::trunc );
+		file << sIndexHeader << "\n" << entry.mUrl << "\n" << entry.mETag << "\n" << entry.mSize << "\n";
+		std::vector<ByteRange> ranges = entry.mRanges.getRanges();
+		for( std::vector<ByteRange>::const_iterator it = ranges.begin(); it != ranges.end(); ++it )
+			file << it->mOffset << " " << it->getEnd() << "\n";
+		if( ! file )
+			return;
+	}
+	std::rename( temporary.c_str(), path.c_str() );
+}
+
+void HttpCache::removeEntry( const EntryRef &entry )
+{
+	std::remove( getPath( entry->mKey, ".index" ).c_str() );
+	std::remove( getPath( entry->mKey, ".data" ).c_str() );
+	mCachedBytes -= std::min( mCachedBytes, entry->mBytes );
+	mEntries.erase( entry->mKey );
+}
+
+void HttpCache::addBytes( const EntryRef &entry, uint64_t bytes )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	entry->mBytes += bytes;
+	mCachedBytes += bytes;
+	evict();
+}
+
+void HttpCache::evict()
+{
+	while( mCachedBytes > mCapacity ) {
+		EntryRef oldest;
+		for( std::map<std::string, EntryRef>::const_iterator it = mEntries.begin(); it != mEntries.end(); ++it ) {
+			if( it->second->mNumOpen == 0 && ( ! oldest || it->second->mLastUse < oldest->mLastUse ) )
+				oldest = it->second;
+		}
+		// open resources are never evicted, even when they alone exceed the capacity
+		if( ! oldest )
+			break;
+		removeEntry( oldest );
+	}
+}
+
+HttpCache::EntryRef HttpCache::acquireEntry( const std::string &url )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::string key = hashUrl( url );
+	std::map<std::string, EntryRef>::iterator it = mEntries.find( key );
+	if( it != mEntries.end() && it->second->mUrl != url && it->second->mNumOpen == 0 )
+		removeEntry( it->second );
+	else if( it != mEntries.end() && it->second->mUrl != url )
+		throw HttpCacheExc();
+
+	EntryRef entry = mEntries[key];
+	if( ! entry ) {
+		entry.reset( new Entry() );
+		entry->mKey = key;
+		entry->mUrl = url;
+		mEntries[key] = entry;
+	}
+	++entry->mNumOpen;
+	entry->mLastUse = mUseCounter = std::max( mUseCounter + 1, getTimeStamp( std::time( NULL ) ) );
+	return entry;
+}
+
+bool HttpCache::updateEntry( const EntryRef &entry, const HttpResponse *response )
+{
+	// the cache lock keeps mNumOpen steady while deciding whether the cached copy may be thrown away
+	std::lock_guard<std::mutex> cacheLock( mMutex );
+	std::lock_guard<std::mutex> lock( entry->mMutex );
+	bool changed = response && entry->mSizeKnown && ( entry->mSize != response->mTotalSize || entry->mETag != response->mETag );
+	if( changed ) {
+		// other streams are still reading the old version, so the new one is refused rather than pulled from under them
+		if( entry->mNumOpen > 1 )
+			return false;
+
+		uint64_t dropped = entry->mRanges.getTotalBytes();
+		entry->mRanges.clear();
+		std::remove( getPath( entry->mKey, ".data" ).c_str() );
+		if( entry->mFd >= 0 ) {
+			::close( entry->mFd );
+			entry->mFd = -1;
+		}
+		entry->mBytes -= std::min( entry->mBytes, dropped );
+		mCachedBytes -= std::min( mCachedBytes, dropped );
+	}
+	if( response ) {
+		entry->mSize = response->mTotalSize;
+		entry->mETag = response->mETag;
+		entry->mSizeKnown = true;
+	}
+
+	// without the server, the cache can still serve what it holds
+	bool usable = entry->mSizeKnown;
+	if( usable && entry->mFd < 0 ) {
+		entry->mFd = ::open( getPath( entry->mKey, ".data" ).c_str(), O_RDWR | O_CREAT, 0644 );
+		usable = entry->mFd >= 0;
+	}
+	if( usable )
+		saveIndex( *entry );
+	return usable;
+}
+
+HttpStreamRef HttpCache::open( const std::string &url, uint64_t prefetchBytes )
+{
+	HttpUrl parsed;
+	if( ! parseHttpUrl( url, &parsed ) )
+		throw HttpCacheExc();
+
+	EntryRef entry = acquireEntry( url );
+
+	// asks for a single byte to learn the size and version of the resource
+	HttpResponse response;
+	bool reached = fetchHttpRange( url, ByteRange( 0, 1 ), &response, []( const uint8_t*, size_t ) { return true; } ) && response.mTotalSizeKnown;
+	if( ! updateEntry( entry, reached ? &response : NULL ) ) {
+		closeEntry( entry );
+		throw HttpCacheExc();
+	}
+
+	HttpStreamRef result( new HttpStream( shared_from_this(), entry, prefetchBytes ) );
+	std::string path = parsed.mPath.substr( 0, parsed.mPath.find( '?' ) );
+	size_t dot = path.find_last_of( "./" );
+	if( dot != std::string::npos && path[dot] == '.' )
+		result->setExtensionHint( path.substr( dot + 1 ) );
+	return result;
+}
+
+bool HttpCache::fetch( const std::string &url, const ByteRange &range, const std::function<bool()> &keepGoing, BandwidthEstimator *bandwidth )
+{
+	HttpUrl parsed;
+	if( ! parseHttpUrl( url, &parsed ) )
+		return false;
+
+	EntryRef entry;
+	try {
+		entry = acquireEntry( url );
+	}
+	catch( HttpCacheExc& ) {
+		return false;
+	}
+
+	// a resource the cache knows reopens its file as it is; a new one learns its size and version from the first fetch
+	bool known;
+	{
+		std::lock_guard<std::mutex> lock( entry->mMutex );
+		known = entry->mSizeKnown;
+	}
+	if( known && ! updateEntry( entry, NULL ) ) {
+		closeEntry( entry );
+		return false;
+	}
+
+	// a stream without prefetching runs no thread, and with nobody reading from it, it may take on a new version
+	HttpStreamRef stream( new HttpStream( shared_from_this(), entry, 0 ) );
+	stream->mAdoptVersion = true;
+	const ByteRange wanted = range.empty() ? ByteRange( 0, std::numeric_limits<uint64_t>::max() ) : range;
+	bool success = true;
+	std::unique_lock<std::mutex> lock( entry->mMutex );
+	while( success ) {
+		ByteRange remaining = wanted;
+		if( entry->mSizeKnown )
+			remaining = ByteRange( wanted.mOffset, std::min( wanted.getEnd(), entry->mSize ) - std::min( wanted.mOffset, entry->mSize ) );
+		std::vector<ByteRange> missing = entry->mRanges.getMissing( remaining );
+		if( missing.empty() )
+			break;
+
+		// bytes another fetch is receiving are waited for, as reads do
+		ByteRangeSet claimed;
+		for( std::list<ByteRange>::const_iterator it = entry->mFetching.begin(); it != entry->mFetching.end(); ++it )
+			claimed.add( *it );
+		if( claimed.getContiguousEnd( missing.front().mOffset ) > missing.front().mOffset ) {
+			entry->mDataCond.wait( lock );
+			continue;
+		}
+		lock.unlock();
+		success = stream->fetch( missing.front(), keepGoing );
+		lock.lock();
+	}
+	lock.unlock();
+
+	// only the time spent receiving counts, not the opening of the stream
+	if( bandwidth && stream->mBandwidth.getBytesSampled() > 0 )
+		bandwidth->addSample( stream->mBandwidth.getBytesSampled(), stream->mBandwidth.getSecondsSampled() );
+	return success;
+}
+
+void HttpCache::closeEntry( const EntryRef &entry )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	entry->mLastUse = mUseCounter = std::max( mUseCounter + 1, getTimeStamp( std::time( NULL ) ) );
+	if( --entry->mNumOpen == 0 ) {
+		std::lock_guard<std::mutex> entryLock( entry->mMutex );
+		if( entry->mFd >= 0 ) {
+			::close( entry->mFd );
+			entry->mFd = -1;
+		}
+		saveIndex( *entry );
+		// an entry that never learned its size has nothing worth keeping
+		if( ! entry->mSizeKnown )
+			removeEntry( entry );
+	}
+	evict();
+}
+
+uint64_t HttpCache::getCapacity() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mCapacity;
+}
+
+void HttpCache::setCapacity( uint64_t capacity )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mCapacity = capacity;
+	evict();
+}
+
+uint64_t HttpCache::getCachedBytes() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mCachedBytes;
+}
+
+ByteRangeSet HttpCache::getCachedRanges( const std::string &url ) const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::map<std::string, EntryRef>::const_iterator it = mEntries.find( hashUrl( url ) );
+	if( it == mEntries.end() || it->second->mUrl != url )
+		return ByteRangeSet();
+
+	std::lock_guard<std::mutex> entryLock( it->second->mMutex );
+	return it->second->mRanges;
+}
+
+bool HttpCache::isCached( const std::string &url, const ByteRange &range ) const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::map<std::string, EntryRef>::const_iterator it = mEntries.find( hashUrl( url ) );
+	if( it == mEntries.end() || it->second->mUrl != url )
+		return false;
+
+	Entry &entry = *it->second;
+	std::lock_guard<std::mutex> entryLock( entry.mMutex );
+	if( ! entry.mSizeKnown )
+		return false;
+	return entry.mRanges.contains( range.empty() ? ByteRange( 0, entry.mSize ) : range );
+}
+
+void HttpCache::clear()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::vector<EntryRef> closed;
+	for( std::map<std::string, EntryRef>::const_iterator it = mEntries.begin(); it != mEntries.end(); ++it ) {
+		if( it->second->mNumOpen == 0 )
+			closed.push_back( it->second );
+	}
+	for( std::vector<EntryRef>::const_iterator it = closed.begin(); it != closed.end(); ++it )
+		removeEntry( *it );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// HttpStream
+
+HttpStream::HttpStream( const HttpCacheRef &cache, const HttpCache::EntryRef &entry, uint64_t prefetchBytes )
+	: mCache( cache ), mEntry( entry ), mPosition( 0 ), mPrefetchBytes( prefetchBytes ), mBytesFetched( 0 ), mGeneration( 0 ), mStopping( false ),
+	mPrefetchScheduled( false ), mAdoptVersion( false )
+{
+	// behind the decoding of every movie on the pool, which needs the bytes only once they have arrived
+	mPrefetchQueue = WorkerPool::getShared().createQueue( WorkerPool::PRIORITY_LOW );
+	std::lock_guard<std::mutex> lock( mPrefetchMutex );
+	schedulePrefetch();
+}
+
+HttpStream::~HttpStream()
+{
+	{
+		std::lock_guard<std::mutex> lock( mPrefetchMutex );
+		mStopping = true;
+	}
+	// a fetch in progress sees mStopping and gives up, but still uses the stream until it returns
+	mPrefetchQueue->clear();
+	mPrefetchQueue->wait();
+	mCache->closeEntry( mEntry );
+}
+
+uint64_t HttpStream::getSize() const
+{
+	std::lock_guard<std::mutex> lock( mEntry->mMutex );
+	return mEntry->mSize;
+}
+
+const std::string& HttpStream::getUrl() const
+{
+	return mEntry->mUrl;
+}
+
+uint64_t HttpStream::getPrefetchBytes() const
+{
+	std::lock_guard<std::mutex> lock( mPrefetchMutex );
+	return mPrefetchBytes;
+}
+
+void HttpStream::setPrefetchBytes( uint64_t bytes )
+{
+	std::lock_guard<std::mutex> lock( mPrefetchMutex );
+	mPrefetchBytes = bytes;
+	++mGeneration;
+	schedulePrefetch();
+}
+
+ByteRangeSet HttpStream::getCachedRanges() const
+{
+	std::lock_guard<std::mutex> lock( mEntry->mMutex );
+	return mEntry->mRanges;
+}
+
+uint64_t HttpStream::getBytesFetched() const
+{
+	std::lock_guard<std::mutex> lock( mPrefetchMutex );
+	return mBytesFetched;
+}
+
+bool HttpStream::fetch( const ByteRange &requested, const std::function<bool()> &keepGoing )
+{
+	HttpCache::Entry &entry = *mEntry;
+	std::list<ByteRange>::iterator claim;
+	ByteRange range;
+	std::string etag;
+	uint64_t totalSize;
+	bool versionKnown;
+	{
+		std::lock_guard<std::mutex> lock( entry.mMutex );
+		// another fetch may have claimed part of the range since the caller looked, which is then left to it
+		ByteRangeSet claimed = entry.mRanges;
+		for( std::list<ByteRange>::const_iterator it = entry.mFetching.begin(); it != entry.mFetching.end(); ++it )
+			claimed.add( *it );
+		std::vector<ByteRange> missing = claimed.getMissing( requested );
+		if( missing.empty() )
+			return true;
+		range = missing.front();
+		claim = entry.mFetching.insert( entry.mFetching.end(), range );
+		etag = entry.mETag;
+		totalSize = entry.mSize;
+		versionKnown = entry.mSizeKnown;
+	}
+	// a range reaching past the end of the resource ends with it, once its size is known
+	uint64_t end = range.getEnd();
+
+	std::vector<uint8_t> pending;
+	uint64_t pendingOffset = range.mOffset;
+	bool written = true;
+	// lands what was received in the cache file, where readers can have it right away
+	auto flush = [&] {
+		if( pending.empty() )
+			return;
+		written = writeAt( entry.mFd, pendingOffset, &pending[0], pending.size() ) == pending.size();
+		// counted before readers can see the bytes, so a reader that got them finds them counted
+		{
+			std::lock_guard<std::mutex> lock( mPrefetchMutex );
+			mBytesFetched += pending.size();
+		}
+		uint64_t added = 0;
+		{
+			std::lock_guard<std::mutex> lock( entry.mMutex );
+			if( written ) {
+				uint64_t before = entry.mRanges.getTotalBytes();
+				entry.mRanges.add( ByteRange( pendingOffset, pending.size() ) );
+				added = entry.mRanges.getTotalBytes() - before;
+			}
+			pendingOffset += pending.size();
+			*claim = ByteRange( pendingOffset, end - std::min( pendingOffset, end ) );
+		}
+		entry.mDataCond.notify_all();
+		if( added > 0 )
+			mCache->addBytes( mEntry, added );
+		pending.clear();
+	};
+
+	HttpResponse response;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool success = fetchHttpRange( entry.mUrl, range, &response, [&]( const uint8_t *data, size_t size ) {
+		// a resource the stream was opened on without asking the server first takes its size and version from the answer
+		if( ! versionKnown || ( mAdoptVersion && ( ! response.mTotalSizeKnown || response.mTotalSize != totalSize || response.mETag != etag ) ) ) {
+			if( ! response.mTotalSizeKnown || ! mCache->updateEntry( mEntry, &response ) )
+				return false;
+			etag = response.mETag;
+			totalSize = response.mTotalSize;
+			end = std::min( end, totalSize );
+			versionKnown = true;
+		}
+		// bytes of another version of the resource must not mix with the cached ones
+		if( response.mETag != etag || response.mOffset != range.mOffset )
+			return false;
+		pending.insert( pending.end(), data, data + size );
+		if( pending.size() >= sWriteSize )
+			flush();
+		return written && keepGoing();
+	} );
+	flush();
+	mBandwidth.addSample( pendingOffset - range.mOffset, std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() );
+
+	{
+		std::lock_guard<std::mutex> lock( entry.mMutex );
+		entry.mFetching.erase( claim );
+		mCache->saveIndex( entry );
+	}
+	entry.mDataCond.notify_all();
+	// a body that ended early counts as a failure, or the same range would be asked for again and again
+	return success && written && pendingOffset >= end;
+}
+
+size_t HttpStream::read( uint64_t offset, void *dst, size_t size )
+{
+	HttpCache::Entry &entry = *mEntry;
+	{
+		std::lock_guard<std::mutex> lock( mPrefetchMutex );
+		mPosition = offset;
+		++mGeneration;
+		schedulePrefetch();
+	}
+
+	std::unique_lock<std::mutex> lock( entry.mMutex );
+	if( offset >= entry.mSize )
+		return 0;
+	size = static_cast<size_t>( std::min<uint64_t>( size, entry.mSize - offset ) );
+	const ByteRange wanted( offset, size );
+
+	while( ! entry.mRanges.contains( wanted ) ) {
+		// bytes a fetch in progress is about to deliver are waited for rather than asked for twice
+		ByteRangeSet claimed = entry.mRanges;
+		for( std::list<ByteRange>::const_iterator it = entry.mFetching.begin(); it != entry.mFetching.end(); ++it )
+			claimed.add( *it );
+		uint64_t missing = entry.mRanges.getMissing( wanted ).front().mOffset;
+		if( claimed.getContiguousEnd( missing ) > missing ) {
+			entry.mDataCond.wait( lock );
+			continue;
+		}
+
+		uint64_t length = std::max<uint64_t>( wanted.getEnd() - missing, sMinFetchSize );
+		ByteRange range = claimed.getMissing( ByteRange( missing, std::min( length, entry.mSize - missing ) ) ).front();
+		lock.unlock();
+		bool success = fetch( range, [] { return true; } );
+		lock.lock();
+		if( ! success )
+			break;
+	}
+
+	// on failure only the bytes up to the first gap are returned
+	size_t count = static_cast<size_t>( std::min<uint64_t>( entry.mRanges.getContiguousEnd( offset ) - offset, size ) );
+	int fd = entry.mFd;
+	lock.unlock();
+	return readAt( fd, offset, static_cast<uint8_t*>( dst ), count );
+}
+
+void HttpStream::schedulePrefetch()
+{
+	if( mPrefetchScheduled || mStopping || mPrefetchBytes == 0 )
+		return;
+	mPrefetchScheduled = true;
+	mPrefetchQueue->post( std::bind( &HttpStream::prefetchNext, this ) );
+}
+
+void HttpStream::prefetchNext()
+{
+	HttpCache::Entry &entry = *mEntry;
+	std::unique_lock<std::mutex> lock( mPrefetchMutex );
+	uint64_t generation = mGeneration, position = mPosition, ahead = mPrefetchBytes;
+	lock.unlock();
+
+	ByteRange range;
+	{
+		std::lock_guard<std::mutex> entryLock( entry.mMutex );
+		ByteRangeSet claimed = entry.mRanges;
+		for( std::list<ByteRange>::const_iterator it = entry.mFetching.begin(); it != entry.mFetching.end(); ++it )
+			claimed.add( *it );
+		ByteRange window;
+		if( clampByteRange( position, ahead, false, entry.mSize, &window ) ) {
+			std::vector<ByteRange> missing = claimed.getMissing( window );
+			if( ! missing.empty() )
+				range = ByteRange( missing.front().mOffset, std::min( missing.front().mLength, sMaxPrefetchSize ) );
+		}
+	}
+
+	bool success = false;
+	if( ! range.empty() ) {
+		// gives up once playback has left the range behind or jumped away from it
+		success = fetch( range, [&] {
+			std::lock_guard<std::mutex> lock( mPrefetchMutex );
+			return ! mStopping && mPosition <= range.getEnd() && mPosition + mPrefetchBytes >= range.mOffset;
+		} );
+	}
+
+	// with nothing left to fetch, or after a failure, the next read schedules the next task, rather than a timer
+	lock.lock();
+	mPrefetchScheduled = false;
+	if( success || mGeneration != generation )
+		schedulePrefetch();
+}
+
+} } // namespace cinder::avf
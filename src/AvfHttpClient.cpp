@@ -0,0 +1,392 @@
+#include "AvfHttpClient.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+const int		sMaxRedirects = 5;
+const size_t	sMaxHeaderSize = 64 * 1024;
+
+#if defined( MSG_NOSIGNAL )
+const int		sSendFlags = MSG_NOSIGNAL;
+#else
+const int		sSendFlags = 0;
+#endif
+
+std::string toLower( std::string text )
+{
+	std::transform( text.begin(), text.end(), text.begin(), ::tolower );
+	return text;
+}
+
+std::string trim( const std::string &text )
+{
+	size_t start = text.find_first_not_of( " \t" ), end = text.find_last_not_of( " \t\r" );
+	return ( start == std::string::npos ) ? std::string() : text.substr( start, end - start + 1 );
+}
+
+bool parseNumber( const std::string &text, uint64_t *result )
+{
+	if( text.empty() || text.find_first_not_of( "0123456789" ) != std::string::npos )
+		return false;
+	*result = std::strtoull( text.c_str(), NULL, 10 );
+	return true;
+}
+
+// Closes the socket when the fetch returns, whichever way it does
+class Connection {
+  public:
+	Connection() : mFd( -1 ) {}
+	~Connection() { if( mFd >= 0 ) ::close( mFd ); }
+
+	bool open( const HttpUrl &url, int timeoutSeconds )
+	{
+		struct addrinfo hints, *addresses = NULL;
+		std::memset( &hints, 0, sizeof( hints ) );
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		std::ostringstream port;
+		port << url.mPort;
+		if( ::getaddrinfo( url.mHost.c_str(), port.str().c_str(), &hints, &addresses ) != 0 )
+			return false;
+
+		struct timeval timeout;
+		timeout.tv_sec = timeoutSeconds;
+		timeout.tv_usec = 0;
+		for( struct addrinfo *address = addresses; address && mFd < 0; address = address->ai_next ) {
+			mFd = ::socket( address->ai_family, address->ai_socktype, address->ai_protocol );
+			if( mFd < 0 )
+				continue;
+			::setsockopt( mFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+			::setsockopt( mFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+#if defined( SO_NOSIGPIPE )
+			int noSigPipe = 1;
+			::setsockopt( mFd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof( noSigPipe ) );
+#endif
+			if( ::connect( mFd, address->ai_addr, address->ai_addrlen ) != 0 ) {
+				::close( mFd );
+				mFd = -1;
+			}
+		}
+		::freeaddrinfo( addresses );
+		return mFd >= 0;
+	}
+
+	bool send( const std::string &data )
+	{
+		for( size_t sent = 0; sent < data.size(); ) {
+			ssize_t result = ::send( mFd, data.data() + sent, data.size() - sent, sSendFlags );
+			if( result < 0 && errno == EINTR )
+				continue;
+			if( result <= 0 )
+				return false;
+			sent += static_cast<size_t>( result );
+		}
+		return true;
+	}
+
+	//! Returns the number of bytes received, \c 0 at the end of the stream and \c -1 on error or timeout
+	ssize_t receive( uint8_t *dst, size_t size )
+	{
+		ssize_t result;
+		do {
+			result = ::recv( mFd, dst, size, 0 );
+		} while( result < 0 && errno == EINTR );
+		return result;
+	}
+
+  private:
+	int		mFd;
+};
+
+// Decodes a body in the chunked transfer coding, which HTTP/1.1 servers may use for any answer, handing the data to a sink
+class ChunkedDecoder {
+  public:
+	enum Result { MORE, DONE, STOPPED, FAILED };
+
+	ChunkedDecoder() : mState( SIZE ), mRemaining( 0 ) {}
+
+	//! Decodes \a size bytes of \a data. \a sink takes the chunk data and returns \c false to stop, after which decode() returns \c STOPPED.
+	template<typename Sink>
+	Result decode( const uint8_t *data, size_t size, Sink &sink )
+	{
+		while( size > 0 && mState != FINISHED ) {
+			if( mState == DATA ) {
+				size_t count = static_cast<size_t>( std::min<uint64_t>( size, mRemaining ) );
+				if( ! sink( data, count ) )
+					return STOPPED;
+				data += count;
+				size -= count;
+				mRemaining -= count;
+				if( mRemaining == 0 )
+					mState = DATA_END;
+				continue;
+			}
+
+			// every other state reads a line
+			uint8_t c = *data++;
+			--size;
+			if( c != '\n' ) {
+				if( mLine.size() > sMaxHeaderSize )
+					return FAILED;
+				mLine.push_back( static_cast<char>( c ) );
+				continue;
+			}
+			std::string line = trim( mLine );
+			mLine.clear();
+			if( mState == SIZE ) {
+				// the size is hexadecimal, optionally followed by extensions
+				line = trim( line.substr( 0, line.find( ';' ) ) );
+				if( line.empty() || line.size() > 15 || line.find_first_not_of( "0123456789abcdefABCDEF" ) != std::string::npos )
+					return FAILED;
+				mRemaining = std::strtoull( line.c_str(), NULL, 16 );
+				mState = ( mRemaining > 0 ) ? DATA : TRAILER;
+			}
+			else if( mState == DATA_END ) {
+				if( ! line.empty() )
+					return FAILED;
+				mState = SIZE;
+			}
+			else if( line.empty() )
+				mState = FINISHED;
+		}
+		return ( mState == FINISHED ) ? DONE : MORE;
+	}
+
+  private:
+	enum State { SIZE, DATA, DATA_END, TRAILER, FINISHED };
+
+	State			mState;
+	uint64_t		mRemaining;
+	std::string		mLine;
+};
+
+// Resolves the target of a redirect against the URL that answered
+std::string resolveLocation( const HttpUrl &base, const std::string &location )
+{
+	if( toLower( location.substr( 0, 7 ) ) == "http://" )
+		return location;
+	if( location.empty() || location[0] != '/' )
+		return std::string();
+
+	std::ostringstream result;
+	result << "http://" << ( base.mHost.find( ':' ) != std::string::npos ? "[" + base.mHost + "]" : base.mHost ) << ":" << base.mPort << location;
+	return result.str();
+}
+
+} // anonymous namespace
+
+bool parseHttpUrl( const std::string &url, HttpUrl *result )
+{
+	if( toLower( url.substr( 0, 7 ) ) != "http://" )
+		return false;
+
+	std::string rest = url.substr( 7 );
+	rest = rest.substr( 0, rest.find( '#' ) );
+	size_t pathStart = rest.find_first_of( "/?" );
+	std::string authority = rest.substr( 0, pathStart );
+	result->mPath = ( pathStart == std::string::npos ) ? "/" : rest.substr( pathStart );
+	if( result->mPath[0] == '?' )
+		result->mPath = "/" + result->mPath;
+	// credentials aren't supported, but mustn't be mistaken for the host
+	if( authority.find( '@' ) != std::string::npos )
+		return false;
+
+	size_t portStart;
+	if( ! authority.empty() && authority[0] == '[' ) {
+		size_t close = authority.find( ']' );
+		if( close == std::string::npos )
+			return false;
+		result->mHost = authority.substr( 1, close - 1 );
+		portStart = ( close + 1 < authority.size() && authority[close + 1] == ':' ) ? close + 2 : std::string::npos;
+		if( portStart == std::string::npos && close + 1 != authority.size() )
+			return false;
+	}
+	else {
+		size_t colon = authority.find( ':' );
+		result->mHost = authority.substr( 0, colon );
+		portStart = ( colon == std::string::npos ) ? std::string::npos : colon + 1;
+	}
+
+	result->mPort = 80;
+	if( portStart != std::string::npos ) {
+		uint64_t port;
+		if( ! parseNumber( authority.substr( portStart ), &port ) || port == 0 || port > 65535 )
+			return false;
+		result->mPort = static_cast<int>( port );
+	}
+	return ! result->mHost.empty();
+}
+
+bool fetchHttpRange( const std::string &url, const ByteRange &range, HttpResponse *response,
+						const std::function<bool( const uint8_t *data, size_t size )> &receive, int timeoutSeconds )
+{
+	std::string target = url;
+	for( int redirect = 0; redirect <= sMaxRedirects; ++redirect ) {
+		*response = HttpResponse();
+		response->mUrl = target;
+
+		HttpUrl parsed;
+		Connection connection;
+		if( ! parseHttpUrl( target, &parsed ) || ! connection.open( parsed, timeoutSeconds ) )
+			return false;
+
+		std::ostringstream request;
+		request << "GET " << parsed.mPath << " HTTP/1.1\r\n";
+		request << "Host: " << ( parsed.mHost.find( ':' ) != std::string::npos ? "[" + parsed.mHost + "]" : parsed.mHost );
+		if( parsed.mPort != 80 )
+			request << ":" << parsed.mPort;
+		request << "\r\nAccept-Encoding: identity\r\nConnection: close\r\n";
+		if( ! range.empty() )
+			request << "Range: bytes=" << range.mOffset << "-" << range.getEnd() - 1 << "\r\n";
+		request << "\r\n";
+		if( ! connection.send( request.str() ) )
+			return false;
+
+		// the header, and whatever part of the body came along with it
+		std::vector<uint8_t> buffer;
+		size_t headerEnd = std::string::npos;
+		uint8_t block[16 * 1024];
+		while( headerEnd == std::string::npos ) {
+			ssize_t count = connection.receive( block, sizeof( block ) );
+			if( count <= 0 || buffer.size() > sMaxHeaderSize )
+				return false;
+			size_t searchStart = ( buffer.size() > 3 ) ? buffer.size() - 3 : 0;
+			buffer.insert( buffer.end(), block, block + count );
+			static const char sTerminator[] = "\r\n\r\n";
+			std::vector<uint8_t>::iterator found = std::search( buffer.begin() + searchStart, buffer.end(), sTerminator, sTerminator + 4 );
+			if( found != buffer.end() )
+				headerEnd = ( found - buffer.begin() ) + 4;
+		}
+
+		std::istringstream header( std::string( buffer.begin(), buffer.begin() + headerEnd ) );
+		std::string line, version;
+		std::getline( header, line );
+		std::istringstream statusLine( line );
+		if( ! ( statusLine >> version >> response->mStatus ) || version.compare( 0, 5, "HTTP/" ) != 0 )
+			return false;
+
+		bool lengthKnown = false, chunked = false;
+		uint64_t contentLength = 0;
+		std::string contentRange, location;
+		while( std::getline( header, line ) ) {
+			size_t colon = line.find( ':' );
+			if( colon == std::string::npos )
+				continue;
+			std::string name = toLower( trim( line.substr( 0, colon ) ) ), value = trim( line.substr( colon + 1 ) );
+			if( name == "content-length" )
+				lengthKnown = parseNumber( value, &contentLength );
+			else if( name == "content-range" )
+				contentRange = value;
+			else if( name == "etag" )
+				response->mETag = value;
+			else if( name == "content-type" )
+				response->mContentType = value;
+			else if( name == "location" )
+				location = value;
+			else if( name == "transfer-encoding" )
+				chunked = toLower( value ).find( "chunked" ) != std::string::npos;
+		}
+
+		// "bytes first-last/total", or "bytes */total" when the range lay outside the resource
+		if( ! contentRange.empty() ) {
+			size_t slash = contentRange.find( '/' );
+			if( slash != std::string::npos )
+				response->mTotalSizeKnown = parseNumber( contentRange.substr( slash + 1 ), &response->mTotalSize );
+		}
+
+		if( response->mStatus >= 300 && response->mStatus < 400 && ! location.empty() ) {
+			target = resolveLocation( parsed, location );
+			if( target.empty() )
+				return false;
+			continue;
+		}
+		if( response->mStatus != 200 && response->mStatus != 206 )
+			return false;
+		// a chunked body carries its own framing, which overrides any Content-Length
+		if( chunked )
+			lengthKnown = false;
+
+		uint64_t bodyOffset = 0;
+		if( response->mStatus == 206 ) {
+			uint64_t first;
+			size_t space = contentRange.find( ' ' ), dash = contentRange.find( '-' );
+			if( space == std::string::npos || dash == std::string::npos || ! parseNumber( contentRange.substr( space + 1, dash - space - 1 ), &first ) )
+				return false;
+			bodyOffset = first;
+		}
+		else if( lengthKnown ) {
+			response->mTotalSize = contentLength;
+			response->mTotalSizeKnown = true;
+		}
+
+		// a server that ignored the range sends more than asked for, which is skipped
+		uint64_t wantedStart = range.empty() ? bodyOffset : range.mOffset;
+		uint64_t wantedEnd = range.empty() ? UINT64_MAX : range.getEnd();
+		if( bodyOffset > wantedStart )
+			return false;
+		response->mOffset = wantedStart;
+
+		// hands body bytes to the receiver, returning false once no more are wanted or the receiver cancelled
+		uint64_t position = bodyOffset, bodyEnd = lengthKnown ? bodyOffset + contentLength : UINT64_MAX;
+		bool cancelled = false;
+		auto deliver = [&]( const uint8_t *data, size_t size ) -> bool {
+			size = static_cast<size_t>( std::min<uint64_t>( size, bodyEnd - position ) );
+			uint64_t start = std::max( position, wantedStart ), end = std::min( position + size, wantedEnd );
+			if( start < end && ! receive( data + ( start - position ), static_cast<size_t>( end - start ) ) ) {
+				cancelled = true;
+				return false;
+			}
+			position += size;
+			return position < wantedEnd && position < bodyEnd;
+		};
+
+		ChunkedDecoder decoder;
+		const uint8_t *data = buffer.empty() ? NULL : &buffer[0] + headerEnd;
+		size_t size = buffer.size() - headerEnd;
+		while( true ) {
+			if( chunked ) {
+				ChunkedDecoder::Result result = decoder.decode( data, size, deliver );
+				if( result == ChunkedDecoder::FAILED || result == ChunkedDecoder::STOPPED )
+					return ! cancelled && result == ChunkedDecoder::STOPPED;
+				if( result == ChunkedDecoder::DONE ) {
+					// the whole resource came, so now its size is known
+					if( response->mStatus == 200 ) {
+						response->mTotalSize = position;
+						response->mTotalSizeKnown = true;
+					}
+					return true;
+				}
+			}
+			else if( size > 0 && ! deliver( data, size ) )
+				return ! cancelled;
+			else if( position >= bodyEnd )
+				return true;
+
+			ssize_t count = connection.receive( block, sizeof( block ) );
+			if( count < 0 )
+				return false;
+			// without a length, the body ends with the connection; a chunked body has to end with its last chunk
+			if( count == 0 )
+				return ! lengthKnown && ! chunked && range.empty();
+			data = block;
+			size = static_cast<size_t>( count );
+		}
+	}
+	return false;
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,180 @@
+#include "AvfMediaTime.h"
+
+#include <cmath>
+#include <limits>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+// products of a value and a time scale need 95 bits, so they're formed in 128-bit integers where the compiler has them
+#if defined( __SIZEOF_INT128__ )
+__extension__ typedef __int128 WideInt;
+#else
+typedef long double WideInt;
+#endif
+
+WideInt floorDivide( WideInt num, WideInt den )
+{
+#if defined( __SIZEOF_INT128__ )
+	if( den < 0 ) {
+		num = -num;
+		den = -den;
+	}
+	WideInt q = num / den;
+	if( num % den != 0 && num < 0 )
+		--q;
+	return q;
+#else
+	return std::floor( num / den );
+#endif
+}
+
+// whether \a value converts back to int64_t; the upper bound is written as a negation since INT64_MAX has no exact long double on some targets
+bool fitsInt64( WideInt value )
+{
+	return value >= static_cast<WideInt>( INT64_MIN ) && value < -static_cast<WideInt>( INT64_MIN );
+}
+
+// value * to / from, rounded to nearest with ties toward positive infinity. Returns false when the result doesn't fit 64 bits.
+bool rescaleValue( int64_t value, int32_t from, int32_t to, int64_t *result )
+{
+	if( from == to ) {
+		*result = value;
+		return true;
+	}
+	WideInt rescaled = floorDivide( static_cast<WideInt>( value ) * to * 2 + from, static_cast<WideInt>( from ) * 2 );
+	if( ! fitsInt64( rescaled ) )
+		return false;
+	*result = static_cast<int64_t>( rescaled );
+	return true;
+}
+
+int64_t greatestCommonDivisor( int64_t a, int64_t b )
+{
+	if( a < 0 ) a = -a;
+	if( b < 0 ) b = -b;
+	while( b != 0 ) {
+		int64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// The time scale both operands convert to exactly, or the larger one when that doesn't fit
+int32_t commonTimeScale( int32_t a, int32_t b )
+{
+	if( a == b )
+		return a;
+	int64_t lcm = static_cast<int64_t>( a ) / greatestCommonDivisor( a, b ) * b;
+	if( lcm <= std::numeric_limits<int32_t>::max() )
+		return static_cast<int32_t>( lcm );
+	return ( a > b ) ? a : b;
+}
+
+// lhs + sign * rhs at a time scale both convert to, or an invalid time when either operand or the result doesn't fit 64 bits
+MediaTime addTimes( const MediaTime &lhs, const MediaTime &rhs, int sign )
+{
+	if( ! lhs.isValid() || ! rhs.isValid() )
+		return MediaTime();
+	int32_t timeScale = commonTimeScale( lhs.getTimeScale(), rhs.getTimeScale() );
+	int64_t l, r;
+	if( ! rescaleValue( lhs.getValue(), lhs.getTimeScale(), timeScale, &l ) || ! rescaleValue( rhs.getValue(), rhs.getTimeScale(), timeScale, &r ) )
+		return MediaTime();
+	WideInt sum = static_cast<WideInt>( l ) + static_cast<WideInt>( r ) * sign;
+	return fitsInt64( sum ) ? MediaTime( static_cast<int64_t>( sum ), timeScale ) : MediaTime();
+}
+
+} // anonymous namespace
+
+const int32_t MediaTime::DEFAULT_TIME_SCALE;
+
+MediaTime MediaTime::fromSeconds( double seconds, int32_t timeScale )
+{
+	if( timeScale <= 0 || seconds != seconds )
+		return MediaTime();
+	// 2^63 is exact as a double, where INT64_MAX isn't
+	const double value = std::floor( seconds * timeScale + 0.5 );
+	if( ! ( value >= -9223372036854775808.0 && value < 9223372036854775808.0 ) )
+		return MediaTime();
+	return MediaTime( static_cast<int64_t>( value ), timeScale );
+}
+
+MediaTime MediaTime::fromFrameRate( double framesPerSecond )
+{
+	if( ! ( framesPerSecond > 0 ) || framesPerSecond > INT32_MAX / 1000 )
+		return MediaTime();
+	// nominal rates come as floats, so match them to the rates they stand for within a tolerance
+	const double tolerance = 0.005;
+	double whole = std::floor( framesPerSecond + 0.5 );
+	if( whole >= 1 && std::fabs( framesPerSecond - whole ) < tolerance )
+		return MediaTime( 1, static_cast<int32_t>( whole ) );
+	double ntsc = std::floor( framesPerSecond * 1.001 + 0.5 );
+	if( ntsc >= 1 && std::fabs( framesPerSecond - ntsc * 1000 / 1001 ) < tolerance )
+		return MediaTime( 1001, static_cast<int32_t>( ntsc * 1000 ) );
+	return MediaTime( 1000, static_cast<int32_t>( std::floor( framesPerSecond * 1000 + 0.5 ) ) ).reduced();
+}
+
+int64_t MediaTime::toFrame( const MediaTime &frameDuration ) const
+{
+	if( ! isValid() || ! frameDuration.isValid() || frameDuration.mValue <= 0 )
+		return 0;
+	return static_cast<int64_t>( floorDivide( static_cast<WideInt>( mValue ) * frameDuration.mTimeScale,
+											  static_cast<WideInt>( frameDuration.mValue ) * mTimeScale ) );
+}
+
+MediaTime MediaTime::rescaled( int32_t timeScale ) const
+{
+	int64_t value;
+	if( ! isValid() || timeScale <= 0 || ! rescaleValue( mValue, mTimeScale, timeScale, &value ) )
+		return MediaTime();
+	return MediaTime( value, timeScale );
+}
+
+MediaTime MediaTime::reduced() const
+{
+	if( ! isValid() )
+		return MediaTime();
+	if( mValue == 0 )
+		return zero();
+	// the remainder has the same divisors and, unlike INT64_MIN, a magnitude that can be negated
+	int64_t gcd = greatestCommonDivisor( mTimeScale, mValue % mTimeScale );
+	return MediaTime( mValue / gcd, static_cast<int32_t>( mTimeScale / gcd ) );
+}
+
+MediaTime MediaTime::operator+( const MediaTime &rhs ) const
+{
+	return addTimes( *this, rhs, 1 );
+}
+
+MediaTime MediaTime::operator-( const MediaTime &rhs ) const
+{
+	// not as the sum with -rhs, which can't represent the negation of INT64_MIN
+	return addTimes( *this, rhs, -1 );
+}
+
+MediaTime MediaTime::operator*( int64_t scale ) const
+{
+	if( ! isValid() )
+		return MediaTime();
+	WideInt product = static_cast<WideInt>( mValue ) * scale;
+	return fitsInt64( product ) ? MediaTime( static_cast<int64_t>( product ), mTimeScale ) : MediaTime();
+}
+
+MediaTime MediaTime::operator-() const
+{
+	return ( isValid() && mValue != INT64_MIN ) ? MediaTime( -mValue, mTimeScale ) : MediaTime();
+}
+
+int MediaTime::compare( const MediaTime &lhs, const MediaTime &rhs )
+{
+	if( ! lhs.isValid() || ! rhs.isValid() )
+		return static_cast<int>( ! lhs.isValid() ) - static_cast<int>( ! rhs.isValid() );
+
+	WideInt l = static_cast<WideInt>( lhs.mValue ) * rhs.mTimeScale;
+	WideInt r = static_cast<WideInt>( rhs.mValue ) * lhs.mTimeScale;
+	return ( l < r ) ? -1 : ( ( l > r ) ? 1 : 0 );
+}
+
+} } // namespace cinder::avf
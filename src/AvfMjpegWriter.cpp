@@ -0,0 +1,734 @@
+#include "AvfMjpegWriter.h"
+#include "AvfFrameAllocator.h"
+#include "AvfSimd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace cinder { namespace avf {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Baseline JPEG encoder
+//
+// Standard IJG quantization tables and the Annex K Huffman tables, with the AAN forward DCT whose
+// output scaling is folded into the quantization step.
+
+namespace {
+
+const uint8_t sZigZag[64] = {
+	0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42, 3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18, 24, 31, 40, 44, 53,
+	10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60, 21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63 };
+
+const uint8_t sLumaQuant[64] = {
+	16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92, 49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99 };
+
+const uint8_t sChromaQuant[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99 };
+
+const uint8_t sDcLumaBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uint8_t sDcLumaValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const uint8_t sDcChromaBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uint8_t sDcChromaValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+const uint8_t sAcLumaBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uint8_t sAcLumaValues[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+	0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+	0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+	0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa };
+
+const uint8_t sAcChromaBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uint8_t sAcChromaValues[162] = {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+	0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+	0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+	0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa };
+
+struct HuffmanCode {
+	uint16_t	mCode;
+	uint8_t		mLength;
+};
+
+// Builds the canonical code for every symbol of a table given as DHT bit counts and values
+void buildHuffmanTable( const uint8_t *bits, const uint8_t *values, HuffmanCode *table )
+{
+	uint16_t code = 0;
+	int32_t k = 0;
+	for( int32_t length = 1; length <= 16; ++length ) {
+		for( int32_t i = 0; i < bits[length - 1]; ++i ) {
+			table[values[k]].mCode = code++;
+			table[values[k]].mLength = static_cast<uint8_t>( length );
+			++k;
+		}
+		code <<= 1;
+	}
+}
+
+struct HuffmanTables {
+	HuffmanTables()
+	{
+		buildHuffmanTable( sDcLumaBits, sDcLumaValues, mDcLuma );
+		buildHuffmanTable( sAcLumaBits, sAcLumaValues, mAcLuma );
+		buildHuffmanTable( sDcChromaBits, sDcChromaValues, mDcChroma );
+		buildHuffmanTable( sAcChromaBits, sAcChromaValues, mAcChroma );
+	}
+
+	HuffmanCode		mDcLuma[256], mAcLuma[256], mDcChroma[256], mAcChroma[256];
+};
+
+const HuffmanTables& getHuffmanTables()
+{
+	static const HuffmanTables sTables;
+	return sTables;
+}
+
+class BitWriter {
+  public:
+	BitWriter( std::vector<uint8_t> *out ) : mOut( out ), mBuffer( 0 ), mCount( 0 ) {}
+
+	void write( uint32_t bits, int32_t length )
+	{
+		mCount += length;
+		mBuffer |= bits << ( 24 - mCount );
+		while( mCount >= 8 ) {
+			uint8_t byte = static_cast<uint8_t>( mBuffer >> 16 );
+			mOut->push_back( byte );
+			if( byte == 0xFF )
+				mOut->push_back( 0 );
+			mBuffer <<= 8;
+			mBuffer &= 0xFFFFFF;
+			mCount -= 8;
+		}
+	}
+
+	void write( const HuffmanCode &code ) { write( code.mCode, code.mLength ); }
+
+	// pads the final byte with ones, as required by the spec
+	void flush() { write( 0x7F, 7 ); }
+
+  private:
+	std::vector<uint8_t>	*mOut;
+	uint32_t				mBuffer;
+	int32_t					mCount;
+};
+
+void forwardDct( float *d0, float *d1, float *d2, float *d3, float *d4, float *d5, float *d6, float *d7 )
+{
+	float tmp0 = *d0 + *d7;
+	float tmp7 = *d0 - *d7;
+	float tmp1 = *d1 + *d6;
+	float tmp6 = *d1 - *d6;
+	float tmp2 = *d2 + *d5;
+	float tmp5 = *d2 - *d5;
+	float tmp3 = *d3 + *d4;
+	float tmp4 = *d3 - *d4;
+
+	// even part
+	float tmp10 = tmp0 + tmp3;
+	float tmp13 = tmp0 - tmp3;
+	float tmp11 = tmp1 + tmp2;
+	float tmp12 = tmp1 - tmp2;
+
+	*d0 = tmp10 + tmp11;
+	*d4 = tmp10 - tmp11;
+
+	float z1 = ( tmp12 + tmp13 ) * 0.707106781f;
+	*d2 = tmp13 + z1;
+	*d6 = tmp13 - z1;
+
+	// odd part
+	tmp10 = tmp4 + tmp5;
+	tmp11 = tmp5 + tmp6;
+	tmp12 = tmp6 + tmp7;
+
+	float z5 = ( tmp10 - tmp12 ) * 0.382683433f;
+	float z2 = tmp10 * 0.541196100f + z5;
+	float z4 = tmp12 * 1.306562965f + z5;
+	float z3 = tmp11 * 0.707106781f;
+
+	float z11 = tmp7 + z3;
+	float z13 = tmp7 - z3;
+
+	*d5 = z13 + z2;
+	*d3 = z13 - z2;
+	*d1 = z11 + z4;
+	*d7 = z11 - z4;
+}
+
+void writeCoefficient( BitWriter *writer, const HuffmanCode &prefix, int32_t value, int32_t category )
+{
+	writer->write( prefix );
+	if( category > 0 ) {
+		int32_t bits = ( value < 0 )? value - 1: value;
+		writer->write( static_cast<uint32_t>( bits ) & ( ( 1u << category ) - 1 ), category );
+	}
+}
+
+int32_t coefficientCategory( int32_t value )
+{
+	uint32_t magnitude = static_cast<uint32_t>( value < 0 ? -value : value );
+	int32_t category = 0;
+	while( magnitude ) {
+		++category;
+		magnitude >>= 1;
+	}
+	return category;
+}
+
+// Transforms, quantizes and entropy codes one 8x8 block, returning its DC coefficient
+int32_t encodeBlock( BitWriter *writer, float *block, const float *quant, int32_t previousDc, const HuffmanCode *dcTable, const HuffmanCode *acTable )
+{
+	for( int32_t row = 0; row < 64; row += 8 )
+		forwardDct( &block[row], &block[row + 1], &block[row + 2], &block[row + 3], &block[row + 4], &block[row + 5], &block[row + 6], &block[row + 7] );
+	for( int32_t col = 0; col < 8; ++col )
+		forwardDct( &block[col], &block[col + 8], &block[col + 16], &block[col + 24], &block[col + 32], &block[col + 40], &block[col + 48], &block[col + 56] );
+
+	int32_t coefficients[64];
+	for( int32_t i = 0; i < 64; ++i ) {
+		float v = block[i] * quant[i];
+		coefficients[sZigZag[i]] = static_cast<int32_t>( v < 0 ? std::ceil( v - 0.5f ) : std::floor( v + 0.5f ) );
+	}
+
+	int32_t diff = coefficients[0] - previousDc;
+	writeCoefficient( writer, dcTable[coefficientCategory( diff )], diff, coefficientCategory( diff ) );
+
+	int32_t last = 63;
+	while( last > 0 && coefficients[last] == 0 )
+		--last;
+
+	for( int32_t i = 1; i <= last; ++i ) {
+		int32_t run = 0;
+		while( coefficients[i] == 0 ) {
+			++run;
+			++i;
+		}
+		while( run >= 16 ) {
+			writer->write( acTable[0xF0] );
+			run -= 16;
+		}
+		int32_t category = coefficientCategory( coefficients[i] );
+		writeCoefficient( writer, acTable[( run << 4 ) + category], coefficients[i], category );
+	}
+	if( last != 63 )
+		writer->write( acTable[0x00] );
+
+	return coefficients[0];
+}
+
+void writeMarker( std::vector<uint8_t> *out, uint8_t marker, uint16_t length )
+{
+	const uint8_t header[4] = { 0xFF, marker, static_cast<uint8_t>( length >> 8 ), static_cast<uint8_t>( length & 0xFF ) };
+	out->insert( out->end(), header, header + 4 );
+}
+
+void writeHuffmanTable( std::vector<uint8_t> *out, uint8_t tableId, const uint8_t *bits, const uint8_t *values, size_t numValues )
+{
+	out->push_back( tableId );
+	out->insert( out->end(), bits, bits + 16 );
+	out->insert( out->end(), values, values + numValues );
+}
+
+} // anonymous namespace
+
+void encodeJpeg( const uint8_t *data, int32_t width, int32_t height, int32_t rowBytes, const MjpegPixelLayout &layout, float quality, std::vector<uint8_t> *result )
+{
+	static const float sAanScale[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+	// IJG quality scaling
+	int32_t q = std::min( std::max( static_cast<int32_t>( quality * 100 + 0.5f ), 1 ), 100 );
+	int32_t scale = ( q < 50 )? 5000 / q: 200 - q * 2;
+
+	uint8_t lumaTable[64], chromaTable[64];
+	for( int32_t i = 0; i < 64; ++i ) {
+		lumaTable[sZigZag[i]] = static_cast<uint8_t>( std::min( std::max( ( sLumaQuant[i] * scale + 50 ) / 100, 1 ), 255 ) );
+		chromaTable[sZigZag[i]] = static_cast<uint8_t>( std::min( std::max( ( sChromaQuant[i] * scale + 50 ) / 100, 1 ), 255 ) );
+	}
+
+	float lumaQuant[64], chromaQuant[64];
+	for( int32_t row = 0; row < 8; ++row ) {
+		for( int32_t col = 0; col < 8; ++col ) {
+			int32_t k = row * 8 + col;
+			float aan = sAanScale[row] * sAanScale[col] * 8;
+			lumaQuant[k] = 1.0f / ( lumaTable[sZigZag[k]] * aan );
+			chromaQuant[k] = 1.0f / ( chromaTable[sZigZag[k]] * aan );
+		}
+	}
+
+	result->clear();
+	result->reserve( static_cast<size_t>( width ) * height / 4 + 1024 );
+
+	// SOI, JFIF APP0
+	result->push_back( 0xFF );
+	result->push_back( 0xD8 );
+	writeMarker( result, 0xE0, 16 );
+	const uint8_t jfif[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	result->insert( result->end(), jfif, jfif + 14 );
+
+	// DQT
+	writeMarker( result, 0xDB, 132 );
+	result->push_back( 0 );
+	result->insert( result->end(), lumaTable, lumaTable + 64 );
+	result->push_back( 1 );
+	result->insert( result->end(), chromaTable, chromaTable + 64 );
+
+	// SOF0, 4:2:0
+	writeMarker( result, 0xC0, 17 );
+	const uint8_t frame[15] = { 8, static_cast<uint8_t>( height >> 8 ), static_cast<uint8_t>( height & 0xFF ), static_cast<uint8_t>( width >> 8 ), static_cast<uint8_t>( width & 0xFF ),
+								3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+	result->insert( result->end(), frame, frame + 15 );
+
+	// DHT
+	writeMarker( result, 0xC4, 2 + 4 * 17 + 12 + 162 + 12 + 162 );
+	writeHuffmanTable( result, 0x00, sDcLumaBits, sDcLumaValues, 12 );
+	writeHuffmanTable( result, 0x10, sAcLumaBits, sAcLumaValues, 162 );
+	writeHuffmanTable( result, 0x01, sDcChromaBits, sDcChromaValues, 12 );
+	writeHuffmanTable( result, 0x11, sAcChromaBits, sAcChromaValues, 162 );
+
+	// SOS
+	writeMarker( result, 0xDA, 12 );
+	const uint8_t scan[10] = { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+	result->insert( result->end(), scan, scan + 10 );
+
+	const HuffmanTables &tables = getHuffmanTables();
+	BitWriter writer( result );
+	int32_t dcY = 0, dcCb = 0, dcCr = 0;
+	float y[4][64], cb[64], cr[64];
+
+	for( int32_t mcuY = 0; mcuY < height; mcuY += 16 ) {
+		for( int32_t mcuX = 0; mcuX < width; mcuX += 16 ) {
+			std::fill( cb, cb + 64, 0.0f );
+			std::fill( cr, cr + 64, 0.0f );
+			for( int32_t py = 0; py < 16; ++py ) {
+				const uint8_t *row = data + std::min( mcuY + py, height - 1 ) * rowBytes;
+				for( int32_t px = 0; px < 16; ++px ) {
+					const uint8_t *pixel = row + std::min( mcuX + px, width - 1 ) * layout.mPixelInc;
+					float r = pixel[layout.mRedOffset], g = pixel[layout.mGreenOffset], b = pixel[layout.mBlueOffset];
+					y[( py >> 3 ) * 2 + ( px >> 3 )][( py & 7 ) * 8 + ( px & 7 )] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+					int32_t c = ( py >> 1 ) * 8 + ( px >> 1 );
+					cb[c] += 0.25f * ( -0.168736f * r - 0.331264f * g + 0.5f * b );
+					cr[c] += 0.25f * ( 0.5f * r - 0.418688f * g - 0.081312f * b );
+				}
+			}
+			for( int32_t i = 0; i < 4; ++i )
+				dcY = encodeBlock( &writer, y[i], lumaQuant, dcY, tables.mDcLuma, tables.mAcLuma );
+			dcCb = encodeBlock( &writer, cb, chromaQuant, dcCb, tables.mDcChroma, tables.mAcChroma );
+			dcCr = encodeBlock( &writer, cr, chromaQuant, dcCr, tables.mDcChroma, tables.mAcChroma );
+		}
+	}
+	writer.flush();
+
+	// EOI
+	result->push_back( 0xFF );
+	result->push_back( 0xD9 );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// QuickTime atom helpers
+
+namespace {
+
+void putBe16( std::vector<uint8_t> *out, uint32_t v )
+{
+	out->push_back( static_cast<uint8_t>( v >> 8 ) );
+	out->push_back( static_cast<uint8_t>( v ) );
+}
+
+void putBe32( std::vector<uint8_t> *out, uint32_t v )
+{
+	putBe16( out, v >> 16 );
+	putBe16( out, v & 0xFFFF );
+}
+
+void putBe64( std::vector<uint8_t> *out, uint64_t v )
+{
+	putBe32( out, static_cast<uint32_t>( v >> 32 ) );
+	putBe32( out, static_cast<uint32_t>( v ) );
+}
+
+void putType( std::vector<uint8_t> *out, const char *type )
+{
+	out->insert( out->end(), type, type + 4 );
+}
+
+void putZeros( std::vector<uint8_t> *out, size_t count )
+{
+	out->insert( out->end(), count, 0 );
+}
+
+void putMatrix( std::vector<uint8_t> *out )
+{
+	const uint32_t identity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+	for( int32_t i = 0; i < 9; ++i )
+		putBe32( out, identity[i] );
+}
+
+// Writes zero creation and modification times, 32 bits each in version 0 atoms and 64 in version 1
+void putTimes( std::vector<uint8_t> *out, bool wide )
+{
+	putZeros( out, wide ? 16 : 8 );
+}
+
+void putDuration( std::vector<uint8_t> *out, int64_t duration, bool wide )
+{
+	if( wide )
+		putBe64( out, static_cast<uint64_t>( duration ) );
+	else
+		putBe32( out, static_cast<uint32_t>( duration ) );
+}
+
+// Opens an atom and returns its start, to be closed with endAtom()
+size_t beginAtom( std::vector<uint8_t> *out, const char *type )
+{
+	size_t start = out->size();
+	putBe32( out, 0 );
+	putType( out, type );
+	return start;
+}
+
+void endAtom( std::vector<uint8_t> *out, size_t start )
+{
+	uint32_t size = static_cast<uint32_t>( out->size() - start );
+	(*out)[start + 0] = static_cast<uint8_t>( size >> 24 );
+	(*out)[start + 1] = static_cast<uint8_t>( size >> 16 );
+	(*out)[start + 2] = static_cast<uint8_t>( size >> 8 );
+	(*out)[start + 3] = static_cast<uint8_t>( size );
+}
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MjpegWriter
+
+MjpegWriter::MjpegWriter( const std::string &path, int32_t width, int32_t height, int32_t timeScale, float quality, size_t numThreads )
+	: mWidth( width ), mHeight( height ), mTimeScale( timeScale ), mQuality( quality ), mNumFrames( 0 ),
+	mFinished( false ), mStopping( false ), mWriteFailed( false ), mInFlight( 0 ), mNextToWrite( 0 ), mMediaDataStart( 0 ), mWritePosition( 0 )
+{
+	mFile = std::fopen( path.c_str(), "wb" );
+	if( ! mFile )
+		throw MjpegWriterExc();
+
+	std::vector<uint8_t> header;
+	size_t ftyp = beginAtom( &header, "ftyp" );
+	putType( &header, "qt  " );
+	putBe32( &header, 0x00000200 );
+	putType( &header, "qt  " );
+	endAtom( &header, ftyp );
+
+	// 64-bit mdat whose size is patched in finish()
+	mMediaDataStart = header.size();
+	putBe32( &header, 1 );
+	putType( &header, "mdat" );
+	putBe64( &header, 0 );
+	if( std::fwrite( &header[0], 1, header.size(), mFile ) != header.size() ) {
+		std::fclose( mFile );
+		throw MjpegWriterExc();
+	}
+	mWritePosition = header.size();
+
+	if( numThreads == 0 )
+		numThreads = std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+	for( size_t i = 0; i < numThreads; ++i )
+		mThreads.push_back( std::thread( &MjpegWriter::workerLoop, this ) );
+}
+
+MjpegWriter::~MjpegWriter()
+{
+	// a failure can't be reported from here; call finish() first to learn of it
+	try {
+		finish();
+	}
+	catch( MjpegWriterExc& ) {
+	}
+}
+
+void MjpegWriter::addFrame( const uint8_t *data, int32_t rowBytes, const MjpegPixelLayout &layout, int64_t duration, const uint8_t *lut )
+{
+	if( mFinished )
+		throw MjpegWriterExc();
+	{
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		if( mWriteFailed )
+			throw MjpegWriterExc();
+	}
+
+	std::shared_ptr<Job> job( new Job );
+	job->mIndex = mNumFrames;
+	job->mLayout = layout;
+	job->mRowBytes = static_cast<int32_t>( FrameAllocator::getRowBytes( mWidth, layout.mPixelInc ) );
+	uint8_t *pixels = static_cast<uint8_t*>( FrameAllocator::allocate( static_cast<size_t>( job->mRowBytes ) * mHeight ) );
+	if( ! pixels )
+		throw MjpegWriterExc();
+	job->mPixels = std::shared_ptr<uint8_t>( pixels, FrameAllocator::free );
+	// JPEG drops alpha, so mapping it along with the color channels does no harm
+	copyPixelRows( data, rowBytes, layout.mPixelInc, pixels, job->mRowBytes, layout.mPixelInc, NULL, mWidth, mHeight, 1, lut );
+
+	{
+		std::unique_lock<std::mutex> lock( mJobMutex );
+		while( mInFlight >= mThreads.size() * 2 )
+			mSlotCondition.wait( lock );
+		++mInFlight;
+		mJobs.push_back( job );
+	}
+	mJobCondition.notify_one();
+
+	{
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		mSampleDurations.push_back( duration );
+	}
+	++mNumFrames;
+}
+
+void MjpegWriter::workerLoop()
+{
+	std::vector<uint8_t> encoded;
+	while( true ) {
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock( mJobMutex );
+			while( mJobs.empty() && ! mStopping )
+				mJobCondition.wait( lock );
+			if( mJobs.empty() )
+				return;
+			job = mJobs.front();
+			mJobs.pop_front();
+		}
+
+		encodeJpeg( job->mPixels.get(), mWidth, mHeight, job->mRowBytes, job->mLayout, mQuality, &encoded );
+
+		{
+			std::lock_guard<std::mutex> lock( mWriteMutex );
+			mEncoded[job->mIndex].swap( encoded );
+			writeEncodedFrames();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( mJobMutex );
+			--mInFlight;
+		}
+		mSlotCondition.notify_one();
+	}
+}
+
+// Writes every completed frame that is next in presentation order. Expects mWriteMutex to be held.
+void MjpegWriter::writeEncodedFrames()
+{
+	std::map<uint32_t, std::vector<uint8_t> >::iterator it = mEncoded.begin();
+	while( it != mEncoded.end() && it->first == mNextToWrite ) {
+		mSampleOffsets.push_back( mWritePosition );
+		mSampleSizes.push_back( static_cast<uint32_t>( it->second.size() ) );
+		if( ! mWriteFailed && std::fwrite( &it->second[0], 1, it->second.size(), mFile ) != it->second.size() )
+			mWriteFailed = true;
+		mWritePosition += it->second.size();
+		mEncoded.erase( it++ );
+		++mNextToWrite;
+	}
+}
+
+void MjpegWriter::finish()
+{
+	if( mFinished )
+		return;
+	mFinished = true;
+
+	{
+		std::lock_guard<std::mutex> lock( mJobMutex );
+		mStopping = true;
+	}
+	mJobCondition.notify_all();
+	for( size_t i = 0; i < mThreads.size(); ++i )
+		mThreads[i].join();
+	mThreads.clear();
+
+	bool success = ! mWriteFailed && writeMovieHeader();
+	// buffered writes can still fail on close
+	success = ( std::fclose( mFile ) == 0 ) && success;
+	mFile = NULL;
+	if( ! success )
+		throw MjpegWriterExc();
+}
+
+bool MjpegWriter::writeMovieHeader()
+{
+	uint64_t mediaDataEnd = mWritePosition;
+
+	int64_t duration = 0;
+	for( size_t i = 0; i < mSampleDurations.size(); ++i )
+		duration += mSampleDurations[i];
+	// version 1 atoms carry 64 bit times, for recordings whose duration doesn't fit 32 bits at the time scale
+	const bool wideTimes = static_cast<uint64_t>( duration ) > UINT32_MAX;
+
+	std::vector<uint8_t> moov;
+	size_t moovAtom = beginAtom( &moov, "moov" );
+
+	size_t mvhd = beginAtom( &moov, "mvhd" );
+	putBe32( &moov, wideTimes ? 0x01000000 : 0 );	// version, flags
+	putTimes( &moov, wideTimes );			// creation and modification time
+	putBe32( &moov, mTimeScale );
+	putDuration( &moov, duration, wideTimes );
+	putBe32( &moov, 0x00010000 );			// preferred rate
+	putBe16( &moov, 0x0100 );				// preferred volume
+	putZeros( &moov, 10 );
+	putMatrix( &moov );
+	putZeros( &moov, 24 );					// preview, poster, selection and current times
+	putBe32( &moov, 2 );					// next track id
+	endAtom( &moov, mvhd );
+
+	size_t trak = beginAtom( &moov, "trak" );
+
+	size_t tkhd = beginAtom( &moov, "tkhd" );
+	putBe32( &moov, ( wideTimes ? 0x01000000 : 0 ) | 0x0000000F );	// enabled, in movie, in preview, in poster
+	putTimes( &moov, wideTimes );
+	putBe32( &moov, 1 );					// track id
+	putBe32( &moov, 0 );
+	putDuration( &moov, duration, wideTimes );
+	putZeros( &moov, 8 );
+	putBe16( &moov, 0 );					// layer
+	putBe16( &moov, 0 );					// alternate group
+	putBe16( &moov, 0 );					// volume
+	putBe16( &moov, 0 );
+	putMatrix( &moov );
+	putBe32( &moov, static_cast<uint32_t>( mWidth ) << 16 );
+	putBe32( &moov, static_cast<uint32_t>( mHeight ) << 16 );
+	endAtom( &moov, tkhd );
+
+	size_t mdia = beginAtom( &moov, "mdia" );
+
+	size_t mdhd = beginAtom( &moov, "mdhd" );
+	putBe32( &moov, wideTimes ? 0x01000000 : 0 );
+	putTimes( &moov, wideTimes );
+	putBe32( &moov, mTimeScale );
+	putDuration( &moov, duration, wideTimes );
+	putBe16( &moov, 0 );					// language
+	putBe16( &moov, 0 );					// quality
+	endAtom( &moov, mdhd );
+
+	size_t hdlr = beginAtom( &moov, "hdlr" );
+	putBe32( &moov, 0 );
+	putType( &moov, "mhlr" );
+	putType( &moov, "vide" );
+	putZeros( &moov, 12 );
+	moov.push_back( 0 );					// empty pascal name
+	endAtom( &moov, hdlr );
+
+	size_t minf = beginAtom( &moov, "minf" );
+
+	size_t vmhd = beginAtom( &moov, "vmhd" );
+	putBe32( &moov, 0x00000001 );
+	putBe16( &moov, 0x0040 );				// graphics mode: dither copy
+	putZeros( &moov, 6 );
+	endAtom( &moov, vmhd );
+
+	size_t dataHdlr = beginAtom( &moov, "hdlr" );
+	putBe32( &moov, 0 );
+	putType( &moov, "dhlr" );
+	putType( &moov, "alis" );
+	putZeros( &moov, 12 );
+	moov.push_back( 0 );
+	endAtom( &moov, dataHdlr );
+
+	size_t dinf = beginAtom( &moov, "dinf" );
+	size_t dref = beginAtom( &moov, "dref" );
+	putBe32( &moov, 0 );
+	putBe32( &moov, 1 );
+	size_t alis = beginAtom( &moov, "alis" );
+	putBe32( &moov, 0x00000001 );			// media data is in this file
+	endAtom( &moov, alis );
+	endAtom( &moov, dref );
+	endAtom( &moov, dinf );
+
+	size_t stbl = beginAtom( &moov, "stbl" );
+
+	size_t stsd = beginAtom( &moov, "stsd" );
+	putBe32( &moov, 0 );
+	putBe32( &moov, 1 );
+	size_t jpeg = beginAtom( &moov, "jpeg" );
+	putZeros( &moov, 6 );
+	putBe16( &moov, 1 );					// data reference index
+	putBe16( &moov, 0 );					// version
+	putBe16( &moov, 0 );					// revision
+	putType( &moov, "appl" );
+	putBe32( &moov, 0 );					// temporal quality
+	putBe32( &moov, static_cast<uint32_t>( std::min( std::max( mQuality, 0.0f ), 1.0f ) * 1023 ) );
+	putBe16( &moov, static_cast<uint32_t>( mWidth ) );
+	putBe16( &moov, static_cast<uint32_t>( mHeight ) );
+	putBe32( &moov, 0x00480000 );			// 72 dpi
+	putBe32( &moov, 0x00480000 );
+	putBe32( &moov, 0 );					// data size
+	putBe16( &moov, 1 );					// frames per sample
+	const char name[] = "Photo - JPEG";
+	moov.push_back( static_cast<uint8_t>( sizeof( name ) - 1 ) );
+	moov.insert( moov.end(), name, name + sizeof( name ) - 1 );
+	putZeros( &moov, 31 - ( sizeof( name ) - 1 ) );
+	putBe16( &moov, 24 );					// depth
+	putBe16( &moov, 0xFFFF );				// no color table
+	endAtom( &moov, jpeg );
+	endAtom( &moov, stsd );
+
+	// run length encoded sample durations
+	std::vector<std::pair<uint32_t, uint32_t> > runs;
+	for( size_t i = 0; i < mSampleDurations.size(); ++i ) {
+		uint32_t d = static_cast<uint32_t>( mSampleDurations[i] );
+		if( ! runs.empty() && runs.back().second == d )
+			++runs.back().first;
+		else
+			runs.push_back( std::make_pair( 1u, d ) );
+	}
+	size_t stts = beginAtom( &moov, "stts" );
+	putBe32( &moov, 0 );
+	putBe32( &moov, static_cast<uint32_t>( runs.size() ) );
+	for( size_t i = 0; i < runs.size(); ++i ) {
+		putBe32( &moov, runs[i].first );
+		putBe32( &moov, runs[i].second );
+	}
+	endAtom( &moov, stts );
+
+	// one sample per chunk
+	size_t stsc = beginAtom( &moov, "stsc" );
+	putBe32( &moov, 0 );
+	putBe32( &moov, 1 );
+	putBe32( &moov, 1 );
+	putBe32( &moov, 1 );
+	putBe32( &moov, 1 );
+	endAtom( &moov, stsc );
+
+	size_t stsz = beginAtom( &moov, "stsz" );
+	putBe32( &moov, 0 );
+	putBe32( &moov, 0 );
+	putBe32( &moov, static_cast<uint32_t>( mSampleSizes.size() ) );
+	for( size_t i = 0; i < mSampleSizes.size(); ++i )
+		putBe32( &moov, mSampleSizes[i] );
+	endAtom( &moov, stsz );
+
+	size_t co64 = beginAtom( &moov, "co64" );
+	putBe32( &moov, 0 );
+	putBe32( &moov, static_cast<uint32_t>( mSampleOffsets.size() ) );
+	for( size_t i = 0; i < mSampleOffsets.size(); ++i )
+		putBe64( &moov, mSampleOffsets[i] );
+	endAtom( &moov, co64 );
+
+	endAtom( &moov, stbl );
+	endAtom( &moov, minf );
+	endAtom( &moov, mdia );
+	endAtom( &moov, trak );
+	endAtom( &moov, moovAtom );
+
+	if( std::fwrite( &moov[0], 1, moov.size(), mFile ) != moov.size() )
+		return false;
+
+	// patch the 64-bit mdat size
+	std::vector<uint8_t> size;
+	putBe64( &size, mediaDataEnd - mMediaDataStart );
+	return std::fseek( mFile, static_cast<long>( mMediaDataStart + 8 ), SEEK_SET ) == 0
+		&& std::fwrite( &size[0], 1, size.size(), mFile ) == size.size();
+}
+
+} } // namespace cinder::avf
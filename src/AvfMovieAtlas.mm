@@ -0,0 +1,130 @@
+#include "AvfMovieAtlas.h"
+#include "AvfUtils.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+// Fills \a blit's channel map from \a src's layout to \a dst's, leaving it a straight copy when both match
+void setBlitChannels( const Surface8u &src, const Surface8u &dst, PixelBlit *blit )
+{
+	const SurfaceChannelOrder &srcOrder = src.getChannelOrder();
+	const SurfaceChannelOrder &dstOrder = dst.getChannelOrder();
+	blit->mDstFromSrc[0] = blit->mDstFromSrc[1] = blit->mDstFromSrc[2] = blit->mDstFromSrc[3] = -1;
+	blit->mDstFromSrc[dstOrder.getRedOffset()] = srcOrder.getRedOffset();
+	blit->mDstFromSrc[dstOrder.getGreenOffset()] = srcOrder.getGreenOffset();
+	blit->mDstFromSrc[dstOrder.getBlueOffset()] = srcOrder.getBlueOffset();
+	if( dst.hasAlpha() && src.hasAlpha() )
+		blit->mDstFromSrc[dstOrder.getAlphaOffset()] = srcOrder.getAlphaOffset();
+
+	bool identity = ( blit->mSrcInc == blit->mDstInc );
+	for( int32_t c = 0; c < blit->mDstInc && identity; ++c )
+		identity = ( blit->mDstFromSrc[c] == c );
+	blit->mSwizzle = ! identity;
+}
+
+bool entryIsLarger( const std::pair<int64_t, size_t> &lhs, const std::pair<int64_t, size_t> &rhs )
+{
+	return lhs.first > rhs.first;
+}
+
+} // anonymous namespace
+
+MovieAtlas::MovieAtlas( int32_t width, int32_t height, int32_t padding, size_t numThreads )
+	: mPacker( width, height, padding ), mNumThreads( numThreads )
+{
+	mSurface = createFrameSurface( width, height, true, SurfaceChannelOrder::BGRA );
+	// padding and unplaced space stay transparent
+	std::memset( mSurface.getData(), 0, mSurface.getRowBytes() * mSurface.getHeight() );
+}
+
+size_t MovieAtlas::addMovie( const MovieSurfaceRef &movie )
+{
+	Entry entry;
+	entry.mMovie = movie;
+	entry.mState = WAITING;
+	mEntries.push_back( entry );
+	return mEntries.size() - 1;
+}
+
+Area MovieAtlas::getArea( size_t index ) const
+{
+	const Entry &entry = mEntries[index];
+	if( entry.mState != PLACED )
+		return Area( 0, 0, 0, 0 );
+	return Area( entry.mRect.mX, entry.mRect.mY, entry.mRect.mX + entry.mRect.mWidth, entry.mRect.mY + entry.mRect.mHeight );
+}
+
+Rectf MovieAtlas::getTexCoords( size_t index ) const
+{
+	Area area = getArea( index );
+	const float width = static_cast<float>( getWidth() ), height = static_cast<float>( getHeight() );
+	return Rectf( area.x1 / width, area.y1 / height, area.x2 / width, area.y2 / height );
+}
+
+void MovieAtlas::place( Entry *entry )
+{
+	const int32_t width = entry->mMovie->getWidth(), height = entry->mMovie->getHeight();
+	if( width <= 0 || height <= 0 )
+		return;
+
+	// a movie that doesn't fit isn't retried every frame, only by repack()
+	entry->mState = mPacker.insert( width, height, &entry->mRect )? PLACED: REJECTED;
+	entry->mFrame.reset();
+}
+
+void MovieAtlas::repack()
+{
+	mPacker.clear();
+	std::memset( mSurface.getData(), 0, mSurface.getRowBytes() * mSurface.getHeight() );
+
+	// tall and wide movies first leave the small ones to fill the gaps
+	std::vector<std::pair<int64_t, size_t> > order;
+	for( size_t i = 0; i < mEntries.size(); ++i ) {
+		mEntries[i].mState = WAITING;
+		order.push_back( std::make_pair( static_cast<int64_t>( mEntries[i].mMovie->getWidth() ) * mEntries[i].mMovie->getHeight(), i ) );
+	}
+	std::stable_sort( order.begin(), order.end(), entryIsLarger );
+	for( size_t i = 0; i < order.size(); ++i )
+		place( &mEntries[order[i].second] );
+}
+
+bool MovieAtlas::update()
+{
+	std::vector<PixelBlit> blits;
+
+	for( size_t i = 0; i < mEntries.size(); ++i ) {
+		Entry &entry = mEntries[i];
+		if( entry.mState == WAITING )
+			place( &entry );
+		if( entry.mState != PLACED )
+			continue;
+		// compared by identity like MovieTiles does, which leaves checkNewFrame() to the application
+		Surface8u frame = entry.mMovie->getSurface();
+		if( ! frame || ( entry.mFrame && frame.getData() == entry.mFrame.getData() ) )
+			continue;
+
+		PixelBlit blit;
+		blit.mSrc = frame.getData();
+		blit.mSrcRowBytes = frame.getRowBytes();
+		blit.mSrcInc = frame.getPixelInc();
+		blit.mDst = mSurface.getData( Vec2i( entry.mRect.mX, entry.mRect.mY ) );
+		blit.mDstRowBytes = mSurface.getRowBytes();
+		blit.mDstInc = mSurface.getPixelInc();
+		// a frame that no longer matches the movie's size, after selecting another track, is cropped to the rectangle
+		blit.mWidth = std::min( frame.getWidth(), entry.mRect.mWidth );
+		blit.mHeight = std::min( frame.getHeight(), entry.mRect.mHeight );
+		setBlitChannels( frame, mSurface, &blit );
+
+		blits.push_back( blit );
+		entry.mFrame = frame;
+	}
+
+	blitPixels( blits, mNumThreads );
+	return ! blits.empty();
+}
+
+} } // namespace cinder::avf
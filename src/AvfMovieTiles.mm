@@ -0,0 +1,96 @@
+#include "AvfMovieTiles.h"
+#include "AvfUtils.h"
+
+#include <algorithm>
+
+namespace cinder { namespace avf {
+
+MovieTiles::MovieTiles( const MovieSurfaceRef &movie, int32_t columns, int32_t rows )
+	: mMovie( movie ), mColumns( std::max( columns, 1 ) ), mRows( std::max( rows, 1 ) ), mCropChanged( false ), mFrameOrigin( 0, 0 )
+{
+	mEnabled.assign( mColumns * mRows, true );
+	mNewFrame.assign( mColumns * mRows, false );
+}
+
+Area MovieTiles::getTileArea( int32_t column, int32_t row ) const
+{
+	const int32_t width = std::max( mMovie->getWidth(), 0 ), height = std::max( mMovie->getHeight(), 0 );
+	return Area( column * width / mColumns, row * height / mRows, ( column + 1 ) * width / mColumns, ( row + 1 ) * height / mRows );
+}
+
+void MovieTiles::enableTile( int32_t column, int32_t row, bool enable )
+{
+	size_t i = index( column, row );
+	if( mEnabled[i] == enable )
+		return;
+
+	mEnabled[i] = enable;
+	if( ! enable )
+		mNewFrame[i] = false;
+	mCropChanged = true;
+}
+
+void MovieTiles::enableAllTiles( bool enable )
+{
+	for( int32_t row = 0; row < mRows; ++row )
+		for( int32_t column = 0; column < mColumns; ++column )
+			enableTile( column, row, enable );
+}
+
+void MovieTiles::updateCropHint()
+{
+	Area bounds( 0, 0, 0, 0 );
+	bool any = false;
+	for( int32_t row = 0; row < mRows; ++row ) {
+		for( int32_t column = 0; column < mColumns; ++column ) {
+			if( ! mEnabled[index( column, row )] )
+				continue;
+			Area tile = getTileArea( column, row );
+			if( any )
+				bounds.include( tile );
+			else
+				bounds = tile;
+			any = true;
+		}
+	}
+
+	// without any tile there's nothing to crop to, and full frames keep the movie ready for the next enable
+	if( any )
+		mMovie->setCropHint( bounds );
+	else
+		mMovie->resetCropHint();
+	mCropChanged = false;
+}
+
+void MovieTiles::update()
+{
+	// the tile grid is only known once the movie has loaded
+	if( mCropChanged && mMovie->getWidth() > 0 )
+		updateCropHint();
+
+	// a frame is new when its pixels differ, which holds because mFrame keeps the previous buffer from being recycled
+	Surface8u frame = mMovie->getSurface();
+	if( ! frame || ( mFrame && frame.getData() == mFrame.getData() ) )
+		return;
+
+	// the movie tags every frame with the crop hint it was rendered with, which lags behind the hint while frames are in flight
+	mFrame = frame;
+	const Area &crop = mMovie->getFrameCrop();
+	mFrameOrigin = ( crop.getWidth() > 0 )? crop.getUL(): Vec2i( 0, 0 );
+	for( size_t i = 0; i < mNewFrame.size(); ++i )
+		mNewFrame[i] = mEnabled[i];
+}
+
+Surface8u MovieTiles::getTile( int32_t column, int32_t row )
+{
+	size_t i = index( column, row );
+	if( ! mEnabled[i] || ! mFrame )
+		return Surface8u();
+
+	mNewFrame[i] = false;
+	Area area = getTileArea( column, row );
+	area.offset( -mFrameOrigin );
+	return createSurfaceView( mFrame, area );
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,240 @@
+#include "AvfMultiTrackPlayer.h"
+#include "AvfUtils.h"
+#include "AvfWorkerPool.h"
+
+#if defined( CINDER_COCOA )
+	#import <AVFoundation/AVFoundation.h>
+	#include <CoreVideo/CoreVideo.h>
+#endif
+
+#include <cmath>
+
+namespace cinder { namespace avf {
+
+MultiTrackPlayer::MultiTrackPlayer( const fs::path &path, const std::vector<size_t> &videoTracks )
+	: mAsset( nil ), mReader( nil ), mPlaying( false ), mLoop( false ), mRate( 1.0f )
+{
+	NSURL* asset_url = [NSURL fileURLWithPath:[NSString stringWithCString:path.c_str() encoding:[NSString defaultCStringEncoding]]];
+	if (!asset_url)
+		throw AvfPathInvalidExc();
+
+	NSDictionary* asset_options = @{(id)AVURLAssetPreferPreciseDurationAndTimingKey: @(YES)};
+	mAsset = [[AVURLAsset alloc] initWithURL:asset_url options:asset_options];
+
+	NSArray* video_tracks = [mAsset tracksWithMediaType:AVMediaTypeVideo];
+	std::vector<size_t> indices( videoTracks );
+	if (indices.empty()) {
+		for (size_t i = 0; i < [video_tracks count]; ++i)
+			indices.push_back( i );
+	}
+	if (indices.empty()) {
+		[mAsset release];
+		throw AvfFileInvalidExc();
+	}
+
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (indices[i] >= [video_tracks count]) {
+			for (size_t t = 0; t < mTracks.size(); ++t)
+				[mTracks[t].mTrack release];
+			[mAsset release];
+			throw AvfFileInvalidExc();
+		}
+
+		Track track;
+		track.mTrack = [[video_tracks objectAtIndex:indices[i]] retain];
+		track.mVideoTrackIndex = indices[i];
+		CGSize size = CGSizeApplyAffineTransform([track.mTrack naturalSize], [track.mTrack preferredTransform]);
+		track.mWidth = static_cast<int32_t>(std::abs(size.width));
+		track.mHeight = static_cast<int32_t>(std::abs(size.height));
+		track.mFrameDuration = getFrameDuration(track.mTrack);
+		mTracks.push_back( track );
+	}
+
+	mMediaDuration = toMediaTime( [mAsset duration] );
+	setPlayhead( MediaTime::zero() );
+}
+
+MultiTrackPlayer::~MultiTrackPlayer()
+{
+	stopReader();
+
+	for (size_t t = 0; t < mTracks.size(); ++t) {
+		mTracks[t].mSurface.reset();
+		[mTracks[t].mTrack release];
+	}
+	[mAsset release];
+}
+
+void MultiTrackPlayer::play()
+{
+	if (mPlaying) return;
+
+	setPlayhead( mPlayheadTime );
+	mPlaying = true;
+}
+
+void MultiTrackPlayer::stop()
+{
+	if (!mPlaying) return;
+
+	setPlayhead( getCurrentMediaTime() );
+	mPlaying = false;
+}
+
+bool MultiTrackPlayer::isDone() const
+{
+	return !mLoop && getCurrentMediaTime() >= mMediaDuration;
+}
+
+void MultiTrackPlayer::setRate( float rate )
+{
+	setPlayhead( getCurrentMediaTime() );
+	mRate = std::fabs( rate );
+}
+
+MediaTime MultiTrackPlayer::getCurrentMediaTime() const
+{
+	if (!mPlaying)
+		return mPlayheadTime;
+
+	double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - mPlayheadClock ).count();
+	MediaTime time = mPlayheadTime + MediaTime::fromSeconds( elapsed * mRate, getTimeScale() );
+	if (time < mMediaDuration)
+		return time;
+
+	if (mLoop && mMediaDuration > MediaTime::zero())
+		return MediaTime::fromSeconds( std::fmod( time.toSeconds(), mMediaDuration.toSeconds() ), getTimeScale() );
+	return mMediaDuration;
+}
+
+void MultiTrackPlayer::seekToTime( const MediaTime &time )
+{
+	if (!time.isValid()) return;
+
+	setPlayhead( time );
+	// the next update() restarts reading at the new time, even when it lies ahead
+	stopReader();
+}
+
+void MultiTrackPlayer::update()
+{
+	@autoreleasepool {
+		MediaTime time = getCurrentMediaTime();
+		// the reader only moves forward, so looping and seeking back start a new one
+		if (!mReader || time < mReaderTime) {
+			if (!startReader( time ))
+				return;
+		}
+		mReaderTime = time;
+
+		// each track is drained by a task of its own, so the tracks decode in parallel instead of one after the other. The frames
+		// are published once every track is done, so they always come from the same update().
+		std::vector<Surface8u> surfaces( mTracks.size() );
+		std::vector<MediaTime> times( mTracks.size() );
+		WorkerPool::getShared().parallelFor( mTracks.size(), [&]( size_t t ) {
+			@autoreleasepool {
+				Track &track = mTracks[t];
+				surfaces[t] = track.mSurface;
+				times[t] = track.mTime;
+				while (true) {
+					if (!track.mNextSurface && !readNextFrame( &track ))
+						break;
+					// the first frame after a restart is shown even if it starts slightly after the playhead
+					if (surfaces[t] && track.mNextTime > time)
+						break;
+					surfaces[t] = track.mNextSurface;
+					times[t] = track.mNextTime;
+					track.mNextSurface.reset();
+				}
+			}
+		} );
+
+		for (size_t t = 0; t < mTracks.size(); ++t) {
+			mTracks[t].mSurface = surfaces[t];
+			mTracks[t].mTime = times[t];
+		}
+	}
+}
+
+bool MultiTrackPlayer::startReader( const MediaTime &time )
+{
+	stopReader();
+
+	std::vector<AVAssetTrack*> tracks;
+	for (size_t t = 0; t < mTracks.size(); ++t)
+		tracks.push_back( mTracks[t].mTrack );
+
+	std::vector<AVAssetReaderTrackOutput*> outputs;
+	mReader = createFrameReader( mAsset, tracks, time, MediaTime(), &outputs );
+	if (!mReader)
+		return false;
+
+	for (size_t t = 0; t < mTracks.size(); ++t) {
+		mTracks[t].mOutput = outputs[t];
+		mTracks[t].mSurface.reset();
+	}
+	mReaderTime = time;
+	return true;
+}
+
+void MultiTrackPlayer::stopReader()
+{
+	if (mReader)
+		[mReader cancelReading];
+	for (size_t t = 0; t < mTracks.size(); ++t) {
+		[mTracks[t].mOutput release];
+		mTracks[t].mOutput = nil;
+		mTracks[t].mNextSurface.reset();
+	}
+	[mReader release];
+	mReader = nil;
+}
+
+// Reads the next frame of \a track into its mNextSurface, returning false at the end of the track
+bool MultiTrackPlayer::readNextFrame( Track *track )
+{
+	while (true) {
+		CMSampleBufferRef sample = [track->mOutput copyNextSampleBuffer];
+		if (!sample)
+			return false;
+
+		CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer( sample );
+		if (imageBuffer) {
+			// the Surface releases the buffer it wraps, while the sample buffer keeps its own reference
+			::CVPixelBufferRetain( imageBuffer );
+			track->mNextSurface = convertCvPixelBufferToSurface( imageBuffer );
+			track->mNextTime = toMediaTime( CMSampleBufferGetPresentationTimeStamp( sample ) );
+		}
+		CFRelease( sample );
+
+		if (imageBuffer)
+			return true;
+	}
+}
+
+FrameInfo MultiTrackPlayer::getFrameInfo( size_t track ) const
+{
+	FrameInfo result;
+	const Track &t = mTracks[track];
+	if (!t.mSurface)
+		return result;
+
+	result.mTime = t.mTime;
+	result.mDuration = t.mFrameDuration;
+	if (t.mTime.isValid() && t.mFrameDuration.isValid())
+		result.mFrameIndex = t.mTime.toFrame( t.mFrameDuration );
+	return result;
+}
+
+int32_t MultiTrackPlayer::getTimeScale() const
+{
+	return mMediaDuration.isValid()? mMediaDuration.getTimeScale(): MediaTime::DEFAULT_TIME_SCALE;
+}
+
+void MultiTrackPlayer::setPlayhead( const MediaTime &time )
+{
+	mPlayheadTime = time;
+	mPlayheadClock = std::chrono::steady_clock::now();
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,233 @@
+#include "AvfPreload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+const size_t sChunkSize = 1024 * 1024;
+
+// Reads up to \a size bytes at \a offset, retrying short and interrupted reads. Returns the number read.
+size_t readAt( int fd, uint64_t offset, uint8_t *dst, size_t size )
+{
+	size_t count = 0;
+	while( count < size ) {
+		ssize_t result = ::pread( fd, dst + count, size - count, static_cast<off_t>( offset + count ) );
+		if( result < 0 && errno == EINTR )
+			continue;
+		if( result <= 0 )
+			break;
+		count += static_cast<size_t>( result );
+	}
+	return count;
+}
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PreloadBudget
+
+PreloadBudget::PreloadBudget( uint64_t limit, uint64_t maxFileSize )
+	: mLimit( limit ), mMaxFileSize( maxFileSize ), mUsed( 0 )
+{
+}
+
+PreloadBudget& PreloadBudget::getShared()
+{
+	static PreloadBudget sShared( 256 * 1024 * 1024, 32 * 1024 * 1024 );
+	return sShared;
+}
+
+uint64_t PreloadBudget::getLimit() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mLimit;
+}
+
+void PreloadBudget::setLimit( uint64_t limit )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mLimit = limit;
+}
+
+uint64_t PreloadBudget::getMaxFileSize() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mMaxFileSize;
+}
+
+void PreloadBudget::setMaxFileSize( uint64_t size )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mMaxFileSize = size;
+}
+
+uint64_t PreloadBudget::getUsed() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mUsed;
+}
+
+bool PreloadBudget::reserve( uint64_t size )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	if( size > mMaxFileSize || mUsed > mLimit || size > mLimit - mUsed )
+		return false;
+	mUsed += size;
+	return true;
+}
+
+void PreloadBudget::release( uint64_t size )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mUsed -= std::min( size, mUsed );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PreloadedFile
+
+// Shared with the background read, so a file destroyed mid-read is only unmapped once the read has noticed
+struct PreloadedFile::State {
+	State( PreloadBudget *budget, int fd, uint64_t size )
+		: mBudget( budget ), mFd( fd ), mData( NULL ), mSize( size ), mLocked( false ), mLoaded( 0 ), mCancelled( false ), mDone( false )
+	{}
+
+	~State()
+	{
+		if( mData ) {
+			if( mLocked )
+				::munlock( mData, static_cast<size_t>( mSize ) );
+			::munmap( mData, static_cast<size_t>( mSize ) );
+		}
+		::close( mFd );
+		mBudget->release( mSize );
+	}
+
+	void load()
+	{
+		uint64_t offset = 0;
+		while( offset < mSize && ! mCancelled ) {
+			size_t size = static_cast<size_t>( std::min<uint64_t>( sChunkSize, mSize - offset ) );
+			size_t count = readAt( mFd, offset, mData + offset, size );
+			offset += count;
+			// publishes the bytes just read to read() and getData() on other threads
+			mLoaded.store( offset, std::memory_order_release );
+			if( count < size )
+				break;
+		}
+
+		std::lock_guard<std::mutex> lock( mMutex );
+		mDone = true;
+		mDoneCond.notify_all();
+	}
+
+	PreloadBudget			*mBudget;
+	int						mFd;
+	uint8_t					*mData;
+	uint64_t				mSize;
+	bool					mLocked;
+	std::atomic<uint64_t>	mLoaded;
+	std::atomic<bool>		mCancelled;
+
+	std::mutex				mMutex;
+	std::condition_variable	mDoneCond;
+	bool					mDone;
+};
+
+PreloadedFile::PreloadedFile( const std::shared_ptr<State> &state )
+	: mState( state )
+{
+}
+
+PreloadedFile::~PreloadedFile()
+{
+	mState->mCancelled = true;
+}
+
+PreloadedFileRef PreloadedFile::create( const std::string &path, PreloadBudget &budget, WorkerPool::Priority priority )
+{
+	int fd = ::open( path.c_str(), O_RDONLY );
+	if( fd < 0 )
+		return PreloadedFileRef();
+
+	struct stat info;
+	if( ::fstat( fd, &info ) != 0 || ! S_ISREG( info.st_mode ) || ! budget.reserve( static_cast<uint64_t>( info.st_size ) ) ) {
+		::close( fd );
+		return PreloadedFileRef();
+	}
+
+	// from here on the state owns the descriptor and the reservation
+	std::shared_ptr<State> state( new State( &budget, fd, static_cast<uint64_t>( info.st_size ) ) );
+	if( state->mSize > 0 ) {
+		void *data = ::mmap( NULL, static_cast<size_t>( state->mSize ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0 );
+		if( data == MAP_FAILED )
+			return PreloadedFileRef();
+		state->mData = static_cast<uint8_t*>( data );
+		state->mLocked = ::mlock( data, static_cast<size_t>( state->mSize ) ) == 0;
+
+		WorkerPool::getShared().post( [state] { state->load(); }, priority );
+	}
+	else
+		state->mDone = true;
+
+	PreloadedFileRef result( new PreloadedFile( state ) );
+	size_t dot = path.find_last_of( "./" );
+	if( dot != std::string::npos && path[dot] == '.' )
+		result->setExtensionHint( path.substr( dot + 1 ) );
+	return result;
+}
+
+uint64_t PreloadedFile::getSize() const
+{
+	return mState->mSize;
+}
+
+uint64_t PreloadedFile::getLoadedSize() const
+{
+	return mState->mLoaded.load( std::memory_order_acquire );
+}
+
+bool PreloadedFile::isLocked() const
+{
+	return mState->mLocked;
+}
+
+size_t PreloadedFile::read( uint64_t offset, void *dst, size_t size )
+{
+	if( offset >= mState->mSize )
+		return 0;
+
+	size = static_cast<size_t>( std::min<uint64_t>( size, mState->mSize - offset ) );
+	if( offset + size <= getLoadedSize() ) {
+		std::memcpy( dst, mState->mData + offset, size );
+		return size;
+	}
+	// not in memory yet, so this one read goes to the disk
+	return readAt( mState->mFd, offset, static_cast<uint8_t*>( dst ), size );
+}
+
+const uint8_t* PreloadedFile::getData( uint64_t offset, size_t size )
+{
+	uint64_t loaded = getLoadedSize();
+	return ( offset <= loaded && size <= loaded - offset ) ? mState->mData + offset : NULL;
+}
+
+bool PreloadedFile::waitUntilLoaded()
+{
+	std::unique_lock<std::mutex> lock( mState->mMutex );
+	while( ! mState->mDone )
+		mState->mDoneCond.wait( lock );
+	return isLoaded();
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,552 @@
+#include "AvfReadScheduler.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+std::mutex			sSharedMutex;
+ReadSchedulerRef	sSharedScheduler;
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FileReadDevice
+
+FileReadDevice::~FileReadDevice()
+{
+	for( std::vector<File>::iterator it = mFiles.begin(); it != mFiles.end(); ++it ) {
+		if( it->mFd >= 0 )
+			::close( it->mFd );
+	}
+}
+
+size_t FileReadDevice::addFile( const std::string &path )
+{
+	int fd = ::open( path.c_str(), O_RDONLY );
+	struct stat info;
+	if( fd < 0 || ::fstat( fd, &info ) != 0 ) {
+		if( fd >= 0 )
+			::close( fd );
+		throw ReadSchedulerExc();
+	}
+
+	File file;
+	file.mFd = fd;
+	file.mSize = static_cast<uint64_t>( info.st_size );
+	file.mInode = static_cast<uint64_t>( info.st_ino );
+
+	// the index of a closed file is reused, so reopening clips doesn't grow the table
+	std::lock_guard<std::mutex> lock( mMutex );
+	if( ! mFreeFiles.empty() ) {
+		size_t index = mFreeFiles.back();
+		mFreeFiles.pop_back();
+		mFiles[index] = file;
+		return index;
+	}
+	mFiles.push_back( file );
+	return mFiles.size() - 1;
+}
+
+size_t FileReadDevice::getNumSlots() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mFiles.size();
+}
+
+uint64_t FileReadDevice::getSize( size_t file ) const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return ( file < mFiles.size() ) ? mFiles[file].mSize : 0;
+}
+
+size_t FileReadDevice::read( size_t file, uint64_t offset, void *dst, size_t size )
+{
+	int fd;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		fd = ( file < mFiles.size() ) ? mFiles[file].mFd : -1;
+	}
+	if( fd < 0 )
+		return 0;
+
+	size_t count = 0;
+	while( count < size ) {
+		ssize_t result = ::pread( fd, static_cast<uint8_t*>( dst ) + count, size - count, static_cast<off_t>( offset + count ) );
+		if( result < 0 && errno == EINTR )
+			continue;
+		if( result <= 0 )
+			break;
+		count += static_cast<size_t>( result );
+	}
+	return count;
+}
+
+uint64_t FileReadDevice::getLocation( size_t file, uint64_t offset ) const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	uint64_t inode = ( file < mFiles.size() ) ? mFiles[file].mInode : 0;
+	return ( inode << 40 ) + offset;
+}
+
+void FileReadDevice::closeFile( size_t file )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	if( file < mFiles.size() && mFiles[file].mFd >= 0 ) {
+		::close( mFiles[file].mFd );
+		mFiles[file].mFd = -1;
+		mFreeFiles.push_back( file );
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SimulatedDisk
+
+SimulatedDisk::SimulatedDisk( double seekTime, double bytesPerSecond )
+	: mSeekTime( seekTime ), mBytesPerSecond( bytesPerSecond ), mRealTime( false ), mHead( 0 ), mBytesRead( 0 ),
+	mNumReads( 0 ), mNumSeeks( 0 ), mElapsedTime( 0 )
+{
+}
+
+size_t SimulatedDisk::addFile( uint64_t size )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mStarts.push_back( mStarts.empty() ? 0 : mStarts.back() + mSizes.back() );
+	mSizes.push_back( size );
+	return mSizes.size() - 1;
+}
+
+void SimulatedDisk::setRealTime( bool realTime )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mRealTime = realTime;
+}
+
+uint64_t SimulatedDisk::getSize( size_t file ) const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return ( file < mSizes.size() ) ? mSizes[file] : 0;
+}
+
+size_t SimulatedDisk::read( size_t file, uint64_t offset, void *dst, size_t size )
+{
+	double duration;
+	size_t count;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( file >= mSizes.size() || offset >= mSizes[file] )
+			return 0;
+
+		count = static_cast<size_t>( std::min<uint64_t>( size, mSizes[file] - offset ) );
+		uint64_t location = mStarts[file] + offset;
+		duration = count / mBytesPerSecond;
+		if( location != mHead ) {
+			duration += mSeekTime;
+			++mNumSeeks;
+		}
+		mHead = location + count;
+		mBytesRead += count;
+		mElapsedTime += duration;
+		++mNumReads;
+		if( ! mRealTime )
+			duration = 0;
+	}
+
+	uint8_t *bytes = static_cast<uint8_t*>( dst );
+	for( size_t i = 0; i < count; ++i )
+		bytes[i] = getByte( file, offset + i );
+	if( duration > 0 )
+		std::this_thread::sleep_for( std::chrono::duration<double>( duration ) );
+	return count;
+}
+
+uint64_t SimulatedDisk::getLocation( size_t file, uint64_t offset ) const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return ( file < mStarts.size() ) ? mStarts[file] + offset : 0;
+}
+
+uint32_t SimulatedDisk::getNumReads() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mNumReads;
+}
+
+uint32_t SimulatedDisk::getNumSeeks() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mNumSeeks;
+}
+
+uint64_t SimulatedDisk::getBytesRead() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mBytesRead;
+}
+
+double SimulatedDisk::getElapsedTime() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mElapsedTime;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ReadScheduler
+
+// State of one stream, guarded by the scheduler's mutex
+struct ReadScheduler::Stream {
+	Stream( size_t file, uint64_t size, double bytesPerSecond )
+		: mFile( file ), mSize( size ), mBytesPerSecond( bytesPerSecond ), mPosition( 0 ), mNumStalls( 0 )
+	{}
+
+	size_t									mFile;
+	uint64_t								mSize;
+	double									mBytesPerSecond;
+	uint64_t								mPosition;
+	//! Chunks in memory by index. A chunk shorter than expected marks a failed read.
+	std::map<uint64_t, std::vector<uint8_t>>	mChunks;
+	std::set<uint64_t>						mInFlight;
+	//! Chunks a read() is waiting for, once per waiting read. They stay until the read has copied them.
+	std::multiset<uint64_t>					mDemand;
+	uint32_t								mNumStalls;
+};
+
+ReadScheduler::Options::Options()
+	: mChunkSize( 1024 * 1024 ), mMaxBatchChunks( 4 ), mReadAheadSeconds( 4 ), mDefaultBitrate( 1024 * 1024 ),
+	mMinReadAhead( 2 * 1024 * 1024 ), mMaxReadAhead( 64 * 1024 * 1024 ), mThread( true )
+{
+}
+
+ReadScheduler::ReadScheduler( const ReadDeviceRef &device, const Options &options )
+	: mDevice( device ), mOptions( options ), mHead( 0 ), mMovingUp( true ), mStopping( false )
+{
+	if( mOptions.isThreadEnabled() )
+		mThread = std::thread( &ReadScheduler::threadLoop, this );
+}
+
+ReadScheduler::~ReadScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mStopping = true;
+	}
+	mWorkCond.notify_all();
+	if( mThread.joinable() )
+		mThread.join();
+}
+
+ReadSchedulerRef ReadScheduler::getShared()
+{
+	std::lock_guard<std::mutex> lock( sSharedMutex );
+	if( ! sSharedScheduler )
+		sSharedScheduler = create( ReadDeviceRef( new FileReadDevice() ) );
+	return sSharedScheduler;
+}
+
+ScheduledStreamRef ReadScheduler::openStream( size_t file, double bytesPerSecond )
+{
+	std::shared_ptr<Stream> stream( new Stream( file, mDevice->getSize( file ), ( bytesPerSecond > 0 ) ? bytesPerSecond : mOptions.getDefaultBitrate() ) );
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mStreams.push_back( stream );
+	}
+	// the stream starts reading ahead from the beginning
+	mWorkCond.notify_all();
+	return ScheduledStreamRef( new ScheduledStream( shared_from_this(), stream ) );
+}
+
+ScheduledStreamRef ReadScheduler::openFile( const std::string &path, double bytesPerSecond )
+{
+	FileReadDevice *device = dynamic_cast<FileReadDevice*>( mDevice.get() );
+	if( ! device )
+		throw ReadSchedulerExc();
+
+	ScheduledStreamRef result = openStream( device->addFile( path ), bytesPerSecond );
+	size_t dot = path.find_last_of( "./" );
+	if( dot != std::string::npos && path[dot] == '.' )
+		result->setExtensionHint( path.substr( dot + 1 ) );
+	return result;
+}
+
+size_t ReadScheduler::getNumStreams() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mStreams.size();
+}
+
+uint64_t ReadScheduler::getTargetBytes( const Stream &stream ) const
+{
+	double target = stream.mBytesPerSecond * mOptions.getReadAheadSeconds();
+	return std::min( std::max( static_cast<uint64_t>( target ), mOptions.getMinReadAhead() ), mOptions.getMaxReadAhead() );
+}
+
+uint64_t ReadScheduler::getBufferedBytes( const Stream &stream ) const
+{
+	const uint64_t chunkSize = mOptions.getChunkSize();
+	uint64_t end = stream.mPosition;
+	for( std::map<uint64_t, std::vector<uint8_t>>::const_iterator it = stream.mChunks.find( end / chunkSize );
+			it != stream.mChunks.end() && it->first * chunkSize <= end; ++it ) {
+		uint64_t chunkEnd = it->first * chunkSize + it->second.size();
+		if( chunkEnd <= end )
+			break;
+		end = chunkEnd;
+	}
+	return end - stream.mPosition;
+}
+
+void ReadScheduler::trimStream( Stream &stream )
+{
+	const uint64_t chunkSize = mOptions.getChunkSize();
+	uint64_t first = stream.mPosition / chunkSize;
+	uint64_t last = ( stream.mPosition + getTargetBytes( stream ) ) / chunkSize;
+	// one chunk behind the read position stays for parsers that step back a little
+	first = ( first > 0 ) ? first - 1 : 0;
+
+	for( std::map<uint64_t, std::vector<uint8_t>>::iterator it = stream.mChunks.begin(); it != stream.mChunks.end(); ) {
+		if( ( it->first < first || it->first > last ) && ! stream.mDemand.count( it->first ) )
+			stream.mChunks.erase( it++ );
+		else
+			++it;
+	}
+}
+
+bool ReadScheduler::findRequest( Stream &stream, Request *result ) const
+{
+	const uint64_t chunkSize = mOptions.getChunkSize();
+	const uint64_t numChunks = ( stream.mSize + chunkSize - 1 ) / chunkSize;
+	const uint64_t last = std::min( ( stream.mPosition + getTargetBytes( stream ) ) / chunkSize, numChunks ? numChunks - 1 : 0 );
+
+	bool found = false;
+	uint64_t first = 0;
+	for( std::multiset<uint64_t>::const_iterator it = stream.mDemand.begin(); it != stream.mDemand.end() && ! found; ++it ) {
+		if( ! stream.mInFlight.count( *it ) && ! stream.mChunks.count( *it ) ) {
+			first = *it;
+			found = true;
+		}
+	}
+	for( uint64_t chunk = stream.mPosition / chunkSize; chunk <= last && chunk < numChunks && ! found; ++chunk ) {
+		if( ! stream.mInFlight.count( chunk ) && ! stream.mChunks.count( chunk ) ) {
+			first = chunk;
+			found = true;
+		}
+	}
+	if( ! found )
+		return false;
+
+	// carries on into the read-ahead, as the following chunks are next to it on the disk
+	uint64_t count = 1;
+	while( count < mOptions.getMaxBatchChunks() && first + count < numChunks && ( first + count <= last || stream.mDemand.count( first + count ) )
+			&& ! stream.mInFlight.count( first + count ) && ! stream.mChunks.count( first + count ) )
+		++count;
+
+	result->mFirstChunk = first;
+	result->mNumChunks = count;
+	result->mLocation = mDevice->getLocation( stream.mFile, first * chunkSize );
+	return true;
+}
+
+bool ReadScheduler::pickRequest( Request *result )
+{
+	std::vector<Request> demanded, readAhead;
+	for( std::vector<std::shared_ptr<Stream>>::iterator it = mStreams.begin(); it != mStreams.end(); ++it ) {
+		Request request;
+		if( findRequest( **it, &request ) ) {
+			request.mStream = *it;
+			bool isDemanded = ( *it )->mDemand.count( request.mFirstChunk ) > 0;
+			( isDemanded ? demanded : readAhead ).push_back( request );
+		}
+	}
+
+	// a movie waiting on a read can't play, so its reads go before anyone's read-ahead
+	const std::vector<Request> &candidates = demanded.empty() ? readAhead : demanded;
+	if( candidates.empty() )
+		return false;
+
+	// elevator: the nearest request in the direction of travel, turning around at the last one
+	const Request *best = NULL;
+	for( int pass = 0; pass < 2 && ! best; ++pass ) {
+		for( std::vector<Request>::const_iterator it = candidates.begin(); it != candidates.end(); ++it ) {
+			bool ahead = mMovingUp ? it->mLocation >= mHead : it->mLocation <= mHead;
+			bool nearer = ! best || ( mMovingUp ? it->mLocation < best->mLocation : it->mLocation > best->mLocation );
+			if( ahead && nearer )
+				best = &*it;
+		}
+		if( ! best )
+			mMovingUp = ! mMovingUp;
+	}
+
+	*result = *best;
+	for( uint64_t i = 0; i < result->mNumChunks; ++i )
+		result->mStream->mInFlight.insert( result->mFirstChunk + i );
+	return true;
+}
+
+bool ReadScheduler::processNext()
+{
+	Request request;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( ! pickRequest( &request ) )
+			return false;
+	}
+
+	performRequest( request );
+	return true;
+}
+
+void ReadScheduler::performRequest( const Request &request )
+{
+	// the file and size of a stream never change, so they are safe to read without the lock
+	const uint64_t chunkSize = mOptions.getChunkSize();
+	const uint64_t offset = request.mFirstChunk * chunkSize;
+	size_t size = static_cast<size_t>( std::min<uint64_t>( request.mNumChunks * chunkSize, request.mStream->mSize - offset ) );
+	std::vector<uint8_t> data( size );
+	size_t count = mDevice->read( request.mStream->mFile, offset, data.empty() ? NULL : &data[0], size );
+
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		Stream &stream = *request.mStream;
+		mHead = request.mLocation + count;
+		for( uint64_t i = 0; i < request.mNumChunks; ++i ) {
+			uint64_t chunk = request.mFirstChunk + i;
+			size_t start = static_cast<size_t>( std::min<uint64_t>( i * chunkSize, count ) );
+			size_t end = static_cast<size_t>( std::min<uint64_t>( ( i + 1 ) * chunkSize, count ) );
+			stream.mChunks[chunk].assign( data.begin() + start, data.begin() + end );
+			stream.mInFlight.erase( chunk );
+		}
+		trimStream( stream );
+	}
+	mDataCond.notify_all();
+}
+
+void ReadScheduler::threadLoop()
+{
+	// looking for work and waiting happen under one lock, so a stream's wake up can't slip in between
+	std::unique_lock<std::mutex> lock( mMutex );
+	while( ! mStopping ) {
+		Request request;
+		if( ! pickRequest( &request ) ) {
+			mWorkCond.wait( lock );
+			continue;
+		}
+
+		lock.unlock();
+		performRequest( request );
+		lock.lock();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ScheduledStream
+
+ScheduledStream::ScheduledStream( const ReadSchedulerRef &scheduler, const std::shared_ptr<ReadScheduler::Stream> &stream )
+	: mScheduler( scheduler ), mStream( stream )
+{
+}
+
+ScheduledStream::~ScheduledStream()
+{
+	std::unique_lock<std::mutex> lock( mScheduler->mMutex );
+	std::vector<std::shared_ptr<ReadScheduler::Stream>> &streams = mScheduler->mStreams;
+	streams.erase( std::find( streams.begin(), streams.end(), mStream ) );
+
+	// the device keeps the file until a read still in flight is done with it
+	while( ! mStream->mInFlight.empty() )
+		mScheduler->mDataCond.wait( lock );
+	lock.unlock();
+	mScheduler->mDevice->closeFile( mStream->mFile );
+}
+
+uint64_t ScheduledStream::getSize() const
+{
+	return mStream->mSize;
+}
+
+size_t ScheduledStream::read( uint64_t offset, void *dst, size_t size )
+{
+	ReadScheduler &scheduler = *mScheduler;
+	ReadScheduler::Stream &stream = *mStream;
+	if( offset >= stream.mSize )
+		return 0;
+
+	const uint64_t chunkSize = scheduler.mOptions.getChunkSize();
+	size = static_cast<size_t>( std::min<uint64_t>( size, stream.mSize - offset ) );
+	size_t count = 0;
+	bool stalled = false, demanding = false;
+
+	std::unique_lock<std::mutex> lock( scheduler.mMutex );
+	stream.mPosition = offset;
+	scheduler.trimStream( stream );
+	while( count < size ) {
+		uint64_t position = offset + count, chunk = position / chunkSize;
+		std::map<uint64_t, std::vector<uint8_t>>::const_iterator it = stream.mChunks.find( chunk );
+		if( it == stream.mChunks.end() ) {
+			if( ! demanding ) {
+				stream.mDemand.insert( chunk );
+				demanding = stalled = true;
+				scheduler.mWorkCond.notify_all();
+			}
+			scheduler.mDataCond.wait( lock );
+			continue;
+		}
+		if( demanding ) {
+			stream.mDemand.erase( stream.mDemand.find( chunk ) );
+			demanding = false;
+		}
+
+		size_t within = static_cast<size_t>( position - chunk * chunkSize );
+		if( within >= it->second.size() )
+			break;
+		size_t length = std::min( size - count, it->second.size() - within );
+		std::memcpy( static_cast<uint8_t*>( dst ) + count, &it->second[within], length );
+		count += length;
+	}
+	if( stalled )
+		++stream.mNumStalls;
+	lock.unlock();
+
+	// the read position moved, so the read-ahead may need topping up
+	scheduler.mWorkCond.notify_all();
+	return count;
+}
+
+void ScheduledStream::setBitrateHint( double bytesPerSecond )
+{
+	if( bytesPerSecond <= 0 )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( mScheduler->mMutex );
+		mStream->mBytesPerSecond = bytesPerSecond;
+		mScheduler->trimStream( *mStream );
+	}
+	mScheduler->mWorkCond.notify_all();
+}
+
+double ScheduledStream::getBitrate() const
+{
+	std::lock_guard<std::mutex> lock( mScheduler->mMutex );
+	return mStream->mBytesPerSecond;
+}
+
+BufferHealth ScheduledStream::getBufferHealth() const
+{
+	std::lock_guard<std::mutex> lock( mScheduler->mMutex );
+	BufferHealth result;
+	result.mBufferedBytes = mScheduler->getBufferedBytes( *mStream );
+	result.mTargetBytes = std::min( mScheduler->getTargetBytes( *mStream ), mStream->mSize - std::min( mStream->mPosition, mStream->mSize ) );
+	result.mBufferedSeconds = result.mBufferedBytes / mStream->mBytesPerSecond;
+	result.mNumStalls = mStream->mNumStalls;
+	return result;
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,44 @@
+#include "AvfRemapPlayer.h"
+#include "AvfSimd.h"
+#include "AvfUtils.h"
+
+namespace cinder { namespace avf {
+
+RemapPlayer::RemapPlayer( const fs::path &path, size_t ringFrames )
+	: mFrameBlending( false )
+{
+	// blending needs both frames around a source time at once
+	mReader = FrameReader::create( path, 0, ringFrames < 2 ? 2 : ringFrames );
+}
+
+MediaTime RemapPlayer::getSourceTime( double outputSeconds ) const
+{
+	const MediaTime &start = getFrameIndex().getFrame( 0 ).mTime;
+	return start + MediaTime::fromSeconds( mCurve.getSourceTime( outputSeconds ), start.getTimeScale() );
+}
+
+Surface8u RemapPlayer::getSurface( double outputSeconds )
+{
+	RemapFrames frames = selectRemapFrames( getFrameIndex(), getSourceTime( outputSeconds ), mFrameBlending );
+
+	Surface8u frame = mReader->getFrame( frames.mFrame, &mFrameInfo );
+	if (!frame)
+		return Surface8u();
+	if (frames.mWeight == 0)
+		return frame;
+
+	Surface8u next = mReader->getFrame( frames.mNextFrame );
+	if (!next || next.getSize() != frame.getSize() || next.getChannelOrder().getCode() != frame.getChannelOrder().getCode())
+		return frame;
+
+	if (!mBlendSurface || mBlendSurface.getSize() != frame.getSize() || mBlendSurface.getChannelOrder().getCode() != frame.getChannelOrder().getCode())
+		mBlendSurface = createFrameSurface( frame.getWidth(), frame.getHeight(), frame.hasAlpha(), frame.getChannelOrder() );
+
+	const size_t rowLength = frame.getWidth() * frame.getPixelInc();
+	for (int32_t y = 0; y < frame.getHeight(); ++y)
+		blendPixels( frame.getData( Vec2i( 0, y ) ), next.getData( Vec2i( 0, y ) ), mBlendSurface.getData( Vec2i( 0, y ) ), rowLength, frames.mWeight );
+
+	return mBlendSurface;
+}
+
+} } // namespace cinder::avf
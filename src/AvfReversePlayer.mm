@@ -0,0 +1,188 @@
+#include "AvfReversePlayer.h"
+#include "AvfUtils.h"
+
+#if defined( CINDER_COCOA )
+	#import <AVFoundation/AVFoundation.h>
+	#include <CoreVideo/CoreVideo.h>
+#endif
+
+#include <cmath>
+
+namespace cinder { namespace avf {
+
+ReversePlayer::ReversePlayer( const fs::path &path, size_t maxBufferedFrames )
+	: mAsset( nil ), mTrack( nil ), mWidth( 0 ), mHeight( 0 ), mPlaying( false ), mRate( 1.0f ), mSurfaceFrame( 0 ), mHasSurface( false )
+{
+	NSURL* asset_url = [NSURL fileURLWithPath:[NSString stringWithCString:path.c_str() encoding:[NSString defaultCStringEncoding]]];
+	if (!asset_url)
+		throw AvfPathInvalidExc();
+
+	NSDictionary* asset_options = @{(id)AVURLAssetPreferPreciseDurationAndTimingKey: @(YES)};
+	mAsset = [[AVURLAsset alloc] initWithURL:asset_url options:asset_options];
+
+	NSArray* video_tracks = [mAsset tracksWithMediaType:AVMediaTypeVideo];
+	if ([video_tracks count] == 0) {
+		[mAsset release];
+		throw AvfFileInvalidExc();
+	}
+	mTrack = [[video_tracks objectAtIndex:0] retain];
+
+	CGSize size = CGSizeApplyAffineTransform([mTrack naturalSize], [mTrack preferredTransform]);
+	mWidth = static_cast<int32_t>(std::abs(size.width));
+	mHeight = static_cast<int32_t>(std::abs(size.height));
+
+	if (!scanFrameIndex(mAsset, mTrack, &mFrameIndex) || mFrameIndex.empty()) {
+		[mTrack release];
+		[mAsset release];
+		throw AvfErrorLoadingExc();
+	}
+
+	mBuffer.reset( new ReverseBuffer<Surface8u>( mFrameIndex, maxBufferedFrames,
+					std::bind( &ReversePlayer::decodeSpan, this, std::placeholders::_1, std::placeholders::_2 ) ) );
+	seekToEnd();
+}
+
+ReversePlayer::~ReversePlayer()
+{
+	// the decode thread uses the asset, so it has to finish first
+	mBuffer.reset();
+	mSurface.reset();
+
+	[mTrack release];
+	[mAsset release];
+}
+
+void ReversePlayer::play()
+{
+	if (mPlaying) return;
+
+	setPlayhead( mPlayheadTime );
+	mPlaying = true;
+}
+
+void ReversePlayer::stop()
+{
+	if (!mPlaying) return;
+
+	setPlayhead( getCurrentMediaTime() );
+	mPlaying = false;
+}
+
+bool ReversePlayer::isDone() const
+{
+	return getCurrentMediaTime() <= mFrameIndex.getFrame( 0 ).mTime;
+}
+
+void ReversePlayer::setRate( float rate )
+{
+	setPlayhead( getCurrentMediaTime() );
+	mRate = std::fabs( rate );
+}
+
+MediaTime ReversePlayer::getCurrentMediaTime() const
+{
+	if (!mPlaying)
+		return mPlayheadTime;
+
+	double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - mPlayheadClock ).count();
+	MediaTime time = mPlayheadTime - MediaTime::fromSeconds( elapsed * mRate, getFrameTimeScale() );
+	const MediaTime &start = mFrameIndex.getFrame( 0 ).mTime;
+	return ( time < start )? start: time;
+}
+
+void ReversePlayer::seekToTime( const MediaTime &time )
+{
+	if (!time.isValid()) return;
+
+	setPlayhead( time );
+}
+
+void ReversePlayer::seekToFrame( size_t frame )
+{
+	if (frame >= mFrameIndex.getNumFrames()) return;
+
+	setPlayhead( mFrameIndex.getFrame( frame ).mTime );
+}
+
+void ReversePlayer::seekToEnd()
+{
+	seekToFrame( mFrameIndex.getNumFrames() - 1 );
+}
+
+Surface8u ReversePlayer::getSurface()
+{
+	size_t frame = 0;
+	mFrameIndex.findFrame( getCurrentMediaTime(), &frame );
+	if (mHasSurface && frame == mSurfaceFrame)
+		return mSurface;
+
+	// only the very first frame is waited on, afterwards the previous frame stays up until the new one is decoded
+	Surface8u surface;
+	if (mBuffer->getFrame( frame, &surface, !mHasSurface )) {
+		mSurface = surface;
+		mSurfaceFrame = frame;
+		mHasSurface = true;
+	}
+
+	return mSurface;
+}
+
+// Runs on the ReverseBuffer's thread
+bool ReversePlayer::decodeSpan( const FrameIndex::Span &span, std::vector<Surface8u> *frames )
+{
+	@autoreleasepool {
+		const FrameIndex::Frame &last = mFrameIndex.getFrame( span.mEnd - 1 );
+		MediaTime start = mFrameIndex.getFrame( span.mFirst ).mTime;
+		MediaTime end = last.mTime + last.mDuration;
+
+		AVAssetReaderTrackOutput* output = nil;
+		AVAssetReader* reader = createFrameReader( mAsset, mTrack, start, end - start, &output );
+		if (!reader)
+			return false;
+
+		frames->assign( span.getNumFrames(), Surface8u() );
+		while (true) {
+			CMSampleBufferRef sample = [output copyNextSampleBuffer];
+			if (!sample)
+				break;
+
+			size_t frame;
+			CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer( sample );
+			if (imageBuffer && mFrameIndex.findFrame( toMediaTime( CMSampleBufferGetPresentationTimeStamp( sample ) ), &frame ) && span.contains( frame )) {
+				// the Surface releases the buffer it wraps, while the sample buffer keeps its own reference
+				::CVPixelBufferRetain( imageBuffer );
+				(*frames)[frame - span.mFirst] = convertCvPixelBufferToSurface( imageBuffer );
+			}
+			CFRelease( sample );
+		}
+		bool success = ( [reader status] == AVAssetReaderStatusCompleted );
+
+		[output release];
+		[reader release];
+
+		// a frame the decoder skipped repeats its neighbour rather than leaving a hole in playback
+		for (size_t i = 1; i < frames->size(); ++i) {
+			if (!(*frames)[i])
+				(*frames)[i] = (*frames)[i - 1];
+		}
+		for (size_t i = frames->size() - 1; i > 0; --i) {
+			if (!(*frames)[i - 1])
+				(*frames)[i - 1] = (*frames)[i];
+		}
+
+		return success && (*frames)[0];
+	}
+}
+
+int32_t ReversePlayer::getFrameTimeScale() const
+{
+	return mFrameIndex.getFrame( 0 ).mTime.isValid()? mFrameIndex.getFrame( 0 ).mTime.getTimeScale(): MediaTime::DEFAULT_TIME_SCALE;
+}
+
+void ReversePlayer::setPlayhead( const MediaTime &time )
+{
+	mPlayheadTime = time;
+	mPlayheadClock = std::chrono::steady_clock::now();
+}
+
+} } // namespace cinder::avf
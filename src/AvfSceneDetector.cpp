@@ -0,0 +1,153 @@
+#include "AvfSceneDetector.h"
+#include "AvfSimd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+//! Weight of a new score in the running average of the scene
+const float		sAverageWeight = 0.1f;
+//! Pixels sampled per grid cell along each axis, which is plenty for an average
+const int32_t	sSamplesPerCell = 4;
+
+} // anonymous namespace
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SceneDetector::Options
+
+SceneDetector::Options::Options()
+	: mThreshold( 0.2f ), mHistogramWeight( 0.5f ), mContrast( 3 ), mMinSceneFrames( 6 ), mGridWidth( 64 )
+{
+}
+
+SceneDetector::Options& SceneDetector::Options::setHistogramWeight( float weight )
+{
+	mHistogramWeight = std::min( std::max( weight, 0.0f ), 1.0f );
+	return *this;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SceneDetector
+
+SceneDetector::SceneDetector( const Options &options )
+	: mOptions( options ), mGridHeight( 0 )
+{
+	clear();
+}
+
+void SceneDetector::restart()
+{
+	mHasPrevious = mHasPending = false;
+	mAverageScore = mLastScore = 0;
+}
+
+void SceneDetector::clear()
+{
+	restart();
+	mPreviousIndex = mLastCut = mNumCompared = 0;
+	mHasCut = mPendingIsCut = false;
+	mCuts.clear();
+}
+
+void SceneDetector::reduce( const uint8_t *data, int32_t width, int32_t height, size_t rowBytes, int32_t pixelInc, int32_t redOffset, int32_t greenOffset, int32_t blueOffset )
+{
+	int32_t gridWidth = std::min( mOptions.getGridWidth(), width );
+	mGridHeight = std::min( std::max( ( gridWidth * height + width / 2 ) / width, 1 ), height );
+	mCurrent.mGrid.resize( static_cast<size_t>( gridWidth ) * mGridHeight );
+	std::memset( mCurrent.mHistogram, 0, sizeof( mCurrent.mHistogram ) );
+
+	for( int32_t gy = 0; gy < mGridHeight; ++gy ) {
+		int32_t y0 = gy * height / mGridHeight, y1 = ( gy + 1 ) * height / mGridHeight;
+		int32_t stepY = std::max( ( y1 - y0 ) / sSamplesPerCell, 1 );
+		for( int32_t gx = 0; gx < gridWidth; ++gx ) {
+			int32_t x0 = gx * width / gridWidth, x1 = ( gx + 1 ) * width / gridWidth;
+			int32_t stepX = std::max( ( x1 - x0 ) / sSamplesPerCell, 1 );
+			uint32_t sum = 0, count = 0;
+			for( int32_t y = y0; y < y1; y += stepY ) {
+				const uint8_t *row = data + y * rowBytes;
+				for( int32_t x = x0; x < x1; x += stepX ) {
+					const uint8_t *pixel = row + x * pixelInc;
+					// Rec. 601 weights in 8 bit fixed point
+					sum += ( 77 * pixel[redOffset] + 150 * pixel[greenOffset] + 29 * pixel[blueOffset] + 128 ) >> 8;
+					++count;
+				}
+			}
+			uint8_t luma = static_cast<uint8_t>( ( sum + count / 2 ) / count );
+			mCurrent.mGrid[gy * gridWidth + gx] = luma;
+			++mCurrent.mHistogram[luma * NUM_BINS / 256];
+		}
+	}
+}
+
+float SceneDetector::score( const Reduced &a, const Reduced &b ) const
+{
+	const size_t count = a.mGrid.size();
+	float sad = sumAbsDifferences( &a.mGrid[0], &b.mGrid[0], count ) / ( 255.0f * count );
+	uint32_t histogramDifference = 0;
+	for( size_t bin = 0; bin < NUM_BINS; ++bin )
+		histogramDifference += ( a.mHistogram[bin] > b.mHistogram[bin] ) ? a.mHistogram[bin] - b.mHistogram[bin] : b.mHistogram[bin] - a.mHistogram[bin];
+	float histogram = histogramDifference / ( 2.0f * count );
+
+	float weight = mOptions.getHistogramWeight();
+	return ( 1 - weight ) * sad + weight * histogram;
+}
+
+bool SceneDetector::addFrame( size_t index, const MediaTime &time, const uint8_t *data, int32_t width, int32_t height, size_t rowBytes,
+								int32_t pixelInc, int32_t redOffset, int32_t greenOffset, int32_t blueOffset )
+{
+	if( ! data || width <= 0 || height <= 0 ) {
+		restart();
+		return false;
+	}
+
+	reduce( data, width, height, rowBytes, pixelInc, redOffset, greenOffset, blueOffset );
+
+	bool result = false;
+	mLastScore = 0;
+	// a grid of another size means the resolution changed, which says nothing about the content
+	if( mHasPrevious && index == mPreviousIndex + 1 && mCurrent.mGrid.size() == mPrevious.mGrid.size() ) {
+		float current = score( mCurrent, mPrevious );
+		bool flash = false;
+		if( mHasPending ) {
+			if( mPendingIsCut ) {
+				// after a flash the picture goes back to what it was, where after a cut it stays changed
+				float across = score( mCurrent, mBefore );
+				flash = ( across < mOptions.getThreshold() );
+				if( flash )
+					current = across;
+				else {
+					mCuts.push_back( mPending );
+					mLastCut = mPending.mFrameIndex;
+					mHasCut = true;
+					mAverageScore = 0;
+					result = true;
+				}
+			}
+			else
+				mAverageScore += ( mPending.mScore - mAverageScore ) * sAverageWeight;
+			++mNumCompared;
+		}
+
+		mLastScore = current;
+		size_t distance = ( index > mLastCut ) ? index - mLastCut : mLastCut - index;
+		mPending = SceneCut( index, time, current );
+		mPendingIsCut = current >= mOptions.getThreshold() && current >= mOptions.getContrast() * mAverageScore && ( ! mHasCut || distance >= mOptions.getMinSceneFrames() );
+		mHasPending = true;
+		// mBefore becomes the frame the current one was compared with, which after a flash is the one before the flash
+		if( ! flash )
+			std::swap( mBefore, mPrevious );
+	}
+	else
+		mHasPending = false;
+
+	std::swap( mPrevious, mCurrent );
+	mPreviousIndex = index;
+	mHasPrevious = true;
+	return result;
+}
+
+} } // namespace cinder::avf
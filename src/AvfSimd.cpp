@@ -0,0 +1,343 @@
+#include "AvfSimd.h"
+#include "AvfWorkerPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#if defined( __AVX2__ )
+	#include <immintrin.h>
+#elif defined( __SSSE3__ )
+	#include <tmmintrin.h>
+#elif defined( __SSE2__ )
+	#include <emmintrin.h>
+#elif defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+	#include <arm_neon.h>
+#endif
+
+namespace cinder { namespace avf {
+
+void accumulatePixels( const uint8_t *src, uint32_t *acc, size_t count )
+{
+	size_t i = 0;
+#if defined( __SSE2__ )
+	const __m128i zero = _mm_setzero_si128();
+	for( ; i + 16 <= count; i += 16 ) {
+		__m128i s = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i ) );
+		__m128i lo = _mm_unpacklo_epi8( s, zero );
+		__m128i hi = _mm_unpackhi_epi8( s, zero );
+		__m128i *a = reinterpret_cast<__m128i*>( acc + i );
+		_mm_storeu_si128( a + 0, _mm_add_epi32( _mm_loadu_si128( a + 0 ), _mm_unpacklo_epi16( lo, zero ) ) );
+		_mm_storeu_si128( a + 1, _mm_add_epi32( _mm_loadu_si128( a + 1 ), _mm_unpackhi_epi16( lo, zero ) ) );
+		_mm_storeu_si128( a + 2, _mm_add_epi32( _mm_loadu_si128( a + 2 ), _mm_unpacklo_epi16( hi, zero ) ) );
+		_mm_storeu_si128( a + 3, _mm_add_epi32( _mm_loadu_si128( a + 3 ), _mm_unpackhi_epi16( hi, zero ) ) );
+	}
+#elif defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+	for( ; i + 16 <= count; i += 16 ) {
+		uint8x16_t s = vld1q_u8( src + i );
+		uint16x8_t lo = vmovl_u8( vget_low_u8( s ) );
+		uint16x8_t hi = vmovl_u8( vget_high_u8( s ) );
+		vst1q_u32( acc + i + 0, vaddw_u16( vld1q_u32( acc + i + 0 ), vget_low_u16( lo ) ) );
+		vst1q_u32( acc + i + 4, vaddw_u16( vld1q_u32( acc + i + 4 ), vget_high_u16( lo ) ) );
+		vst1q_u32( acc + i + 8, vaddw_u16( vld1q_u32( acc + i + 8 ), vget_low_u16( hi ) ) );
+		vst1q_u32( acc + i + 12, vaddw_u16( vld1q_u32( acc + i + 12 ), vget_high_u16( hi ) ) );
+	}
+#endif
+	for( ; i < count; ++i )
+		acc[i] += src[i];
+}
+
+void resolveAccumulatedPixels( const uint32_t *acc, uint8_t *dst, size_t count, uint32_t frames )
+{
+	const float scale = 1.0f / frames;
+	size_t i = 0;
+#if defined( __SSE2__ )
+	const __m128 s = _mm_set1_ps( scale );
+	const __m128 half = _mm_set1_ps( 0.5f );
+	for( ; i + 16 <= count; i += 16 ) {
+		const __m128i *a = reinterpret_cast<const __m128i*>( acc + i );
+		// adding a half and truncating rounds halves up like the other paths, where _mm_cvtps_epi32 would round them to even
+		__m128i v0 = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_loadu_si128( a + 0 ) ), s ), half ) );
+		__m128i v1 = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_loadu_si128( a + 1 ) ), s ), half ) );
+		__m128i v2 = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_loadu_si128( a + 2 ) ), s ), half ) );
+		__m128i v3 = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_loadu_si128( a + 3 ) ), s ), half ) );
+		__m128i packed = _mm_packus_epi16( _mm_packs_epi32( v0, v1 ), _mm_packs_epi32( v2, v3 ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( dst + i ), packed );
+	}
+#elif defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+	const float32x4_t s = vdupq_n_f32( scale );
+	const float32x4_t half = vdupq_n_f32( 0.5f );
+	for( ; i + 8 <= count; i += 8 ) {
+		uint32x4_t v0 = vcvtq_u32_f32( vmlaq_f32( half, vcvtq_f32_u32( vld1q_u32( acc + i + 0 ) ), s ) );
+		uint32x4_t v1 = vcvtq_u32_f32( vmlaq_f32( half, vcvtq_f32_u32( vld1q_u32( acc + i + 4 ) ), s ) );
+		uint16x8_t v = vcombine_u16( vqmovn_u32( v0 ), vqmovn_u32( v1 ) );
+		vst1_u8( dst + i, vqmovn_u16( v ) );
+	}
+#endif
+	for( ; i < count; ++i ) {
+		// kept as two statements so the compiler can't fuse them into an FMA the vector paths don't use
+		float scaled = acc[i] * scale;
+		uint32_t v = static_cast<uint32_t>( scaled + 0.5f );
+		dst[i] = static_cast<uint8_t>( v > 255 ? 255 : v );
+	}
+}
+
+void blendPixels( const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t count, uint32_t weight )
+{
+	if( weight == 0 || weight >= 256 ) {
+		std::memmove( dst, ( weight == 0 )? a: b, count );
+		return;
+	}
+	
+	// a * (256 - w) + b * w fits 16 bits for w in [1,255], so one rounding shift finishes the lerp
+	const uint32_t inverse = 256 - weight;
+	size_t i = 0;
+#if defined( __SSE2__ )
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wa = _mm_set1_epi16( static_cast<int16_t>( inverse ) );
+	const __m128i wb = _mm_set1_epi16( static_cast<int16_t>( weight ) );
+	const __m128i round = _mm_set1_epi16( 128 );
+	for( ; i + 16 <= count; i += 16 ) {
+		__m128i va = _mm_loadu_si128( reinterpret_cast<const __m128i*>( a + i ) );
+		__m128i vb = _mm_loadu_si128( reinterpret_cast<const __m128i*>( b + i ) );
+		__m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( va, zero ), wa ), _mm_mullo_epi16( _mm_unpacklo_epi8( vb, zero ), wb ) );
+		__m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( va, zero ), wa ), _mm_mullo_epi16( _mm_unpackhi_epi8( vb, zero ), wb ) );
+		lo = _mm_srli_epi16( _mm_add_epi16( lo, round ), 8 );
+		hi = _mm_srli_epi16( _mm_add_epi16( hi, round ), 8 );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( dst + i ), _mm_packus_epi16( lo, hi ) );
+	}
+#elif defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+	const uint8x8_t wa = vdup_n_u8( static_cast<uint8_t>( inverse ) );
+	const uint8x8_t wb = vdup_n_u8( static_cast<uint8_t>( weight ) );
+	for( ; i + 16 <= count; i += 16 ) {
+		uint8x16_t va = vld1q_u8( a + i );
+		uint8x16_t vb = vld1q_u8( b + i );
+		uint16x8_t lo = vmlal_u8( vmull_u8( vget_low_u8( va ), wa ), vget_low_u8( vb ), wb );
+		uint16x8_t hi = vmlal_u8( vmull_u8( vget_high_u8( va ), wa ), vget_high_u8( vb ), wb );
+		vst1q_u8( dst + i, vcombine_u8( vrshrn_n_u16( lo, 8 ), vrshrn_n_u16( hi, 8 ) ) );
+	}
+#endif
+	for( ; i < count; ++i )
+		dst[i] = static_cast<uint8_t>( ( a[i] * inverse + b[i] * weight + 128 ) >> 8 );
+}
+
+uint64_t sumAbsDifferences( const uint8_t *a, const uint8_t *b, size_t count )
+{
+	uint64_t result = 0;
+	size_t i = 0;
+#if defined( __SSE2__ )
+	// psadbw sums 8 absolute differences into each 64 bit half
+	__m128i sum = _mm_setzero_si128();
+	for( ; i + 16 <= count; i += 16 ) {
+		__m128i va = _mm_loadu_si128( reinterpret_cast<const __m128i*>( a + i ) );
+		__m128i vb = _mm_loadu_si128( reinterpret_cast<const __m128i*>( b + i ) );
+		sum = _mm_add_epi64( sum, _mm_sad_epu8( va, vb ) );
+	}
+	uint64_t halves[2];
+	_mm_storeu_si128( reinterpret_cast<__m128i*>( halves ), sum );
+	result = halves[0] + halves[1];
+#elif defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+	uint64x2_t sum = vdupq_n_u64( 0 );
+	for( ; i + 16 <= count; i += 16 ) {
+		uint8x16_t diff = vabdq_u8( vld1q_u8( a + i ), vld1q_u8( b + i ) );
+		sum = vpadalq_u32( sum, vpaddlq_u16( vpaddlq_u8( diff ) ) );
+	}
+	result = vgetq_lane_u64( sum, 0 ) + vgetq_lane_u64( sum, 1 );
+#endif
+	for( ; i < count; ++i )
+		result += ( a[i] > b[i] ) ? a[i] - b[i] : b[i] - a[i];
+	return result;
+}
+
+void applyLookupTable( const uint8_t *lut, const uint8_t *src, uint8_t *dst, size_t count, int32_t pixelInc, int32_t alphaOffset )
+{
+	size_t i = 0;
+	// the vector paths keep alpha by blending with a mask, which only lines up with 4 byte pixels
+	const bool vectorize = ( alphaOffset < 0 || pixelInc == 4 );
+#if defined( __AVX2__ )
+	if( vectorize ) {
+		// as the SSSE3 path below, 32 bytes at a time; the shuffle works within each 128 bit lane, so both lanes hold the same tables.
+		// On the CPUs measured this beats a 32 bit gather, which fetches one entry per element.
+		__m256i tables[16];
+		for( int32_t t = 0; t < 16; ++t )
+			tables[t] = _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i*>( lut + t * 16 ) ) );
+		__m256i alphaMask = _mm256_setzero_si256();
+		if( alphaOffset >= 0 ) {
+			uint8_t mask[32];
+			for( int32_t k = 0; k < 32; ++k )
+				mask[k] = ( k % 4 == alphaOffset )? 0xFF: 0;
+			alphaMask = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( mask ) );
+		}
+		const __m256i bias = _mm256_set1_epi8( 0x70 );
+		const __m256i step = _mm256_set1_epi8( 16 );
+		for( ; i + 32 <= count; i += 32 ) {
+			__m256i index = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( src + i ) );
+			__m256i shifted = index;
+			__m256i mapped = _mm256_setzero_si256();
+			for( int32_t t = 0; t < 16; ++t ) {
+				mapped = _mm256_or_si256( mapped, _mm256_shuffle_epi8( tables[t], _mm256_adds_epu8( shifted, bias ) ) );
+				shifted = _mm256_sub_epi8( shifted, step );
+			}
+			_mm256_storeu_si256( reinterpret_cast<__m256i*>( dst + i ), _mm256_blendv_epi8( mapped, index, alphaMask ) );
+		}
+	}
+#endif
+#if defined( __SSSE3__ )
+	if( vectorize ) {
+		// sixteen 16 entry shuffles, each answering for one high nibble; a saturating add pushes every other byte past 0x7F,
+		// where the shuffle writes zero, so OR-ing the sixteen results leaves each byte's own entry
+		__m128i tables[16];
+		for( int32_t t = 0; t < 16; ++t )
+			tables[t] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( lut + t * 16 ) );
+		__m128i alphaMask = _mm_setzero_si128();
+		if( alphaOffset >= 0 ) {
+			uint8_t mask[16];
+			for( int32_t k = 0; k < 16; ++k )
+				mask[k] = ( k % 4 == alphaOffset )? 0xFF: 0;
+			alphaMask = _mm_loadu_si128( reinterpret_cast<const __m128i*>( mask ) );
+		}
+		const __m128i bias = _mm_set1_epi8( 0x70 );
+		const __m128i step = _mm_set1_epi8( 16 );
+		for( ; i + 16 <= count; i += 16 ) {
+			__m128i index = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i ) );
+			__m128i shifted = index;
+			__m128i mapped = _mm_setzero_si128();
+			for( int32_t t = 0; t < 16; ++t ) {
+				mapped = _mm_or_si128( mapped, _mm_shuffle_epi8( tables[t], _mm_adds_epu8( shifted, bias ) ) );
+				shifted = _mm_sub_epi8( shifted, step );
+			}
+			mapped = _mm_or_si128( _mm_and_si128( alphaMask, index ), _mm_andnot_si128( alphaMask, mapped ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( dst + i ), mapped );
+		}
+	}
+#elif defined( __aarch64__ )
+	if( vectorize ) {
+		uint8x16x4_t tables[4];
+		for( int32_t t = 0; t < 4; ++t )
+			tables[t] = vld1q_u8_x4( lut + t * 64 );
+		uint8x16_t alphaMask = vdupq_n_u8( 0 );
+		if( alphaOffset >= 0 ) {
+			uint8_t mask[16];
+			for( int32_t k = 0; k < 16; ++k )
+				mask[k] = ( k % 4 == alphaOffset )? 0xFF: 0;
+			alphaMask = vld1q_u8( mask );
+		}
+		const uint8x16_t step = vdupq_n_u8( 64 );
+		for( ; i + 16 <= count; i += 16 ) {
+			// four 64 entry table lookups; out of range indices leave the previous result untouched
+			uint8x16_t index = vld1q_u8( src + i );
+			uint8x16_t mapped = vqtbl4q_u8( tables[0], index );
+			uint8x16_t shifted = vsubq_u8( index, step );
+			mapped = vqtbx4q_u8( mapped, tables[1], shifted );
+			shifted = vsubq_u8( shifted, step );
+			mapped = vqtbx4q_u8( mapped, tables[2], shifted );
+			shifted = vsubq_u8( shifted, step );
+			mapped = vqtbx4q_u8( mapped, tables[3], shifted );
+			vst1q_u8( dst + i, vbslq_u8( alphaMask, index, mapped ) );
+		}
+	}
+#endif
+	if( alphaOffset < 0 ) {
+		for( ; i < count; ++i )
+			dst[i] = lut[src[i]];
+	}
+	else {
+		for( ; i < count; ++i )
+			dst[i] = ( static_cast<int32_t>( i % pixelInc ) == alphaOffset )? src[i]: lut[src[i]];
+	}
+	(void)vectorize;
+}
+
+void swizzlePixels( const uint8_t *src, int32_t srcInc, uint8_t *dst, int32_t dstInc, const int8_t *dstFromSrc, size_t numPixels )
+{
+	size_t p = 0;
+#if defined( __SSSE3__ ) || defined( __aarch64__ )
+	if( dstInc == 4 && ( srcInc == 4 || srcInc == 3 ) ) {
+		// one shuffle moves four pixels; channels without a source are zeroed by the shuffle and filled by the OR
+		uint8_t shuffle[16], fill[16];
+		for( int32_t px = 0; px < 4; ++px ) {
+			for( int32_t c = 0; c < 4; ++c ) {
+				shuffle[px * 4 + c] = ( dstFromSrc[c] >= 0 )? static_cast<uint8_t>( px * srcInc + dstFromSrc[c] ): 0x80;
+				fill[px * 4 + c] = ( dstFromSrc[c] >= 0 )? 0: 0xFF;
+			}
+		}
+		// a three byte source reads 16 bytes to consume 12, so stay clear of the end of the row
+		const size_t tail = ( srcInc == 3 )? 6: 4;
+	#if defined( __SSSE3__ )
+		const __m128i mask = _mm_loadu_si128( reinterpret_cast<const __m128i*>( shuffle ) );
+		const __m128i alpha = _mm_loadu_si128( reinterpret_cast<const __m128i*>( fill ) );
+		for( ; p + tail <= numPixels; p += 4 ) {
+			__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + p * srcInc ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( dst + p * 4 ), _mm_or_si128( _mm_shuffle_epi8( v, mask ), alpha ) );
+		}
+	#else
+		const uint8x16_t mask = vld1q_u8( shuffle );
+		const uint8x16_t alpha = vld1q_u8( fill );
+		for( ; p + tail <= numPixels; p += 4 ) {
+			uint8x16_t v = vld1q_u8( src + p * srcInc );
+			vst1q_u8( dst + p * 4, vorrq_u8( vqtbl1q_u8( v, mask ), alpha ) );
+		}
+	#endif
+	}
+#endif
+	for( ; p < numPixels; ++p ) {
+		const uint8_t *s = src + p * srcInc;
+		uint8_t *d = dst + p * dstInc;
+		for( int32_t c = 0; c < dstInc; ++c )
+			d[c] = ( dstFromSrc[c] >= 0 )? s[dstFromSrc[c]]: 0xFF;
+	}
+}
+
+namespace {
+
+void copyPixelRowRange( const uint8_t *src, size_t srcRowBytes, int32_t srcInc, uint8_t *dst, size_t dstRowBytes, int32_t dstInc, const int8_t *dstFromSrc,
+						int32_t width, int32_t rowBegin, int32_t rowEnd, const uint8_t *lut, int32_t alphaOffset )
+{
+	if( ! dstFromSrc && ! lut && srcRowBytes == dstRowBytes ) {
+		std::memcpy( dst + rowBegin * dstRowBytes, src + rowBegin * srcRowBytes, ( rowEnd - rowBegin ) * dstRowBytes );
+		return;
+	}
+	
+	const size_t rowLength = static_cast<size_t>( width ) * dstInc;
+	for( int32_t y = rowBegin; y < rowEnd; ++y ) {
+		uint8_t *row = dst + y * dstRowBytes;
+		if( dstFromSrc ) {
+			swizzlePixels( src + y * srcRowBytes, srcInc, row, dstInc, dstFromSrc, width );
+			// the row is still in cache, so mapping it in place costs next to nothing
+			if( lut )
+				applyLookupTable( lut, row, row, rowLength, dstInc, alphaOffset );
+		}
+		else if( lut )
+			applyLookupTable( lut, src + y * srcRowBytes, row, rowLength, dstInc, alphaOffset );
+		else
+			std::memcpy( row, src + y * srcRowBytes, width * srcInc );
+	}
+}
+
+} // anonymous namespace
+
+void copyPixelRows( const uint8_t *src, size_t srcRowBytes, int32_t srcInc, uint8_t *dst, size_t dstRowBytes, int32_t dstInc, const int8_t *dstFromSrc,
+					int32_t width, int32_t height, size_t numThreads, const uint8_t *lut, int32_t alphaOffset )
+{
+	// below a few megabytes, spinning up threads costs more than the copy
+	if( numThreads == 0 ) {
+		size_t bytes = static_cast<size_t>( width ) * height * dstInc;
+		numThreads = std::min<size_t>( std::max<size_t>( std::thread::hardware_concurrency(), 1 ), bytes / ( 4 * 1024 * 1024 ) + 1 );
+	}
+	numThreads = std::min<size_t>( numThreads, std::max( height, 1 ) );
+	
+	if( numThreads <= 1 ) {
+		copyPixelRowRange( src, srcRowBytes, srcInc, dst, dstRowBytes, dstInc, dstFromSrc, width, 0, height, lut, alphaOffset );
+		return;
+	}
+	
+	// bands run on the shared pool rather than threads of their own
+	const int32_t band = static_cast<int32_t>( ( height + numThreads - 1 ) / numThreads );
+	const size_t numBands = static_cast<size_t>( ( height + band - 1 ) / band );
+	WorkerPool::getShared().parallelFor( numBands, [=]( size_t i ) {
+		int32_t rowBegin = static_cast<int32_t>( i ) * band;
+		copyPixelRowRange( src, srcRowBytes, srcInc, dst, dstRowBytes, dstInc, dstFromSrc, width, rowBegin, std::min( rowBegin + band, height ), lut, alphaOffset );
+	} );
+}
+
+} } // namespace cinder::avf
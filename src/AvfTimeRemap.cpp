@@ -0,0 +1,157 @@
+#include "AvfTimeRemap.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cinder { namespace avf {
+
+TimeRemapCurve& TimeRemapCurve::addKey( double outputTime, double sourceTime )
+{
+	Key key = { outputTime, sourceTime, 0 };
+	std::vector<Key>::iterator it = mKeys.begin();
+	while( it != mKeys.end() && it->mOutput < outputTime )
+		++it;
+	if( it != mKeys.end() && it->mOutput == outputTime )
+		*it = key;
+	else
+		mKeys.insert( it, key );
+
+	updateTangents();
+	return *this;
+}
+
+TimeRemapCurve& TimeRemapCurve::clear()
+{
+	mKeys.clear();
+	return *this;
+}
+
+TimeRemapCurve& TimeRemapCurve::setInterpolation( Interpolation interpolation )
+{
+	mInterpolation = interpolation;
+	updateTangents();
+	return *this;
+}
+
+// Fritsch-Carlson tangents: secant averages, limited so each cubic stays within its keys
+void TimeRemapCurve::updateTangents()
+{
+	const size_t n = mKeys.size();
+	if( n < 2 ) {
+		for( size_t i = 0; i < n; ++i )
+			mKeys[i].mTangent = 1;
+		return;
+	}
+
+	std::vector<double> secants( n - 1 );
+	for( size_t i = 0; i + 1 < n; ++i )
+		secants[i] = ( mKeys[i + 1].mSource - mKeys[i].mSource ) / ( mKeys[i + 1].mOutput - mKeys[i].mOutput );
+
+	mKeys[0].mTangent = secants[0];
+	mKeys[n - 1].mTangent = secants[n - 2];
+	for( size_t i = 1; i + 1 < n; ++i ) {
+		if( secants[i - 1] * secants[i] <= 0 )
+			mKeys[i].mTangent = 0;
+		else
+			mKeys[i].mTangent = ( secants[i - 1] + secants[i] ) / 2;
+	}
+
+	for( size_t i = 0; i + 1 < n; ++i ) {
+		if( secants[i] == 0 ) {
+			mKeys[i].mTangent = mKeys[i + 1].mTangent = 0;
+			continue;
+		}
+		double alpha = mKeys[i].mTangent / secants[i];
+		double beta = mKeys[i + 1].mTangent / secants[i];
+		double length = alpha * alpha + beta * beta;
+		if( length > 9 ) {
+			double tau = 3 / std::sqrt( length );
+			mKeys[i].mTangent = tau * alpha * secants[i];
+			mKeys[i + 1].mTangent = tau * beta * secants[i];
+		}
+	}
+}
+
+// Returns the index of the key starting the segment containing \a outputTime, clamped to the first and last segments
+size_t TimeRemapCurve::findSegment( double outputTime ) const
+{
+	size_t i = 0;
+	while( i + 2 < mKeys.size() && mKeys[i + 1].mOutput <= outputTime )
+		++i;
+	return i;
+}
+
+double TimeRemapCurve::getSourceTime( double outputTime ) const
+{
+	if( mKeys.empty() )
+		return outputTime;
+	if( mKeys.size() == 1 )
+		return mKeys[0].mSource + ( outputTime - mKeys[0].mOutput );
+
+	const Key &first = mKeys.front();
+	const Key &last = mKeys.back();
+	if( outputTime <= first.mOutput )
+		return first.mSource + ( outputTime - first.mOutput ) * getSpeed( first.mOutput );
+	if( outputTime >= last.mOutput )
+		return last.mSource + ( outputTime - last.mOutput ) * getSpeed( last.mOutput );
+
+	const size_t i = findSegment( outputTime );
+	const Key &k0 = mKeys[i];
+	const Key &k1 = mKeys[i + 1];
+	const double h = k1.mOutput - k0.mOutput;
+	const double t = ( outputTime - k0.mOutput ) / h;
+
+	if( mInterpolation == INTERPOLATION_LINEAR )
+		return k0.mSource + ( k1.mSource - k0.mSource ) * t;
+
+	// cubic Hermite basis
+	const double t2 = t * t, t3 = t2 * t;
+	return ( 2 * t3 - 3 * t2 + 1 ) * k0.mSource + ( t3 - 2 * t2 + t ) * h * k0.mTangent
+			+ ( -2 * t3 + 3 * t2 ) * k1.mSource + ( t3 - t2 ) * h * k1.mTangent;
+}
+
+double TimeRemapCurve::getSpeed( double outputTime ) const
+{
+	if( mKeys.size() < 2 )
+		return 1;
+
+	const size_t i = findSegment( outputTime );
+	const Key &k0 = mKeys[i];
+	const Key &k1 = mKeys[i + 1];
+	const double h = k1.mOutput - k0.mOutput;
+
+	if( mInterpolation == INTERPOLATION_LINEAR )
+		return ( k1.mSource - k0.mSource ) / h;
+
+	// outside the keys the end tangent carries on
+	if( outputTime <= k0.mOutput )
+		return k0.mTangent;
+	if( outputTime >= k1.mOutput )
+		return k1.mTangent;
+
+	const double t = ( outputTime - k0.mOutput ) / h;
+	const double t2 = t * t;
+	return ( ( 6 * t2 - 6 * t ) * k0.mSource + ( -6 * t2 + 6 * t ) * k1.mSource ) / h
+			+ ( 3 * t2 - 4 * t + 1 ) * k0.mTangent + ( 3 * t2 - 2 * t ) * k1.mTangent;
+}
+
+RemapFrames selectRemapFrames( const FrameIndex &index, const MediaTime &sourceTime, bool blend )
+{
+	RemapFrames result;
+	if( index.empty() )
+		return result;
+
+	if( ! index.findFrame( sourceTime, &result.mFrame ) )
+		result.mFrame = 0;
+	result.mNextFrame = std::min( result.mFrame + 1, index.getNumFrames() - 1 );
+
+	const FrameIndex::Frame &frame = index.getFrame( result.mFrame );
+	if( blend && result.mNextFrame != result.mFrame && frame.mDuration.isValid() && frame.mDuration.getValue() > 0 ) {
+		double offset = ( sourceTime - frame.mTime ).toSeconds() / frame.mDuration.toSeconds();
+		offset = std::max( 0.0, std::min( 1.0, offset ) );
+		result.mWeight = static_cast<uint32_t>( offset * 256 + 0.5 );
+	}
+	return result;
+}
+
+} } // namespace cinder::avf
@@ -1,17 +1,123 @@
 #include "cinder/gl/gl.h"
 
 #include "Avf.h"
+#include "AvfFrameAllocator.h"
+#include "AvfPixelFormat.h"
+#include "AvfSimd.h"
 #include "AvfUtils.h"
+#include "AvfWorkerPool.h"
 
 #if defined( CINDER_COCOA )
 	#include <CoreVideo/CoreVideo.h>
 	#include <AVFoundation/AVFoundation.h>
 #endif
 
+#include <cmath>
+
 using namespace std;
 
+// Answers the range requests of an asset from a ByteSource. Requests are served on a serial WorkerPool queue of their own,
+// piece by piece, so a request for the whole movie neither blocks the loader queue shared by every movie nor outlives
+// its cancellation by more than one piece.
+@interface ByteSourceLoader : NSObject<AVAssetResourceLoaderDelegate> {
+	ci::avf::ByteSourceRef source;
+	ci::avf::WorkerPool::QueueRef queue;
+	NSString* contentType;
+}
+
+- (id)initWithSource:(const ci::avf::ByteSourceRef&)aSource contentType:(NSString*)aContentType;
+- (void)serveRequest:(AVAssetResourceLoadingRequest*)loadingRequest;
+
+@end
+
+@implementation ByteSourceLoader
+
+- (id)initWithSource:(const ci::avf::ByteSourceRef&)aSource contentType:(NSString*)aContentType
+{
+	self = [super init];
+	self->source = aSource;
+	self->queue = ci::avf::WorkerPool::getShared().createQueue();
+	self->contentType = [aContentType copy];
+	return self;
+}
+
+- (void)dealloc
+{
+	// requests in flight still read from the source
+	self->queue->wait();
+	[self->contentType release];
+	[super dealloc];
+}
+
+- (BOOL)resourceLoader:(AVAssetResourceLoader*)resourceLoader shouldWaitForLoadingOfRequestedResource:(AVAssetResourceLoadingRequest*)loadingRequest
+{
+	[loadingRequest retain];
+	ci::avf::ByteSourceRef keep_source = self->source;
+	self->queue->post([self, loadingRequest, keep_source] {
+		@autoreleasepool {
+			[self serveRequest:loadingRequest];
+		}
+		[loadingRequest release];
+	});
+	return YES;
+}
+
+- (void)serveRequest:(AVAssetResourceLoadingRequest*)loadingRequest
+{
+	// pieces are copied into the NSData handed over, since AVFoundation may hold on to it past the movie
+	static const size_t kChunkSize = 1024 * 1024;
+	
+	if ([loadingRequest isCancelled]) return;
+	
+	const uint64_t size = self->source->getSize();
+	AVAssetResourceLoadingContentInformationRequest* info = [loadingRequest contentInformationRequest];
+	if (info) {
+		[info setContentType:self->contentType];
+		[info setContentLength:(long long)size];
+		[info setByteRangeAccessSupported:YES];
+	}
+	
+	AVAssetResourceLoadingDataRequest* data_request = [loadingRequest dataRequest];
+	if (data_request) {
+		bool to_end = [data_request respondsToSelector:@selector(requestsAllDataToEndOfResource)] && [data_request requestsAllDataToEndOfResource];
+		ci::avf::ByteRange range;
+		if (!ci::avf::clampByteRange([data_request requestedOffset], [data_request requestedLength], to_end, size, &range)) {
+			[loadingRequest finishLoadingWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorResourceUnavailable userInfo:nil]];
+			return;
+		}
+		
+		bool served = ci::avf::serveByteRange(*self->source, range, kChunkSize, [loadingRequest, data_request](const uint8_t* bytes, size_t length) {
+			if ([loadingRequest isCancelled]) return false;
+			@autoreleasepool {
+				[data_request respondWithData:[NSData dataWithBytes:bytes length:length]];
+			}
+			return true;
+		});
+		if (!served) {
+			if (![loadingRequest isCancelled])
+				[loadingRequest finishLoadingWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCannotDecodeRawData userInfo:nil]];
+			return;
+		}
+	}
+	
+	[loadingRequest finishLoading];
+}
+
+@end
+
 namespace cinder { namespace avf {
 
+// The delegate of every byte source asset runs on this queue, and only hands the requests over to the loader's own queue
+static dispatch_queue_t sharedResourceLoaderQueue()
+{
+	static dispatch_queue_t queue = NULL;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		queue = dispatch_queue_create("movieResourceLoaderQueue", DISPATCH_QUEUE_SERIAL);
+	});
+	return queue;
+}
+
 bool setAudioSessionModes()
 {
 #if defined( CINDER_COCOA_TOUCH )
@@ -45,13 +151,8 @@ bool dictionarySetValue( CFMutableDictionaryRef dict, CFStringRef key, SInt32 va
 
 bool dictionarySetPixelBufferPixelFormatType( bool alpha, CFMutableDictionaryRef dict )
 {
-	bool setPixelBufferOptions = false;
-#if defined( CINDER_COCOA_TOUCH )
-	setPixelBufferOptions = dictionarySetValue( dict, kCVPixelBufferPixelFormatTypeKey, ( alpha ) ? kCVPixelFormatType_32BGRA : kCVPixelFormatType_24RGB );
-#elif defined( CINDER_COCOA )
-	setPixelBufferOptions = dictionarySetValue( dict, kCVPixelBufferPixelFormatTypeKey, ( alpha ) ? k32BGRAPixelFormat : k24RGBPixelFormat );
-#endif
-	return  setPixelBufferOptions;
+	const PixelFormatDesc &desc = getPixelFormatDesc( ( alpha ) ? PIXEL_FORMAT_BGRA : PIXEL_FORMAT_RGB );
+	return dictionarySetValue( dict, kCVPixelBufferPixelFormatTypeKey, desc.mCvType );
 }
 
 bool dictionarySetPixelBufferSize( const unsigned int width, const unsigned int height, CFMutableDictionaryRef dict )
@@ -67,7 +168,7 @@ bool dictionarySetPixelBufferSize( const unsigned int width, const unsigned int
 bool dictionarySetPixelBufferBytesPerRowAlignment( CFMutableDictionaryRef dict )
 {
 	bool setAlignment = false;
-	setAlignment = dictionarySetValue( dict, kCVPixelBufferBytesPerRowAlignmentKey, 1 );
+	setAlignment = dictionarySetValue( dict, kCVPixelBufferBytesPerRowAlignmentKey, FrameAllocator::ALIGNMENT );
 	return setAlignment;
 }
 
@@ -117,140 +218,55 @@ CFMutableDictionaryRef initQTVisualContextOptions( int width, int height, bool a
 	
 	return  visualContextOptions;
 }
-	 
-Handle createPointerReferenceHandle( void *data, Size dataSize )
+*/
+	
+Surface8u createFrameSurface( int32_t width, int32_t height, bool alpha, SurfaceChannelOrder channelOrder )
 {
-	Handle dataRef = NULL;
-	PointerDataRefRecord ptrDataRefRec;
-	OSErr err;
-
-	ptrDataRefRec.data = data;
-	ptrDataRefRec.dataLength = dataSize;
-
-	// create a data reference handle for our data
-	err = ::PtrToHand( &ptrDataRefRec, &dataRef, sizeof(PointerDataRefRecord) );
-	if( err != noErr )
-		return 0;
-
-	return dataRef;
+	int32_t rowBytes = (int32_t)FrameAllocator::getRowBytes( width, channelOrder.getPixelInc() );
+	uint8_t *data = reinterpret_cast<uint8_t*>( FrameAllocator::allocate( rowBytes * height ) );
+	if( ! data )
+		throw std::bad_alloc();
+	
+	Surface8u result( data, width, height, rowBytes, channelOrder );
+	result.setDeallocator( FrameAllocator::freeDeallocator, data );
+	return result;
 }
 
-OSStatus ptrDataRefAddFileNameExtension( ComponentInstance dataRefHandler, const string &fileName )
+// Pixel buffer attributes applying the FrameAllocator row alignment. Release with CFRelease().
+static CFMutableDictionaryRef createFramePixelBufferAttributes()
 {
-	OSStatus osErr = noErr;
-	unsigned char myChar = 0;
-	Handle fileNameHandle = NULL;
-
-	// create a handle with our file name string
-	// if we were passed an empty string, then we need to add this null string (a single 0 byte) to the handle
-	if( fileName.empty() )
-		osErr = ::PtrToHand( &myChar, &fileNameHandle, sizeof(myChar) );
-	else {
-		shared_ptr<char> tempStr( new char[fileName.size()+1], checked_array_deleter<char>() );
-		memcpy( &tempStr.get()[1], &fileName[0], fileName.size() );
-		tempStr.get()[0] = fileName.size();
-		osErr = ::PtrToHand( &tempStr.get()[0], &fileNameHandle, tempStr.get()[0] + 1 );
-		if( osErr != noErr ) goto bail;
-	}
-	if( osErr != noErr) goto bail;
-
-	// set the data ref extension for the data ref handler
-	osErr = ::DataHSetDataRefExtension( dataRefHandler, fileNameHandle, kDataRefExtensionFileName );
-
- bail:
-    if( fileNameHandle )         // no longer need this
-        ::DisposeHandle( fileNameHandle );
-
-    return osErr;
-
+	CFMutableDictionaryRef attributes = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+	dictionarySetPixelBufferBytesPerRowAlignment( attributes );
+	return attributes;
 }
 
-OSStatus ptrDataRefAddMIMETypeExtension( ComponentInstance dataRefHandler, const std::string &mimeType )
+// Channel order of a Surface wrapping pixels of a convertible \a format
+static SurfaceChannelOrder surfaceChannelOrder( PixelFormat format )
 {
-    OSStatus osErr = noErr;
-    Handle mimeTypeHndl = NULL;
-
-    if( mimeType.empty() )
-        return paramErr;
-
-	shared_ptr<char> tempStr( new char[mimeType.size()+1], checked_array_deleter<char>() );
-	memcpy( &tempStr.get()[1], &mimeType[0], mimeType.size() );
-	tempStr.get()[0] = mimeType.size();
-    osErr = ::PtrToHand( &tempStr.get()[0], &mimeTypeHndl, tempStr.get()[0] + 1 );
-    if( osErr != noErr ) goto bail;
-
-    // set the data ref extension for the data ref handler
-    osErr = ::DataHSetDataRefExtension( dataRefHandler, mimeTypeHndl, kDataRefExtensionMIMEType );
-
- bail:
-    if( mimeTypeHndl )         // no longer need this
-        ::DisposeHandle( mimeTypeHndl );
-
-    return osErr;
+	switch( format ) {
+		case PIXEL_FORMAT_RGB:	return SurfaceChannelOrder::RGB;
+		case PIXEL_FORMAT_BGR:	return SurfaceChannelOrder::BGR;
+		case PIXEL_FORMAT_ARGB:	return SurfaceChannelOrder::ARGB;
+		case PIXEL_FORMAT_ABGR:	return SurfaceChannelOrder::ABGR;
+		case PIXEL_FORMAT_RGBA:	return SurfaceChannelOrder::RGBA;
+		default:				return SurfaceChannelOrder::BGRA;
+	}
 }
 
-Handle createPointerDataRefWithExtensions( void *data, size_t dataSize, const string &fileName, const string &mimeType )
+// Looks up the PixelFormat laid out like \a sco, returning false for the padded RGBX style orders
+static bool findSurfacePixelFormat( const SurfaceChannelOrder &sco, PixelFormat *result )
 {
-	OSStatus err = noErr;
-	Handle dataRef = NULL;
-	ComponentInstance dataRefHandler = NULL;
-
-	// First create a data reference handle for our data
-	dataRef = createPointerReferenceHandle( data, dataSize );
-	if( ! dataRef )
-		goto bail;
-
-	//  Get a data handler for our data reference
-	err = OpenADataHandler(
-			dataRef,                    // data reference
-			PointerDataHandlerSubType,  // data ref. type
-			NULL,                       // anchor data ref.
-			(OSType)0,                  // anchor data ref. type
-			NULL,                       // time base for data handler
-			kDataHCanRead,              // flag for data handler usage
-			&dataRefHandler);           // returns the data handler
-	if( err ) goto bail;
-
-	// We can add the filename to the data ref to help
-	// importer finding process. Find uses the extension.
-	// If we add a filetype or mimetype we must add a
-	// filename -- even if it is an empty string
-	if( ( ! fileName.empty() ) || ( ! mimeType.empty() ) ) {
-		err = ptrDataRefAddFileNameExtension( dataRefHandler, fileName );
-		if( err ) goto bail;
+	switch( sco.getCode() ) {
+		case SurfaceChannelOrder::RGB:	*result = PIXEL_FORMAT_RGB; return true;
+		case SurfaceChannelOrder::BGR:	*result = PIXEL_FORMAT_BGR; return true;
+		case SurfaceChannelOrder::ARGB:	*result = PIXEL_FORMAT_ARGB; return true;
+		case SurfaceChannelOrder::BGRA:	*result = PIXEL_FORMAT_BGRA; return true;
+		case SurfaceChannelOrder::ABGR:	*result = PIXEL_FORMAT_ABGR; return true;
+		case SurfaceChannelOrder::RGBA:	*result = PIXEL_FORMAT_RGBA; return true;
+		default:						return false;
 	}
-
-	// to add MIME type information, add a classic atom followed by
-	// a Pascal string holding the MIME type
-	if ( ! mimeType.empty() ) {
-		err = ptrDataRefAddMIMETypeExtension( dataRefHandler, mimeType );
-		if( err ) goto bail;
-	}
-
-	// dispose old data ref handle because it does not contain our new changes
-	::DisposeHandle( dataRef );
-	dataRef = NULL;
-
-	// re-acquire data reference from the data handler to get the new changes
-	err = ::DataHGetDataRef( dataRefHandler, &dataRef );
-	if( err ) goto bail;
-
-	::CloseComponent( dataRefHandler );
-
-	return dataRef;
- bail:
-    if( dataRefHandler ) {
-		::CloseComponent(dataRefHandler);
-    }
-
-    if( dataRef ) {         // make sure and dispose the data reference handle once we are done with it
-        ::DisposeHandle( dataRef );
-    }
-
-    return NULL;
 }
-*/
-	
+
 static void CVPixelBufferDealloc( void* refcon )
 {
 	::CVBufferRelease( (CVPixelBufferRef)(refcon) );
@@ -267,32 +283,10 @@ Surface8u convertCvPixelBufferToSurface( CVPixelBufferRef pixelBufferRef )
 	CVPixelBufferUnlockBaseAddress(pixelBufferRef, 0);
 	
 	SurfaceChannelOrder sco;
-#if defined( CINDER_COCOA_TOUCH )
-	if (type == kCVPixelFormatType_24RGB )
-		sco = SurfaceChannelOrder::RGB;
-	else if (type == kCVPixelFormatType_24BGR )
-		sco = SurfaceChannelOrder::BGR;
-	else if (type == kCVPixelFormatType_30RGB )
-		sco = SurfaceChannelOrder::RGB;
-	else if ( type == kCVPixelFormatType_32ARGB )
-		sco = SurfaceChannelOrder::ARGB;
-	else if (type == kCVPixelFormatType_32BGRA )
-		sco = SurfaceChannelOrder::BGRA;
-	else if (type == kCVPixelFormatType_32ABGR )
-		sco = SurfaceChannelOrder::ABGR;
-	else if (type == kCVPixelFormatType_32RGBA )
-		sco = SurfaceChannelOrder::BGRA;
+	PixelFormat format;
+	if( findPixelFormat( type, &format ) && getPixelFormatDesc( format ).isConvertible() )
+		sco = surfaceChannelOrder( format );
 	
-#elif defined( CINDER_COCOA )
-	if( type == k24RGBPixelFormat )
-		sco = SurfaceChannelOrder::RGB;
-	else if( type == k32ARGBPixelFormat )
-		sco = SurfaceChannelOrder::ARGB;
-	else if( type == k24BGRPixelFormat )
-		sco = SurfaceChannelOrder::BGR;
-	else if( type == k32BGRAPixelFormat )
-		sco = SurfaceChannelOrder::BGRA;
-#endif
 	Surface result( ptr, width, height, rowBytes, sco );
 	result.setDeallocator( CVPixelBufferDealloc, pixelBufferRef );
 	
@@ -305,6 +299,131 @@ Surface8u convertCmSampleBufferToSurface( CMSampleBufferRef sampleBufferRef )
 	return convertCvPixelBufferToSurface(imageBuffer);
 }
 
+static void SurfaceViewDealloc( void* refcon )
+{
+	delete reinterpret_cast<Surface8u*>( refcon );
+}
+
+Surface8u createSurfaceView( const Surface8u &surface, const Area &area )
+{
+	if( ! surface )
+		return Surface8u();
+	Area clipped = area.getClipBy( surface.getBounds() );
+	if( clipped.getWidth() <= 0 || clipped.getHeight() <= 0 )
+		return Surface8u();
+	
+	// the view holds a reference to the parent, which releases the pixels once the last view is gone
+	Surface8u result( const_cast<uint8_t*>( surface.getData( clipped.getUL() ) ), clipped.getWidth(), clipped.getHeight(), surface.getRowBytes(), surface.getChannelOrder() );
+	result.setDeallocator( SurfaceViewDealloc, new Surface8u( surface ) );
+	return result;
+}
+
+MediaTime getFrameDuration( AVAssetTrack *track )
+{
+	float frame_rate = [track nominalFrameRate];
+	MediaTime nominal = MediaTime::fromFrameRate( frame_rate );
+	if( ! [track respondsToSelector:@selector(minFrameDuration)] )
+		return nominal;
+	
+	// the sample timing is exact, unless the time scale can't hold the rate, such as 29.97 in 600ths alternating 20 and 21 ticks
+	MediaTime minimum = toMediaTime( [track minFrameDuration] );
+	if( ! minimum.isValid() || minimum.getValue() <= 0 )
+		return nominal;
+	if( nominal.isValid() && std::fabs( minimum.toSeconds() - nominal.toSeconds() ) > nominal.toSeconds() * 0.001 )
+		return nominal;
+	return minimum.reduced();
+}
+
+bool scanFrameIndex( AVAsset *asset, AVAssetTrack *track, FrameIndex *result )
+{
+	result->clear();
+
+	NSError* error = nil;
+	AVAssetReader* reader = [[AVAssetReader alloc] initWithAsset:asset error:&error];
+	if( ! reader || error ) {
+		[reader release];
+		return false;
+	}
+
+	// compressed samples carry their timing and sync flags, so nothing has to be decoded
+	AVAssetReaderTrackOutput* output = [[AVAssetReaderTrackOutput alloc] initWithTrack:track outputSettings:nil];
+	[output setAlwaysCopiesSampleData:NO];
+	[reader addOutput:output];
+
+	bool success = [reader startReading];
+	while( success ) {
+		CMSampleBufferRef sample = [output copyNextSampleBuffer];
+		if( ! sample )
+			break;
+
+		CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray( sample, false );
+		CMItemCount numSamples = CMSampleBufferGetNumSamples( sample );
+		for( CMItemCount i = 0; i < numSamples; ++i ) {
+			CMSampleTimingInfo timing;
+			if( CMSampleBufferGetSampleTimingInfo( sample, i, &timing ) != noErr )
+				continue;
+
+			bool keyFrame = true;
+			if( attachments && i < CFArrayGetCount( attachments ) ) {
+				CFDictionaryRef sampleAttachments = (CFDictionaryRef)CFArrayGetValueAtIndex( attachments, i );
+				keyFrame = ( CFDictionaryGetValue( sampleAttachments, kCMSampleAttachmentKey_NotSync ) != kCFBooleanTrue );
+			}
+			result->addFrame( toMediaTime( timing.presentationTimeStamp ), toMediaTime( timing.duration ), toMediaTime( timing.decodeTimeStamp ), keyFrame );
+		}
+		CFRelease( sample );
+	}
+	success = success && ( [reader status] == AVAssetReaderStatusCompleted );
+
+	[output release];
+	[reader release];
+
+	result->finalize();
+	return success;
+}
+
+AVAssetReader* createFrameReader( AVAsset *asset, AVAssetTrack *track, const MediaTime &start, const MediaTime &duration, AVAssetReaderTrackOutput **output )
+{
+	std::vector<AVAssetReaderTrackOutput*> outputs;
+	AVAssetReader* reader = createFrameReader( asset, std::vector<AVAssetTrack*>( 1, track ), start, duration, &outputs );
+	*output = reader ? outputs[0] : nil;
+	return reader;
+}
+
+AVAssetReader* createFrameReader( AVAsset *asset, const std::vector<AVAssetTrack*> &tracks, const MediaTime &start, const MediaTime &duration, std::vector<AVAssetReaderTrackOutput*> *outputs )
+{
+	outputs->clear();
+	if( tracks.empty() )
+		return nil;
+
+	NSError* error = nil;
+	AVAssetReader* reader = [[AVAssetReader alloc] initWithAsset:asset error:&error];
+	if( ! reader || error ) {
+		[reader release];
+		return nil;
+	}
+
+	// the reader starts decoding at the key frame preceding the range on its own, and only returns frames inside it
+	[reader setTimeRange:CMTimeRangeMake( toCmTime( start ), duration.isValid() ? toCmTime( duration ) : kCMTimePositiveInfinity )];
+	NSDictionary* settings = @{(id)kCVPixelBufferPixelFormatTypeKey: @(getPixelFormatDesc( PIXEL_FORMAT_BGRA ).mCvType),
+							   (id)kCVPixelBufferBytesPerRowAlignmentKey: @(FrameAllocator::ALIGNMENT)};
+	// all outputs share the reader's demuxer, so each sample of the file is read once whatever the number of tracks
+	for( size_t i = 0; i < tracks.size(); ++i ) {
+		AVAssetReaderTrackOutput* output = [[AVAssetReaderTrackOutput alloc] initWithTrack:tracks[i] outputSettings:settings];
+		[output setAlwaysCopiesSampleData:NO];
+		[reader addOutput:output];
+		outputs->push_back( output );
+	}
+
+	if( ! [reader startReading] ) {
+		for( size_t i = 0; i < outputs->size(); ++i )
+			[(*outputs)[i] release];
+		outputs->clear();
+		[reader release];
+		return nil;
+	}
+	return reader;
+}
+
 // @see http://developer.apple.com/library/ios/#documentation/AVFoundation/Reference/AVAssetWriterInputPixelBufferAdaptor_Class/Reference/Reference.html
 // @see http://developer.apple.com/library/ios/#qa/qa1702/_index.html
 // @see http://stackoverflow.com/questions/11863416/read-texture-bytes-with-glreadpixels
@@ -317,6 +436,34 @@ CMSampleBufferRef convertSurfaceToCmSampleBuffer( Surface8u source )
 	::CVPixelBufferRetain( result );
 	return (CMSampleBufferRef) result;
 }
+
+ByteSourceRef createByteSource( const DataSourceRef &dataSource )
+{
+	if( ! dataSource )
+		return ByteSourceRef();
+	
+	// the buffer belongs to the data source, so the data source is what keeps the bytes alive
+	Buffer &buffer = dataSource->getBuffer();
+	ByteSourceRef result = MemoryByteSource::create( buffer.getData(), buffer.getDataSize(), dataSource );
+	result->setExtensionHint( dataSource->getFilePathHint().extension().string() );
+	return result;
+}
+
+AVURLAsset* createByteSourceAsset( const ByteSourceRef &source, ByteSourceLoader **loader )
+{
+	const char* type_identifier = source ? getContainerTypeIdentifier( detectContainerType( *source ) ) : NULL;
+	if( ! type_identifier )
+		return nil;
+	
+	// any scheme AVFoundation can't load itself is routed to the resource loader's delegate
+	NSURL* url = [NSURL URLWithString:@"avfbytesource://movie"];
+	NSDictionary* asset_options = @{(id)AVURLAssetPreferPreciseDurationAndTimingKey: @(YES)};
+	AVURLAsset* asset = [[AVURLAsset alloc] initWithURL:url options:asset_options];
+	
+	*loader = [[ByteSourceLoader alloc] initWithSource:source contentType:[NSString stringWithUTF8String:type_identifier]];
+	[[asset resourceLoader] setDelegate:*loader queue:sharedResourceLoaderQueue()];
+	return asset;
+}
 	
 	/*
 CVPixelBufferRef convertTextureToCvPixelBuffer( TextureRef source )
@@ -402,19 +549,11 @@ ImageTargetCvPixelBuffer::ImageTargetCvPixelBuffer( ImageSourceRef imageSource,
             case ImageIo::UINT8:
                 setDataType( ImageIo::UINT8 );
                 if( imageSource->hasAlpha () ) {
-#if defined( CINDER_COCOA_TOUCH )
-                    formatType = kCVPixelFormatType_32ARGB;
-#elif defined( CINDER_COCOA )
-                    formatType = k32ARGBPixelFormat;
-#endif
+                    formatType = getPixelFormatDesc( PIXEL_FORMAT_ARGB ).mCvType;
                     setChannelOrder( ImageIo::ARGB );
                 }
                 else {
-#if defined( CINDER_COCOA_TOUCH )
-                    formatType = kCVPixelFormatType_24RGB;
-#elif defined( CINDER_COCOA )
-                    formatType = k24RGBPixelFormat;
-#endif
+                    formatType = getPixelFormatDesc( PIXEL_FORMAT_RGB ).mCvType;
                     setChannelOrder( ImageIo::RGB );
                 }
                 setColorModel( ImageIo::CM_RGB );
@@ -461,19 +600,11 @@ ImageTargetCvPixelBuffer::ImageTargetCvPixelBuffer( ImageSourceRef imageSource,
 			case ImageIo::UINT8:
 				setDataType( ImageIo::UINT8 );
 				if( imageSource->hasAlpha () ) {
-#if defined( CINDER_COCOA_TOUCH )
-					formatType = kCVPixelFormatType_32ARGB;
-#elif defined( CINDER_COCOA )
-					formatType = k32ARGBPixelFormat;
-#endif
+					formatType = getPixelFormatDesc( PIXEL_FORMAT_ARGB ).mCvType;
 					setChannelOrder( ImageIo::ARGB );
 				}
 				else {
-#if defined( CINDER_COCOA_TOUCH )
-					formatType = kCVPixelFormatType_24RGB;
-#elif defined( CINDER_COCOA )
-					formatType = k24RGBPixelFormat;
-#endif
+					formatType = getPixelFormatDesc( PIXEL_FORMAT_RGB ).mCvType;
 					setChannelOrder( ImageIo::RGB );
 				}
 				setColorModel( ImageIo::CM_RGB );
@@ -489,8 +620,10 @@ ImageTargetCvPixelBuffer::ImageTargetCvPixelBuffer( ImageSourceRef imageSource,
 		setColorModel( ImageIo::CM_RGB );
 	}
 
-	if( ::CVPixelBufferCreate( kCFAllocatorDefault, imageSource->getWidth(), imageSource->getHeight(), 
-				formatType, NULL, &mPixelBufferRef ) != kCVReturnSuccess )
+	CFMutableDictionaryRef attributes = createFramePixelBufferAttributes();
+	CVReturn status = ::CVPixelBufferCreate( kCFAllocatorDefault, imageSource->getWidth(), imageSource->getHeight(), formatType, attributes, &mPixelBufferRef );
+	CFRelease( attributes );
+	if( status != kCVReturnSuccess )
 		throw ImageIoException();
 	
 	if( ::CVPixelBufferLockBaseAddress( mPixelBufferRef, 0 ) != kCVReturnSuccess )
@@ -584,4 +717,115 @@ CVPixelBufferRef createCvPixelBuffer( ImageSourceRef imageSource, CVPixelBufferP
 	return result;
 }
 
-} } // namespace cinder::avf
\ No newline at end of file
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Direct Surface8u copies
+
+// Fills \a dstFromSrc with the source channel feeding each channel of \a format
+static void surfaceChannelMap( const Surface8u &surface, const PixelFormatDesc &format, int8_t dstFromSrc[4] )
+{
+	const SurfaceChannelOrder &sco = surface.getChannelOrder();
+	dstFromSrc[format.mRed] = sco.getRedOffset();
+	dstFromSrc[format.mGreen] = sco.getGreenOffset();
+	dstFromSrc[format.mBlue] = sco.getBlueOffset();
+	if( format.hasAlpha() )
+		dstFromSrc[format.mAlpha] = surface.hasAlpha()? (int8_t)sco.getAlphaOffset(): -1;
+}
+
+// Picks the pixel format that a Surface can be copied into without reordering, or 32BGRA when it has to be swizzled
+static OSType surfacePixelFormat( const Surface8u &surface )
+{
+	PixelFormat format;
+	if( ! findSurfacePixelFormat( surface.getChannelOrder(), &format ) || format == PIXEL_FORMAT_ABGR || format == PIXEL_FORMAT_RGBA )
+		format = PIXEL_FORMAT_BGRA;
+	return getPixelFormatDesc( format ).mCvType;
+}
+
+// Returns a copy of \a surface mapped through \a lut, for the ImageSource fallbacks that can't map while converting.
+// The copy comes from the FrameAllocator, so its rows are aligned for the vector table kernels.
+static Surface8u mapSurface( const Surface8u &surface, const uint8_t *lut )
+{
+	Surface8u result = createFrameSurface( surface.getWidth(), surface.getHeight(), surface.hasAlpha(), surface.getChannelOrder() );
+	const int32_t alphaOffset = surface.hasAlpha()? surface.getChannelOrder().getAlphaOffset(): -1;
+	for( int32_t y = 0; y < surface.getHeight(); ++y )
+		applyLookupTable( lut, surface.getData( Vec2i( 0, y ) ), result.getData( Vec2i( 0, y ) ), surface.getWidth() * surface.getPixelInc(), surface.getPixelInc(), alphaOffset );
+	return result;
+}
+
+// Copies \a surface into \a pixelBuffer, mapping it through \a lut when given. Returns false when the buffer's size or layout doesn't allow a direct copy
+static bool copySurfaceToCvPixelBuffer( const Surface8u &surface, CVPixelBufferRef pixelBuffer, size_t numThreads, const uint8_t *lut )
+{
+	if( ::CVPixelBufferGetWidth( pixelBuffer ) != (size_t)surface.getWidth() || ::CVPixelBufferGetHeight( pixelBuffer ) != (size_t)surface.getHeight() )
+		return false;
+	
+	PixelFormat dstFormat;
+	if( ! findPixelFormat( ::CVPixelBufferGetPixelFormatType( pixelBuffer ), &dstFormat ) || ! getPixelFormatDesc( dstFormat ).isConvertible() )
+		return false;
+	
+	const PixelFormatDesc &dstDesc = getPixelFormatDesc( dstFormat );
+	const int32_t srcInc = surface.getPixelInc();
+	const int32_t dstInc = dstDesc.mPixelInc;
+	int8_t dstFromSrc[4];
+	surfaceChannelMap( surface, dstDesc, dstFromSrc );
+	
+	// a straight copy when every destination byte comes from the same source byte
+	bool identity = ( srcInc == dstInc );
+	for( int32_t c = 0; c < dstInc && identity; ++c )
+		identity = ( dstFromSrc[c] == c );
+	
+	// swizzlePixels() only vectorizes layouts producing four byte pixels, the rest go through the converter specialized for the pair,
+	// unless there is a table to apply, which copyPixelRows() does while each row is in cache
+	PixelFormat srcFormat;
+	PixelConvertFn convertFn = NULL;
+	if( ! identity && dstInc != 4 && ! lut && findSurfacePixelFormat( surface.getChannelOrder(), &srcFormat ) )
+		convertFn = getPixelConverter( srcFormat, dstFormat );
+	
+	if( ::CVPixelBufferLockBaseAddress( pixelBuffer, 0 ) != kCVReturnSuccess )
+		return false;
+	uint8_t *data = reinterpret_cast<uint8_t*>( ::CVPixelBufferGetBaseAddress( pixelBuffer ) );
+	size_t rowBytes = ::CVPixelBufferGetBytesPerRow( pixelBuffer );
+	if( convertFn )
+		convertFn( surface.getData(), surface.getRowBytes(), data, rowBytes, surface.getWidth(), surface.getHeight() );
+	else
+		copyPixelRows( surface.getData(), surface.getRowBytes(), srcInc, data, rowBytes, dstInc, identity? NULL: dstFromSrc,
+					   surface.getWidth(), surface.getHeight(), numThreads, lut, dstDesc.hasAlpha()? dstDesc.mAlpha: -1 );
+	::CVPixelBufferUnlockBaseAddress( pixelBuffer, 0 );
+	
+	return true;
+}
+
+CVPixelBufferRef createCvPixelBuffer( const Surface8u &surface, bool convertToYpCbCr, size_t numThreads, const uint8_t *lut )
+{
+	if( convertToYpCbCr )
+		return createCvPixelBuffer( (ImageSourceRef)( lut? mapSurface( surface, lut ): surface ), convertToYpCbCr );
+	
+	::CVPixelBufferRef result = NULL;
+	CFMutableDictionaryRef attributes = createFramePixelBufferAttributes();
+	CVReturn status = ::CVPixelBufferCreate( kCFAllocatorDefault, surface.getWidth(), surface.getHeight(), surfacePixelFormat( surface ), attributes, &result );
+	CFRelease( attributes );
+	if( status != kCVReturnSuccess )
+		throw ImageIoException();
+	
+	if( ! copySurfaceToCvPixelBuffer( surface, result, numThreads, lut ) ) {
+		::CVPixelBufferRelease( result );
+		return createCvPixelBuffer( (ImageSourceRef)( lut? mapSurface( surface, lut ): surface ), convertToYpCbCr );
+	}
+	return result;
+}
+
+CVPixelBufferRef createCvPixelBuffer( const Surface8u &surface, CVPixelBufferPoolRef pbPool, bool convertToYpCbCr, size_t numThreads, const uint8_t *lut )
+{
+	if( convertToYpCbCr )
+		return createCvPixelBuffer( (ImageSourceRef)( lut? mapSurface( surface, lut ): surface ), pbPool, convertToYpCbCr );
+	
+	::CVPixelBufferRef result = NULL;
+	if( ::CVPixelBufferPoolCreatePixelBuffer( kCFAllocatorDefault, pbPool, &result ) != kCVReturnSuccess )
+		throw ImageIoException();
+	
+	if( ! copySurfaceToCvPixelBuffer( surface, result, numThreads, lut ) ) {
+		::CVPixelBufferRelease( result );
+		return createCvPixelBuffer( (ImageSourceRef)( lut? mapSurface( surface, lut ): surface ), pbPool, convertToYpCbCr );
+	}
+	return result;
+}
+
+} } // namespace cinder::avf
@@ -0,0 +1,204 @@
+#include "AvfWorkerPool.h"
+
+#include <algorithm>
+
+namespace cinder { namespace avf {
+
+namespace {
+
+std::mutex						sSharedMutex;
+std::unique_ptr<WorkerPool>		sSharedPool;
+size_t							sSharedNumThreads = 0;
+
+struct ParallelForState {
+	ParallelForState() : mNext( 0 ), mDone( 0 ) {}
+
+	std::atomic<size_t>		mNext, mDone;
+	std::mutex				mMutex;
+	std::condition_variable	mFinished;
+};
+
+// Claims and runs indices until none are left. Helpers that start after the last index was claimed never touch \a fn.
+void runParallelFor( const std::shared_ptr<ParallelForState> &state, size_t count, const std::function<void( size_t )> &fn )
+{
+	for( size_t i = state->mNext++; i < count; i = state->mNext++ ) {
+		fn( i );
+		if( ++state->mDone == count ) {
+			std::lock_guard<std::mutex> lock( state->mMutex );
+			state->mFinished.notify_all();
+		}
+	}
+}
+
+} // anonymous namespace
+
+WorkerPool::Queue::Queue( WorkerPool *pool, Priority priority )
+	: mPool( pool ), mPriority( priority ), mScheduled( false )
+{
+}
+
+void WorkerPool::Queue::post( const Task &task )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mTasks.push_back( task );
+	if( ! mScheduled ) {
+		mScheduled = true;
+		mPool->post( std::bind( &Queue::runNext, shared_from_this() ), getPriority() );
+	}
+}
+
+void WorkerPool::Queue::clear()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mTasks.clear();
+}
+
+void WorkerPool::Queue::wait()
+{
+	std::unique_lock<std::mutex> lock( mMutex );
+	mIdle.wait( lock, [this] { return mTasks.empty() && ! mScheduled; } );
+}
+
+void WorkerPool::Queue::runNext()
+{
+	Task task;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( ! mTasks.empty() ) {
+			task = mTasks.front();
+			mTasks.pop_front();
+		}
+	}
+	if( task )
+		task();
+
+	// one task per turn lets the other queues of the same priority interleave with a busy one
+	std::lock_guard<std::mutex> lock( mMutex );
+	if( mTasks.empty() ) {
+		mScheduled = false;
+		mIdle.notify_all();
+	}
+	else
+		mPool->post( std::bind( &Queue::runNext, shared_from_this() ), getPriority() );
+}
+
+WorkerPool::WorkerPool( size_t numThreads )
+	: mPending( 0 ), mNextWorker( 0 ), mStopping( false )
+{
+	if( numThreads == 0 )
+		numThreads = std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+
+	for( size_t i = 0; i < numThreads; ++i )
+		mWorkers.push_back( std::unique_ptr<Worker>( new Worker ) );
+	for( size_t i = 0; i < numThreads; ++i )
+		mThreads.push_back( std::thread( &WorkerPool::workerLoop, this, i ) );
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mSleepMutex );
+		mStopping = true;
+	}
+	mWake.notify_all();
+	for( size_t i = 0; i < mThreads.size(); ++i )
+		mThreads[i].join();
+}
+
+WorkerPool& WorkerPool::getShared()
+{
+	std::lock_guard<std::mutex> lock( sSharedMutex );
+	if( ! sSharedPool )
+		sSharedPool.reset( new WorkerPool( sSharedNumThreads ) );
+	return *sSharedPool;
+}
+
+void WorkerPool::setSharedNumThreads( size_t numThreads )
+{
+	std::lock_guard<std::mutex> lock( sSharedMutex );
+	sSharedNumThreads = numThreads;
+}
+
+WorkerPool::QueueRef WorkerPool::createQueue( Priority priority )
+{
+	return QueueRef( new Queue( this, priority ) );
+}
+
+void WorkerPool::post( const Task &task, Priority priority )
+{
+	Worker &worker = *mWorkers[mNextWorker++ % mWorkers.size()];
+	{
+		std::lock_guard<std::mutex> lock( worker.mMutex );
+		worker.mTasks[priority].push_back( task );
+	}
+	// counted under the sleep mutex, so a thread about to sleep either sees the task or gets woken
+	{
+		std::lock_guard<std::mutex> lock( mSleepMutex );
+		++mPending;
+	}
+	mWake.notify_one();
+}
+
+void WorkerPool::parallelFor( size_t count, const std::function<void( size_t )> &fn )
+{
+	if( count == 0 )
+		return;
+	if( count == 1 ) {
+		fn( 0 );
+		return;
+	}
+
+	std::shared_ptr<ParallelForState> state( new ParallelForState );
+	size_t helpers = std::min( count - 1, mThreads.size() );
+	for( size_t i = 0; i < helpers; ++i )
+		post( std::bind( runParallelFor, state, count, std::cref( fn ) ), PRIORITY_HIGH );
+
+	// the caller claims indices too, so the loop finishes even when every pool thread is busy
+	runParallelFor( state, count, fn );
+
+	std::unique_lock<std::mutex> lock( state->mMutex );
+	state->mFinished.wait( lock, [&] { return state->mDone == count; } );
+}
+
+bool WorkerPool::popTask( size_t index, Task *task )
+{
+	// own work first, oldest first, then steal the newest work of the others
+	for( int priority = 0; priority < NUM_PRIORITIES; ++priority ) {
+		for( size_t i = 0; i < mWorkers.size(); ++i ) {
+			Worker &worker = *mWorkers[( index + i ) % mWorkers.size()];
+			std::lock_guard<std::mutex> lock( worker.mMutex );
+			std::deque<Task> &tasks = worker.mTasks[priority];
+			if( tasks.empty() )
+				continue;
+			if( i == 0 ) {
+				*task = tasks.front();
+				tasks.pop_front();
+			}
+			else {
+				*task = tasks.back();
+				tasks.pop_back();
+			}
+			--mPending;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkerPool::workerLoop( size_t index )
+{
+	while( true ) {
+		Task task;
+		if( popTask( index, &task ) ) {
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock( mSleepMutex );
+		mWake.wait( lock, [this] { return mStopping || mPending > 0; } );
+		if( mStopping && mPending == 0 )
+			return;
+	}
+}
+
+} } // namespace cinder::avf
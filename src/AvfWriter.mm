@@ -6,6 +6,7 @@
 	#import <Foundation/Foundation.h>
 #endif
 
+#include "AvfSimd.h"
 #include "AvfUtils.h"
 #include "AvfWriter.h"
 
@@ -36,11 +37,17 @@ MovieWriter::Format::Format( uint32_t codec, float quality, float frameRate, boo
 	setTimeScale( (long)(frameRate * 100) );
 	setDefaultDuration( 1.0f / frameRate );
 	setGamma( PLATFORM_DEFAULT_GAMMA );
+	mCaptureFrames = 1;
+	mCaptureSeconds = 0;
+	mTemporalAveraging = false;
+	mTransferFunction = TRANSFER_LINEAR;
 }
 
 MovieWriter::Format::Format( const Format &format )
-:	mCodec( format.mCodec ), mTimeBase( format.mTimeBase ), mDefaultTime( format.mDefaultTime ), 
-	mGamma( format.mGamma ), mEnableMultiPass( format.mEnableMultiPass ), mQualityFloat( format.mQualityFloat )
+:	mCodec( format.mCodec ), mTimeBase( format.mTimeBase ), mDefaultTime( format.mDefaultTime ), mDefaultMediaTime( format.mDefaultMediaTime ),
+	mGamma( format.mGamma ), mEnableMultiPass( format.mEnableMultiPass ), mQualityFloat( format.mQualityFloat ),
+	mCaptureFrames( format.mCaptureFrames ), mCaptureSeconds( format.mCaptureSeconds ), mTemporalAveraging( format.mTemporalAveraging ),
+	mTransferFunction( format.mTransferFunction )
 {
 	//  TODO: ???
 }
@@ -55,6 +62,10 @@ void MovieWriter::Format::initDefaults()
 	mDefaultTime = 1 / 30.0f;
 	mGamma = PLATFORM_DEFAULT_GAMMA;
 	mEnableMultiPass = false;
+	mCaptureFrames = 1;
+	mCaptureSeconds = 0;
+	mTemporalAveraging = false;
+	mTransferFunction = TRANSFER_LINEAR;
 
 	enableTemporal( true );
 	enableReordering( true );
@@ -64,8 +75,8 @@ void MovieWriter::Format::initDefaults()
 
 MovieWriter::Format& MovieWriter::Format::setQuality( float quality )
 {
-	/* TODO: RE-IMPLEMENT
 	mQualityFloat = constrain<float>( quality, 0, 1 );
+	/* TODO: RE-IMPLEMENT
 	CodecQ compressionQuality = CodecQ(0x00000400 * mQualityFloat);
 	OSStatus err = ICMCompressionSessionOptionsSetProperty( mOptions,
                                 kQTPropertyClass_ICMCompressionSessionOptions,
@@ -124,14 +135,34 @@ MovieWriter::Format& MovieWriter::Format::setMaxKeyFrameRate( int32_t rate )
 	return *this;
 }
 
+MediaTime MovieWriter::Format::getDefaultMediaDuration() const
+{
+	if( mDefaultMediaTime.isValid() )
+		return mDefaultMediaTime;
+	return MediaTime::fromSeconds( mDefaultTime, (int32_t)mTimeBase );
+}
+
+MovieWriter::Format& MovieWriter::Format::setDefaultDuration( const MediaTime &defaultDuration )
+{
+	mDefaultMediaTime = defaultDuration;
+	mDefaultTime = (float)defaultDuration.toSeconds();
+	return *this;
+}
+
 const MovieWriter::Format& MovieWriter::Format::operator=( const Format &format )
 {
 	// TODO: UPDATE
 	mCodec = format.mCodec;
 	mTimeBase = format.mTimeBase;
 	mDefaultTime = format.mDefaultTime;
+	mDefaultMediaTime = format.mDefaultMediaTime;
 	mGamma = format.mGamma;
 	mEnableMultiPass = format.mEnableMultiPass;
+	mQualityFloat = format.mQualityFloat;
+	mCaptureFrames = format.mCaptureFrames;
+	mCaptureSeconds = format.mCaptureSeconds;
+	mTemporalAveraging = format.mTemporalAveraging;
+	mTransferFunction = format.mTransferFunction;
 
 	return *this;
 }
@@ -139,12 +170,29 @@ const MovieWriter::Format& MovieWriter::Format::operator=( const Format &format
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // MovieWriter
 MovieWriter::MovieWriter( const fs::path &path, int32_t width, int32_t height, const Format &format )
-	: mPath( path ), mWidth( width ), mHeight( height ), mFormat( format ), mFinished( false ), mNumFrames(0)
+	: mPath( path ), mWidth( width ), mHeight( height ), mFormat( format ), mFinished( false ), mNumFrames(0),
+	mCurrentTimeValue( 0 ), mCurrentTime( MediaTime::zero() ), mCaptureFrameCount( 0 ), mCaptureElapsed( 0 ), mWriter( nil ), mWriterSink( nil ), mSinkAdapater( nil ), mGammaLevel( NULL )
 {
+	buildTransferLut();
+	
+	// intra-only: every frame is encoded independently on a thread pool, bypassing AVAssetWriter
+	if( mFormat.mCodec == CODEC_JPEG ) {
+		try {
+			mMjpegWriter = MjpegWriter::create( mPath.string(), mWidth, mHeight, (int32_t)mFormat.mTimeBase, mFormat.mQualityFloat );
+		}
+		catch( MjpegWriterExc& ) {
+			throw MovieWriterExcInvalidPath();
+		}
+		return;
+	}
+	
 //	AVFileTypeQuickTimeMovie
 //	AVFileTypeMPEG4
 //	AVFileTypeAppleM4V
 	
+	// attached to every pixel buffer, so build it once
+	mGammaLevel = CFNumberCreate( kCFAllocatorDefault, kCFNumberFloatType, &mFormat.mGamma );
+	
 	NSURL* localOutputURL = [NSURL fileURLWithPath:[NSString stringWithCString:mPath.c_str() encoding:[NSString defaultCStringEncoding]]];
 	NSError* error = nil;
 	mWriter = [[AVAssetWriter alloc] initWithURL:localOutputURL fileType:AVFileTypeQuickTimeMovie error:&error];
@@ -184,11 +232,32 @@ MovieWriter::MovieWriter( const fs::path &path, int32_t width, int32_t height, c
 
 MovieWriter::~MovieWriter()
 {
-	if( ! mFinished )
-		finish();
+	if( ! mFinished ) {
+		try {
+			finish();
+		}
+		catch( MovieWriterExc& ) {
+		}
+	}
+	
+	if( mGammaLevel )
+		CFRelease( mGammaLevel );
 }
 
 void MovieWriter::addFrame( const Surface8u& imageSource, float duration )
+{
+	addFrame( imageSource, ( duration > 0 )? MediaTime::fromSeconds( duration, (int32_t)mFormat.mTimeBase ): MediaTime() );
+}
+
+// Advances the exact movie time by \a duration and returns the frame's length in units of the Format's time scale.
+// Rounding the end time rather than each duration keeps frames such as 1001/30000 from drifting at a coarser time scale.
+int64_t MovieWriter::advanceTime( const MediaTime& duration )
+{
+	mCurrentTime += duration;
+	return mCurrentTime.rescaled( (int32_t)mFormat.mTimeBase ).getValue() - mCurrentTimeValue;
+}
+
+void MovieWriter::addFrame( const Surface8u& imageSource, const MediaTime &duration )
 //void MovieWriter::addFrame( const ImageSourceRef& imageSource, float duration )
 {
 	/* RE-IMPLEMENT
@@ -235,6 +304,36 @@ void MovieWriter::addFrame( const Surface8u& imageSource, float duration )
 	if( mFinished )
 		throw MovieWriterExcAlreadyFinished();
 	
+	MediaTime frameDuration = ( duration.isValid() && duration.getValue() > 0 )? duration: mFormat.getDefaultMediaDuration();
+	
+	// timelapse: everything between two recorded frames is dropped (or accumulated) before any conversion
+	Surface8u frame = imageSource;
+	if( mFormat.isTimelapse() ) {
+		if( ! captureTimelapseFrame( imageSource, (float)frameDuration.toSeconds() ) )
+			return;
+		if( mFormat.mTemporalAveraging )
+			frame = mAccumulatorSurface;
+		frameDuration = mFormat.getDefaultMediaDuration();
+	}
+	
+	// the transfer function is applied by the copy into the encoder's buffer, rather than as a pass of its own
+	const uint8_t *transferLut = ( mFormat.mTransferFunction != TRANSFER_LINEAR )? mTransferLut: NULL;
+	
+	if( mMjpegWriter ) {
+		SurfaceChannelOrder sco = frame.getChannelOrder();
+		MjpegPixelLayout layout( frame.getPixelInc(), sco.getRedOffset(), sco.getGreenOffset(), sco.getBlueOffset() );
+		int64_t durationVal = advanceTime( frameDuration );
+		try {
+			mMjpegWriter->addFrame( frame.getData(), frame.getRowBytes(), layout, durationVal, transferLut );
+		}
+		catch( MjpegWriterExc& ) {
+			throw MovieWriterExcFrameEncode();
+		}
+		mCurrentTimeValue += durationVal;
+		++mNumFrames;
+		return;
+	}
+	
 	NSError* error = nil;
 	AVAssetWriterStatus status = [mWriter status];
 	if (AVAssetWriterStatusFailed == status) {
@@ -297,10 +396,7 @@ void MovieWriter::addFrame( const Surface8u& imageSource, float duration )
 	*/
 	
 	
-	if( duration <= 0 )
-		duration = mFormat.mDefaultTime;
-	
-	int64_t durationVal = static_cast<int64_t>( duration * mFormat.mTimeBase );
+	int64_t durationVal = advanceTime( frameDuration );
     
     // The general idea here is that we need to create a CVPixelBuffer from an existing pool
     // this will allow the memory management to stay native to the GPU (and recycle the pixel
@@ -322,31 +418,101 @@ void MovieWriter::addFrame( const Surface8u& imageSource, float duration )
 //	AVAssetWriterInput* _input = [mSinkAdapater assetWriterInput];
 //	CVPixelBufferPoolRef poolRef = [mSinkAdapater pixelBufferPool];
 	
-	::CVPixelBufferRef pixelBuffer = createCvPixelBuffer( imageSource, false );
+	::CVPixelBufferRef pixelBuffer = createCvPixelBuffer( frame, false, 0, transferLut );
 //	CVPixelBufferRef pixelBuffer = NULL;
 //	CVReturn s = CVPixelBufferPoolCreatePixelBuffer (kCFAllocatorDefault, [mSinkAdapater pixelBufferPool], &pixelBuffer);
 //	GLubyte *pixelBufferData = (GLubyte *)CVPixelBufferGetBaseAddress(pixelBuffer);
 //	glReadPixels(0, 0, getWidth(), getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, pixelBufferData);
-	::CFNumberRef gammaLevel = CFNumberCreate( kCFAllocatorDefault, kCFNumberFloatType, &mFormat.mGamma );
-	::CVBufferSetAttachment( pixelBuffer, kCVImageBufferGammaLevelKey, gammaLevel, kCVAttachmentMode_ShouldPropagate );
-	::CFRelease( gammaLevel );
+	::CVBufferSetAttachment( pixelBuffer, kCVImageBufferGammaLevelKey, mGammaLevel, kCVAttachmentMode_ShouldPropagate );
 	
 //	CVPixelBufferLockBaseAddress(pixelBuffer, nil);
-	CMTime time = CMTimeMakeWithSeconds(mCurrentTimeValue, mFormat.mTimeBase);
 //	NSDate* d = [NSDate date];
 //	double seconds = [d timeIntervalSinceDate:mStartTime];
 //	CMTime currentTime = CMTimeMakeWithSeconds(seconds,120);
-	static double seconds = 0;
-	seconds += 0.016667;
-	CMTime currentTime = CMTimeMakeWithSeconds(seconds,120);
+	CMTime currentTime = CMTimeMake(mCurrentTimeValue, mFormat.mTimeBase);
 
 	[mSinkAdapater appendPixelBuffer:pixelBuffer withPresentationTime:currentTime];
 //	CVPixelBufferUnlockBaseAddress(pixelBuffer, nil);
 	CVPixelBufferRelease( pixelBuffer );
 	mCurrentTimeValue += durationVal;
 	++mNumFrames;
+}
+
+// Returns true when \a imageSource closes the current capture interval and a frame should be recorded
+bool MovieWriter::captureTimelapseFrame( const Surface8u& imageSource, float duration )
+{
+	++mCaptureFrameCount;
+	mCaptureElapsed += duration;
+	
+	if( mFormat.mTemporalAveraging ) {
+		if( mCaptureFrameCount == 1 || ! mAccumulatorSurface || mAccumulatorSurface.getSize() != imageSource.getSize()
+				|| mAccumulatorSurface.getChannelOrder().getCode() != imageSource.getChannelOrder().getCode() ) {
+			resetTimelapseAccumulator( imageSource );
+			mCaptureFrameCount = 1;
+		}
+		
+		const size_t rowLength = imageSource.getWidth() * imageSource.getPixelInc();
+		for( int32_t y = 0; y < imageSource.getHeight(); ++y )
+			accumulatePixels( imageSource.getData( Vec2i( 0, y ) ), &mAccumulator[y * rowLength], rowLength );
+	}
+	
+	bool intervalClosed = ( mFormat.mCaptureFrames > 1 && mCaptureFrameCount >= mFormat.mCaptureFrames )
+							|| ( mFormat.mCaptureSeconds > 0 && mCaptureElapsed >= mFormat.mCaptureSeconds );
+	if( ! intervalClosed )
+		return false;
+	
+	if( mFormat.mTemporalAveraging ) {
+		const size_t rowLength = mAccumulatorSurface.getWidth() * mAccumulatorSurface.getPixelInc();
+		for( int32_t y = 0; y < mAccumulatorSurface.getHeight(); ++y )
+			resolveAccumulatedPixels( &mAccumulator[y * rowLength], mAccumulatorSurface.getData( Vec2i( 0, y ) ), rowLength, mCaptureFrameCount );
+	}
 	
-	ci::app::console() << "MovieWriter::addFrame is done..." << time.value << std::endl;
+	mCaptureFrameCount = 0;
+	mCaptureElapsed = ( mFormat.mCaptureSeconds > 0 )? fmodf( mCaptureElapsed, mFormat.mCaptureSeconds ): 0;
+	return true;
+}
+
+// Encodes a linear value in [0,1] with \a function
+static float encodeTransfer( MovieWriter::TransferFunction function, float linear, float gamma )
+{
+	switch( function ) {
+		case MovieWriter::TRANSFER_SRGB:
+			return ( linear <= 0.0031308f )? linear * 12.92f: 1.055f * powf( linear, 1 / 2.4f ) - 0.055f;
+		case MovieWriter::TRANSFER_REC709:
+			return ( linear < 0.018f )? linear * 4.5f: 1.099f * powf( linear, 0.45f ) - 0.099f;
+		case MovieWriter::TRANSFER_PQ: {
+			// SMPTE ST 2084
+			const float m1 = 2610 / 16384.0f, m2 = 2523 / 4096.0f * 128, c1 = 3424 / 4096.0f, c2 = 2413 / 4096.0f * 32, c3 = 2392 / 4096.0f * 32;
+			float y = powf( linear, m1 );
+			return powf( ( c1 + c2 * y ) / ( 1 + c3 * y ), m2 );
+		}
+		case MovieWriter::TRANSFER_HLG: {
+			// ITU-R BT.2100 OETF
+			const float a = 0.17883277f, b = 0.28466892f, c = 0.55991073f;
+			return ( linear <= 1 / 12.0f )? sqrtf( 3 * linear ): a * logf( 12 * linear - b ) + c;
+		}
+		case MovieWriter::TRANSFER_GAMMA:
+			return powf( linear, 1 / gamma );
+		default:
+			return linear;
+	}
+}
+
+void MovieWriter::buildTransferLut()
+{
+	for( int32_t i = 0; i < 256; ++i ) {
+		float encoded = encodeTransfer( mFormat.mTransferFunction, i / 255.0f, mFormat.mGamma );
+		mTransferLut[i] = static_cast<uint8_t>( constrain<float>( encoded * 255 + 0.5f, 0, 255 ) );
+	}
+}
+
+void MovieWriter::resetTimelapseAccumulator( const Surface8u& imageSource )
+{
+	if( ! mAccumulatorSurface || mAccumulatorSurface.getSize() != imageSource.getSize()
+			|| mAccumulatorSurface.getChannelOrder().getCode() != imageSource.getChannelOrder().getCode() )
+		mAccumulatorSurface = createFrameSurface( imageSource.getWidth(), imageSource.getHeight(), imageSource.hasAlpha(), imageSource.getChannelOrder() );
+	
+	mAccumulator.assign( imageSource.getWidth() * imageSource.getPixelInc() * imageSource.getHeight(), 0 );
 }
 
 extern "C" {
@@ -477,6 +643,17 @@ void MovieWriter::finish()
 	if( mFinished )
 		return;
 	
+	if( mMjpegWriter ) {
+		mFinished = true;
+		try {
+			mMjpegWriter->finish();
+		}
+		catch( MjpegWriterExc& ) {
+			throw MovieWriterExcFrameEncode();
+		}
+		return;
+	}
+	
 	[mWriterSink markAsFinished];
 	
 	NSError* error = nil;
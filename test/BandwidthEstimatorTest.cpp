@@ -0,0 +1,125 @@
+#include "AvfBandwidthEstimator.h"
+#include "Test.h"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace cinder::avf;
+
+namespace {
+
+const double MB = 1024 * 1024;
+
+bool near( double a, double b, double tolerance )
+{
+	return std::fabs( a - b ) <= tolerance * std::fabs( b );
+}
+
+//! Adds \a seconds of downloading at \a rate bytes per second, in samples of a quarter second
+void download( BandwidthEstimator *estimator, double rate, double seconds )
+{
+	for( double t = 0; t < seconds - 1e-9; t += 0.25 )
+		estimator->addSample( static_cast<uint64_t>( rate * 0.25 ), 0.25 );
+}
+
+//! Returns whether playback started after \a delay keeps \a margin seconds ahead of the playhead until everything has loaded
+bool keepsAhead( const PlayThroughEstimate &estimate, double safetyFactor, double delay, double margin )
+{
+	const double loadRate = estimate.mBandwidth * safetyFactor / estimate.mMediaBitrate;
+	for( double t = delay; t <= estimate.mTimeToLoad; t += 0.01 ) {
+		if( estimate.mBufferedSeconds + loadRate * t - ( t - delay ) < margin - 1e-6 )
+			return false;
+	}
+	// once loaded, playback must not have come closer than the margin to the end
+	return estimate.mRemainingSeconds - ( estimate.mTimeToLoad - delay ) >= margin - 1e-6;
+}
+
+void testSamples()
+{
+	BandwidthEstimator estimator;
+	AVF_CHECK( ! estimator.hasEstimate() && estimator.getBandwidth() == 0 );
+
+	// too small to time, or untimed
+	estimator.addSample( 1000, 0.001 );
+	estimator.addSample( 1 * MB, 0 );
+	AVF_CHECK( ! estimator.hasEstimate() && estimator.getBytesSampled() == 0 );
+
+	// a single sample is the estimate, whatever its duration, since the averages are corrected for starting at zero
+	estimator.addSample( 500000, 0.1 );
+	AVF_CHECK( estimator.hasEstimate() && near( estimator.getBandwidth(), 5000000, 1e-9 ) );
+	AVF_CHECK( estimator.getBytesSampled() == 500000 && near( estimator.getSecondsSampled(), 0.1, 1e-9 ) );
+
+	estimator.reset();
+	AVF_CHECK( ! estimator.hasEstimate() && estimator.getBandwidth() == 0 && estimator.getSecondsSampled() == 0 );
+}
+
+void testConvergence()
+{
+	BandwidthEstimator estimator;
+	download( &estimator, 1 * MB, 20 );
+	AVF_CHECK( near( estimator.getBandwidth(), 1 * MB, 1e-9 ) );
+
+	// a drop shows within the fast half-life, and settles after a few slow ones
+	download( &estimator, 0.2 * MB, 2 );
+	double fast = 0.2 * MB + 0.8 * MB * 0.5;
+	AVF_CHECK( near( estimator.getBandwidth(), fast, 1e-3 ) );
+	download( &estimator, 0.2 * MB, 30 );
+	AVF_CHECK( near( estimator.getBandwidth(), 0.2 * MB, 0.01 ) );
+
+	// a short burst barely moves the estimate, which follows the slow average on the way up
+	download( &estimator, 2 * MB, 1 );
+	double slow = 0.2 * MB + 0.8 * MB * std::pow( 0.5, 32.0 / 5 );
+	slow += ( 2 * MB - slow ) * ( 1 - std::pow( 0.5, 1.0 / 5 ) );
+	AVF_CHECK( near( estimator.getBandwidth(), slow, 1e-3 ) && estimator.getBandwidth() < 0.5 * MB );
+
+	// longer half-lives converge more slowly
+	BandwidthEstimator slower( BandwidthEstimator::Options().setHalfLives( 4, 10 ) );
+	download( &slower, 1 * MB, 20 );
+	download( &slower, 0.2 * MB, 2 );
+	AVF_CHECK( slower.getBandwidth() > estimator.getBandwidth() && slower.getBandwidth() > fast );
+	// the slow half-life is never shorter than the fast one
+	AVF_CHECK( BandwidthEstimator::Options().setHalfLives( 3, 1 ).getSlowHalfLife() == 3 );
+}
+
+void testPredict()
+{
+	BandwidthEstimator estimator;
+	const double safety = estimator.getOptions().getSafetyFactor(), margin = estimator.getOptions().getMinBufferSeconds();
+
+	// without an estimate only a movie that is loaded already can be predicted
+	AVF_CHECK( ! estimator.predict( 100000, 5, 60 ).mValid );
+	PlayThroughEstimate loaded = estimator.predict( 100000, 80, 60 );
+	AVF_CHECK( loaded.mValid && loaded.mStallFree && loaded.mStartDelay == 0 && loaded.mBufferedSeconds == 60 );
+
+	download( &estimator, 1 * MB, 10 );
+
+	// a network faster than the media plays through once the margin is buffered
+	PlayThroughEstimate fast = estimator.predict( 0.5 * MB, 10, 60 );
+	AVF_CHECK( fast.mValid && fast.mStallFree && fast.mStartDelay == 0 );
+	AVF_CHECK( near( fast.mTimeToLoad, 50 / ( 1 * MB * safety / ( 0.5 * MB ) ), 1e-9 ) );
+	PlayThroughEstimate empty = estimator.predict( 0.5 * MB, 0, 60 );
+	AVF_CHECK( ! empty.mStallFree && empty.mStartDelay > 0 && keepsAhead( empty, safety, empty.mStartDelay, margin ) );
+
+	// a slower one has to wait, for exactly as long as it takes never to catch up with the download
+	PlayThroughEstimate slow = estimator.predict( 2 * MB, 10, 60 );
+	AVF_CHECK( slow.mValid && ! slow.mStallFree && slow.mStartDelay > 0 );
+	AVF_CHECK( slow.mStartDelay <= slow.mTimeToLoad && slow.mTimeToLoad > 50 );
+	AVF_CHECK( keepsAhead( slow, safety, slow.mStartDelay, margin ) );
+	AVF_CHECK( ! keepsAhead( slow, safety, slow.mStartDelay - 0.1, margin ) );
+
+	// inputs are clamped to what makes sense
+	PlayThroughEstimate clamped = estimator.predict( -1, -5, -1 );
+	AVF_CHECK( clamped.mValid && clamped.mStallFree && clamped.mMediaBitrate == 0 && clamped.mRemainingSeconds == 0 && clamped.mBufferedSeconds == 0 );
+	AVF_CHECK( ! estimator.predict( 0, 5, 60 ).mValid );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testSamples();
+	testConvergence();
+	testPredict();
+	std::printf( "BandwidthEstimatorTest passed\n" );
+	return 0;
+}
@@ -0,0 +1,239 @@
+#include "AvfClipPack.h"
+#include "AvfMjpegWriter.h"
+#include "Test.h"
+
+#include <cstring>
+#include <vector>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace cinder::avf;
+
+namespace {
+
+std::string sDirectory;
+
+std::vector<uint8_t> readAll( const std::string &path )
+{
+	std::vector<uint8_t> result;
+	FILE *file = std::fopen( path.c_str(), "rb" );
+	AVF_CHECK( file );
+	uint8_t buffer[64 * 1024];
+	size_t count;
+	while( ( count = std::fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+		result.insert( result.end(), buffer, buffer + count );
+	std::fclose( file );
+	return result;
+}
+
+void writeAll( const std::string &path, const std::vector<uint8_t> &data )
+{
+	FILE *file = std::fopen( path.c_str(), "wb" );
+	AVF_CHECK( file );
+	AVF_CHECK( data.empty() || std::fwrite( &data[0], 1, data.size(), file ) == data.size() );
+	AVF_CHECK( std::fclose( file ) == 0 );
+}
+
+std::vector<uint8_t> makeMovie( int32_t width, int32_t height, int32_t numFrames, int64_t frameDuration )
+{
+	const std::string path = sDirectory + "/movie.mov";
+	{
+		MjpegWriter writer( path, width, height, 600, 0.5f, 1 );
+		std::vector<uint8_t> pixels( width * height * 3, 128 );
+		for( int32_t i = 0; i < numFrames; ++i )
+			writer.addFrame( &pixels[0], width * 3, MjpegPixelLayout(), frameDuration );
+		writer.finish();
+	}
+	std::vector<uint8_t> result = readAll( path );
+	std::remove( path.c_str() );
+	return result;
+}
+
+bool opens( const std::string &path )
+{
+	try {
+		ClipPack::create( path );
+		return true;
+	}
+	catch( ClipPackExc& ) {
+		return false;
+	}
+}
+
+void testRoundTrip()
+{
+	std::vector<uint8_t> wide = makeMovie( 64, 16, 5, 20 ), tall = makeMovie( 8, 40, 3, 25 );
+	std::vector<uint8_t> notes( 1000 );
+	for( size_t i = 0; i < notes.size(); ++i )
+		notes[i] = static_cast<uint8_t>( i * 31 );
+	const std::string tallPath = sDirectory + "/tall.mov";
+	writeAll( tallPath, tall );
+
+	// added out of order, from memory and from a file, one of them empty and one not a movie at all
+	ClipPackWriter writer;
+	writer.addData( "wide.mov", &wide[0], wide.size() );
+	writer.addData( "notes.txt", &notes[0], notes.size() );
+	writer.addFile( "tall.mov", tallPath );
+	writer.addData( "empty", NULL, 0 );
+	AVF_CHECK( writer.getNumClips() == 4 );
+	const std::string packPath = sDirectory + "/clips.pack";
+	writer.write( packPath );
+	std::remove( tallPath.c_str() );
+
+	ClipPackRef pack = ClipPack::create( packPath );
+	AVF_CHECK( pack->getNumClips() == 4 );
+	AVF_CHECK( pack->getName( 0 ) == "empty" && pack->getName( 1 ) == "notes.txt" && pack->getName( 2 ) == "tall.mov" && pack->getName( 3 ) == "wide.mov" );
+	AVF_CHECK( pack->getName( 4 ).empty() );
+
+	const char *names[] = { "empty", "notes.txt", "tall.mov", "wide.mov" };
+	const std::vector<uint8_t> *sources[] = { NULL, &notes, &tall, &wide };
+	for( size_t i = 0; i < 4; ++i ) {
+		size_t index = 99;
+		AVF_CHECK( pack->findClip( names[i], &index ) && index == i );
+		const std::vector<uint8_t> empty;
+		const std::vector<uint8_t> &source = sources[i] ? *sources[i] : empty;
+		AVF_CHECK( pack->getClipSize( i ) == source.size() );
+
+		// the clip is served in place, 64 byte aligned
+		ByteSourceRef clip = pack->getClip( names[i] );
+		AVF_CHECK( clip && clip->getSize() == source.size() );
+		if( ! source.empty() ) {
+			const uint8_t *data = clip->getData( 0, source.size() );
+			AVF_CHECK( data && reinterpret_cast<uintptr_t>( data ) % 64 == 0 );
+			AVF_CHECK( std::memcmp( data, &source[0], source.size() ) == 0 );
+		}
+
+		const std::string extracted = sDirectory + "/extracted";
+		pack->extract( i, extracted );
+		AVF_CHECK( readAll( extracted ) == source );
+		std::remove( extracted.c_str() );
+	}
+	const char *missing[] = { "", "a", "notes", "notes.txt2", "tall.mo", "zzz" };
+	for( size_t i = 0; i < sizeof( missing ) / sizeof( missing[0] ); ++i ) {
+		size_t index;
+		AVF_CHECK( ! pack->findClip( missing[i], &index ) && ! pack->getClip( missing[i] ) );
+	}
+
+	// the info stored in the index is the one read from each movie
+	ClipInfo info = pack->getInfo( 3 );
+	AVF_CHECK( info.mHasVideo && ! info.mHasAudio && info.mWidth == 64 && info.mHeight == 16 && info.mNumFrames == 5 );
+	AVF_CHECK( info.mDuration == MediaTime( 100, 600 ) && info.mFrameDuration == MediaTime( 20, 600 ) );
+	info = pack->getInfo( 2 );
+	AVF_CHECK( info.mHasVideo && info.mWidth == 8 && info.mHeight == 40 && info.mNumFrames == 3 );
+	AVF_CHECK( info.mDuration == MediaTime( 75, 600 ) && info.mFrameDuration == MediaTime( 25, 600 ) );
+	info = pack->getInfo( 1 );
+	AVF_CHECK( ! info.mHasVideo && ! info.mHasAudio && info.mNumFrames == 0 );
+	AVF_CHECK( ! pack->getInfo( 4 ).mHasVideo );
+
+	const std::string directory = sDirectory + "/all";
+	AVF_CHECK( ::mkdir( directory.c_str(), 0700 ) == 0 );
+	pack->extractAll( directory );
+	for( size_t i = 1; i < 4; ++i ) {
+		const std::string path = directory + "/" + names[i];
+		AVF_CHECK( readAll( path ) == *sources[i] );
+		std::remove( path.c_str() );
+	}
+	std::remove( ( directory + "/empty" ).c_str() );
+	AVF_CHECK( ::rmdir( directory.c_str() ) == 0 );
+
+	// a clip keeps the pack mapped after the pack itself is released
+	ByteSourceRef clip = pack->getClip( "wide.mov" );
+	pack.reset();
+	std::vector<uint8_t> read( wide.size() );
+	AVF_CHECK( clip->read( 0, &read[0], read.size() ) == read.size() && read == wide );
+	std::remove( packPath.c_str() );
+}
+
+void testDuplicateNames()
+{
+	const std::string path = sDirectory + "/duplicate.pack";
+	const uint8_t data[4] = { 1, 2, 3, 4 };
+	ClipPackWriter writer;
+	writer.addData( "a", data, 4 );
+	writer.addData( "b", data, 4 );
+	writer.addData( "a", data, 2 );
+	bool threw = false;
+	try {
+		writer.write( path );
+	}
+	catch( ClipPackExc& ) {
+		threw = true;
+	}
+	AVF_CHECK( threw && ::access( path.c_str(), F_OK ) != 0 );
+
+	// a pack built elsewhere whose second record names the first clip again
+	ClipPackWriter valid;
+	valid.addData( "a", data, 4 );
+	valid.addData( "b", data, 4 );
+	valid.write( path );
+	AVF_CHECK( opens( path ) );
+	std::vector<uint8_t> pack = readAll( path );
+	const size_t secondRecord = 32 + 64;
+	std::memset( &pack[secondRecord + 16], 0, 4 );
+	writeAll( path, pack );
+	AVF_CHECK( ! opens( path ) );
+
+	// and one whose index is out of order, "b" before "a"
+	pack[32 + 16] = 1;
+	writeAll( path, pack );
+	AVF_CHECK( ! opens( path ) );
+	std::remove( path.c_str() );
+}
+
+void testDamagedPacks()
+{
+	const std::string path = sDirectory + "/damaged.pack";
+	AVF_CHECK( ! opens( path ) );
+
+	std::vector<uint8_t> clip( 300, 7 );
+	ClipPackWriter writer;
+	writer.addData( "first", &clip[0], clip.size() );
+	writer.addData( "second", &clip[0], 100 );
+	writer.write( path );
+	const std::vector<uint8_t> pack = readAll( path );
+	AVF_CHECK( opens( path ) );
+
+	// cut inside the header, the index, the names and each clip; the last clip ends the file, so every cut loses bytes it needs
+	const size_t cuts[] = { 0, 8, 31, 32, 32 + 64, 32 + 128, 32 + 128 + 5, 32 + 128 + 11, 256, pack.size() - 100, pack.size() - 1 };
+	for( size_t i = 0; i < sizeof( cuts ) / sizeof( cuts[0] ); ++i ) {
+		writeAll( path, std::vector<uint8_t>( pack.begin(), pack.begin() + cuts[i] ) );
+		AVF_CHECK( ! opens( path ) );
+	}
+
+	// records pointing past the end: a clip offset, a clip size, a name offset and a name length
+	const size_t fields[][2] = { { 0, 8 }, { 8, 8 }, { 16, 4 }, { 20, 4 } };
+	for( size_t i = 0; i < sizeof( fields ) / sizeof( fields[0] ); ++i ) {
+		std::vector<uint8_t> damaged = pack;
+		std::memset( &damaged[32 + 64 + fields[i][0]], 0xFF, fields[i][1] );
+		writeAll( path, damaged );
+		AVF_CHECK( ! opens( path ) );
+	}
+
+	// a clip count that doesn't match the index, and a foreign file
+	std::vector<uint8_t> damaged = pack;
+	damaged[12] = 3;
+	writeAll( path, damaged );
+	AVF_CHECK( ! opens( path ) );
+	damaged = pack;
+	damaged[0] = 'X';
+	writeAll( path, damaged );
+	AVF_CHECK( ! opens( path ) );
+	std::remove( path.c_str() );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	char directory[] = "/tmp/ClipPackTestXXXXXX";
+	AVF_CHECK( ::mkdtemp( directory ) );
+	sDirectory = directory;
+	testRoundTrip();
+	testDuplicateNames();
+	testDamagedPacks();
+	::rmdir( directory );
+	std::printf( "ClipPackTest passed\n" );
+	return 0;
+}
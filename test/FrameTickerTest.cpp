@@ -0,0 +1,156 @@
+#include "AvfFrameTicker.h"
+#include "Test.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace cinder::avf;
+
+namespace {
+
+struct Counter {
+	Counter() : mTicker( NULL ), mNumCalls( 0 ), mStayActive( true ), mRemoveSelf( false ), mRemoveOther( NULL ), mAddOther( NULL ) {}
+
+	FrameTicker				*mTicker;
+	std::vector<double>		mTimes;
+	int						mNumCalls;
+	bool					mStayActive, mRemoveSelf;
+	Counter					*mRemoveOther, *mAddOther;
+};
+
+bool countTick( void *target, double time )
+{
+	Counter *counter = static_cast<Counter*>( target );
+	++counter->mNumCalls;
+	counter->mTimes.push_back( time );
+	if( counter->mRemoveSelf )
+		counter->mTicker->remove( counter );
+	if( counter->mRemoveOther )
+		counter->mTicker->remove( counter->mRemoveOther );
+	if( counter->mAddOther )
+		counter->mTicker->add( counter->mAddOther, countTick );
+	return counter->mStayActive;
+}
+
+bool near( double a, double b )
+{
+	return std::fabs( a - b ) < 1e-9;
+}
+
+void testCadence()
+{
+	ManualClock *clock = new ManualClock( 1.0 / 60.0 );
+	FrameTicker ticker( ( std::unique_ptr<FrameTicker::Clock>( clock ) ) );
+	Counter a, b;
+	ticker.add( &a, countTick );
+	ticker.add( &b, countTick );
+
+	// one second at 60 Hz, counting the tick at zero
+	AVF_CHECK( clock->advance( 1.0 ) == 61 );
+	AVF_CHECK( a.mNumCalls == 61 && b.mNumCalls == 61 && ticker.getNumTicks() == 61 );
+	for( size_t i = 0; i < a.mTimes.size(); ++i )
+		AVF_CHECK( near( a.mTimes[i], i / 60.0 ) && a.mTimes[i] == b.mTimes[i] );
+	AVF_CHECK( near( ticker.getLastTickTime(), 1.0 ) );
+
+	// steps shorter than the interval tick every other step, and a long step delivers every tick it passes
+	for( int i = 0; i < 10; ++i )
+		AVF_CHECK( clock->advance( 1.0 / 120.0 ) == static_cast<size_t>( i % 2 ) );
+	AVF_CHECK( a.mNumCalls == 66 );
+	AVF_CHECK( clock->advance( 0.5 ) == 30 && a.mNumCalls == 96 );
+	AVF_CHECK( clock->advance( 0 ) == 0 && clock->advance( -1 ) == 0 );
+
+	// a rate the interval doesn't divide evenly stays on its multiples
+	ManualClock *ntsc = new ManualClock( 1001.0 / 30000.0 );
+	// the old clock goes with the switch, and the new one starts since targets are active
+	ticker.setClock( std::unique_ptr<FrameTicker::Clock>( ntsc ) );
+	AVF_CHECK( ntsc->isRunning() );
+	a.mTimes.clear();
+	AVF_CHECK( ntsc->advance( 10.01 ) == 301 );
+	AVF_CHECK( near( a.mTimes.back(), 300 * 1001.0 / 30000.0 ) );
+}
+
+void testIdle()
+{
+	ManualClock *clock = new ManualClock( 0.1 );
+	FrameTicker ticker( ( std::unique_ptr<FrameTicker::Clock>( clock ) ) );
+	AVF_CHECK( ticker.hasClock() && ! clock->isRunning() );
+
+	// an idle target keeps its registration without running the clock
+	Counter a, b;
+	ticker.add( &a, countTick, false );
+	AVF_CHECK( ticker.contains( &a ) && ! ticker.isActive( &a ) && ! clock->isRunning() );
+	AVF_CHECK( clock->advance( 1.0 ) == 0 && a.mNumCalls == 0 );
+
+	ticker.setActive( &a, true );
+	AVF_CHECK( clock->isRunning() && ticker.getNumActiveTargets() == 1 );
+	// the ticks passed while stopped aren't delivered late; the one due at the current time still is
+	AVF_CHECK( clock->advance( 0.1 ) == 2 && a.mNumCalls == 2 && near( a.mTimes[0], 1.0 ) && near( a.mTimes[1], 1.1 ) );
+
+	ticker.add( &b, countTick );
+	ticker.setActive( &a, false );
+	AVF_CHECK( clock->isRunning() );
+	AVF_CHECK( clock->advance( 0.2 ) == 2 && a.mNumCalls == 2 && b.mNumCalls == 2 );
+	ticker.setActive( &b, false );
+	AVF_CHECK( ! clock->isRunning() && ticker.getNumActiveTargets() == 0 && ticker.getNumTargets() == 2 );
+	AVF_CHECK( clock->advance( 1.0 ) == 0 );
+
+	// a target that reports itself done goes idle, which stops the clock before the next tick
+	ticker.setActive( &a, true );
+	a.mStayActive = false;
+	AVF_CHECK( clock->advance( 1.0 ) == 1 && a.mNumCalls == 3 );
+	AVF_CHECK( ! ticker.isActive( &a ) && ! clock->isRunning() );
+
+	// adding an active target again restarts it, and removing the last one stops the clock
+	a.mStayActive = true;
+	ticker.add( &a, countTick );
+	AVF_CHECK( clock->isRunning() );
+	ticker.remove( &a );
+	AVF_CHECK( ! clock->isRunning() && ! ticker.contains( &a ) && ticker.getNumTargets() == 1 );
+}
+
+void testRemoveDuringTick()
+{
+	ManualClock *clock = new ManualClock( 1.0 );
+	FrameTicker ticker( ( std::unique_ptr<FrameTicker::Clock>( clock ) ) );
+	Counter first, self, last;
+	first.mTicker = self.mTicker = last.mTicker = &ticker;
+	ticker.add( &first, countTick );
+	ticker.add( &self, countTick );
+	ticker.add( &last, countTick );
+
+	// a target removing itself still lets the targets after it run in the same tick
+	self.mRemoveSelf = true;
+	AVF_CHECK( clock->advance( 0 ) == 1 );
+	AVF_CHECK( first.mNumCalls == 1 && self.mNumCalls == 1 && last.mNumCalls == 1 );
+	AVF_CHECK( ! ticker.contains( &self ) && ticker.getNumTargets() == 2 && ticker.getNumActiveTargets() == 2 );
+	AVF_CHECK( clock->advance( 1.0 ) == 1 && self.mNumCalls == 1 && last.mNumCalls == 2 );
+
+	// a target removed by an earlier one isn't called again, even in the tick that removed it
+	first.mRemoveOther = &last;
+	AVF_CHECK( clock->advance( 1.0 ) == 1 && last.mNumCalls == 2 && ticker.getNumTargets() == 1 );
+	first.mRemoveOther = NULL;
+
+	// targets added from within a tick first run on the next one
+	first.mAddOther = &self;
+	self.mRemoveSelf = false;
+	AVF_CHECK( clock->advance( 1.0 ) == 1 && self.mNumCalls == 1 );
+	first.mAddOther = NULL;
+	AVF_CHECK( clock->advance( 1.0 ) == 1 && self.mNumCalls == 2 && first.mNumCalls == 5 );
+
+	// the last active target removing itself from its own tick stops the clock
+	ticker.remove( &first );
+	self.mRemoveSelf = true;
+	AVF_CHECK( clock->advance( 5.0 ) == 1 && self.mNumCalls == 3 );
+	AVF_CHECK( ticker.getNumTargets() == 0 && ! clock->isRunning() );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testCadence();
+	testIdle();
+	testRemoveDuringTick();
+	std::printf( "FrameTickerTest passed\n" );
+	return 0;
+}
@@ -0,0 +1,249 @@
+#include "AvfHls.h"
+#include "HttpTestServer.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cinder::avf;
+
+namespace {
+
+const char *sVariants[] = { "low", "mid", "high" };
+const size_t sSegmentSizes[] = { 20000, 100000, 400000 };
+
+//! The content of a segment, different for every path
+std::string makeBody( const std::string &path, size_t size )
+{
+	unsigned seed = 0;
+	for( size_t i = 0; i < path.size(); ++i )
+		seed = seed * 31 + static_cast<unsigned char>( path[i] );
+	std::string result( size, '\0' );
+	for( size_t i = 0; i < size; ++i )
+		result[i] = static_cast<char>( i * 13 + ( i >> 7 ) + seed );
+	return result;
+}
+
+std::string makeLivePlaylist( uint64_t firstSequence )
+{
+	std::ostringstream text;
+	text << "#EXTM3U\n#EXT-X-TARGETDURATION:1\n#EXT-X-MEDIA-SEQUENCE:" << firstSequence << "\n";
+	for( uint64_t i = firstSequence; i < firstSequence + 6; ++i )
+		text << "#EXTINF:1.0,\n/live/seg" << i << ".ts\n";
+	return text.str();
+}
+
+//! Serves a master playlist of three variants of ten 4 second segments, relative to the playlists, and a live playlist
+void setUpServer( HttpTestServer *server )
+{
+	server->setResource( "/tv/master.m3u8", "#EXTM3U\n"
+		"#EXT-X-STREAM-INF:BANDWIDTH=400000,RESOLUTION=320x180,CODECS=\"avc1.42c00d,mp4a.40.2\"\nlow/index.m3u8\n"
+		"#EXT-X-STREAM-INF:BANDWIDTH=2000000,AVERAGE-BANDWIDTH=1800000,RESOLUTION=1280x720\nmid/index.m3u8\n"
+		"#EXT-X-STREAM-INF:BANDWIDTH=8000000,RESOLUTION=1920x1080,FRAME-RATE=29.97\nhigh/index.m3u8\n" );
+	for( size_t v = 0; v < 3; ++v ) {
+		std::string directory = std::string( "/tv/" ) + sVariants[v] + "/";
+		std::ostringstream playlist;
+		playlist << "#EXTM3U\n#EXT-X-TARGETDURATION:4\n#EXT-X-MEDIA-SEQUENCE:100\n#EXT-X-MAP:URI=\"init.mp4\"\n";
+		server->setResource( directory + "init.mp4", makeBody( directory + "init.mp4", 1000 ) );
+		for( int i = 0; i < 10; ++i ) {
+			std::ostringstream name;
+			name << "seg" << i << ".m4s";
+			playlist << "#EXTINF:4.0,\n" << name.str() << "\n";
+			server->setResource( directory + name.str(), makeBody( directory + name.str(), sSegmentSizes[v] ) );
+		}
+		playlist << "#EXT-X-ENDLIST\n";
+		server->setResource( directory + "index.m3u8", playlist.str() );
+	}
+
+	server->setResource( "/live/index.m3u8", makeLivePlaylist( 0 ) );
+	for( int i = 0; i < 20; ++i ) {
+		std::ostringstream path;
+		path << "/live/seg" << i << ".ts";
+		server->setResource( path.str(), makeBody( path.str(), 30000 ) );
+	}
+
+	std::ostringstream single;
+	single << "#EXTM3U\n#EXT-X-TARGETDURATION:2\n";
+	for( int i = 0; i < 3; ++i )
+		single << "#EXTINF:2.0,\n#EXT-X-BYTERANGE:50000\nall.ts\n";
+	single << "#EXT-X-ENDLIST\n";
+	server->setResource( "/single/index.m3u8", single.str() );
+	server->setResource( "/single/all.ts", makeBody( "/single/all.ts", 150000 ) );
+}
+
+bool waitUntil( const std::function<bool()> &condition )
+{
+	for( int i = 0; i < 200 && ! condition(); ++i )
+		std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+	return condition();
+}
+
+void testUrls()
+{
+	AVF_CHECK( resolveHlsUrl( "http://h:1/a/b/c.m3u8?x=1", "d.ts" ) == "http://h:1/a/b/d.ts" );
+	AVF_CHECK( resolveHlsUrl( "http://h/a/b/c.m3u8", "../d.ts" ) == "http://h/a/d.ts" );
+	AVF_CHECK( resolveHlsUrl( "http://h/a/b/c.m3u8", "/x/./y.ts?q" ) == "http://h/x/y.ts?q" );
+	AVF_CHECK( resolveHlsUrl( "http://h/a/c.m3u8", "//cdn/z.ts" ) == "http://cdn/z.ts" );
+	AVF_CHECK( resolveHlsUrl( "http://h", "z.ts" ) == "http://h/z.ts" );
+	AVF_CHECK( resolveHlsUrl( "http://h/a/c.m3u8", "https://o/p.ts" ) == "https://o/p.ts" );
+}
+
+void testParsing()
+{
+	HlsPlaylist playlist;
+	AVF_CHECK( ! parseHlsPlaylist( "hello", "http://h/", &playlist ) );
+
+	AVF_CHECK( parseHlsPlaylist( "\xEF\xBB\xBF#EXTM3U\r\n#EXT-X-UNKNOWN:1\r\n#EXT-X-STREAM-INF:CODECS=\"a,b\",BANDWIDTH=5,RESOLUTION=4x3\r\nv.m3u8\r\n",
+		"http://h/m/x.m3u8", &playlist ) );
+	AVF_CHECK( playlist.isMaster() && playlist.mVariants.size() == 1 );
+	const HlsVariant &variant = playlist.mVariants[0];
+	AVF_CHECK( variant.mCodecs == "a,b" && variant.mBandwidth == 5 && variant.mWidth == 4 && variant.mHeight == 3 );
+	AVF_CHECK( variant.mUrl == "http://h/m/v.m3u8" );
+
+	AVF_CHECK( parseHlsPlaylist( "#EXTM3U\n#EXT-X-MEDIA-SEQUENCE:7\n#EXT-X-MAP:URI=\"i.mp4\",BYTERANGE=\"10@0\"\n#EXTINF:2.5,title\na.ts\n"
+		"#EXT-X-BYTERANGE:100@50\n#EXTINF:3,\nb.ts\n#EXT-X-BYTERANGE:20\n#EXT-X-DISCONTINUITY\n#EXT-X-KEY:METHOD=AES-128,URI=\"k\"\n#EXTINF:1,\nb.ts\n#EXT-X-ENDLIST\n",
+		"http://h/p.m3u8", &playlist ) );
+	AVF_CHECK( ! playlist.isMaster() && playlist.mEndList && playlist.mSegments.size() == 3 );
+	AVF_CHECK( playlist.mInitUrl == "http://h/i.mp4" && playlist.mInitByteRange.mOffset == 0 && playlist.mInitByteRange.mLength == 10 );
+	AVF_CHECK( playlist.mSegments[0].mSequence == 7 && playlist.mSegments[2].mSequence == 9 && playlist.mSegments[1].mUrl == "http://h/b.ts" );
+	AVF_CHECK( playlist.mSegments[1].mByteRange.mOffset == 50 && playlist.mSegments[1].mByteRange.mLength == 100 );
+	// a byte range without an offset follows the previous one
+	AVF_CHECK( playlist.mSegments[2].mByteRange.mOffset == 150 && playlist.mSegments[2].mByteRange.mLength == 20 );
+	AVF_CHECK( playlist.mSegments[2].mDiscontinuity && playlist.mSegments[2].mEncrypted && ! playlist.mSegments[1].mEncrypted );
+	AVF_CHECK( playlist.getDuration() == 6.5 );
+	AVF_CHECK( playlist.findSegment( 0 ) == 0 && playlist.findSegment( 2.5 ) == 1 && playlist.findSegment( 100 ) == 2 );
+
+	std::vector<HlsVariant> variants( 3 );
+	variants[0].mBandwidth = 800000;
+	variants[1].mBandwidth = 400000;
+	variants[2].mBandwidth = 8000000;
+	variants[2].mAverageBandwidth = 1600000;
+	AVF_CHECK( selectHlsVariant( variants, 0 ) == 1 && selectHlsVariant( variants, 100000 ) == 0 );
+	// the average bitrate decides where it is given
+	AVF_CHECK( selectHlsVariant( variants, 200000 ) == 2 );
+	AVF_CHECK( selectHlsVariant( std::vector<HlsVariant>(), 1 ) == 0 );
+}
+
+//! A VOD stream climbs to the top variant on a fast network, and keeps the segments after the position cached
+void testVod( HttpTestServer &server, const HttpCacheRef &cache )
+{
+	HlsPrefetcherRef prefetcher = HlsPrefetcher::create( server.getUrl( "/tv/master.m3u8" ), cache );
+	AVF_CHECK( prefetcher->waitForSegments( 20 ) );
+	AVF_CHECK( prefetcher->getVariants().size() == 3 && prefetcher->getSequence() == 100 && prefetcher->getNumSegmentsCached() == 3 );
+	AVF_CHECK( prefetcher->getVariants()[1].mUrl == server.getUrl( "/tv/mid/index.m3u8" ) );
+
+	AVF_CHECK( waitUntil( [&] { return prefetcher->getVariantIndex() == 2; } ) );
+	AVF_CHECK( prefetcher->waitForSegments( 20 ) && prefetcher->getBandwidthEstimator().hasEstimate() );
+	AVF_CHECK( prefetcher->getPlaylist().mSegments[0].mUrl == server.getUrl( "/tv/high/seg0.m4s" ) );
+	AVF_CHECK( cache->isCached( server.getUrl( "/tv/high/init.mp4" ) ) );
+
+	// 21 seconds in is the sixth segment; the window of three follows it and goes no further
+	prefetcher->setPosition( 21 );
+	AVF_CHECK( prefetcher->waitForSegments( 20 ) && prefetcher->getSequence() == 105 );
+	AVF_CHECK( cache->isCached( server.getUrl( "/tv/high/seg7.m4s" ) ) && ! cache->isCached( server.getUrl( "/tv/high/seg8.m4s" ) ) );
+	AVF_CHECK( server.getNumRequests( "/tv/high/seg8.m4s" ) == 0 && server.getNumRequests( "/tv/high/seg9.m4s" ) == 0 );
+
+	prefetcher->lockVariant( 0 );
+	AVF_CHECK( prefetcher->waitForSegments( 20 ) && prefetcher->getVariantIndex() == 0 );
+	AVF_CHECK( cache->isCached( server.getUrl( "/tv/low/seg5.m4s" ) ) );
+	// going back finds the segments on disk, and each was fetched with a single request
+	prefetcher->lockVariant( 2 );
+	AVF_CHECK( prefetcher->waitForSegments( 20 ) && prefetcher->getVariantIndex() == 2 );
+	AVF_CHECK( server.getNumRequests( "/tv/high/seg6.m4s" ) == 1 );
+
+	// cached segments play with the server gone
+	server.setDown( true );
+	const std::string path = "/tv/high/seg6.m4s";
+	HttpStreamRef stream = prefetcher->openSegment( prefetcher->getPlaylist().mSegments[6] );
+	std::string expected = makeBody( path, sSegmentSizes[2] );
+	std::vector<uint8_t> data( stream->getSize() );
+	AVF_CHECK( data.size() == expected.size() && stream->read( 0, &data[0], data.size() ) == data.size() );
+	AVF_CHECK( std::equal( data.begin(), data.end(), expected.begin(), []( uint8_t a, char b ) { return a == static_cast<uint8_t>( b ); } ) );
+	server.setDown( false );
+}
+
+//! A live stream starts three segments from the end, and follows the playlist as it moves on
+void testLive( HttpTestServer &server, const HttpCacheRef &cache )
+{
+	HlsPrefetcherRef prefetcher = HlsPrefetcher::create( server.getUrl( "/live/index.m3u8" ), cache, HlsPrefetcher::Options().setSegmentsAhead( 2 ) );
+	AVF_CHECK( prefetcher->waitForSegments( 20 ) );
+	AVF_CHECK( prefetcher->getVariants().empty() && prefetcher->getSequence() == 3 && ! prefetcher->getPlaylist().mEndList );
+	AVF_CHECK( cache->isCached( server.getUrl( "/live/seg4.ts" ) ) && ! cache->isCached( server.getUrl( "/live/seg5.ts" ) ) );
+
+	server.setResource( "/live/index.m3u8", makeLivePlaylist( 4 ) );
+	prefetcher->setSequence( 8 );
+	AVF_CHECK( waitUntil( [&] { return cache->isCached( server.getUrl( "/live/seg9.ts" ) ); } ) );
+	AVF_CHECK( cache->isCached( server.getUrl( "/live/seg8.ts" ) ) && prefetcher->getPlaylist().mMediaSequence == 4 );
+}
+
+//! Segments that are byte ranges of one resource are fetched as such
+void testByteRanges( HttpTestServer &server, const HttpCacheRef &cache )
+{
+	HlsPrefetcherRef prefetcher = HlsPrefetcher::create( server.getUrl( "/single/index.m3u8" ), cache, HlsPrefetcher::Options().setSegmentsAhead( 2 ) );
+	AVF_CHECK( prefetcher->waitForSegments( 20 ) );
+	const std::string url = server.getUrl( "/single/all.ts" );
+	AVF_CHECK( cache->isCached( url, ByteRange( 0, 100000 ) ) && ! cache->isCached( url ) );
+	AVF_CHECK( cache->getCachedRanges( url ).getTotalBytes() == 100000 );
+}
+
+void testFailures( const HttpTestServer &server, const HttpCacheRef &cache )
+{
+	HlsPrefetcherRef prefetcher = HlsPrefetcher::create( server.getUrl( "/missing.m3u8" ), cache );
+	AVF_CHECK( ! prefetcher->waitForSegments( 5 ) && prefetcher->hasFailed() );
+
+	bool threw = false;
+	try {
+		HlsPrefetcher::create( "ftp://host/index.m3u8", cache );
+	}
+	catch( HlsExc& ) {
+		threw = true;
+	}
+	AVF_CHECK( threw );
+
+	// every prefetcher has a thread, so only so many may exist at once
+	const size_t maxPrefetchers = HlsPrefetcher::getMaxPrefetchers();
+	HlsPrefetcher::setMaxPrefetchers( 1 );
+	threw = false;
+	try {
+		HlsPrefetcher::create( server.getUrl( "/missing.m3u8" ), cache );
+	}
+	catch( HlsExc& ) {
+		threw = true;
+	}
+	AVF_CHECK( threw );
+	prefetcher.reset();
+	prefetcher = HlsPrefetcher::create( server.getUrl( "/missing.m3u8" ), cache );
+	HlsPrefetcher::setMaxPrefetchers( maxPrefetchers );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testUrls();
+	testParsing();
+
+	HttpTestServer server;
+	setUpServer( &server );
+	char directory[] = "/tmp/AvfHlsTestXXXXXX";
+	AVF_CHECK( ::mkdtemp( directory ) != NULL );
+	{
+		HttpCacheRef cache = HttpCache::create( directory );
+		testVod( server, cache );
+		testLive( server, cache );
+		testByteRanges( server, cache );
+		testFailures( server, cache );
+		cache->clear();
+	}
+	std::string command = std::string( "rm -rf '" ) + directory + "'";
+	AVF_CHECK( std::system( command.c_str() ) == 0 );
+	std::printf( "HlsTest passed\n" );
+	return 0;
+}
@@ -0,0 +1,347 @@
+#include "AvfHttpCache.h"
+#include "AvfHttpClient.h"
+#include "HttpTestServer.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cinder::avf;
+
+namespace {
+
+const uint64_t MB = 1024 * 1024;
+
+std::string makeBody( size_t size, int seed )
+{
+	std::string result( size, '\0' );
+	for( size_t i = 0; i < size; ++i )
+		result[i] = static_cast<char>( i * 7 + ( i >> 9 ) + seed );
+	return result;
+}
+
+bool hasContent( const std::string &body, uint64_t offset, const std::vector<uint8_t> &data, size_t size )
+{
+	return offset + size <= body.size() && std::equal( data.begin(), data.begin() + size, body.begin() + offset,
+		[]( uint8_t a, char b ) { return a == static_cast<uint8_t>( b ); } );
+}
+
+//! Fetches \a range of \a url into \a data, returning whether fetchHttpRange() succeeded
+bool fetchInto( const std::string &url, const ByteRange &range, HttpResponse *response, std::vector<uint8_t> *data, size_t cancelAfter = 0 )
+{
+	data->clear();
+	return fetchHttpRange( url, range, response, [=]( const uint8_t *bytes, size_t size ) {
+		data->insert( data->end(), bytes, bytes + size );
+		return cancelAfter == 0 || data->size() < cancelAfter;
+	} );
+}
+
+//! Reads the whole of \a stream in pieces of \a pieceSize, returning whether it matched \a body
+bool readAll( const HttpStreamRef &stream, const std::string &body, size_t pieceSize )
+{
+	std::vector<uint8_t> data( pieceSize );
+	uint64_t offset = 0;
+	size_t count;
+	while( ( count = stream->read( offset, &data[0], data.size() ) ) > 0 ) {
+		if( ! hasContent( body, offset, data, count ) )
+			return false;
+		offset += count;
+	}
+	return offset == body.size();
+}
+
+std::string makeDirectory()
+{
+	char path[] = "/tmp/AvfHttpCacheTestXXXXXX";
+	AVF_CHECK( ::mkdtemp( path ) != NULL );
+	return path;
+}
+
+void removeDirectory( const std::string &path )
+{
+	std::string command = "rm -rf '" + path + "'";
+	AVF_CHECK( std::system( command.c_str() ) == 0 );
+}
+
+void testUrls()
+{
+	HttpUrl url;
+	AVF_CHECK( parseHttpUrl( "http://Host:8080/a/b.mp4?x#f", &url ) );
+	AVF_CHECK( url.mHost == "Host" && url.mPort == 8080 && url.mPath == "/a/b.mp4?x" );
+	AVF_CHECK( parseHttpUrl( "http://[::1]", &url ) && url.mHost == "::1" && url.mPort == 80 && url.mPath == "/" );
+	AVF_CHECK( ! parseHttpUrl( "https://host/", &url ) );
+	AVF_CHECK( ! parseHttpUrl( "http://host:0/", &url ) );
+}
+
+//! Ranges, servers that ignore them, redirects and chunked bodies
+void testClient()
+{
+	HttpTestServer server;
+	const std::string body = makeBody( 300000, 1 );
+	server.setResource( "/clip.mp4", body, "\"a\"" );
+	server.setRedirect( "/moved", "/clip.mp4" );
+	const std::string url = server.getUrl( "/clip.mp4" );
+	HttpResponse response;
+	std::vector<uint8_t> data;
+
+	AVF_CHECK( fetchInto( url, ByteRange( 1000, 5000 ), &response, &data ) );
+	AVF_CHECK( response.mStatus == 206 && response.mOffset == 1000 && response.mTotalSizeKnown && response.mTotalSize == body.size() );
+	AVF_CHECK( response.mETag == "\"a\"" && data.size() == 5000 && hasContent( body, 1000, data, data.size() ) );
+
+	// a range reaching past the end is cut short by the server
+	AVF_CHECK( fetchInto( url, ByteRange( body.size() - 10, 100 ), &response, &data ) );
+	AVF_CHECK( data.size() == 10 && hasContent( body, body.size() - 10, data, 10 ) );
+
+	AVF_CHECK( fetchInto( server.getUrl( "/moved" ), ByteRange( 5, 5 ), &response, &data ) );
+	AVF_CHECK( response.mUrl == url && data.size() == 5 && hasContent( body, 5, data, 5 ) );
+
+	AVF_CHECK( ! fetchInto( server.getUrl( "/missing" ), ByteRange(), &response, &data ) && response.mStatus == 404 );
+
+	// the part before the range is skipped when the server sends everything
+	server.setIgnoreRange( true );
+	AVF_CHECK( fetchInto( url, ByteRange( 100000, 300 ), &response, &data ) );
+	AVF_CHECK( response.mStatus == 200 && response.mOffset == 100000 && data.size() == 300 && hasContent( body, 100000, data, 300 ) );
+
+	server.setChunked( true );
+	AVF_CHECK( fetchInto( url, ByteRange(), &response, &data ) );
+	AVF_CHECK( data.size() == body.size() && hasContent( body, 0, data, data.size() ) );
+	AVF_CHECK( response.mTotalSizeKnown && response.mTotalSize == body.size() );
+	AVF_CHECK( fetchInto( url, ByteRange( 50, 20000 ), &response, &data ) );
+	AVF_CHECK( data.size() == 20000 && hasContent( body, 50, data, data.size() ) );
+	AVF_CHECK( ! fetchInto( url, ByteRange(), &response, &data, 3000 ) );
+	server.setIgnoreRange( false );
+	AVF_CHECK( fetchInto( url, ByteRange( 7, 70000 ), &response, &data ) );
+	AVF_CHECK( response.mStatus == 206 && data.size() == 70000 && hasContent( body, 7, data, data.size() ) );
+}
+
+//! A resource played once plays again from disk, even with the server gone
+void testReplay()
+{
+	HttpTestServer server;
+	const std::string body = makeBody( 3 * MB + 17, 2 );
+	server.setResource( "/clip.mp4", body );
+	const std::string url = server.getUrl( "/clip.mp4" );
+	const std::string root = makeDirectory(), directory = root + "/a/b";
+
+	{
+		HttpCacheRef cache = HttpCache::create( directory );
+		HttpStreamRef stream = cache->open( url, 1 * MB );
+		AVF_CHECK( stream->getSize() == body.size() && stream->getExtensionHint() == "mp4" );
+		AVF_CHECK( readAll( stream, body, 100000 ) );
+		AVF_CHECK( stream->getCachedRanges().contains( ByteRange( 0, body.size() ) ) );
+		AVF_CHECK( stream->getBytesFetched() == body.size() && stream->getBandwidthEstimator()->hasEstimate() );
+	}
+
+	// a new cache in the same directory picks up the index
+	uint64_t served = server.getBytesServed();
+	{
+		HttpCacheRef cache = HttpCache::create( directory + "/" );
+		AVF_CHECK( cache->getCachedBytes() == body.size() && cache->isCached( url ) );
+		HttpStreamRef stream = cache->open( url );
+		AVF_CHECK( readAll( stream, body, 777777 ) && stream->getBytesFetched() == 0 );
+	}
+	// only the probe's single byte went over the network
+	AVF_CHECK( server.getBytesServed() - served == 1 );
+
+	server.setDown( true );
+	{
+		HttpCacheRef cache = HttpCache::create( directory );
+		HttpStreamRef stream = cache->open( url );
+		AVF_CHECK( readAll( stream, body, 1 * MB ) );
+
+		bool threw = false;
+		try {
+			cache->open( server.getUrl( "/never-played.mp4" ) );
+		}
+		catch( HttpCacheExc& ) {
+			threw = true;
+		}
+		AVF_CHECK( threw );
+	}
+	removeDirectory( root );
+}
+
+//! Returns whether \a stream has \a range on disk within a few seconds, prefetching in the background
+bool waitForCached( const HttpStreamRef &stream, const ByteRange &range )
+{
+	for( int i = 0; i < 500; ++i ) {
+		if( stream->getCachedRanges().contains( range ) )
+			return true;
+		std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+	}
+	return false;
+}
+
+//! Prefetch tasks on the shared WorkerPool keep ahead of the read position, follow it, and stop with the stream
+void testPrefetch()
+{
+	HttpTestServer server;
+	const std::string body = makeBody( 6 * MB, 4 );
+	server.setResource( "/clip.mp4", body );
+	const std::string url = server.getUrl( "/clip.mp4" );
+	const std::string directory = makeDirectory();
+	HttpCacheRef cache = HttpCache::create( directory );
+	std::vector<uint8_t> data( 1000 );
+
+	HttpStreamRef stream = cache->open( url, 3 * MB );
+	AVF_CHECK( stream->read( 0, &data[0], data.size() ) == data.size() && hasContent( body, 0, data, data.size() ) );
+	AVF_CHECK( waitForCached( stream, ByteRange( 0, 3 * MB ) ) );
+	AVF_CHECK( stream->read( 4 * MB, &data[0], data.size() ) == data.size() && hasContent( body, 4 * MB, data, data.size() ) );
+	AVF_CHECK( waitForCached( stream, ByteRange( 4 * MB, 2 * MB ) ) );
+
+	// a stream that reads ahead nothing fetches only what is read, until asked to
+	server.setResource( "/other.mp4", body );
+	HttpStreamRef other = cache->open( server.getUrl( "/other.mp4" ), 0 );
+	AVF_CHECK( other->read( 0, &data[0], data.size() ) == data.size() );
+	std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+	AVF_CHECK( other->getBytesFetched() < 1 * MB );
+	other->setPrefetchBytes( 1 * MB );
+	AVF_CHECK( waitForCached( other, ByteRange( 0, 1 * MB ) ) );
+
+	// a stream can go away while its prefetch is under way
+	server.setResource( "/third.mp4", body );
+	HttpStreamRef third = cache->open( server.getUrl( "/third.mp4" ), 6 * MB );
+	AVF_CHECK( third->read( 0, &data[0], data.size() ) == data.size() );
+	third.reset();
+	stream.reset();
+	other.reset();
+	cache->clear();
+	removeDirectory( directory );
+}
+
+//! Seeks fetch only what they need, and a new version on the server replaces the cached one
+void testRevalidation()
+{
+	HttpTestServer server;
+	const std::string first = makeBody( 3 * MB, 3 ), second = makeBody( 3 * MB, 4 );
+	server.setResource( "/clip.mp4", first, "\"v1\"" );
+	const std::string url = server.getUrl( "/clip.mp4" );
+	const std::string directory = makeDirectory();
+	HttpCacheRef cache = HttpCache::create( directory );
+	std::vector<uint8_t> data( 5000 );
+
+	HttpStreamRef stream = cache->open( url, 0 );
+	AVF_CHECK( stream->read( 2 * MB, &data[0], data.size() ) == data.size() && hasContent( first, 2 * MB, data, data.size() ) );
+	AVF_CHECK( stream->read( 3, &data[0], 10 ) == 10 && hasContent( first, 3, data, 10 ) );
+	AVF_CHECK( stream->getCachedRanges().getRanges().size() == 2 && stream->getCachedRanges().getTotalBytes() < 1 * MB );
+
+	// an unchanged resource keeps what was cached
+	HttpStreamRef again = cache->open( url, 0 );
+	AVF_CHECK( again->read( 2 * MB, &data[0], data.size() ) == data.size() && again->getBytesFetched() == 0 );
+	again.reset();
+
+	// while a stream still reads the old version, the new one is refused and the old one stays readable
+	server.setResource( "/clip.mp4", second, "\"v2\"" );
+	bool threw = false;
+	try {
+		cache->open( url, 0 );
+	}
+	catch( HttpCacheExc& ) {
+		threw = true;
+	}
+	AVF_CHECK( threw );
+	AVF_CHECK( stream->read( 2 * MB, &data[0], data.size() ) == data.size() && hasContent( first, 2 * MB, data, data.size() ) );
+	stream.reset();
+
+	stream = cache->open( url, 0 );
+	AVF_CHECK( stream->getCachedRanges().empty() && cache->getCachedBytes() == 0 );
+	AVF_CHECK( stream->read( 2 * MB, &data[0], data.size() ) == data.size() && hasContent( second, 2 * MB, data, data.size() ) );
+	stream.reset();
+	cache->clear();
+	removeDirectory( directory );
+}
+
+//! Fetching into the cache learns the size from the data, without a probe, and skips what is on disk
+void testFetch()
+{
+	HttpTestServer server;
+	const std::string body = makeBody( 1 * MB + 5, 5 );
+	server.setResource( "/segment.ts", body );
+	server.setResource( "/other.ts", body );
+	const std::string url = server.getUrl( "/segment.ts" );
+	const std::string directory = makeDirectory();
+	HttpCacheRef cache = HttpCache::create( directory );
+	BandwidthEstimator bandwidth;
+	const auto keepGoing = [] { return true; };
+
+	AVF_CHECK( cache->fetch( url, ByteRange(), keepGoing, &bandwidth ) );
+	AVF_CHECK( server.getNumRequests( "/segment.ts" ) == 1 && cache->isCached( url ) && bandwidth.hasEstimate() );
+	AVF_CHECK( cache->fetch( url, ByteRange( 100, 1000 ), keepGoing ) && server.getNumRequests( "/segment.ts" ) == 1 );
+	HttpStreamRef stream = cache->open( url );
+	AVF_CHECK( readAll( stream, body, 65536 ) && stream->getBytesFetched() == 0 );
+	stream.reset();
+
+	// chunks of the whole resource don't tell its size, which a range answer does
+	server.setIgnoreRange( true );
+	server.setChunked( true );
+	const std::string other = server.getUrl( "/other.ts" );
+	AVF_CHECK( ! cache->fetch( other, ByteRange( 1000, 2000 ), keepGoing ) );
+	server.setIgnoreRange( false );
+	AVF_CHECK( cache->fetch( other, ByteRange( 1000, 2000 ), keepGoing ) );
+	AVF_CHECK( cache->isCached( other, ByteRange( 1000, 2000 ) ) && ! cache->isCached( other ) );
+	AVF_CHECK( cache->fetch( other, ByteRange( 5000, 1000 ), keepGoing ) );
+	AVF_CHECK( cache->getCachedRanges( other ).getTotalBytes() == 3000 );
+	server.setChunked( false );
+
+	// a new version on the server replaces what was fetched of the old one
+	const std::string changed = makeBody( 2 * MB, 6 );
+	server.setResource( "/other.ts", changed, "\"2\"" );
+	AVF_CHECK( cache->fetch( other, ByteRange( 0, 100 ), keepGoing ) );
+	AVF_CHECK( cache->getCachedRanges( other ).getTotalBytes() == 100 );
+	stream = cache->open( other, 0 );
+	std::vector<uint8_t> data( 100 );
+	AVF_CHECK( stream->getSize() == changed.size() && stream->read( 0, &data[0], data.size() ) == data.size() );
+	AVF_CHECK( hasContent( changed, 0, data, data.size() ) && stream->getBytesFetched() == 0 );
+	stream.reset();
+
+	AVF_CHECK( ! cache->fetch( server.getUrl( "/missing.ts" ), ByteRange(), keepGoing ) );
+	cache->clear();
+	removeDirectory( directory );
+}
+
+//! The resources used least recently go first, and open ones stay
+void testEviction()
+{
+	HttpTestServer server;
+	const std::string body = makeBody( 3 * MB, 6 );
+	server.setResource( "/a.mp4", body );
+	server.setResource( "/b.mp4", body );
+	server.setResource( "/c.mp4", body );
+	const std::string directory = makeDirectory();
+	HttpCacheRef cache = HttpCache::create( directory, 5 * MB );
+	const auto keepGoing = [] { return true; };
+
+	AVF_CHECK( cache->fetch( server.getUrl( "/a.mp4" ), ByteRange(), keepGoing ) );
+	AVF_CHECK( cache->fetch( server.getUrl( "/b.mp4" ), ByteRange(), keepGoing ) );
+	AVF_CHECK( cache->getCachedBytes() <= 5 * MB && cache->isCached( server.getUrl( "/b.mp4" ) ) );
+	AVF_CHECK( cache->getCachedRanges( server.getUrl( "/a.mp4" ) ).empty() );
+
+	HttpStreamRef open = cache->open( server.getUrl( "/b.mp4" ), 0 );
+	AVF_CHECK( cache->fetch( server.getUrl( "/c.mp4" ), ByteRange(), keepGoing ) );
+	AVF_CHECK( cache->getCachedBytes() <= 5 * MB && cache->isCached( server.getUrl( "/b.mp4" ) ) );
+	open.reset();
+
+	cache->setCapacity( 1 * MB );
+	AVF_CHECK( cache->getCachedBytes() == 0 );
+	removeDirectory( directory );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testUrls();
+	testClient();
+	testReplay();
+	testRevalidation();
+	testPrefetch();
+	testFetch();
+	testEviction();
+	std::printf( "HttpCacheTest passed\n" );
+	return 0;
+}
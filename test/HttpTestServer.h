@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// HTTP/1.1 server on the loopback interface for the tests of the network modules. It serves the resources a test sets,
+// answering single byte ranges unless told to ignore them, and can redirect, send chunked bodies or drop every request.
+// Each connection answers one request and closes.
+
+class HttpTestServer {
+  public:
+	HttpTestServer()
+		: mIgnoreRange( false ), mChunked( false ), mDown( false ), mStopping( false ), mBytesServed( 0 )
+	{
+		mFd = ::socket( AF_INET, SOCK_STREAM, 0 );
+		sockaddr_in address = sockaddr_in();
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		socklen_t length = sizeof( address );
+		if( mFd < 0 || ::bind( mFd, reinterpret_cast<sockaddr*>( &address ), length ) != 0 || ::listen( mFd, 64 ) != 0
+			|| ::getsockname( mFd, reinterpret_cast<sockaddr*>( &address ), &length ) != 0 ) {
+			std::fprintf( stderr, "HttpTestServer: can't listen on the loopback interface\n" );
+			std::exit( 1 );
+		}
+		mPort = ntohs( address.sin_port );
+		mThread = std::thread( &HttpTestServer::acceptLoop, this );
+	}
+
+	~HttpTestServer()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mStopping = true;
+		}
+		::shutdown( mFd, SHUT_RDWR );
+		mThread.join();
+		::close( mFd );
+		for( size_t i = 0; i < mConnections.size(); ++i )
+			mConnections[i].join();
+	}
+
+	std::string	getUrl( const std::string &path ) const
+	{
+		std::ostringstream url;
+		url << "http://127.0.0.1:" << mPort << path;
+		return url.str();
+	}
+
+	//! Serves \a body at \a path, with \a etag unless it is empty
+	void		setResource( const std::string &path, const std::string &body, const std::string &etag = "\"1\"" )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		Resource &resource = mResources[path];
+		resource.mBody = body;
+		resource.mETag = etag;
+	}
+	//! Answers requests for \a path with a redirect to \a location
+	void		setRedirect( const std::string &path, const std::string &location )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mRedirects[path] = location;
+	}
+	//! Answers every request with the whole resource, as servers without range support do
+	void		setIgnoreRange( bool ignore ) { std::lock_guard<std::mutex> lock( mMutex ); mIgnoreRange = ignore; }
+	//! Sends bodies with the chunked transfer coding instead of a \c Content-Length
+	void		setChunked( bool chunked ) { std::lock_guard<std::mutex> lock( mMutex ); mChunked = chunked; }
+	//! Closes every connection without answering, as if the server had gone away
+	void		setDown( bool down ) { std::lock_guard<std::mutex> lock( mMutex ); mDown = down; }
+
+	//! Returns the requests answered for \a path
+	int			getNumRequests( const std::string &path ) const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		std::map<std::string, int>::const_iterator it = mNumRequests.find( path );
+		return it == mNumRequests.end() ? 0 : it->second;
+	}
+	//! Returns the body bytes sent so far, over every resource
+	uint64_t	getBytesServed() const { std::lock_guard<std::mutex> lock( mMutex ); return mBytesServed; }
+
+  private:
+	struct Resource {
+		std::string		mBody, mETag;
+	};
+
+	void acceptLoop()
+	{
+		while( true ) {
+			int connection = ::accept( mFd, NULL, NULL );
+			std::lock_guard<std::mutex> lock( mMutex );
+			if( mStopping ) {
+				if( connection >= 0 )
+					::close( connection );
+				return;
+			}
+			if( connection >= 0 )
+				mConnections.push_back( std::thread( &HttpTestServer::answer, this, connection ) );
+		}
+	}
+
+	bool sendAll( int connection, const char *data, size_t size )
+	{
+		while( size > 0 ) {
+			ssize_t sent = ::send( connection, data, size, MSG_NOSIGNAL );
+			if( sent <= 0 )
+				return false;
+			data += sent;
+			size -= static_cast<size_t>( sent );
+		}
+		return true;
+	}
+
+	void answer( int connection )
+	{
+		std::string request;
+		char buffer[4096];
+		while( request.find( "\r\n\r\n" ) == std::string::npos ) {
+			ssize_t received = ::recv( connection, buffer, sizeof( buffer ), 0 );
+			if( received <= 0 ) {
+				::close( connection );
+				return;
+			}
+			request.append( buffer, static_cast<size_t>( received ) );
+		}
+		size_t pathStart = request.find( ' ' ) + 1;
+		std::string path = request.substr( pathStart, request.find( ' ', pathStart ) - pathStart );
+
+		std::unique_lock<std::mutex> lock( mMutex );
+		if( mDown ) {
+			lock.unlock();
+			::close( connection );
+			return;
+		}
+		++mNumRequests[path];
+		std::ostringstream header;
+		std::string body;
+		bool chunked = false;
+		std::map<std::string, std::string>::const_iterator redirect = mRedirects.find( path );
+		std::map<std::string, Resource>::const_iterator resource = mResources.find( path );
+		if( redirect != mRedirects.end() )
+			header << "HTTP/1.1 302 Found\r\nLocation: " << redirect->second << "\r\nContent-Length: 0\r\n";
+		else if( resource == mResources.end() )
+			header << "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n";
+		else {
+			const std::string &whole = resource->second.mBody;
+			unsigned long long first = 0, last = whole.size() - 1;
+			size_t range = request.find( "\r\nRange: bytes=" );
+			int fields = range == std::string::npos ? 0 : std::sscanf( request.c_str() + range + 15, "%llu-%llu", &first, &last );
+			if( fields > 0 && ! mIgnoreRange && first >= whole.size() )
+				header << "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" << whole.size() << "\r\nContent-Length: 0\r\n";
+			else {
+				if( fields > 0 && ! mIgnoreRange ) {
+					last = std::min<unsigned long long>( last, whole.size() - 1 );
+					header << "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " << first << "-" << last << "/" << whole.size() << "\r\n";
+				}
+				else {
+					first = 0;
+					last = whole.size() - 1;
+					header << "HTTP/1.1 200 OK\r\n";
+				}
+				body = whole.substr( first, last + 1 - first );
+				chunked = mChunked;
+				if( ! resource->second.mETag.empty() )
+					header << "ETag: " << resource->second.mETag << "\r\n";
+				if( chunked )
+					header << "Transfer-Encoding: chunked\r\n";
+				else
+					header << "Content-Length: " << body.size() << "\r\n";
+			}
+		}
+		lock.unlock();
+
+		header << "Connection: close\r\n\r\n";
+		std::string text = header.str();
+		bool sent = sendAll( connection, text.data(), text.size() );
+		// sent in pieces, so a client that cancels stops the transfer
+		const size_t pieceSize = chunked ? 7000 : 65536;
+		for( size_t offset = 0; sent && offset < body.size(); offset += pieceSize ) {
+			size_t size = std::min( pieceSize, body.size() - offset );
+			if( chunked ) {
+				std::ostringstream line;
+				line << std::hex << size << ";piece\r\n";
+				std::string sizeLine = line.str();
+				sent = sendAll( connection, sizeLine.data(), sizeLine.size() );
+			}
+			sent = sent && sendAll( connection, body.data() + offset, size ) && ( ! chunked || sendAll( connection, "\r\n", 2 ) );
+			if( sent ) {
+				std::lock_guard<std::mutex> countLock( mMutex );
+				mBytesServed += size;
+			}
+		}
+		if( sent && chunked )
+			sendAll( connection, "0\r\nX-Trailer: 1\r\n\r\n", 19 );
+		::close( connection );
+	}
+
+	int									mFd, mPort;
+	std::thread							mThread;
+	mutable std::mutex					mMutex;
+	std::map<std::string, Resource>		mResources;
+	std::map<std::string, std::string>	mRedirects;
+	std::map<std::string, int>			mNumRequests;
+	bool								mIgnoreRange, mChunked, mDown, mStopping;
+	uint64_t							mBytesServed;
+	std::vector<std::thread>			mConnections;
+};
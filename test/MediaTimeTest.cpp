@@ -0,0 +1,139 @@
+#include "AvfMediaTime.h"
+#include "Test.h"
+
+#include <limits>
+
+using namespace cinder::avf;
+
+namespace {
+
+void testFromFrameRate()
+{
+	// NTSC rates as AVFoundation reports them, as floats
+	AVF_CHECK( MediaTime::fromFrameRate( 29.97f ) == MediaTime( 1001, 30000 ) );
+	AVF_CHECK( MediaTime::fromFrameRate( 30000 / 1001.0 ) == MediaTime( 1001, 30000 ) );
+	AVF_CHECK( MediaTime::fromFrameRate( 23.976f ) == MediaTime( 1001, 24000 ) );
+	AVF_CHECK( MediaTime::fromFrameRate( 59.94f ) == MediaTime( 1001, 60000 ) );
+	AVF_CHECK( MediaTime::fromFrameRate( 25 ) == MediaTime( 1, 25 ) );
+	AVF_CHECK( MediaTime::fromFrameRate( 30.0001f ) == MediaTime( 1, 30 ) );
+	AVF_CHECK( MediaTime::fromFrameRate( 12.5 ) == MediaTime( 2, 25 ) );
+	AVF_CHECK( ! MediaTime::fromFrameRate( 0 ).isValid() && ! MediaTime::fromFrameRate( -1 ).isValid() );
+
+	// a frame step that is exact keeps frame indices exact over hours of 29.97
+	const MediaTime step = MediaTime::fromFrameRate( 29.97f );
+	const int64_t frames = 30 * 60 * 60 * 3;
+	MediaTime t = MediaTime::fromFrame( frames, step );
+	AVF_CHECK( t == MediaTime( frames * 1001, 30000 ) );
+	AVF_CHECK( t.toFrame( step ) == frames && ( t - MediaTime( 1, 30000 ) ).toFrame( step ) == frames - 1 );
+}
+
+void testArithmetic()
+{
+	// sums across time scales land on the smallest scale both convert to exactly
+	MediaTime sum = MediaTime( 1, 30 ) + MediaTime( 1, 25 );
+	AVF_CHECK( sum.getValue() == 11 && sum.getTimeScale() == 150 );
+	AVF_CHECK( MediaTime( 1001, 30000 ) - MediaTime( 1, 30 ) == MediaTime( 1, 30000 ) );
+	AVF_CHECK( MediaTime( 1, 2 ) - MediaTime( 3, 4 ) == MediaTime( -1, 4 ) );
+	AVF_CHECK( MediaTime( 5, 600 ) + MediaTime::zero() == MediaTime( 5, 600 ) );
+	MediaTime accumulated = MediaTime::zero();
+	for( int i = 0; i < 30000; ++i )
+		accumulated += MediaTime( 1001, 30000 );
+	AVF_CHECK( accumulated == MediaTime( 1001, 1 ) );
+	AVF_CHECK( MediaTime( 7, 3 ) * 3 == MediaTime( 7, 1 ) && -MediaTime( 7, 3 ) == MediaTime( -7, 3 ) );
+
+	// scales whose least common multiple doesn't fit 32 bits fall back to the finer one, rounding the other operand
+	sum = MediaTime( 1, INT32_MAX ) + MediaTime( 1, INT32_MAX - 1 );
+	AVF_CHECK( sum.getTimeScale() == INT32_MAX && sum.getValue() == 2 );
+}
+
+void testComparison()
+{
+	AVF_CHECK( MediaTime( 2, 6 ) == MediaTime( 1, 3 ) && MediaTime( 0, 1 ) == MediaTime( 0, 90000 ) );
+	AVF_CHECK( MediaTime( 1, 3 ) < MediaTime( 334, 1000 ) && MediaTime( 333, 1000 ) < MediaTime( 1, 3 ) );
+	AVF_CHECK( MediaTime( 1001, 30000 ) > MediaTime( 1, 30 ) && MediaTime( -1, 2 ) < MediaTime( -1, 3 ) );
+	AVF_CHECK( MediaTime( 1, 3 ) <= MediaTime( 2, 6 ) && MediaTime( 1, 3 ) >= MediaTime( 2, 6 ) && MediaTime( 1, 3 ) != MediaTime( 1, 4 ) );
+	// exact at the edges of the value range, where a double comparison isn't
+	AVF_CHECK( MediaTime( INT64_MAX, 2 ) < MediaTime( INT64_MAX, 1 ) );
+	AVF_CHECK( MediaTime( INT64_MAX - 1, INT32_MAX ) < MediaTime( INT64_MAX, INT32_MAX ) );
+
+	// invalid times sort after valid ones and equal each other
+	AVF_CHECK( MediaTime( INT64_MAX, 1 ) < MediaTime() && MediaTime() > MediaTime( 0, 1 ) );
+	AVF_CHECK( MediaTime() == MediaTime() && MediaTime( 5, 0 ) == MediaTime( 3, -1 ) );
+}
+
+void testRounding()
+{
+	// rescaling rounds to nearest, ties toward positive infinity
+	AVF_CHECK( MediaTime( 1, 3 ).rescaled( 10 ).getValue() == 3 && MediaTime( 2, 3 ).rescaled( 10 ).getValue() == 7 );
+	AVF_CHECK( MediaTime( 5, 10 ).rescaled( 1 ).getValue() == 1 && MediaTime( 15, 10 ).rescaled( 1 ).getValue() == 2 );
+	AVF_CHECK( MediaTime( -5, 10 ).rescaled( 1 ).getValue() == 0 && MediaTime( -6, 10 ).rescaled( 1 ).getValue() == -1 );
+	AVF_CHECK( MediaTime( -15, 10 ).rescaled( 1 ).getValue() == -1 );
+	MediaTime rescaled = MediaTime( 1001, 30000 ).rescaled( 600 );
+	AVF_CHECK( rescaled.getValue() == 20 && rescaled.getTimeScale() == 600 );
+	AVF_CHECK( MediaTime( 3, 600 ).rescaled( 90000 ).getValue() == 450 );
+
+	MediaTime reduced = MediaTime( 1001 * 4, 30000 * 4 ).reduced();
+	AVF_CHECK( reduced.getValue() == 1001 && reduced.getTimeScale() == 30000 );
+	reduced = MediaTime( -10, 4 ).reduced();
+	AVF_CHECK( reduced.getValue() == -5 && reduced.getTimeScale() == 2 );
+	reduced = MediaTime( 0, 600 ).reduced();
+	AVF_CHECK( reduced.getValue() == 0 && reduced.getTimeScale() == 1 );
+	reduced = MediaTime( INT64_MIN, 2 ).reduced();
+	AVF_CHECK( reduced.getValue() == INT64_MIN / 2 && reduced.getTimeScale() == 1 );
+
+	AVF_CHECK( MediaTime::fromSeconds( 0.5, 3 ).getValue() == 2 && MediaTime::fromSeconds( -0.5, 1 ).getValue() == 0 );
+	AVF_CHECK( MediaTime::fromSeconds( 1.0 / 3, 600 ).getValue() == 200 );
+}
+
+void testInvalid()
+{
+	const MediaTime invalid = MediaTime::invalid(), valid( 1, 30 );
+	AVF_CHECK( ! invalid.isValid() && ! MediaTime( 1, 0 ).isValid() && ! MediaTime( 1, -30 ).isValid() );
+	AVF_CHECK( ! ( invalid + valid ).isValid() && ! ( valid + invalid ).isValid() );
+	AVF_CHECK( ! ( invalid - valid ).isValid() && ! ( valid - invalid ).isValid() );
+	AVF_CHECK( ! ( invalid * 2 ).isValid() && ! ( -invalid ).isValid() );
+	AVF_CHECK( ! invalid.rescaled( 600 ).isValid() && ! valid.rescaled( 0 ).isValid() && ! invalid.reduced().isValid() );
+	AVF_CHECK( invalid.toSeconds() == 0 && invalid.toFrame( valid ) == 0 && valid.toFrame( invalid ) == 0 );
+	AVF_CHECK( ! MediaTime::fromSeconds( 1, 0 ).isValid() && ! MediaTime::fromSeconds( std::numeric_limits<double>::quiet_NaN() ).isValid() );
+	MediaTime accumulated = valid;
+	accumulated += invalid;
+	accumulated += valid;
+	AVF_CHECK( ! accumulated.isValid() );
+}
+
+void testOverflow()
+{
+	// the common scale of 3 takes the first operand past 64 bits
+	const int64_t half = INT64_MAX / 2;
+	AVF_CHECK( MediaTime( half, 1 ) + MediaTime( half, 3 ) == MediaTime::invalid() );
+	AVF_CHECK( ( MediaTime( half / 3, 1 ) + MediaTime( half, 3 ) ).isValid() );
+
+	AVF_CHECK( ! ( MediaTime( INT64_MAX, 1 ) + MediaTime( 1, 1 ) ).isValid() );
+	AVF_CHECK( MediaTime( INT64_MAX - 1, 1 ) + MediaTime( 1, 1 ) == MediaTime( INT64_MAX, 1 ) );
+	AVF_CHECK( ! ( MediaTime( INT64_MIN, 1 ) - MediaTime( 1, 1 ) ).isValid() );
+	AVF_CHECK( ( MediaTime( INT64_MIN + 1, 1 ) - MediaTime( 1, 1 ) ).getValue() == INT64_MIN );
+	// subtracting INT64_MIN can still fit, though negating it can't
+	AVF_CHECK( ( MediaTime( -1, 1 ) - MediaTime( INT64_MIN, 1 ) ).getValue() == INT64_MAX );
+	AVF_CHECK( ! ( -MediaTime( INT64_MIN, 1 ) ).isValid() && ( -MediaTime( INT64_MAX, 1 ) ).getValue() == -INT64_MAX );
+	AVF_CHECK( ! ( MediaTime( INT64_MAX, 1 ) * 2 ).isValid() && ! ( MediaTime( 2, 1 ) * INT64_MIN ).isValid() );
+	AVF_CHECK( ! MediaTime::fromFrame( INT64_MAX, MediaTime( 1001, 30000 ) ).isValid() );
+	AVF_CHECK( ! MediaTime( INT64_MAX, 1 ).rescaled( 2 ).isValid() && MediaTime( INT64_MAX, 2 ).rescaled( 1 ).isValid() );
+
+	AVF_CHECK( ! MediaTime::fromSeconds( 1e300 ).isValid() && ! MediaTime::fromSeconds( -1e300 ).isValid() );
+	AVF_CHECK( ! MediaTime::fromSeconds( std::numeric_limits<double>::infinity() ).isValid() && ! MediaTime::fromSeconds( 9.3e18, 1 ).isValid() );
+	AVF_CHECK( MediaTime::fromSeconds( -9.2e18, 1 ).isValid() && ! MediaTime::fromSeconds( 1e15, INT32_MAX ).isValid() );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testFromFrameRate();
+	testArithmetic();
+	testComparison();
+	testRounding();
+	testInvalid();
+	testOverflow();
+	std::printf( "MediaTimeTest passed\n" );
+	return 0;
+}
@@ -0,0 +1,199 @@
+#include "AvfClipPack.h"
+#include "AvfMjpegWriter.h"
+#include "Test.h"
+
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace cinder::avf;
+
+namespace {
+
+std::string getTempPath( const char *name )
+{
+	return std::string( "/tmp/" ) + name + "-" + std::to_string( ::getpid() ) + ".mov";
+}
+
+std::vector<uint8_t> readAll( const std::string &path )
+{
+	std::vector<uint8_t> result;
+	FILE *file = std::fopen( path.c_str(), "rb" );
+	AVF_CHECK( file );
+	uint8_t buffer[64 * 1024];
+	size_t count;
+	while( ( count = std::fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+		result.insert( result.end(), buffer, buffer + count );
+	std::fclose( file );
+	return result;
+}
+
+uint64_t getBe( const uint8_t *data, size_t bytes )
+{
+	uint64_t result = 0;
+	for( size_t i = 0; i < bytes; ++i )
+		result = ( result << 8 ) | data[i];
+	return result;
+}
+
+// Returns the body of the first atom of \a type among the atoms in \a data, storing its size in \a bodySize, or NULL
+const uint8_t* findAtom( const uint8_t *data, uint64_t size, const char *type, uint64_t *bodySize )
+{
+	for( uint64_t offset = 0; offset + 8 <= size; ) {
+		uint64_t atomSize = getBe( data + offset, 4 ), header = 8;
+		if( atomSize == 1 ) {
+			atomSize = getBe( data + offset + 8, 8 );
+			header = 16;
+		}
+		if( atomSize < header || atomSize > size - offset )
+			return NULL;
+		if( std::memcmp( data + offset + 4, type, 4 ) == 0 ) {
+			*bodySize = atomSize - header;
+			return data + offset + header;
+		}
+		offset += atomSize;
+	}
+	return NULL;
+}
+
+// a horizontal gradient that moves with the frame index, in BGRA
+std::vector<uint8_t> makeFrame( int32_t width, int32_t height, int32_t rowBytes, int32_t index )
+{
+	std::vector<uint8_t> pixels( static_cast<size_t>( rowBytes ) * height, 0 );
+	for( int32_t y = 0; y < height; ++y ) {
+		for( int32_t x = 0; x < width; ++x ) {
+			uint8_t *pixel = &pixels[y * rowBytes + x * 4];
+			pixel[0] = static_cast<uint8_t>( x * 255 / width );
+			pixel[1] = static_cast<uint8_t>( y * 255 / height );
+			pixel[2] = static_cast<uint8_t>( index * 40 );
+			pixel[3] = 255;
+		}
+	}
+	return pixels;
+}
+
+void testRoundTrip()
+{
+	const int32_t width = 70, height = 38, rowBytes = width * 4 + 8, numFrames = 9, timeScale = 600;
+	const std::string path = getTempPath( "MjpegWriterTest" );
+	{
+		// more frames than the four two workers keep in flight, so addFrame() blocks and frames can finish out of order
+		MjpegWriterRef writer = MjpegWriter::create( path, width, height, timeScale, 0.8f, 2 );
+		for( int32_t i = 0; i < numFrames; ++i ) {
+			std::vector<uint8_t> frame = makeFrame( width, height, rowBytes, i );
+			// the last frame lasts twice as long
+			writer->addFrame( &frame[0], rowBytes, MjpegPixelLayout( 4, 2, 1, 0 ), ( i == numFrames - 1 ) ? 40 : 20 );
+		}
+		AVF_CHECK( writer->getNumFrames() == numFrames );
+		writer->finish();
+		writer->finish();
+		AVF_CHECK( writer->getNumFrames() == numFrames );
+	}
+
+	std::vector<uint8_t> movie = readAll( path );
+	std::remove( path.c_str() );
+
+	ClipInfo info;
+	AVF_CHECK( parseClipInfo( &movie[0], movie.size(), &info ) );
+	AVF_CHECK( info.mHasVideo && ! info.mHasAudio );
+	AVF_CHECK( info.mWidth == width && info.mHeight == height );
+	AVF_CHECK( info.mNumFrames == numFrames );
+	AVF_CHECK( info.mDuration == MediaTime( 20 * ( numFrames - 1 ) + 40, timeScale ) );
+	AVF_CHECK( info.mFrameDuration == MediaTime( 20, timeScale ) );
+
+	// every sample is a whole JPEG, from SOI to EOI, inside the mdat
+	uint64_t moovSize, mdatSize, size;
+	const uint8_t *moov = findAtom( &movie[0], movie.size(), "moov", &moovSize );
+	const uint8_t *mdat = findAtom( &movie[0], movie.size(), "mdat", &mdatSize );
+	AVF_CHECK( moov && mdat );
+	const uint8_t *trak = findAtom( moov, moovSize, "trak", &size );
+	const uint8_t *mdia = trak ? findAtom( trak, size, "mdia", &size ) : NULL;
+	const uint8_t *minf = mdia ? findAtom( mdia, size, "minf", &size ) : NULL;
+	const uint8_t *stbl = minf ? findAtom( minf, size, "stbl", &size ) : NULL;
+	AVF_CHECK( stbl );
+	uint64_t stszSize, co64Size;
+	const uint8_t *stsz = findAtom( stbl, size, "stsz", &stszSize );
+	const uint8_t *co64 = findAtom( stbl, size, "co64", &co64Size );
+	AVF_CHECK( stsz && co64 );
+	AVF_CHECK( getBe( stsz + 8, 4 ) == numFrames && getBe( co64 + 4, 4 ) == numFrames );
+	AVF_CHECK( stszSize >= 12 + 4 * numFrames && co64Size >= 8 + 8 * numFrames );
+
+	uint64_t expectedOffset = static_cast<uint64_t>( mdat - &movie[0] );
+	for( int32_t i = 0; i < numFrames; ++i ) {
+		uint64_t sampleSize = getBe( stsz + 12 + i * 4, 4 ), offset = getBe( co64 + 8 + i * 8, 8 );
+		// samples are written back to back, in presentation order
+		AVF_CHECK( offset == expectedOffset );
+		AVF_CHECK( sampleSize > 4 && offset + sampleSize <= static_cast<uint64_t>( mdat - &movie[0] ) + mdatSize );
+		const uint8_t *sample = &movie[offset];
+		AVF_CHECK( sample[0] == 0xFF && sample[1] == 0xD8 );
+		AVF_CHECK( sample[sampleSize - 2] == 0xFF && sample[sampleSize - 1] == 0xD9 );
+		expectedOffset += sampleSize;
+	}
+	AVF_CHECK( expectedOffset == static_cast<uint64_t>( mdat - &movie[0] ) + mdatSize );
+}
+
+void testEmptyMovie()
+{
+	const std::string path = getTempPath( "MjpegWriterTestEmpty" );
+	MjpegWriter( path, 16, 16 ).finish();
+	std::vector<uint8_t> movie = readAll( path );
+	std::remove( path.c_str() );
+
+	ClipInfo info;
+	AVF_CHECK( parseClipInfo( &movie[0], movie.size(), &info ) );
+	AVF_CHECK( info.mHasVideo && info.mNumFrames == 0 && info.mDuration.getValue() == 0 );
+}
+
+void testFailures()
+{
+	bool threw = false;
+	try {
+		MjpegWriter( "/nonexistent/directory/movie.mov", 16, 16 );
+	}
+	catch( MjpegWriterExc& ) {
+		threw = true;
+	}
+	AVF_CHECK( threw );
+
+	// a device that fails every write; the buffered writes only fail when flushed, so finish() is the one to report it
+	std::vector<uint8_t> frame = makeFrame( 16, 16, 64, 0 );
+	if( ::access( "/dev/full", W_OK ) == 0 ) {
+		MjpegWriter writer( "/dev/full", 16, 16 );
+		writer.addFrame( &frame[0], 64, MjpegPixelLayout( 4, 2, 1, 0 ), 20 );
+		threw = false;
+		try {
+			writer.finish();
+		}
+		catch( MjpegWriterExc& ) {
+			threw = true;
+		}
+		AVF_CHECK( threw );
+		// reported once, and the destructor stays quiet
+		writer.finish();
+	}
+
+	const std::string path = getTempPath( "MjpegWriterTestFinished" );
+	MjpegWriter writer( path, 16, 16 );
+	writer.finish();
+	std::remove( path.c_str() );
+	threw = false;
+	try {
+		writer.addFrame( &frame[0], 64, MjpegPixelLayout( 4, 2, 1, 0 ), 20 );
+	}
+	catch( MjpegWriterExc& ) {
+		threw = true;
+	}
+	AVF_CHECK( threw );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testRoundTrip();
+	testEmptyMovie();
+	testFailures();
+	std::printf( "MjpegWriterTest passed\n" );
+	return 0;
+}
@@ -0,0 +1,145 @@
+#include "AvfPixelFormat.h"
+#include "Test.h"
+
+#include <vector>
+
+using namespace cinder::avf;
+
+namespace {
+
+const PixelFormat sConvertible[] = { PIXEL_FORMAT_RGB, PIXEL_FORMAT_BGR, PIXEL_FORMAT_ARGB, PIXEL_FORMAT_BGRA, PIXEL_FORMAT_ABGR, PIXEL_FORMAT_RGBA };
+const size_t sNumConvertible = sizeof( sConvertible ) / sizeof( sConvertible[0] );
+
+const int32_t	sWidth = 7, sHeight = 3;
+//! Rows are padded, so converters that ignore the row stride fail
+const size_t	sPadding = 5;
+
+struct Color {
+	uint8_t		r, g, b, a;
+};
+
+Color colorAt( int32_t x, int32_t y )
+{
+	Color c = { uint8_t( 10 + x * 20 + y ), uint8_t( 100 + x * 3 + y * 7 ), uint8_t( 250 - x * 11 - y ), uint8_t( 30 + x + y * 50 ) };
+	return c;
+}
+
+std::vector<uint8_t> makeImage( PixelFormat format )
+{
+	const PixelFormatDesc &desc = getPixelFormatDesc( format );
+	const size_t rowBytes = sWidth * desc.mPixelInc + sPadding;
+	std::vector<uint8_t> result( rowBytes * sHeight, 0xEE );
+	for( int32_t y = 0; y < sHeight; ++y ) {
+		for( int32_t x = 0; x < sWidth; ++x ) {
+			uint8_t *p = &result[y * rowBytes + x * desc.mPixelInc];
+			Color c = colorAt( x, y );
+			p[desc.mRed] = c.r;
+			p[desc.mGreen] = c.g;
+			p[desc.mBlue] = c.b;
+			if( desc.hasAlpha() )
+				p[desc.mAlpha] = c.a;
+		}
+	}
+	return result;
+}
+
+//! Checks \a image of \a format holds the known pixels, with an alpha of \c 255 when \a opaque
+void checkImage( PixelFormat format, const std::vector<uint8_t> &image, bool opaque )
+{
+	const PixelFormatDesc &desc = getPixelFormatDesc( format );
+	const size_t rowBytes = sWidth * desc.mPixelInc + sPadding;
+	for( int32_t y = 0; y < sHeight; ++y ) {
+		for( int32_t x = 0; x < sWidth; ++x ) {
+			const uint8_t *p = &image[y * rowBytes + x * desc.mPixelInc];
+			Color c = colorAt( x, y );
+			AVF_CHECK( p[desc.mRed] == c.r && p[desc.mGreen] == c.g && p[desc.mBlue] == c.b );
+			if( desc.hasAlpha() )
+				AVF_CHECK( p[desc.mAlpha] == ( opaque ? 0xFF : c.a ) );
+		}
+		// the padding is never written
+		for( size_t i = sWidth * desc.mPixelInc; i < rowBytes; ++i )
+			AVF_CHECK( image[y * rowBytes + i] == 0xEE );
+	}
+}
+
+void testLookups()
+{
+	for( int32_t i = 0; i < PIXEL_FORMAT_COUNT; ++i ) {
+		PixelFormat format = static_cast<PixelFormat>( i );
+		const PixelFormatDesc &desc = getPixelFormatDesc( format );
+		PixelFormat found;
+		AVF_CHECK( findPixelFormat( desc.mCvType, &found ) && found == format );
+		AVF_CHECK( desc.mPixelInc == desc.mChannelBytes * ( desc.hasAlpha() ? 4 : 3 ) );
+	}
+
+	// kCVPixelFormatType_422YpCbCr8 isn't in the table
+	PixelFormat found = PIXEL_FORMAT_COUNT;
+	AVF_CHECK( ! findPixelFormat( makeFourCc( '2', 'v', 'u', 'y' ), &found ) && found == PIXEL_FORMAT_COUNT );
+	AVF_CHECK( getPixelFormatDesc( PIXEL_FORMAT_BGRA ).mCvType == makeFourCc( 'B', 'G', 'R', 'A' ) );
+	AVF_CHECK( getPixelFormatDesc( PIXEL_FORMAT_RGB ).mCvType == 24 && getPixelFormatDesc( PIXEL_FORMAT_ARGB ).mCvType == 32 );
+
+	static_assert( ! getPixelFormatDesc( PIXEL_FORMAT_ARGB64 ).isConvertible(), "64 bit ARGB has 16-bit channels" );
+	static_assert( getPixelFormatDesc( PIXEL_FORMAT_ABGR ).hasAlpha() && ! getPixelFormatDesc( PIXEL_FORMAT_BGR ).hasAlpha(), "alpha" );
+	for( size_t i = 0; i < sNumConvertible; ++i ) {
+		AVF_CHECK( getPixelFormatDesc( sConvertible[i] ).isConvertible() );
+		AVF_CHECK( getPixelConverter( sConvertible[i], PIXEL_FORMAT_ARGB64 ) == NULL );
+		AVF_CHECK( getPixelConverter( PIXEL_FORMAT_ARGB64, sConvertible[i] ) == NULL );
+	}
+	uint8_t pixel[8] = { 0 };
+	AVF_CHECK( ! convertPixels( PIXEL_FORMAT_ARGB64, pixel, 8, PIXEL_FORMAT_BGRA, pixel, 4, 1, 1 ) );
+}
+
+//! Converts the known pixels through every pair and back
+void testRoundTrips()
+{
+	for( size_t s = 0; s < sNumConvertible; ++s ) {
+		for( size_t d = 0; d < sNumConvertible; ++d ) {
+			const PixelFormat src = sConvertible[s], dst = sConvertible[d];
+			const PixelFormatDesc &srcDesc = getPixelFormatDesc( src ), &dstDesc = getPixelFormatDesc( dst );
+			const size_t srcRowBytes = sWidth * srcDesc.mPixelInc + sPadding, dstRowBytes = sWidth * dstDesc.mPixelInc + sPadding;
+
+			std::vector<uint8_t> image = makeImage( src );
+			std::vector<uint8_t> converted( dstRowBytes * sHeight, 0xEE );
+			PixelConvertFn fn = getPixelConverter( src, dst );
+			AVF_CHECK( fn != NULL );
+			fn( &image[0], srcRowBytes, &converted[0], dstRowBytes, sWidth, sHeight );
+			// a source without alpha comes out opaque
+			checkImage( dst, converted, ! srcDesc.hasAlpha() );
+
+			std::vector<uint8_t> back( srcRowBytes * sHeight, 0xEE );
+			AVF_CHECK( convertPixels( dst, &converted[0], dstRowBytes, src, &back[0], srcRowBytes, sWidth, sHeight ) );
+			checkImage( src, back, ! dstDesc.hasAlpha() );
+		}
+	}
+}
+
+void testConvertTemplates()
+{
+	// the templates are usable directly, and a same format conversion is a row copy
+	std::vector<uint8_t> bgra = makeImage( PIXEL_FORMAT_BGRA );
+	const size_t rowBytes = sWidth * 4 + sPadding;
+	std::vector<uint8_t> copy( bgra.size(), 0xEE );
+	convert<PIXEL_FORMAT_BGRA, PIXEL_FORMAT_BGRA>( &bgra[0], rowBytes, &copy[0], rowBytes, sWidth, sHeight );
+	checkImage( PIXEL_FORMAT_BGRA, copy, false );
+
+	// one known pixel: BGRA 1,2,3,4 is red 3, green 2, blue 1, alpha 4
+	const uint8_t pixel[4] = { 1, 2, 3, 4 };
+	uint8_t rgba[4], rgb[3], argb[4];
+	convert<PIXEL_FORMAT_BGRA, PIXEL_FORMAT_RGBA>( pixel, 4, rgba, 4, 1, 1 );
+	convert<PIXEL_FORMAT_BGRA, PIXEL_FORMAT_RGB>( pixel, 4, rgb, 3, 1, 1 );
+	convert<PIXEL_FORMAT_RGB, PIXEL_FORMAT_ARGB>( rgb, 3, argb, 4, 1, 1 );
+	AVF_CHECK( rgba[0] == 3 && rgba[1] == 2 && rgba[2] == 1 && rgba[3] == 4 );
+	AVF_CHECK( rgb[0] == 3 && rgb[1] == 2 && rgb[2] == 1 );
+	AVF_CHECK( argb[0] == 255 && argb[1] == 3 && argb[2] == 2 && argb[3] == 1 );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testLookups();
+	testRoundTrips();
+	testConvertTemplates();
+	std::printf( "PixelFormatTest passed\n" );
+	return 0;
+}
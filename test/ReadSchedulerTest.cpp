@@ -0,0 +1,168 @@
+#include "AvfReadScheduler.h"
+#include "Test.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace cinder::avf;
+
+namespace {
+
+const uint64_t MB = 1024 * 1024;
+
+bool hasContent( size_t file, uint64_t offset, const std::vector<uint8_t> &data, size_t size )
+{
+	for( size_t i = 0; i < size; ++i ) {
+		if( data[i] != SimulatedDisk::getByte( file, offset + i ) )
+			return false;
+	}
+	return true;
+}
+
+//! Streams fill their read-ahead in one sweep across the disk, and later sweeps cost a seek per file
+void testElevator()
+{
+	std::shared_ptr<SimulatedDisk> disk( new SimulatedDisk() );
+	for( int i = 0; i < 8; ++i )
+		disk->addFile( 16 * MB + i * 1000 );
+	ReadSchedulerRef scheduler = ReadScheduler::create( disk, ReadScheduler::Options().enableThread( false ) );
+
+	// opened against the order of the disk, which the scheduler mustn't follow
+	std::vector<ScheduledStreamRef> streams;
+	for( int i = 7; i >= 0; --i )
+		streams.push_back( scheduler->openStream( i, 1 * MB ) );
+	while( scheduler->processNext() )
+		;
+	AVF_CHECK( disk->getNumSeeks() <= 8 );
+	for( size_t i = 0; i < streams.size(); ++i ) {
+		BufferHealth health = streams[i]->getBufferHealth();
+		AVF_CHECK( health.getFill() == 1.0f && health.mTargetBytes == 4 * MB && health.mNumStalls == 0 );
+	}
+
+	std::vector<uint8_t> data( 300000 );
+	AVF_CHECK( streams[3]->read( 100, &data[0], data.size() ) == data.size() );
+	AVF_CHECK( hasContent( 4, 100, data, data.size() ) );
+
+	// moving every stream forward empties part of each read-ahead, refilled by one more sweep
+	for( size_t i = 0; i < streams.size(); ++i )
+		streams[i]->read( 2 * MB, &data[0], 10 );
+	uint32_t seeks = disk->getNumSeeks();
+	while( scheduler->processNext() )
+		;
+	AVF_CHECK( disk->getNumSeeks() - seeks <= 8 );
+
+	// a higher bitrate grows the read-ahead, here to the rest of the file
+	streams[2]->setBitrateHint( 4 * MB );
+	AVF_CHECK( scheduler->processNext() );
+	while( scheduler->processNext() )
+		;
+	AVF_CHECK( streams[2]->getBufferHealth().mTargetBytes == streams[2]->getSize() - 2 * MB );
+	AVF_CHECK( streams[2]->getBufferHealth().getFill() == 1.0f );
+
+	// reads past the end of the file are cut short
+	std::thread reader( [&] {
+		while( scheduler->getNumStreams() ) {
+			if( ! scheduler->processNext() )
+				std::this_thread::yield();
+		}
+	} );
+	const uint64_t size = streams[0]->getSize();
+	AVF_CHECK( streams[0]->read( size - 10, &data[0], 100 ) == 10 );
+	AVF_CHECK( hasContent( 7, size - 10, data, 10 ) );
+	streams.clear();
+	reader.join();
+}
+
+//! Several movies playing at once from a disk in real time read the right bytes, and only wait for the disk when they start
+void testConcurrentStreams()
+{
+	const int numStreams = 6;
+	std::shared_ptr<SimulatedDisk> disk( new SimulatedDisk( 0.002, 400e6 ) );
+	disk->setRealTime();
+	for( int i = 0; i < numStreams; ++i )
+		disk->addFile( 3 * MB + i * 77 );
+	ReadSchedulerRef scheduler = ReadScheduler::create( disk, ReadScheduler::Options().setChunkSize( 256 * 1024 ).setReadAheadLimits( 512 * 1024, 4 * MB ) );
+
+	std::vector<uint32_t> stalls( numStreams );
+	std::vector<int> complete( numStreams, 0 );
+	std::vector<std::thread> threads;
+	for( int i = 0; i < numStreams; ++i ) {
+		threads.push_back( std::thread( [&, i] {
+			// 64KB every 10ms is a little over 6MB per second
+			ScheduledStreamRef stream = scheduler->openStream( i, 8 * MB );
+			std::vector<uint8_t> data( 65536 );
+			uint64_t offset = 0;
+			size_t count;
+			bool correct = true;
+			while( ( count = stream->read( offset, &data[0], data.size() ) ) > 0 ) {
+				correct = correct && hasContent( i, offset, data, count );
+				offset += count;
+				std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+			}
+			complete[i] = correct && offset == stream->getSize() ? 1 : 0;
+			stalls[i] = stream->getBufferHealth().mNumStalls;
+		} ) );
+	}
+	for( size_t i = 0; i < threads.size(); ++i )
+		threads[i].join();
+
+	for( int i = 0; i < numStreams; ++i ) {
+		AVF_CHECK( complete[i] );
+		// the first read always waits; the bound leaves room for a loaded machine, against 48 reads per stream
+		AVF_CHECK( stalls[i] >= 1 && stalls[i] <= 4 );
+	}
+	// batched reads keep the seeks well below one per chunk
+	AVF_CHECK( disk->getNumSeeks() < disk->getNumReads() );
+	AVF_CHECK( disk->getBytesRead() >= numStreams * 3 * MB );
+	AVF_CHECK( scheduler->getNumStreams() == 0 );
+}
+
+//! Files reopened through the device reuse the slots of closed ones
+void testFileSlots()
+{
+	char path[] = "/tmp/AvfReadSchedulerTestXXXXXX";
+	int fd = ::mkstemp( path );
+	AVF_CHECK( fd >= 0 );
+	std::vector<uint8_t> content( 100000 );
+	for( size_t i = 0; i < content.size(); ++i )
+		content[i] = static_cast<uint8_t>( i * 7 );
+	AVF_CHECK( ::write( fd, &content[0], content.size() ) == static_cast<ssize_t>( content.size() ) );
+	::close( fd );
+
+	std::shared_ptr<FileReadDevice> device( new FileReadDevice );
+	ReadSchedulerRef scheduler = ReadScheduler::create( device );
+	for( int i = 0; i < 20; ++i ) {
+		ScheduledStreamRef a = scheduler->openFile( path );
+		ScheduledStreamRef b = scheduler->openFile( path );
+		std::vector<uint8_t> data( 1000 );
+		AVF_CHECK( b->read( 5000, &data[0], data.size() ) == data.size() );
+		AVF_CHECK( std::equal( data.begin(), data.end(), content.begin() + 5000 ) );
+		AVF_CHECK( a->getSize() == content.size() );
+	}
+	AVF_CHECK( device->getNumSlots() == 2 );
+
+	bool threw = false;
+	try {
+		scheduler->openFile( "/nonexistent/AvfReadSchedulerTest" );
+	}
+	catch( ReadSchedulerExc& ) {
+		threw = true;
+	}
+	AVF_CHECK( threw );
+	::unlink( path );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testElevator();
+	testConcurrentStreams();
+	testFileSlots();
+	std::printf( "ReadSchedulerTest passed\n" );
+	return 0;
+}
@@ -0,0 +1,201 @@
+#include "AvfSceneDetector.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace cinder::avf;
+
+namespace {
+
+const int32_t	WIDTH = 128, HEIGHT = 72;
+
+//! An RGBA frame whose pixels are all gray, at the level \a gray returns for them
+template<typename GrayFn>
+std::vector<uint8_t> makeFrame( GrayFn gray )
+{
+	std::vector<uint8_t> result( WIDTH * HEIGHT * 4 );
+	for( int32_t y = 0; y < HEIGHT; ++y ) {
+		for( int32_t x = 0; x < WIDTH; ++x ) {
+			uint8_t *pixel = &result[( y * WIDTH + x ) * 4];
+			pixel[0] = pixel[1] = pixel[2] = gray( x, y );
+			pixel[3] = 255;
+		}
+	}
+	return result;
+}
+
+//! Horizontal ramp moving a pixel per frame, so the scene is never quite still
+std::vector<uint8_t> sceneA( int frame )
+{
+	return makeFrame( [=]( int32_t x, int32_t ) { return static_cast<uint8_t>( 40 + ( x + frame ) % 128 ); } );
+}
+
+std::vector<uint8_t> sceneB( int )
+{
+	return makeFrame( []( int32_t, int32_t y ) { return static_cast<uint8_t>( 220 - y * 2 ); } );
+}
+
+std::vector<uint8_t> sceneC( int )
+{
+	return makeFrame( []( int32_t x, int32_t y ) { return static_cast<uint8_t>( ( ( x / 16 + y / 16 ) % 2 ) ? 230 : 20 ); } );
+}
+
+std::vector<uint8_t> sceneD( int )
+{
+	return makeFrame( []( int32_t x, int32_t y ) { return static_cast<uint8_t>( 110 + ( x * y ) % 24 ); } );
+}
+
+std::vector<uint8_t> white( int )
+{
+	return makeFrame( []( int32_t, int32_t ) { return static_cast<uint8_t>( 255 ); } );
+}
+
+typedef std::vector<uint8_t> (*SceneFn)( int );
+
+//! Adds frames [\a first, \a last) of \a scene to \a detector at 30 frames per second, returning the number of cuts addFrame() reported
+size_t addFrames( SceneDetector *detector, size_t first, size_t last, SceneFn scene )
+{
+	size_t reported = 0;
+	for( size_t i = first; i < last; ++i ) {
+		std::vector<uint8_t> frame = scene( static_cast<int>( i ) );
+		if( detector->addFrame( i, MediaTime( i, 30 ), &frame[0], WIDTH, HEIGHT, WIDTH * 4, 4, 0, 1, 2 ) )
+			++reported;
+	}
+	return reported;
+}
+
+void testHardCut()
+{
+	SceneDetector detector;
+	AVF_CHECK( addFrames( &detector, 0, 20, sceneA ) == 0 );
+	AVF_CHECK( detector.getCuts().empty() && detector.getLastScore() < detector.getOptions().getThreshold() );
+
+	// the cut is only reported with the frame after it, which tells it from a flash
+	AVF_CHECK( addFrames( &detector, 20, 21, sceneB ) == 0 && detector.getCuts().empty() );
+	AVF_CHECK( detector.getLastScore() >= detector.getOptions().getThreshold() );
+	AVF_CHECK( addFrames( &detector, 21, 22, sceneB ) == 1 );
+	AVF_CHECK( addFrames( &detector, 22, 40, sceneB ) == 0 );
+
+	const std::vector<SceneCut> &cuts = detector.getCuts();
+	AVF_CHECK( cuts.size() == 1 && cuts[0].mFrameIndex == 20 && cuts[0].mTime == MediaTime( 20, 30 ) );
+	AVF_CHECK( cuts[0].mScore >= detector.getOptions().getThreshold() && cuts[0].mScore <= 1 );
+	// every frame but the first and the last is decided on
+	AVF_CHECK( detector.getNumCompared() == 38 );
+
+	detector.clear();
+	AVF_CHECK( detector.getCuts().empty() && detector.getNumCompared() == 0 );
+}
+
+void testFlash()
+{
+	SceneDetector detector;
+	addFrames( &detector, 0, 10, sceneA );
+	addFrames( &detector, 10, 11, white );
+	AVF_CHECK( addFrames( &detector, 11, 30, sceneA ) == 0 && detector.getCuts().empty() );
+
+	// a cut right after a flash is still found
+	addFrames( &detector, 30, 31, white );
+	addFrames( &detector, 31, 50, sceneC );
+	AVF_CHECK( detector.getCuts().size() == 1 && detector.getCuts()[0].mFrameIndex == 30 );
+}
+
+void testGradualChanges()
+{
+	// a pan across stripes
+	SceneDetector detector;
+	addFrames( &detector, 0, 90, []( int frame ) {
+		return makeFrame( [=]( int32_t x, int32_t ) { return static_cast<uint8_t>( 128 + 100 * std::sin( ( x + frame ) * 3.14159 / 24 ) ); } );
+	} );
+	AVF_CHECK( detector.getCuts().empty() && detector.getNumCompared() == 88 );
+
+	// a fade to a third of the brightness over two seconds
+	detector.clear();
+	addFrames( &detector, 0, 60, []( int frame ) {
+		return makeFrame( [=]( int32_t x, int32_t y ) { return static_cast<uint8_t>( ( 60 + x + y ) * ( 90 - frame ) / 90 ); } );
+	} );
+	AVF_CHECK( detector.getCuts().empty() );
+
+	// a dissolve between two scenes over a second
+	detector.clear();
+	addFrames( &detector, 0, 60, []( int frame ) {
+		const int mix = std::min( std::max( frame - 15, 0 ), 30 );
+		const std::vector<uint8_t> from = sceneB( frame ), to = sceneC( frame );
+		return makeFrame( [&]( int32_t x, int32_t y ) {
+			return static_cast<uint8_t>( ( from[( y * WIDTH + x ) * 4] * ( 30 - mix ) + to[( y * WIDTH + x ) * 4] * mix ) / 30 );
+		} );
+	} );
+	AVF_CHECK( detector.getCuts().empty() );
+}
+
+void testThreshold()
+{
+	SceneDetector detector;
+	addFrames( &detector, 0, 20, sceneA );
+	addFrames( &detector, 20, 40, sceneD );
+	AVF_CHECK( detector.getCuts().size() == 1 );
+	const float score = detector.getCuts()[0].mScore;
+
+	// the threshold is the score a cut has to reach
+	SceneDetector above( SceneDetector::Options().setThreshold( score + 0.01f ) );
+	addFrames( &above, 0, 20, sceneA );
+	addFrames( &above, 20, 40, sceneD );
+	AVF_CHECK( above.getCuts().empty() );
+
+	SceneDetector below( SceneDetector::Options().setThreshold( score - 0.01f ) );
+	addFrames( &below, 0, 20, sceneA );
+	addFrames( &below, 20, 40, sceneD );
+	AVF_CHECK( below.getCuts().size() == 1 && below.getCuts()[0].mFrameIndex == 20 && below.getCuts()[0].mScore == score );
+}
+
+void testMinSceneFrames()
+{
+	// scenes of 10, 3 and 17 frames, then one to the end
+	const SceneFn scenes[] = { sceneA, sceneB, sceneC, sceneD };
+	const size_t starts[] = { 0, 10, 13, 30, 50 };
+
+	SceneDetector detector;
+	AVF_CHECK( detector.getOptions().getMinSceneFrames() == 6 );
+	for( int s = 0; s < 4; ++s )
+		addFrames( &detector, starts[s], starts[s + 1], scenes[s] );
+	// the scene of 3 frames is too short to count
+	AVF_CHECK( detector.getCuts().size() == 2 && detector.getCuts()[0].mFrameIndex == 10 && detector.getCuts()[1].mFrameIndex == 30 );
+
+	SceneDetector shortScenes( SceneDetector::Options().setMinSceneFrames( 3 ) );
+	for( int s = 0; s < 4; ++s )
+		addFrames( &shortScenes, starts[s], starts[s + 1], scenes[s] );
+	AVF_CHECK( shortScenes.getCuts().size() == 3 && shortScenes.getCuts()[1].mFrameIndex == 13 );
+}
+
+//! Frames that don't follow each other are remembered but not compared
+void testRestart()
+{
+	SceneDetector detector;
+	addFrames( &detector, 0, 10, sceneA );
+	addFrames( &detector, 20, 21, sceneB );
+	AVF_CHECK( detector.getLastScore() == 0 );
+	addFrames( &detector, 21, 30, sceneB );
+	AVF_CHECK( detector.getCuts().empty() );
+
+	// nor is the frame after a restart
+	addFrames( &detector, 30, 31, sceneC );
+	detector.restart();
+	addFrames( &detector, 31, 40, sceneC );
+	AVF_CHECK( detector.getCuts().empty() );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testHardCut();
+	testFlash();
+	testGradualChanges();
+	testThreshold();
+	testMinSceneFrames();
+	testRestart();
+	std::printf( "SceneDetectorTest passed\n" );
+	return 0;
+}
@@ -0,0 +1,251 @@
+#include "AvfSimd.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace cinder::avf;
+
+// Checks every kernel against a scalar reference over lengths that leave a tail after each vector width, with inputs
+// that include 0 and 255. The Makefile builds this file once per instruction set, so each vector path gets checked.
+
+namespace {
+
+const size_t kLengths[] = { 1, 15, 17, 33, 1023 };
+
+std::mt19937 sRandom( 1234 );
+
+//! Returns \a count random bytes, the first and last of each sixteen forced to 0 and 255
+std::vector<uint8_t> makeBytes( size_t count )
+{
+	std::vector<uint8_t> bytes( count );
+	for( size_t i = 0; i < count; ++i )
+		bytes[i] = static_cast<uint8_t>( sRandom() );
+	for( size_t i = 0; i < count; i += 16 ) {
+		bytes[i] = 0;
+		if( i + 15 < count )
+			bytes[i + 15] = 255;
+	}
+	return bytes;
+}
+
+void testAccumulateAndResolve()
+{
+	const uint32_t frameCounts[] = { 1, 2, 3, 4, 6, 7 };
+	for( size_t l = 0; l < sizeof( kLengths ) / sizeof( kLengths[0] ); ++l ) {
+		const size_t count = kLengths[l];
+		for( size_t f = 0; f < sizeof( frameCounts ) / sizeof( frameCounts[0] ); ++f ) {
+			const uint32_t frames = frameCounts[f];
+			std::vector<uint32_t> acc( count, 0 ), expected( count, 0 );
+			for( uint32_t n = 0; n < frames; ++n ) {
+				std::vector<uint8_t> src = makeBytes( count );
+				accumulatePixels( src.data(), acc.data(), count );
+				for( size_t i = 0; i < count; ++i )
+					expected[i] += src[i];
+			}
+			AVF_CHECK( acc == expected );
+
+			std::vector<uint8_t> dst( count );
+			resolveAccumulatedPixels( acc.data(), dst.data(), count, frames );
+			const float scale = 1.0f / frames;
+			for( size_t i = 0; i < count; ++i ) {
+				float scaled = acc[i] * scale;
+				uint32_t v = static_cast<uint32_t>( scaled + 0.5f );
+				AVF_CHECK( dst[i] == ( v > 255 ? 255 : v ) );
+			}
+		}
+	}
+
+	// the extremes, and halves rounding up where the scale is exact
+	const size_t count = 1023;
+	std::vector<uint32_t> acc( count );
+	std::vector<uint8_t> dst( count );
+	for( size_t i = 0; i < count; ++i )
+		acc[i] = ( i % 3 == 0 ) ? 0 : ( i % 3 == 1 ) ? 255 * 4 : static_cast<uint32_t>( i % 256 ) * 4 + 2;
+	resolveAccumulatedPixels( acc.data(), dst.data(), count, 4 );
+	for( size_t i = 0; i < count; ++i )
+		AVF_CHECK( dst[i] == ( ( i % 3 == 0 ) ? 0 : ( i % 3 == 1 ) ? 255 : std::min<size_t>( i % 256 + 1, 255 ) ) );
+}
+
+void testBlend()
+{
+	const uint32_t weights[] = { 0, 1, 64, 128, 200, 255, 256 };
+	for( size_t l = 0; l < sizeof( kLengths ) / sizeof( kLengths[0] ); ++l ) {
+		const size_t count = kLengths[l];
+		for( size_t w = 0; w < sizeof( weights ) / sizeof( weights[0] ); ++w ) {
+			const uint32_t weight = weights[w];
+			std::vector<uint8_t> a = makeBytes( count ), b = makeBytes( count ), dst( count );
+			std::vector<uint8_t> expected( count );
+			for( size_t i = 0; i < count; ++i )
+				expected[i] = static_cast<uint8_t>( ( a[i] * ( 256 - weight ) + b[i] * weight + 128 ) >> 8 );
+			blendPixels( a.data(), b.data(), dst.data(), count, weight );
+			AVF_CHECK( dst == expected );
+
+			// in place over either input
+			std::vector<uint8_t> inPlace = a;
+			blendPixels( inPlace.data(), b.data(), inPlace.data(), count, weight );
+			AVF_CHECK( inPlace == expected );
+			inPlace = b;
+			blendPixels( a.data(), inPlace.data(), inPlace.data(), count, weight );
+			AVF_CHECK( inPlace == expected );
+		}
+	}
+
+	// the ends of the weight range leave the extremes untouched
+	std::vector<uint8_t> black( 33, 0 ), white( 33, 255 ), dst( 33 );
+	blendPixels( black.data(), white.data(), dst.data(), 33, 255 );
+	AVF_CHECK( dst == std::vector<uint8_t>( 33, 254 ) );
+	blendPixels( white.data(), white.data(), dst.data(), 33, 100 );
+	AVF_CHECK( dst == white );
+	blendPixels( black.data(), black.data(), dst.data(), 33, 100 );
+	AVF_CHECK( dst == black );
+}
+
+void testSumAbsDifferences()
+{
+	for( size_t l = 0; l < sizeof( kLengths ) / sizeof( kLengths[0] ); ++l ) {
+		const size_t count = kLengths[l];
+		std::vector<uint8_t> a = makeBytes( count ), b = makeBytes( count );
+		uint64_t expected = 0;
+		for( size_t i = 0; i < count; ++i )
+			expected += ( a[i] > b[i] ) ? a[i] - b[i] : b[i] - a[i];
+		AVF_CHECK( sumAbsDifferences( a.data(), b.data(), count ) == expected );
+		AVF_CHECK( sumAbsDifferences( a.data(), a.data(), count ) == 0 );
+
+		std::vector<uint8_t> black( count, 0 ), white( count, 255 );
+		AVF_CHECK( sumAbsDifferences( black.data(), white.data(), count ) == 255 * count );
+		AVF_CHECK( sumAbsDifferences( white.data(), black.data(), count ) == 255 * count );
+	}
+}
+
+void testLookupTable()
+{
+	std::vector<uint8_t> lut = makeBytes( 256 );
+	lut[0] = 255;
+	lut[255] = 0;
+	// every alpha position of every pixel size the kernel handles, plus no alpha
+	const int32_t layouts[][2] = { { 4, -1 }, { 4, 0 }, { 4, 3 }, { 3, -1 }, { 3, 1 }, { 1, -1 } };
+	for( size_t l = 0; l < sizeof( kLengths ) / sizeof( kLengths[0] ); ++l ) {
+		for( size_t k = 0; k < sizeof( layouts ) / sizeof( layouts[0] ); ++k ) {
+			const int32_t pixelInc = layouts[k][0], alphaOffset = layouts[k][1];
+			const size_t count = kLengths[l] * pixelInc;
+			std::vector<uint8_t> src = makeBytes( count ), dst( count ), expected( count );
+			for( size_t i = 0; i < count; ++i )
+				expected[i] = ( static_cast<int32_t>( i % pixelInc ) == alphaOffset ) ? src[i] : lut[src[i]];
+			applyLookupTable( lut.data(), src.data(), dst.data(), count, pixelInc, alphaOffset );
+			AVF_CHECK( dst == expected );
+
+			applyLookupTable( lut.data(), src.data(), src.data(), count, pixelInc, alphaOffset );
+			AVF_CHECK( src == expected );
+		}
+	}
+
+	// every index through a table that is its own inverse
+	std::vector<uint8_t> all( 256 ), dst( 256 ), invert( 256 );
+	for( int32_t i = 0; i < 256; ++i ) {
+		all[i] = static_cast<uint8_t>( i );
+		invert[i] = static_cast<uint8_t>( 255 - i );
+	}
+	applyLookupTable( invert.data(), all.data(), dst.data(), 256, 1, -1 );
+	for( int32_t i = 0; i < 256; ++i )
+		AVF_CHECK( dst[i] == 255 - i );
+}
+
+void referenceSwizzle( const uint8_t *src, int32_t srcInc, uint8_t *dst, int32_t dstInc, const int8_t *dstFromSrc, size_t numPixels )
+{
+	for( size_t p = 0; p < numPixels; ++p )
+		for( int32_t c = 0; c < dstInc; ++c )
+			dst[p * dstInc + c] = ( dstFromSrc[c] >= 0 ) ? src[p * srcInc + dstFromSrc[c]] : 0xFF;
+}
+
+struct SwizzleLayout {
+	int32_t		mSrcInc, mDstInc;
+	int8_t		mDstFromSrc[4];
+};
+
+// BGRA to RGBA, RGB to RGBX, ARGB to RGBA, RGBA to RGB and a gray channel widened to RGBX
+const SwizzleLayout kSwizzles[] = {
+	{ 4, 4, { 2, 1, 0, 3 } }, { 3, 4, { 0, 1, 2, -1 } }, { 4, 4, { 1, 2, 3, 0 } }, { 4, 3, { 0, 1, 2, 0 } }, { 1, 4, { 0, 0, 0, -1 } }
+};
+
+void testSwizzle()
+{
+	for( size_t l = 0; l < sizeof( kLengths ) / sizeof( kLengths[0] ); ++l ) {
+		const size_t numPixels = kLengths[l];
+		for( size_t k = 0; k < sizeof( kSwizzles ) / sizeof( kSwizzles[0] ); ++k ) {
+			const SwizzleLayout &layout = kSwizzles[k];
+			std::vector<uint8_t> src = makeBytes( numPixels * layout.mSrcInc );
+			std::vector<uint8_t> dst( numPixels * layout.mDstInc ), expected( dst.size() );
+			referenceSwizzle( src.data(), layout.mSrcInc, expected.data(), layout.mDstInc, layout.mDstFromSrc, numPixels );
+			swizzlePixels( src.data(), layout.mSrcInc, dst.data(), layout.mDstInc, layout.mDstFromSrc, numPixels );
+			AVF_CHECK( dst == expected );
+		}
+	}
+}
+
+void testCopyPixelRows()
+{
+	std::vector<uint8_t> lut( 256 );
+	for( int32_t i = 0; i < 256; ++i )
+		lut[i] = static_cast<uint8_t>( 255 - i );
+	const size_t threadCounts[] = { 0, 1, 3, 8 };
+	for( size_t l = 0; l < sizeof( kLengths ) / sizeof( kLengths[0] ); ++l ) {
+		const int32_t width = static_cast<int32_t>( kLengths[l] ), height = 13;
+		for( size_t k = 0; k < sizeof( kSwizzles ) / sizeof( kSwizzles[0] ) + 1; ++k ) {
+			// the last pass is the plain copy, without a swizzle
+			const bool swizzle = k < sizeof( kSwizzles ) / sizeof( kSwizzles[0] );
+			const int32_t srcInc = swizzle ? kSwizzles[k].mSrcInc : 4, dstInc = swizzle ? kSwizzles[k].mDstInc : 4;
+			const int8_t *dstFromSrc = swizzle ? kSwizzles[k].mDstFromSrc : NULL;
+			// rows padded past their pixels, by different amounts on each side
+			const size_t srcRowBytes = width * srcInc + 5, dstRowBytes = width * dstInc + 11;
+			std::vector<uint8_t> src = makeBytes( srcRowBytes * height );
+			for( int32_t useLut = 0; useLut < 2; ++useLut ) {
+				const int32_t alphaOffset = ( dstInc == 4 ) ? 3 : -1;
+				std::vector<uint8_t> expected( dstRowBytes * height, 0x5A );
+				for( int32_t y = 0; y < height; ++y ) {
+					uint8_t *row = &expected[y * dstRowBytes];
+					if( dstFromSrc )
+						referenceSwizzle( &src[y * srcRowBytes], srcInc, row, dstInc, dstFromSrc, width );
+					else
+						std::memcpy( row, &src[y * srcRowBytes], width * srcInc );
+					for( int32_t i = 0; useLut && i < width * dstInc; ++i )
+						if( i % dstInc != alphaOffset )
+							row[i] = lut[row[i]];
+				}
+				for( size_t t = 0; t < sizeof( threadCounts ) / sizeof( threadCounts[0] ); ++t ) {
+					std::vector<uint8_t> dst( dstRowBytes * height, 0x5A );
+					copyPixelRows( src.data(), srcRowBytes, srcInc, dst.data(), dstRowBytes, dstInc, dstFromSrc, width, height, threadCounts[t],
+									useLut ? lut.data() : NULL, alphaOffset );
+					AVF_CHECK( dst == expected );
+				}
+			}
+		}
+	}
+
+	// matching strides take the single memcpy, padding included
+	std::vector<uint8_t> src = makeBytes( 40 * 7 ), dst( src.size() );
+	copyPixelRows( src.data(), 40, 4, dst.data(), 40, 4, NULL, 9, 7, 2 );
+	AVF_CHECK( dst == src );
+}
+
+} // anonymous namespace
+
+int main()
+{
+#if defined( __AVX2__ ) && defined( __GNUC__ )
+	if( ! __builtin_cpu_supports( "avx2" ) ) {
+		std::printf( "SimdTest skipped, the CPU lacks AVX2\n" );
+		return 0;
+	}
+#endif
+	testAccumulateAndResolve();
+	testBlend();
+	testSumAbsDifferences();
+	testLookupTable();
+	testSwizzle();
+	testCopyPixelRows();
+	std::printf( "SimdTest passed\n" );
+	return 0;
+}
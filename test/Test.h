@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal checks for the portable parts of the block, which build and run without OS X. A failed check
+// reports its location and expression and ends the test with a non-zero exit code.
+
+#define AVF_CHECK( expr ) \
+	do { \
+		if( ! ( expr ) ) { \
+			std::fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr ); \
+			std::exit( 1 ); \
+		} \
+	} while( 0 )
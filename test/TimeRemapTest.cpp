@@ -0,0 +1,132 @@
+#include "AvfTimeRemap.h"
+#include "Test.h"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace cinder::avf;
+
+namespace {
+
+const double EPSILON = 1e-9;
+
+bool near( double a, double b, double tolerance = EPSILON )
+{
+	return std::fabs( a - b ) <= tolerance;
+}
+
+//! Samples \a curve across [\a start, \a end], returning whether it never runs backwards and its speed agrees with its slope
+bool isMonotone( const TimeRemapCurve &curve, double start, double end )
+{
+	const double step = 0.001;
+	double previous = curve.getSourceTime( start );
+	for( double t = start + step; t <= end; t += step ) {
+		double source = curve.getSourceTime( t );
+		if( source < previous - EPSILON || curve.getSpeed( t ) < -EPSILON )
+			return false;
+		// the slope of a chord matches the speed at its middle, up to the curvature over the step
+		if( ! near( ( source - previous ) / step, curve.getSpeed( t - step / 2 ), 1e-3 ) )
+			return false;
+		previous = source;
+	}
+	return true;
+}
+
+void testIdentity()
+{
+	TimeRemapCurve curve;
+	AVF_CHECK( curve.getNumKeys() == 0 && curve.getSourceTime( 3.25 ) == 3.25 && curve.getSpeed( 3.25 ) == 1 );
+
+	// a single key shifts the curve without changing its speed
+	curve.addKey( 1, 4 );
+	AVF_CHECK( near( curve.getSourceTime( 1 ), 4 ) && near( curve.getSourceTime( 3 ), 6 ) && curve.getSpeed( 0 ) == 1 );
+	AVF_CHECK( curve.clear().getNumKeys() == 0 && curve.getSourceTime( 2 ) == 2 );
+}
+
+void testEndpoints()
+{
+	const double keys[][2] = { { 0, 0 }, { 1, 0.25 }, { 2, 3 }, { 3, 3.5 }, { 5, 8 } };
+	const TimeRemapCurve::Interpolation interpolations[] = { TimeRemapCurve::INTERPOLATION_LINEAR, TimeRemapCurve::INTERPOLATION_SMOOTH };
+	for( int i = 0; i < 2; ++i ) {
+		TimeRemapCurve curve;
+		curve.setInterpolation( interpolations[i] );
+		// keys may come in any order
+		for( int k = 4; k >= 0; --k )
+			curve.addKey( keys[k][0], keys[k][1] );
+		AVF_CHECK( curve.getNumKeys() == 5 );
+		for( int k = 0; k < 5; ++k )
+			AVF_CHECK( near( curve.getSourceTime( keys[k][0] ), keys[k][1] ) );
+
+		// outside the keys the curve carries on at the speed of the end segments
+		AVF_CHECK( near( curve.getSourceTime( -2 ), -2 * curve.getSpeed( 0 ) ) );
+		AVF_CHECK( near( curve.getSourceTime( 7 ), 8 + 2 * curve.getSpeed( 5 ) ) );
+		AVF_CHECK( near( curve.getSpeed( -2 ), curve.getSpeed( 0 ) ) && near( curve.getSpeed( 7 ), curve.getSpeed( 5 ) ) );
+	}
+
+	// a key at the same output time replaces the one there
+	TimeRemapCurve curve;
+	curve.addKey( 0, 0 ).addKey( 2, 1 ).addKey( 2, 4 );
+	AVF_CHECK( curve.getNumKeys() == 2 && near( curve.getSourceTime( 2 ), 4 ) && near( curve.getSpeed( 1 ), 2, 1e-6 ) );
+}
+
+void testMonotonicity()
+{
+	// a slow-motion ramp whose steep middle would make a plain cubic overshoot its neighbours
+	TimeRemapCurve ramp;
+	ramp.addKey( 0, 0 ).addKey( 1, 0.1 ).addKey( 2, 3 ).addKey( 3, 3.1 ).addKey( 4, 6 );
+	AVF_CHECK( ramp.getInterpolation() == TimeRemapCurve::INTERPOLATION_SMOOTH );
+	AVF_CHECK( isMonotone( ramp, -1, 5 ) );
+	// the curve stays between the keys of each segment
+	for( double t = 0; t <= 1; t += 0.01 )
+		AVF_CHECK( ramp.getSourceTime( t ) >= -EPSILON && ramp.getSourceTime( t ) <= 0.1 + EPSILON );
+
+	ramp.setInterpolation( TimeRemapCurve::INTERPOLATION_LINEAR );
+	AVF_CHECK( isMonotone( ramp, -1, 5 ) && near( ramp.getSourceTime( 1.5 ), 1.55 ) && near( ramp.getSpeed( 1.5 ), 2.9 ) );
+
+	// a freeze frame holds the source time, and playback picks up again after it
+	TimeRemapCurve freeze;
+	freeze.addKey( 0, 0 ).addKey( 1, 1 ).addKey( 2, 1 ).addKey( 3, 2 );
+	AVF_CHECK( isMonotone( freeze, 0, 3 ) );
+	for( double t = 1; t <= 2; t += 0.05 )
+		AVF_CHECK( near( freeze.getSourceTime( t ), 1 ) && near( freeze.getSpeed( t ), 0 ) );
+}
+
+void testSelectFrames()
+{
+	// ten frames at 30 frames per second
+	FrameIndex index;
+	const MediaTime frameDuration( 1, 30 );
+	for( int64_t i = 0; i < 10; ++i )
+		index.addFrame( frameDuration * i, frameDuration, MediaTime(), i == 0 );
+	index.finalize();
+
+	RemapFrames frames = selectRemapFrames( index, MediaTime( 3, 30 ), true );
+	AVF_CHECK( frames.mFrame == 3 && frames.mNextFrame == 4 && frames.mWeight == 0 );
+	frames = selectRemapFrames( index, MediaTime( 7, 60 ), true );
+	AVF_CHECK( frames.mFrame == 3 && frames.mNextFrame == 4 && frames.mWeight == 128 );
+	frames = selectRemapFrames( index, MediaTime( 7, 60 ), false );
+	AVF_CHECK( frames.mFrame == 3 && frames.mWeight == 0 );
+
+	// times outside the track clamp to its first and last frames, without blending past them
+	frames = selectRemapFrames( index, MediaTime( -1, 30 ), true );
+	AVF_CHECK( frames.mFrame == 0 && frames.mWeight == 0 );
+	frames = selectRemapFrames( index, MediaTime( 21, 60 ), true );
+	AVF_CHECK( frames.mFrame == 9 && frames.mNextFrame == 9 && frames.mWeight == 0 );
+	frames = selectRemapFrames( index, MediaTime( 5, 1 ), true );
+	AVF_CHECK( frames.mFrame == 9 && frames.mNextFrame == 9 );
+
+	frames = selectRemapFrames( FrameIndex(), MediaTime( 1, 30 ), true );
+	AVF_CHECK( frames.mFrame == 0 && frames.mNextFrame == 0 && frames.mWeight == 0 );
+}
+
+} // anonymous namespace
+
+int main()
+{
+	testIdentity();
+	testEndpoints();
+	testMonotonicity();
+	testSelectFrames();
+	std::printf( "TimeRemapTest passed\n" );
+	return 0;
+}